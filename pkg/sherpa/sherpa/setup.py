@@ -136,6 +136,18 @@ cpp_libs = []
 if platform.system() == 'SunOS':
     cpp_libs.extend(['Cstd', 'sunmath'])
 
+#
+# GCC reports the ABI notes about the vector types of sherpa/vecmath.hh at
+# the end of the file, past the diagnostic pragmas around the vector code,
+# so the modules with vector kernels are built with -Wno-psabi
+#
+
+vecmath_args = []
+
+if ( platform.system() == 'Linux' and
+     platform.machine() in ('x86_64', 'i386', 'i686') ):
+    vecmath_args.append('-Wno-psabi')
+
 
 #
 # Link against libfui and libmtsk when building with Sun's Fortran compiler
@@ -263,12 +275,18 @@ header_deps = {
     'constants': (),
     'extension': ('array',),
     'integration': (),
-    'model_extension': ('extension', 'integration'),
-    'models': ('constants', 'utils'),
-    'stat_extension': ('extension',),
-    'stats': ('utils',),
+    'model_cache': ('extension', 'threads'),
+    'model_expr': ('model_extension',),
+    'model_extension': ('extension', 'integration', 'quadrature',
+                        'threads'),
+    'models': ('constants', 'utils', 'vecmath'),
+    'quadrature': (),
+    'stat_extension': ('extension', 'stats'),
+    'stats': ('threads', 'utils'),
+    'threads': (),
     'utils': ('constants','extension'),
-    'astro/models': ('constants', 'utils'),
+    'vecmath': (),
+    'astro/models': ('constants', 'utils', 'vecmath'),
     'astro/utils': (),
     'astro/xspec_extension': ('extension',),
     }
@@ -331,7 +349,8 @@ extension_modules = [
               ['sherpa/models/src/_modelfcts.cc'],
               sherpa_inc,
               libraries=cpp_libs,
-              depends=get_deps(['model_extension', 'models'])),
+              extra_compile_args=vecmath_args,
+              depends=get_deps(['model_cache', 'model_expr', 'models'])),
 
 ##################################optmethods###################################
     
@@ -413,12 +432,13 @@ extension_modules = [
                'sherpa/optmethods/src/Simplex.cc'],
               sherpa_inc + ['sherpa/utils/src/gsl'],
               libraries=(cpp_libs + ['sherpa']),              
-              depends=(get_deps(['myArray', 'extension']) +
+              depends=(get_deps(['myArray', 'extension', 'threads']) +
                        ['sherpa/include/sherpa/fcmp.hh',
                         'sherpa/include/sherpa/MersenneTwister.h',
                         'sherpa/include/sherpa/functor.hh',
                         'sherpa/optmethods/src/DifEvo.hh',
                         'sherpa/optmethods/src/DifEvo.cc',
+                        'sherpa/optmethods/src/MultiStart.hh',
                         'sherpa/optmethods/src/NelderMead.hh',
                         'sherpa/optmethods/src/NelderMead.cc',
                         'sherpa/optmethods/src/Opt.hh',
@@ -533,7 +553,8 @@ extension_modules = [
               ['sherpa/astro/models/src/_modelfcts.cc'],
               sherpa_inc,
               libraries=cpp_libs,
-              depends=get_deps(['model_extension', 'astro/models'])),
+              extra_compile_args=vecmath_args,
+              depends=get_deps(['model_expr', 'astro/models'])),
 
     # sherpa.astro.utils._pileup
     Extension('sherpa.astro.utils._pileup',
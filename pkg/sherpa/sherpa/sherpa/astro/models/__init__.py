@@ -19,7 +19,8 @@
 
 import numpy
 from sherpa.models.parameter import Parameter, tinyval
-from sherpa.models.model import ArithmeticModel, CompositeModel, modelCacher1d
+from sherpa.models.model import ArithmeticModel, CompositeModel, \
+    modelCacher1d, register_expr_kernels
 from sherpa.astro.utils import apply_pileup
 from sherpa.utils.err import ModelErr
 from sherpa.utils import *
@@ -623,3 +624,12 @@ class Shell2D(ArithmeticModel):
         integral = 2 * numpy.pi / 3 * (r_out ** 3 - r_0 ** 3)
         # integral = 1
         return ampl * integral * non_normalized
+
+
+# Schechter is left out: it is only defined for integrated grids
+register_expr_kernels(_modelfcts.expr_kernels(), {
+        Atten: ('atten', False), BBody: 'bbody', BBodyFreq: 'bbodyfreq',
+        Beta1D: 'beta1d', BPL1D: 'bpl1d', Dered: 'dered', Edge: 'edge',
+        LineBroad: 'linebroad', Lorentz1D: 'lorentz1d', NormBeta1D: 'nbeta1d',
+        Beta2D: 'beta2d', DeVaucouleurs2D: 'devau', HubbleReynolds: 'hr',
+        Lorentz2D: 'lorentz2d', Sersic2D: 'sersic'})
@@ -17,10 +17,10 @@
 //  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 //
 
-#define _MODELFCTPTR(name) \
-  sherpa::astro::models::name< SherpaFloat, SherpaFloatArray >
+#define _MODELFCTNS sherpa::astro::models
 
 #include "sherpa/model_extension.hh"
+#include "sherpa/model_expr.hh"
 #include "sherpa/astro/models.hh"
 
 extern "C" {
@@ -28,13 +28,37 @@ extern "C" {
 }
 
 
+// Kernels for compiled model expressions
+sherpa::models::ExprKernel AstroModelExprKernels[] = {
+
+  EXPRKERNEL1D_NOINT( atten, 3 ),
+  EXPRKERNEL1D_NOINT( bbody, 3 ),
+  EXPRKERNEL1D_NOINT( bbodyfreq, 2 ),
+  EXPRKERNEL1D_NOINT( beta1d, 4 ),
+  EXPRKERNEL1D_VEC( bpl1d, 5 ),
+  EXPRKERNEL1D_NOINT( dered, 2 ),
+  EXPRKERNEL1D_NOINT( edge, 3 ),
+  EXPRKERNEL1D( linebroad, 3 ),
+  EXPRKERNEL1D( lorentz1d, 3 ),
+  EXPRKERNEL1D_NOINT( nbeta1d, 4 ),
+
+  EXPRKERNEL2D_NOINT( beta2d, 7 ),
+  EXPRKERNEL2D_NOINT( devau, 6 ),
+  EXPRKERNEL2D_NOINT( sersic, 7 ),
+  EXPRKERNEL2D_NOINT( hr, 6 ),
+  EXPRKERNEL2D_NOINT( lorentz2d, 6 ),
+
+  { NULL, 0, 0, NULL, NULL }
+
+};
+
 static PyMethodDef ModelFcts[] = {
 
   MODELFCT1D_NOINT( atten, 3 ),
   MODELFCT1D_NOINT( bbody, 3 ),
   MODELFCT1D_NOINT( bbodyfreq, 2 ),
   MODELFCT1D_NOINT( beta1d, 4 ),
-  MODELFCT1D( bpl1d, 5 ),
+  MODELFCT1D_VEC( bpl1d, 5 ),
   MODELFCT1D_NOINT( dered, 2 ),
   MODELFCT1D_NOINT( edge, 3 ),
   MODELFCT1D( linebroad, 3 ),
@@ -48,6 +72,11 @@ static PyMethodDef ModelFcts[] = {
   MODELFCT2D_NOINT( hr, 6 ),
   MODELFCT2D_NOINT( lorentz2d, 6 ),
 
+  MODELFCT_THREADS,
+  MODELFCT_PIXELS,
+
+  MODELEXPR_KERNELS( AstroModelExprKernels ),
+
   { NULL, NULL, 0, NULL }
 
 };
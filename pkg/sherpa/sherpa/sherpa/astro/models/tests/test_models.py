@@ -17,7 +17,8 @@
 #  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 #
 
-from numpy import arange
+from numpy import abs, arange, array, empty, isnan, linspace, meshgrid, \
+    nan, spacing
 import sherpa.astro.models as models
 from sherpa.utils import SherpaFloat, SherpaTestCase
 from sherpa.models.model import ArithmeticModel
@@ -63,3 +64,81 @@ class test_models(SherpaTestCase):
                 self.assertEqual(out.shape, x.shape)
 
         self.assertEqual(count, 18)
+
+    def test_vector_kernels(self):
+        # bpl1d has batch kernels; they must agree with the scalar path
+        # (used for strided arrays) to 4 ulp of the largest value for
+        # point evaluation and 8 ulp of the summed absolute values for
+        # integrated bins, and fail the same way
+        from sherpa.astro.models import _modelfcts
+
+        def strided(a):
+            s = empty(2 * len(a))
+            s[::2] = a
+            return s[::2]
+
+        def evaluate(pars, *args):
+            try:
+                return _modelfcts.bpl1d(pars, *args)
+            except ValueError, e:
+                return str(e)
+
+        for x in (linspace(0.1, 10.0, 2002), linspace(-5.0, 5.0, 2002)):
+            for pars in ([1.2, 2.5, 2.0, 1.0, 3.0], [1.0, 2.5, 2.0, 1.0, 3.0],
+                         [1.2, 2.5, 2.0, 0.0, 3.0], [1.2, nan, 2.0, 1.0, 3.0]):
+                for args in ((x,), (x[:-1], x[1:])):
+                    vec = evaluate(pars, *args)
+                    sca = evaluate(pars, *[strided(a) for a in args])
+                    if isinstance(vec, str) or isinstance(sca, str):
+                        self.assertEqual(vec, sca)
+                        continue
+                    self.assert_((isnan(vec) == isnan(sca)).all())
+                    good = ~isnan(sca)
+                    vec = vec[good]
+                    sca = sca[good]
+                    if len(sca) == 0:
+                        continue
+                    if len(args) == 1:
+                        tol = 4 * spacing(abs(sca).max())
+                    else:
+                        tol = 8 * spacing(abs(sca).sum())
+                    self.assert_(((vec == sca) |
+                                  (abs(vec - sca) <= tol)).all())
+
+    def test_gradients(self):
+        from sherpa.astro.models import _modelfcts
+        x = linspace(0.1, 10.0, 101)
+        xlo = x[:-1]
+        xhi = x[1:]
+        x0, x1 = meshgrid(linspace(-5, 5, 11), linspace(-5, 5, 11))
+        x0 = x0.ravel() + 0.05
+        x1 = x1.ravel() - 0.05
+
+        tests = ((_modelfcts.bpl1d, [1.2, 2.5, 2.0, 1.0, 3.0], (xlo,)),
+                 (_modelfcts.bpl1d, [1.2, 2.5, 2.0, 1.0, 3.0], (xlo, xhi)),
+                 (_modelfcts.lorentz1d, [3.0, 5.0, 2.0], (xlo,)),
+                 (_modelfcts.lorentz1d, [3.0, 5.0, 2.0], (xlo, xhi)),
+                 (_modelfcts.schechter, [-1.2, 2.0, 3.0], (xlo, xhi)),
+                 (_modelfcts.beta2d, [2.0, 0.5, -0.5, 0.3, 0.7, 3.0, 1.5],
+                  (x0, x1)))
+
+        for func, pars, args in tests:
+            grad = getattr(_modelfcts, func.__name__ + '_grad')
+            pars = array(pars)
+            vals, jac = grad(pars, *args)
+            # bpl1d values come from the batch kernels, its gradients
+            # from the scalar ones
+            ref = func(pars, *args)
+            self.assert_(abs(vals - ref).max() <= 8 * spacing(abs(ref).sum()))
+            self.assertEqual(jac.shape, (len(pars), len(args[0])))
+
+            for ii in xrange(len(pars)):
+                h = 1.0e-6 * max(abs(pars[ii]), 1.0)
+                hi = pars.copy()
+                lo = pars.copy()
+                hi[ii] += h
+                lo[ii] -= h
+                fd = (func(hi, *args) - func(lo, *args)) / (2.0 * h)
+                scale = max(abs(fd).max(), 1.0)
+                self.assert_(abs(jac[ii] - fd).max() < 1e-5 * scale,
+                             "%s_grad parameter %d" % (func.__name__, ii))
@@ -366,6 +366,30 @@ class DataSimulFit(Data):
         
         return numpy.concatenate(total_model)
 
+    def eval_model_to_fit_segments(self, modelfuncs):
+        "The model values of each data set, as a list"
+        return [data.eval_model_to_fit(func)
+                for func, data in izip(modelfuncs, self.datasets)]
+
+    def to_fit_segments(self, staterrfunc=None):
+        """The dependent values, statistical errors and systematic
+        errors of each data set, as three lists for the segmented
+        statistics; the errors are None if no data set has any"""
+        deps, staterrors, syserrors = zip(*[data.to_fit(staterrfunc)
+                                            for data in self.datasets])
+        deps, staterrors, syserrors = (list(deps), list(staterrors),
+                                       list(syserrors))
+
+        if all(staterror is None for staterror in staterrors):
+            staterrors = None
+        elif [staterror for staterror in staterrors if staterror is None]:
+            raise DataErr('staterrsimulfit')
+
+        if all(syserror is None for syserror in syserrors):
+            syserrors = None
+
+        return (deps, staterrors, syserrors)
+
     def to_fit(self, staterrfunc=None):        
         total_dep = []
         total_staterror = []
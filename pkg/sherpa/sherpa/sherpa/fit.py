@@ -22,7 +22,7 @@ import logging
 import os
 import signal
 from numpy import power, arange, array, abs, iterable, sqrt, where, \
-     ones_like, isnan, isinf, float, float32, finfo, nan, any
+     ones_like, isnan, isinf, float, float32, finfo, nan, any, cumsum, split
 from sherpa.utils import NoNewAttributesAfterInit, print_fields, erf, igamc, \
     bool_cast, is_in, is_iterable, list_to_open_interval, sao_fcmp
 from sherpa.utils.err import FitErr, EstErr, SherpaErr
@@ -410,13 +410,45 @@ class IterFit(NoNewAttributesAfterInit):
                           if not par.frozen])
             print >> self._file, ' '.join(names)
 
+        # Only the optimizers that look at the per-bin deviations get them;
+        # the others are passed (statistic, None), from the statistic
+        # prepared for the data being fit (prepared again if an iterative
+        # method replaces the data).  A fit to several data sets is
+        # prepared data set by data set, so that the models need not be
+        # joined; the segments are cut from the same arrays.
+        needs_fvec = getattr(self.method, 'needs_fvec', True)
+        segmented = len(self.data.datasets) > 1
+        prepared = [None, None]
+
+        def prepare(inputs):
+            if not segmented:
+                return self.stat.prepare(*inputs)
+            bounds = cumsum([len(d.get_dep(True))
+                             for d in self.data.datasets])[:-1]
+            return self.stat.prepare_segments(
+                *[split(a, bounds) if a is not None else None
+                  for a in inputs])
+
         def cb(pars):
             # We need to store the new parameter values in order to support
             # linked parameters
 
             self.model.thawedpars = pars
-            model = self.data.eval_model_to_fit(self.model)
-            stat = self.stat.calc_stat(self._dep, model, self._staterror, self._syserror)
+            if needs_fvec:
+                model = self.data.eval_model_to_fit(self.model)
+                stat = self.stat.calc_stat(self._dep, model, self._staterror,
+                                           self._syserror)
+            else:
+                inputs = (self._dep, self._staterror, self._syserror)
+                if (prepared[0] is None or
+                    [a for a, b in zip(prepared[0], inputs) if a is not b]):
+                    prepared[:] = [inputs, prepare(inputs)]
+                if segmented:
+                    models = self.data.eval_model_to_fit_segments(self.model)
+                    stat = (prepared[1](models)[0], None)
+                else:
+                    model = self.data.eval_model_to_fit(self.model)
+                    stat = (prepared[1](model), None)
 
             if self._file is not None:
                 vals = ['%5e %5e' % (self._nfev, stat[0])]
@@ -426,6 +458,32 @@ class IterFit(NoNewAttributesAfterInit):
             self._nfev+=1
             return stat
 
+        # The statistic and deviations for each row of parameter values,
+        # for the optimizers that evaluate several points at a time
+        # (e.g. the jacobian of LevMar with batch=True); the models are
+        # evaluated in turn but the statistics in a single call
+        def batch(points):
+            models = []
+            for pars in points:
+                self.model.thawedpars = pars
+                models.append(self.data.eval_model_to_fit(self.model))
+            stats = self.stat.calc_stat_batch(self._dep, array(models),
+                                              self._staterror,
+                                              self._syserror, fvec=True)
+
+            if self._file is not None:
+                for pars, val in izip(points, stats[0]):
+                    vals = ['%5e %5e' % (self._nfev, val)]
+                    vals.extend(['%5e' % par for par in pars])
+                    print >> self._file, ' '.join(vals)
+                    self._nfev+=1
+            else:
+                self._nfev+=len(points)
+            return stats
+
+        if needs_fvec:
+            cb.batch = batch
+
         return cb
 
     def primini(self, statfunc, pars, parmins, parmaxes, statargs = (),
@@ -457,6 +515,9 @@ class IterFit(NoNewAttributesAfterInit):
             st = d.get_staterror(filter=False)
             staterror_original.append(st)
             d.staterror = ones_like(st)
+        # Update stored y, staterror and syserror values from data, so
+        # the callback function sees the errors Primini's method sets
+        self._dep, self._staterror, self._syserror = self.data.to_fit(self.stat.calc_staterror)
 
         # Keep record of current and previous statistics;
         # when these are within some tolerace, Primini's method
@@ -493,6 +554,7 @@ class IterFit(NoNewAttributesAfterInit):
                 for d in self.data.datasets:
                     d.staterror = self.stat.calc_staterror(
                         d.eval_model(model_iterator.next()))
+                self._dep, self._staterror, self._syserror = self.data.to_fit(self.stat.calc_staterror)
 
             # Final number of function evaluations is the sum
             # of the numbers of function evaluations from all calls
@@ -504,6 +566,7 @@ class IterFit(NoNewAttributesAfterInit):
             staterror_original.reverse()
             for d in self.data.datasets:
                 d.staterror = staterror_original.pop()
+            self._dep, self._staterror, self._syserror = self.data.to_fit(self.stat.calc_staterror)
             
         # Return results from Primini's iterative fitting method
         return final_fit_results
@@ -754,7 +817,7 @@ class Fit(NoNewAttributesAfterInit):
     def calc_stat(self):
         dep, staterror, syserror = self.data.to_fit(self.stat.calc_staterror)
         model = self.data.eval_model_to_fit(self.model)
-        return self.stat.calc_stat(dep, model, staterror, syserror)[0]
+        return self.stat.calc_stat_scalar(dep, model, staterror, syserror)
 
     def calc_chisqr(self):
         if not isinstance(self.stat, Chi2):
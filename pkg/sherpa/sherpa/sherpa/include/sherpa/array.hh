@@ -24,6 +24,15 @@
 #include <numpy/arrayobject.h>
 
 
+// Lets the compiler assume raw data pointers do not overlap, so loops
+// over contiguous buffers can be vectorized
+#if defined(__GNUC__) || defined(__INTEL_COMPILER)
+#define SHERPA_RESTRICT __restrict__
+#else
+#define SHERPA_RESTRICT
+#endif
+
+
 namespace sherpa {
 
 
@@ -91,6 +100,26 @@ namespace sherpa {
       return PyArray_DIMS( array );
     }
 
+    // True if the elements can be walked with a unit-stride CType
+    // pointer (C-contiguous and properly aligned)
+    bool is_contiguous() const
+    {
+      return ( ( ( size < 2 ) ||
+		 ( npy_intp( sizeof( CType ) ) == stride ) ) &&
+	       ( 0 == ( reinterpret_cast< size_t >( data ) %
+			sizeof( CType ) ) ) );
+    }
+
+    const CType* get_data() const
+    {
+      return static_cast< const CType* >( static_cast< void* >( data ) );
+    }
+
+    CType* get_data()
+    {
+      return static_cast< CType* >( static_cast< void* >( data ) );
+    }
+
     const CType& operator[]( npy_intp index ) const
     {
       return *( static_cast< CType* >
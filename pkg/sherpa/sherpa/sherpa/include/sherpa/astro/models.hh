@@ -22,6 +22,7 @@
 
 #include <sherpa/utils.hh>
 #include <sherpa/constants.hh>
+#include <sherpa/vecmath.hh>
 
 
 namespace sherpa { namespace astro { namespace models {
@@ -267,19 +268,19 @@ namespace sherpa { namespace astro { namespace models {
 	return EXIT_FAILURE;
       }
       DataType tauh_val;
-      if ( EXIT_SUCCESS != tauh( wav, heiicol, 2.0, tauh_val ) ) {
+      if ( EXIT_SUCCESS != tauh( wav, heiicol, DataType( 2.0 ), tauh_val ) ) {
 	val = SMP_MAX;
 	return EXIT_FAILURE;
       }
       tau = hcol * mmcross_val + tauhe_val + tauh_val;
     } else {
       DataType tauh_val1;
-      if ( EXIT_SUCCESS != tauh( wav, hcol, 1.0, tauh_val1 ) ) {
+      if ( EXIT_SUCCESS != tauh( wav, hcol, DataType( 1.0 ), tauh_val1 ) ) {
 	val = SMP_MAX;
 	return EXIT_FAILURE;
       }
       DataType tauh_val2;
-      if ( EXIT_SUCCESS != tauh( wav, heiicol, 2.0, tauh_val2 ) ) {
+      if ( EXIT_SUCCESS != tauh( wav, heiicol, DataType( 2.0 ), tauh_val2 ) ) {
 	val = SMP_MAX;
 	return EXIT_FAILURE;
       }
@@ -305,6 +306,26 @@ namespace sherpa { namespace astro { namespace models {
   }
 
 
+  //
+  // Gradients with respect to every parameter, as for the *_grad
+  // functions in sherpa/models.hh.  The models built from tabulated
+  // fits or with several branches use central differences.
+  //
+
+  template <typename DataType, typename ConstArrayType>
+  inline int atten_point_grad( const ConstArrayType& p, DataType x,
+			       DataType& val, DataType* grad )
+  {
+
+    return sherpa::utils::fd_point_grad
+      ( 3, atten_point< DataType,
+			sherpa::utils::shifted_pars< ConstArrayType,
+						     DataType > >,
+	p, x, val, grad );
+
+  }
+
+
   template <typename DataType>
   inline int bbody_energy( DataType elo, DataType ehi, DataType t,
 			   bool integrate, DataType& val )
@@ -391,11 +412,11 @@ namespace sherpa { namespace astro { namespace models {
     DataType wave;
     DataType energy;
 
-    if( EXIT_SUCCESS != bbody_wave(x, 0.0, p[1], false, wave)) {
+    if( EXIT_SUCCESS != bbody_wave(x, DataType(0.0), p[1], false, wave)) {
       return EXIT_FAILURE;
     }
   
-    if( EXIT_SUCCESS != bbody_energy(x, 0.0, p[1], false, energy)) {
+    if( EXIT_SUCCESS != bbody_energy(x, DataType(0.0), p[1], false, energy)) {
       return EXIT_FAILURE;
     }
 
@@ -409,6 +430,20 @@ namespace sherpa { namespace astro { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int bbody_point_grad( const ConstArrayType& p, DataType x,
+			       DataType& val, DataType* grad )
+  {
+
+    return sherpa::utils::fd_point_grad
+      ( 3, bbody_point< DataType,
+			sherpa::utils::shifted_pars< ConstArrayType,
+						     DataType > >,
+	p, x, val, grad );
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int bbodyfreq_point( const ConstArrayType& p, DataType x,
 			      DataType& val )
@@ -424,6 +459,25 @@ namespace sherpa { namespace astro { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int bbodyfreq_point_grad( const ConstArrayType& p, DataType x,
+				   DataType& val, DataType* grad )
+  {
+
+    if(p[0] == 0.0)
+      // val = NAN;
+      return EXIT_FAILURE;
+
+    register DataType f =
+      (TWO_H_OVER_C_SQUARED)*x*x*x*(1.0/EXP((H_OVER_K)*(x/p[0])));
+    val = p[1]*f;
+    grad[0] = val*(H_OVER_K)*x/(p[0]*p[0]);
+    grad[1] = f;
+    return EXIT_SUCCESS;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int beta1d_point( const ConstArrayType& p, DataType x, DataType& val )
   {
@@ -436,6 +490,28 @@ namespace sherpa { namespace astro { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int beta1d_point_grad( const ConstArrayType& p, DataType x,
+				DataType& val, DataType* grad )
+  {
+    if ( 0.0 == p[0] ) {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+    register DataType u = (x-p[2])/p[0];
+    register DataType base = 1.0+(u*u);
+    register DataType f = POW(base,((-3.0*p[1])+0.5));
+    val = p[3]*f;
+    // d(val)/d(base) times d(base)/d(u)
+    register DataType du = val*((-3.0*p[1])+0.5)/base*2.0*u;
+    grad[0] = -du*u/p[0];
+    grad[1] = -3.0*val*LOG(base);
+    grad[2] = -du/p[0];
+    grad[3] = f;
+    return EXIT_SUCCESS;
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int bpl1d_point( const ConstArrayType& p, DataType x, DataType& val )
   {
@@ -539,6 +615,150 @@ namespace sherpa { namespace astro { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int bpl1d_point_grad( const ConstArrayType& p, DataType x,
+			       DataType& val, DataType* grad )
+  {
+
+    return sherpa::utils::fd_point_grad
+      ( 5, bpl1d_point< DataType,
+			sherpa::utils::shifted_pars< ConstArrayType,
+						     DataType > >,
+	p, x, val, grad );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int bpl1d_integrated_grad( const ConstArrayType& p,
+				    DataType xlo, DataType xhi,
+				    DataType& val, DataType* grad )
+  {
+
+    return sherpa::utils::fd_integrated_grad
+      ( 5, bpl1d_integrated< DataType,
+			     sherpa::utils::shifted_pars< ConstArrayType,
+							  DataType > >,
+	p, xlo, xhi, val, grad );
+
+  }
+
+
+  //
+  // Batch versions of bpl1d_point and bpl1d_integrated for MODELFCT1D_VEC;
+  // see the corresponding section of sherpa/models.hh
+  //
+
+SHERPA_VEC_BEGIN
+
+  struct bpl1d_point_kernel {
+
+    // a1 and a2 are the amplitudes below and above the break
+    bpl1d_point_kernel( double g1, double g2, double eb, double r,
+			double a1, double a2 )
+      : gamma1( g1 ), gamma2( g2 ), ebreak( eb ), ref( r ),
+	ampl1( a1 ), ampl2( a2 ) { }
+
+    template <typename V, typename M>
+    SHERPA_VEC_INLINE V operator()( V x, M& fail ) const
+    {
+      M below = x <= ebreak;
+      V val = vecmath::select( below, V() + ampl1, V() + ampl2 ) *
+	vecmath::vpow( x / ref,
+		       vecmath::select( below, V() - gamma1, V() - gamma2 ) );
+      return vecmath::select( x >= 0.0, val, V() );
+    }
+
+    double gamma1, gamma2, ebreak, ref, ampl1, ampl2;
+
+  };
+
+
+  struct bpl1d_integrated_kernel {
+
+    // The antiderivatives are a1 x^e1 below the break and a2 x^e2 above
+    // it; f1 and f2 are their values at the break
+    bpl1d_integrated_kernel( double eb, double e1, double e2,
+			     double a1, double a2 )
+      : ebreak( eb ), exp1( e1 ), exp2( e2 ), ampl1( a1 ), ampl2( a2 ),
+	f1( std::pow( eb, e1 ) ), f2( std::pow( eb, e2 ) ) { }
+
+    template <typename V, typename M>
+    SHERPA_VEC_INLINE V operator()( V xlo, V xhi, M& fail ) const
+    {
+
+      // Bins entirely below the break, entirely above it, or across it
+      M below = xhi <= ebreak;
+      M above = ~below & ( xlo >= ebreak );
+      M across = ~( below | above );
+
+      V plo = vecmath::vpow( xlo, vecmath::select( above, V() + exp2,
+						   V() + exp1 ) );
+      V phi = vecmath::vpow( xhi, vecmath::select( below, V() + exp1,
+						   V() + exp2 ) );
+
+      V out1 = vecmath::select( above, V() + ampl2, V() + ampl1 ) *
+	( vecmath::select( across, V() + f1, phi ) - plo );
+      V out2 = vecmath::select( across, ampl2 * ( phi - f2 ), V() );
+
+      return vecmath::select( xlo >= 0.0, out1 + out2, V() );
+
+    }
+
+    double ebreak, exp1, exp2, ampl1, ampl2, f1, f2;
+
+  };
+
+
+  template <typename DataType, typename ConstArrayType, typename IndexType>
+  inline int bpl1d_point_vec( const ConstArrayType& p, IndexType nelem,
+			      const DataType* x, DataType* val )
+  {
+
+    if ( 0.0 != p[3] ) {
+      DataType a = p[4]*POW((p[2]/p[3]),p[1])*POW((p[2]/p[3]),-p[0]);
+      IndexType nfail = vecmath::apply
+	( bpl1d_point_kernel( p[0], p[1], p[2], p[3], p[4], a ),
+	  nelem, x, val );
+      if ( nfail >= 0 )
+	return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+    }
+
+    return vecmath::scalar_point_loop
+      < DataType, ConstArrayType, IndexType,
+	bpl1d_point< DataType, ConstArrayType > >( p, nelem, x, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType, typename IndexType>
+  inline int bpl1d_integrated_vec( const ConstArrayType& p, IndexType nelem,
+				   const DataType* xlo, const DataType* xhi,
+				   DataType* val )
+  {
+
+    // The logarithmic cases gamma = 1 are left to the scalar code
+    if ( ( 0.0 != p[3] ) && ( p[0] != 1.0 ) && ( p[1] != 1.0 ) ) {
+      DataType a = p[4]*POW((p[2]/p[3]),p[1])*POW((p[2]/p[3]),-p[0]);
+      DataType a1 = p[4]/POW(p[3],-p[0])/(1.0-p[0]);
+      DataType a2 = a/POW(p[3],-p[1])/(1.0-p[1]);
+      IndexType nfail = vecmath::apply
+	( bpl1d_integrated_kernel( p[2], 1.0-p[0], 1.0-p[1], a1, a2 ),
+	  nelem, xlo, xhi, val );
+      if ( nfail >= 0 )
+	return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+    }
+
+    return vecmath::scalar_integrated_loop
+      < DataType, ConstArrayType, IndexType,
+	bpl1d_integrated< DataType, ConstArrayType > >( p, nelem,
+							xlo, xhi, val );
+
+  }
+
+SHERPA_VEC_END
+
+
   template <typename DataType, typename ConstArrayType>
   inline int dered_point( const ConstArrayType& p, DataType x, DataType& val )
   {
@@ -610,6 +830,20 @@ namespace sherpa { namespace astro { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int dered_point_grad( const ConstArrayType& p, DataType x,
+			       DataType& val, DataType* grad )
+  {
+
+    return sherpa::utils::fd_point_grad
+      ( 2, dered_point< DataType,
+			sherpa::utils::shifted_pars< ConstArrayType,
+						     DataType > >,
+	p, x, val, grad );
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int edge_point( const ConstArrayType& p, DataType x, DataType& val )
   {
@@ -642,6 +876,20 @@ namespace sherpa { namespace astro { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int edge_point_grad( const ConstArrayType& p, DataType x,
+			      DataType& val, DataType* grad )
+  {
+
+    return sherpa::utils::fd_point_grad
+      ( 3, edge_point< DataType,
+		       sherpa::utils::shifted_pars< ConstArrayType,
+						    DataType > >,
+	p, x, val, grad );
+
+  }
+
+
   // FIXME: restore analytical portion
   /*
   template <typename DataType, typename ConstArrayType>
@@ -784,6 +1032,35 @@ namespace sherpa { namespace astro { namespace models {
     val = 0.5*prefix*(val1 - val0);
     return EXIT_SUCCESS;
   
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int linebroad_point_grad( const ConstArrayType& p, DataType x,
+				   DataType& val, DataType* grad )
+  {
+
+    return sherpa::utils::fd_point_grad
+      ( 3, linebroad_point< DataType,
+			    sherpa::utils::shifted_pars< ConstArrayType,
+							 DataType > >,
+	p, x, val, grad );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int linebroad_integrated_grad( const ConstArrayType& p,
+					DataType xlo, DataType xhi,
+					DataType& val, DataType* grad )
+  {
+
+    return sherpa::utils::fd_integrated_grad
+      ( 3, linebroad_integrated< DataType,
+				 sherpa::utils::shifted_pars
+				 < ConstArrayType, DataType > >,
+	p, xlo, xhi, val, grad );
+
   }
     /*
       > beta:=2*c*A/Pi/rest/vsini;
@@ -869,6 +1146,64 @@ namespace sherpa { namespace astro { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int lorentz1d_point_grad( const ConstArrayType& p, DataType x,
+				   DataType& val, DataType* grad )
+  {
+
+    register DataType hw2 = (p[0]/2)*(p[0]/2);
+    register DataType dx2 = (x-p[1])*(x-p[1]);
+    register DataType denom = hw2+dx2;
+    val = (p[2]/PI)*(p[0]/2)/(hw2+dx2);
+    grad[0] = (p[2]/(2.0*PI))*(dx2-hw2)/(denom*denom);
+    grad[1] = (p[2]/PI)*p[0]*(x-p[1])/(denom*denom);
+    grad[2] = (p[0]/2)/(PI*denom);
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int lorentz1d_integrated_grad( const ConstArrayType& p,
+					DataType xlo, DataType xhi,
+					DataType& val, DataType* grad )
+  {
+
+    register DataType angle1 = 0.0;
+    register DataType angle2 = 0.0;
+    if ( xhi - p[1] != 0.0 ) {
+      angle2 = atan2( p[0] / 2.0, xhi - p[1] );
+    } else {
+      angle2 = PI / 2.0;
+    }
+    if ( xlo - p[1] != 0.0 ) {
+      angle1 = atan2( p[0] / 2.0, xlo - p[1] );
+    } else {
+      angle1 = PI / 2.0;
+    }
+
+    val = -1.0 * p[2] * ( angle2 - angle1 ) / PI;
+
+    // The derivatives of atan2(p[0]/2, x-p[1]) with respect to the half
+    // width and the position are (x-p[1])/d and (p[0]/2)/d
+    register DataType hw = p[0] / 2.0;
+    register DataType dx1 = xlo - p[1];
+    register DataType dx2 = xhi - p[1];
+    register DataType d1 = hw*hw + dx1*dx1;
+    register DataType d2 = hw*hw + dx2*dx2;
+    if ( 0.0 == d1 || 0.0 == d2 ) {
+      grad[0] = grad[1] = 0.0;
+    } else {
+      grad[0] = -0.5 * p[2] * ( dx2/d2 - dx1/d1 ) / PI;
+      grad[1] = -1.0 * p[2] * ( hw/d2 - hw/d1 ) / PI;
+    }
+    grad[2] = -1.0 * ( angle2 - angle1 ) / PI;
+
+    return EXIT_SUCCESS;
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int nbeta1d_point( const ConstArrayType& p, DataType x,
 			    DataType& val )
@@ -887,6 +1222,20 @@ namespace sherpa { namespace astro { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int nbeta1d_point_grad( const ConstArrayType& p, DataType x,
+				 DataType& val, DataType* grad )
+  {
+
+    return sherpa::utils::fd_point_grad
+      ( 4, nbeta1d_point< DataType,
+			  sherpa::utils::shifted_pars< ConstArrayType,
+						       DataType > >,
+	p, x, val, grad );
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int schechter_point( const ConstArrayType& p, DataType x, 
 			      DataType& val )
@@ -918,6 +1267,40 @@ namespace sherpa { namespace astro { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int schechter_point_grad( const ConstArrayType& p, DataType x,
+				   DataType& val, DataType* grad )
+  {
+
+    grad[0] = grad[1] = grad[2] = 0.0;
+    return schechter_point( p, x, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int schechter_integrated_grad( const ConstArrayType& p,
+					DataType xlo, DataType xhi,
+					DataType& val, DataType* grad )
+  {
+
+    if( p[1] == 0.0 )
+      // val = NAN;
+      return EXIT_FAILURE;
+    else {
+      register DataType xthis = xlo/p[1];
+      register DataType xnext = xhi/p[1];
+      register DataType f = POW(xthis, p[0])*EXP(-xthis)*(xnext - xthis);
+      val = p[2]*f;
+      grad[0] = ( 0.0 == val ) ? 0.0 : val*LOG(xthis);
+      grad[1] = val*(xthis - p[0] - 1.0)/p[1];
+      grad[2] = f;
+      return EXIT_SUCCESS;
+    }
+
+  }
+
+
   // =============================================================
 
 
@@ -943,6 +1326,38 @@ namespace sherpa { namespace astro { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int beta2d_point_grad( const ConstArrayType& p,
+				DataType x0, DataType x1, DataType& val,
+				DataType* grad )
+  {
+
+    register DataType r;
+
+    if( EXIT_SUCCESS != sherpa::utils::radius2_grad(p, x0, x1, r,
+						    grad + 1)) {
+      return EXIT_FAILURE;
+    }
+
+    if( 0 == p[0] )
+      // val = NAN;
+      return EXIT_FAILURE;
+    else {
+      register DataType base = 1.0 + r/(p[0]*p[0]);
+      register DataType f = POW(base, -p[6]);
+      val = p[5] * f;
+      register DataType dr = -p[6]*val/(base*p[0]*p[0]);
+      grad[0] = -2.0*dr*r/p[0];
+      for ( int ii = 1; ii <= 4; ii++ )
+	grad[ii] *= dr;
+      grad[5] = f;
+      grad[6] = -val*LOG(base);
+      return EXIT_SUCCESS;
+    }
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int devau_point( const ConstArrayType& p,
 			  DataType x0, DataType x1, DataType& val )
@@ -965,6 +1380,40 @@ namespace sherpa { namespace astro { namespace models {
 
   }
 
+
+  template <typename DataType, typename ConstArrayType>
+  inline int devau_point_grad( const ConstArrayType& p,
+			       DataType x0, DataType x1, DataType& val,
+			       DataType* grad )
+  {
+
+    register DataType r;
+
+    if( EXIT_SUCCESS != sherpa::utils::radius_grad(p, x0, x1, r,
+						   grad + 1)) {
+      return EXIT_FAILURE;
+    }
+
+    if( 0.0 == p[0] )
+      return EXIT_FAILURE;
+    else {
+      // Ciotti & Bertin (1999)
+      DataType b4 = 8.0 - 1./3. + 1.0/405. + 23./204120;
+      register DataType w = POW(r/p[0],0.25);
+      register DataType f = EXP(-b4*(w-1.0));
+      val = p[5]*f;
+      // The slope in r is infinite at the centre; radius_grad has zeroed
+      // the position derivatives there
+      register DataType dr = ( 0.0 == r ) ? 0.0 : -0.25*b4*val*w/r;
+      grad[0] = 0.25*b4*val*w/p[0];
+      for ( int ii = 1; ii <= 4; ii++ )
+	grad[ii] *= dr;
+      grad[5] = f;
+      return EXIT_SUCCESS;
+    }
+
+  }
+
   template <typename DataType, typename ConstArrayType>
   inline int hr_point( const ConstArrayType& p,
 		       DataType x0, DataType x1, DataType& val )
@@ -986,6 +1435,34 @@ namespace sherpa { namespace astro { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int hr_point_grad( const ConstArrayType& p,
+			    DataType x0, DataType x1, DataType& val,
+			    DataType* grad )
+  {
+
+    register DataType r;
+
+    if( EXIT_SUCCESS != sherpa::utils::radius2_grad(p, x0, x1, r,
+						    grad + 1)) {
+      return EXIT_FAILURE;
+    }
+    if( p[0] == 0.0 )
+      // val = NAN;
+      return EXIT_FAILURE;
+    else {
+      register DataType f = 1.0/(r/((p[0]+1.0)*(p[0]+1.0)));
+      val = p[5]/(r/((p[0]+1.0)*(p[0]+1.0)));
+      grad[0] = 2.0*val/(p[0]+1.0);
+      for ( int ii = 1; ii <= 4; ii++ )
+	grad[ii] *= -val/r;
+      grad[5] = f;
+      return EXIT_SUCCESS;
+    }
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int lorentz2d_point( const ConstArrayType& p,
 			      DataType x0, DataType x1, DataType& val )
@@ -1006,6 +1483,35 @@ namespace sherpa { namespace astro { namespace models {
 
   }
 
+
+  template <typename DataType, typename ConstArrayType>
+  inline int lorentz2d_point_grad( const ConstArrayType& p,
+				   DataType x0, DataType x1, DataType& val,
+				   DataType* grad )
+  {
+
+    register DataType r;
+
+    if( EXIT_SUCCESS != sherpa::utils::radius2_grad(p, x0, x1, r,
+						    grad + 1)) {
+      return EXIT_FAILURE;
+    }
+    if( p[0] == 0.0 && r == 0.0 )
+      return EXIT_FAILURE;
+    else {
+      register DataType hw2 = ( p[0] / 2.0 ) * ( p[0] / 2.0 );
+      register DataType denom = r + hw2;
+      val = p[5] * ( p[0] / 2.0 ) * ( p[0] / 2.0 ) /
+	( r + ( p[0] / 2.0 ) * ( p[0] / 2.0 ) );
+      grad[0] = p[5] * ( p[0] / 2.0 ) * r / ( denom * denom );
+      for ( int ii = 1; ii <= 4; ii++ )
+	grad[ii] *= -p[5] * hw2 / ( denom * denom );
+      grad[5] = hw2 / denom;
+      return EXIT_SUCCESS;
+    }
+
+  }
+
   template <typename DataType, typename ConstArrayType>
   inline int sersic_point( const ConstArrayType& p,
 			   DataType x0, DataType x1, DataType& val )
@@ -1029,6 +1535,44 @@ namespace sherpa { namespace astro { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int sersic_point_grad( const ConstArrayType& p,
+				DataType x0, DataType x1, DataType& val,
+				DataType* grad )
+  {
+
+    register DataType r;
+
+    if( EXIT_SUCCESS != sherpa::utils::radius_grad(p, x0, x1, r,
+						   grad + 1)) {
+      return EXIT_FAILURE;
+    }
+
+    if( 0.0 == p[0] || 0.0 == p[6] )
+      return EXIT_FAILURE;
+    else {
+      // Ciotti & Bertin (1999)
+      DataType bn = 2.0*p[6] - 1./3. + 4.0/(405*p[6]) + 46./(25515.0*p[6]*p[6]);
+      DataType dbn = 2.0 - 4.0/(405*p[6]*p[6]) -
+	92./(25515.0*p[6]*p[6]*p[6]);
+      register DataType w = POW(r/p[0],1./p[6]);
+      register DataType f = EXP(-bn*(w-1.0));
+      val = p[5]*f;
+      // As for devau, the slope in r is infinite at the centre
+      register DataType dr = ( 0.0 == r ) ? 0.0 : -val*bn*w/(p[6]*r);
+      grad[0] = val*bn*w/(p[6]*p[0]);
+      for ( int ii = 1; ii <= 4; ii++ )
+	grad[ii] *= dr;
+      grad[5] = f;
+      grad[6] = -val*dbn*(w-1.0);
+      if ( 0.0 != w )
+	grad[6] += val*bn*w*LOG(r/p[0])/(p[6]*p[6]);
+      return EXIT_SUCCESS;
+    }
+
+  }
+
+
 }  }  } /* namespace models, namespace astro, namespace sherpa */
 
 
@@ -21,6 +21,7 @@
 #define __sherpa_extension_hh__
 
 #include <sherpa/array.hh>
+#include <algorithm>
 
 
 typedef unsigned int SherpaUInt;
@@ -30,6 +31,11 @@ typedef double SherpaFloat;
 typedef sherpa::Array< double, NPY_DOUBLE > DoubleArray;
 typedef DoubleArray SherpaFloatArray;
 
+// Single precision evaluation, for the module functions that offer it
+typedef float SherpaFloat32;
+typedef sherpa::Array< float, NPY_FLOAT > FloatArray;
+typedef FloatArray SherpaFloat32Array;
+
 typedef sherpa::Array< char, NPY_CHAR > CharArray;
 typedef sherpa::Array< int, NPY_INT > IntArray;
 
@@ -37,6 +43,46 @@ typedef int (*converter)( PyObject*, void* );
 
 #define CONVERTME(arg) ((converter) sherpa::convert_to_contig_array<arg>)
 
+
+namespace sherpa {
+
+  // Whether the module functions that offer single precision evaluation
+  // use it.  It is off by default, so those functions work in double
+  // precision whatever the type of the arrays they are given; switched
+  // on, they read every array as float32 instead.  Each extension module
+  // has its own switch.
+  inline bool& single_precision()
+  {
+    static bool single = false;
+    return single;
+  }
+
+
+  inline PyObject* set_single_precision( PyObject* self, PyObject* args )
+  {
+
+    int single = 0;
+
+    if ( !PyArg_ParseTuple( args, (char*)"i", &single ) )
+      return NULL;
+
+    single_precision() = ( 0 != single );
+
+    Py_RETURN_NONE;
+
+  }
+
+
+  inline PyObject* get_single_precision( PyObject* self, PyObject* args )
+  {
+
+    return PyBool_FromLong( single_precision() );
+
+  }
+
+}  /* namespace sherpa */
+
+
 #define SHERPAMOD(name, fctlist) \
 PyMODINIT_FUNC \
 init##name(void) \
@@ -49,5 +95,9 @@ init##name(void) \
 #define FCTSPEC(name, func) \
  { (char*)#name, (PyCFunction)func, METH_VARARGS, NULL }
 
+#define PRECISIONFCTS \
+  FCTSPEC(set_single_precision, sherpa::set_single_precision), \
+  FCTSPEC(get_single_precision, sherpa::get_single_precision)
+
 
 #endif /* __sherpa_extension_hh__ */
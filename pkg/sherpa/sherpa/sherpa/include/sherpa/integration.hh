@@ -20,6 +20,7 @@
 #ifndef __sherpa_integration_hh__
 #define __sherpa_integration_hh__
 
+#include <cstddef>
 #include <sstream>
 
 extern "C" {
@@ -53,6 +54,16 @@ int py_integrate_1d( integrand_1d_vec fct, void* params,
 		     std::ostringstream& err);
 
 
+// py_integrate_1d over nbins bins at once: fct is called once for the
+// nodes of every bin and at most twice more for the bins that need the
+// higher-order rules
+int py_integrate_1d_batch( integrand_1d_vec fct, void* params,
+			   std::size_t nbins, const double* xlo,
+			   const double* xhi, unsigned int maxeval,
+			   double epsabs, double epsrel, double* result,
+			   int errflag, std::ostringstream& err );
+
+
 }  }  /* namespace integration, namespace sherpa */
 
 #endif  /* defined(_INTEGRATIONMODULE) || !defined(Py_PYTHON_H) */
@@ -81,11 +92,19 @@ typedef int (*_py_integrate_1d)( integrand_1d_vec fct, void* params,
 				 double &result, double& abserr, int errflag,
 				 std::ostringstream& err );
 
+typedef int (*_py_integrate_1d_batch)( integrand_1d_vec fct, void* params,
+				       std::size_t nbins, const double* xlo,
+				       const double* xhi, unsigned int maxeval,
+				       double epsabs, double epsrel,
+				       double* result, int errflag,
+				       std::ostringstream& err );
+
 static void **Integration_API;
 
 #define integrate_1d ((_integrate_1d)Integration_API[0])
 #define integrate_Nd ((_integrate_Nd)Integration_API[1])
 #define py_integrate_1d ((_py_integrate_1d)Integration_API[2])
+#define py_integrate_1d_batch ((_py_integrate_1d_batch)Integration_API[3])
 
 static int
 import_integration(void)
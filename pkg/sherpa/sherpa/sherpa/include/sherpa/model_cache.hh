@@ -0,0 +1,438 @@
+//
+//  Copyright (C) 2013  Smithsonian Astrophysical Observatory
+//
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with this program; if not, write to the Free Software Foundation, Inc.,
+//  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __sherpa_model_cache_hh__
+#define __sherpa_model_cache_hh__
+
+//
+// The cache of model values behind sherpa.models.model.modelCacher1d.
+//
+// Grids are registered once with cache_grid(), which keeps a copy of the
+// grid arrays and returns an integer token for them; asking again for an
+// equal grid gives the same token back after a memcmp against the copy,
+// so the grid is never hashed.  Values are then looked up by
+// (model id, bits of the parameter vector, grid token, integrate flags).
+//
+// The entries are kept in least recently used order and evicted once
+// their values take more than the memory budget (default 64 MB, or the
+// environment variable SHERPA_MODEL_CACHE_MB), or once a model has more
+// than its own maximum number of entries.  Dropping a grid from the
+// registry, which holds at most MAX_GRIDS of them, drops its entries too.
+// Everything here runs with the GIL held.
+//
+
+#include <sherpa/extension.hh>
+#include <sherpa/threads.hh>
+#include <cstring>
+#include <list>
+#include <map>
+#include <vector>
+
+namespace sherpa { namespace models {
+
+  class ModelCache {
+
+  public:
+
+    enum {
+      MAX_GRIDS = 8,
+      MAX_GRID_ARRAYS = 4,
+      DEFAULT_BUDGET_MB = 64
+    };
+
+    static ModelCache& instance()
+    {
+      static ModelCache cache;
+      return cache;
+    }
+
+    // Return the token of the grid made of the narrays arrays, registering
+    // it if it is new
+    long grid_token( const DoubleArray* arrays, int narrays )
+    {
+
+      for ( std::list< Grid >::iterator g = grids.begin(); g != grids.end();
+	    ++g )
+	if ( g->matches( arrays, narrays ) ) {
+	  grids.splice( grids.begin(), grids, g );
+	  return g->token;
+	}
+
+      if ( grids.size() >= std::size_t( MAX_GRIDS ) ) {
+	remove_grid( grids.back().token );
+	grids.pop_back();
+      }
+
+      grids.push_front( Grid() );
+      Grid& grid = grids.front();
+      grid.token = next_token++;
+      grid.data.resize( narrays );
+      for ( int ii = 0; ii < narrays; ii++ )
+	grid.data[ ii ].assign( arrays[ ii ].get_data(),
+				arrays[ ii ].get_data() +
+				arrays[ ii ].get_size() );
+
+      return grid.token;
+
+    }
+
+    // Return a new reference to the cached values, or NULL on a miss
+    PyObject* lookup( long model, long grid, int integrate,
+		      const DoubleArray& pars )
+    {
+
+      Key key( model, grid, integrate, pars );
+      std::map< Key, EntryIter >::iterator found = index.find( key );
+
+      if ( index.end() == found ) {
+	++misses;
+	return NULL;
+      }
+
+      ++hits;
+      lru.splice( lru.begin(), lru, found->second );
+      Py_INCREF( found->second->vals );
+      return found->second->vals;
+
+    }
+
+    // Keep a reference to vals, unless it is larger than the budget
+    void store( long model, long grid, int integrate,
+		const DoubleArray& pars, PyObject* vals, long maxentries )
+    {
+
+      std::size_t nbytes = std::size_t( PyArray_NBYTES( vals ) ) +
+	std::size_t( pars.get_size() ) * sizeof( double );
+      if ( maxentries < 1 || nbytes > budget )
+	return;
+
+      Key key( model, grid, integrate, pars );
+      std::map< Key, EntryIter >::iterator found = index.find( key );
+      if ( index.end() != found )
+	erase( found->second );
+
+      while ( nentries( model ) >= maxentries )
+	erase_oldest( model );
+
+      Entry entry = { key, vals, nbytes };
+      Py_INCREF( vals );
+      lru.push_front( entry );
+      index[ key ] = lru.begin();
+      counts[ model ]++;
+      used += nbytes;
+
+      while ( used > budget )
+	erase( --lru.end() );
+
+    }
+
+    // Drop the entries of model, or all of them if model is negative
+    void clear( long model )
+    {
+      for ( EntryIter it = lru.begin(); it != lru.end(); )
+	if ( model < 0 || it->key.model == model )
+	  erase( it++ );
+	else
+	  ++it;
+    }
+
+    void set_budget( std::size_t nbytes )
+    {
+      budget = nbytes;
+      while ( used > budget )
+	erase( --lru.end() );
+    }
+
+    unsigned long get_hits() const { return hits; }
+    unsigned long get_misses() const { return misses; }
+    std::size_t get_entries() const { return lru.size(); }
+    std::size_t get_used() const { return used; }
+    std::size_t get_budget() const { return budget; }
+    std::size_t get_grids() const { return grids.size(); }
+
+  private:
+
+    // Parameters are compared bit for bit, so -0.0 and 0.0 differ and a
+    // NaN matches itself
+    struct Key {
+
+      Key( long model_, long grid_, int integrate_, const DoubleArray& pars_ )
+	: model( model_ ), grid( grid_ ), integrate( integrate_ ),
+	  pars( pars_.get_data(), pars_.get_data() + pars_.get_size() )
+      { }
+
+      bool operator<( const Key& rhs ) const
+      {
+	if ( model != rhs.model )
+	  return model < rhs.model;
+	if ( grid != rhs.grid )
+	  return grid < rhs.grid;
+	if ( integrate != rhs.integrate )
+	  return integrate < rhs.integrate;
+	if ( pars.size() != rhs.pars.size() )
+	  return pars.size() < rhs.pars.size();
+	return ( pars.size() &&
+		 std::memcmp( &pars[0], &rhs.pars[0],
+			      pars.size() * sizeof( double ) ) < 0 );
+      }
+
+      long model;
+      long grid;
+      int integrate;
+      std::vector< double > pars;
+
+    };
+
+    struct Entry {
+      Key key;
+      PyObject* vals;
+      std::size_t nbytes;
+    };
+
+    typedef std::list< Entry >::iterator EntryIter;
+
+    struct Grid {
+
+      bool matches( const DoubleArray* arrays, int narrays ) const
+      {
+	if ( std::size_t( narrays ) != data.size() )
+	  return false;
+	for ( int ii = 0; ii < narrays; ii++ )
+	  if ( std::size_t( arrays[ ii ].get_size() ) != data[ ii ].size() )
+	    return false;
+	for ( int ii = 0; ii < narrays; ii++ )
+	  if ( data[ ii ].size() &&
+	       0 != std::memcmp( arrays[ ii ].get_data(), &data[ ii ][0],
+				 data[ ii ].size() * sizeof( double ) ) )
+	    return false;
+	return true;
+      }
+
+      long token;
+      std::vector< std::vector< double > > data;
+
+    };
+
+    ModelCache()
+      : budget( std::size_t( sherpa::threads::env_setting
+			     ( "SHERPA_MODEL_CACHE_MB",
+			       DEFAULT_BUDGET_MB ) ) << 20 ),
+	used( 0 ),
+	hits( 0 ),
+	misses( 0 ),
+	next_token( 0 )
+    { }
+
+    // Never destroyed, like the values it refers to at exit
+
+    long nentries( long model ) const
+    {
+      std::map< long, long >::const_iterator found = counts.find( model );
+      return ( counts.end() == found ) ? 0 : found->second;
+    }
+
+    void erase( EntryIter it )
+    {
+      used -= it->nbytes;
+      if ( 0 == --counts[ it->key.model ] )
+	counts.erase( it->key.model );
+      index.erase( it->key );
+      Py_DECREF( it->vals );
+      lru.erase( it );
+    }
+
+    void erase_oldest( long model )
+    {
+      for ( EntryIter it = lru.end(); it != lru.begin(); )
+	if ( ( --it )->key.model == model ) {
+	  erase( it );
+	  return;
+	}
+    }
+
+    void remove_grid( long token )
+    {
+      for ( EntryIter it = lru.begin(); it != lru.end(); )
+	if ( it->key.grid == token )
+	  erase( it++ );
+	else
+	  ++it;
+    }
+
+    std::list< Entry > lru;		// most recently used first
+    std::map< Key, EntryIter > index;
+    std::map< long, long > counts;	// entries per model
+    std::list< Grid > grids;		// most recently used first
+    std::size_t budget;
+    std::size_t used;
+    unsigned long hits;
+    unsigned long misses;
+    long next_token;
+
+  };
+
+
+  inline PyObject* cache_grid( PyObject* self, PyObject* args )
+  {
+
+    DoubleArray arrays[ ModelCache::MAX_GRID_ARRAYS ];
+
+    if ( !PyArg_ParseTuple( args, (char*)"O&|O&O&O&",
+			    CONVERTME( DoubleArray ), &arrays[0],
+			    CONVERTME( DoubleArray ), &arrays[1],
+			    CONVERTME( DoubleArray ), &arrays[2],
+			    CONVERTME( DoubleArray ), &arrays[3] ) )
+      return NULL;
+
+    int narrays = int( PyTuple_GET_SIZE( args ) );
+
+    return PyInt_FromLong( ModelCache::instance().grid_token( arrays,
+							      narrays ) );
+
+  }
+
+
+  inline PyObject* cache_lookup( PyObject* self, PyObject* args )
+  {
+
+    long model;
+    DoubleArray pars;
+    long grid;
+    int integrate;
+
+    if ( !PyArg_ParseTuple( args, (char*)"lO&li", &model,
+			    CONVERTME( DoubleArray ), &pars, &grid,
+			    &integrate ) )
+      return NULL;
+
+    PyObject* vals = ModelCache::instance().lookup( model, grid, integrate,
+						    pars );
+    if ( NULL == vals )
+      Py_RETURN_NONE;
+
+    return vals;
+
+  }
+
+
+  inline PyObject* cache_store( PyObject* self, PyObject* args )
+  {
+
+    long model;
+    DoubleArray pars;
+    long grid;
+    int integrate;
+    PyObject* vals;
+    long maxentries = 1;
+
+    if ( !PyArg_ParseTuple( args, (char*)"lO&liO!|l", &model,
+			    CONVERTME( DoubleArray ), &pars, &grid,
+			    &integrate, &PyArray_Type, &vals, &maxentries ) )
+      return NULL;
+
+    ModelCache::instance().store( model, grid, integrate, pars, vals,
+				  maxentries );
+
+    Py_RETURN_NONE;
+
+  }
+
+
+  inline PyObject* cache_clear( PyObject* self, PyObject* args )
+  {
+
+    long model = -1;
+
+    if ( !PyArg_ParseTuple( args, (char*)"|l", &model ) )
+      return NULL;
+
+    ModelCache::instance().clear( model );
+
+    Py_RETURN_NONE;
+
+  }
+
+
+  inline PyObject* cache_set_budget( PyObject* self, PyObject* args )
+  {
+
+    Py_ssize_t nbytes;
+
+    if ( !PyArg_ParseTuple( args, (char*)"n", &nbytes ) )
+      return NULL;
+
+    if ( nbytes < 0 ) {
+      PyErr_SetString( PyExc_ValueError,
+		       (char*)"cache budget must not be negative" );
+      return NULL;
+    }
+
+    ModelCache::instance().set_budget( std::size_t( nbytes ) );
+
+    Py_RETURN_NONE;
+
+  }
+
+
+  inline PyObject* cache_stats( PyObject* self )
+  {
+
+    const ModelCache& cache = ModelCache::instance();
+
+    return Py_BuildValue( (char*)"{s:k,s:k,s:n,s:n,s:n,s:n}",
+			  "hits", cache.get_hits(),
+			  "misses", cache.get_misses(),
+			  "entries", Py_ssize_t( cache.get_entries() ),
+			  "nbytes", Py_ssize_t( cache.get_used() ),
+			  "budget", Py_ssize_t( cache.get_budget() ),
+			  "grids", Py_ssize_t( cache.get_grids() ) );
+
+  }
+
+
+}  }  /* namespace models, namespace sherpa */
+
+
+#define MODELCACHE_FUNCS \
+  { (char*)"cache_grid", (PyCFunction)sherpa::models::cache_grid, \
+    METH_VARARGS, \
+    (char*)"cache_grid(x0 [, x1 [, x2, x3]])\n\n" \
+    "Return the model cache token of a grid, registering it if new" }, \
+  { (char*)"cache_lookup", (PyCFunction)sherpa::models::cache_lookup, \
+    METH_VARARGS, \
+    (char*)"cache_lookup(model, pars, grid, integrate)\n\n" \
+    "Return the cached model values, or None" }, \
+  { (char*)"cache_store", (PyCFunction)sherpa::models::cache_store, \
+    METH_VARARGS, \
+    (char*)"cache_store(model, pars, grid, integrate, vals [, maxentries])\n\n" \
+    "Cache model values, keeping at most maxentries for the model" }, \
+  { (char*)"cache_clear", (PyCFunction)sherpa::models::cache_clear, \
+    METH_VARARGS, \
+    (char*)"cache_clear([model])\n\n" \
+    "Drop the cached values of a model, or of every model" }, \
+  { (char*)"cache_set_budget", (PyCFunction)sherpa::models::cache_set_budget, \
+    METH_VARARGS, \
+    (char*)"cache_set_budget(nbytes)\n\n" \
+    "Set the memory budget of the model cache" }, \
+  { (char*)"cache_stats", (PyCFunction)sherpa::models::cache_stats, \
+    METH_NOARGS, \
+    (char*)"cache_stats()\n\n" \
+    "Return the hit and miss counts and the size of the model cache" }
+
+#endif /* __sherpa_model_cache_hh__ */
@@ -0,0 +1,684 @@
+//
+//  Copyright (C) 2013  Smithsonian Astrophysical Observatory
+//
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with this program; if not, write to the Free Software Foundation, Inc.,
+//  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __sherpa_model_expr_hh__
+#define __sherpa_model_expr_hh__
+
+//
+// Compiled evaluation of model expressions such as
+// (powlaw1d + gauss1d) * atten.
+//
+// The expression is compiled (by sherpa.models.model) into a postfix
+// program whose operands are model kernels, constants and precomputed
+// arrays.  The program is run over the grid one tile at a time, on a
+// stack of tile-sized buffers, so the whole expression is evaluated in a
+// single pass with no grid-sized temporaries.
+//
+// Each model module exports its kernels through expr_kernels(), as
+// PyCObjects wrapping ExprKernel entries, so an expression may combine
+// models from different modules.
+//
+
+#include <sherpa/model_extension.hh>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace sherpa { namespace models {
+
+  // Evaluate a model on nelem contiguous grid points.  x holds the grid
+  // arrays in the order the model functions take them: x (1D point), xlo,
+  // xhi (1D integrated), x0, x1 (2D point) or x0lo, x1lo, x0hi, x1hi (2D
+  // integrated).
+  typedef int (*expr_kernel_func)( const SherpaFloatArray& p, npy_intp nelem,
+				   const SherpaFloat* const* x,
+				   SherpaFloat* val );
+
+
+  struct ExprKernel {
+    const char* name;
+    int ndim;
+    npy_intp npars;
+    expr_kernel_func point;
+    expr_kernel_func integrated;
+  };
+
+
+  template <int (*PtFunc)( const SherpaFloatArray& p, SherpaFloat x,
+			   SherpaFloat& val )>
+  int expr_point1d( const SherpaFloatArray& p, npy_intp nelem,
+		    const SherpaFloat* const* x, SherpaFloat* val )
+  {
+    int nfail = 0;
+    for ( npy_intp ii = 0; ii < nelem; ii++ )
+      nfail += ( EXIT_SUCCESS != PtFunc( p, x[0][ii], val[ii] ) );
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+  }
+
+
+  template <int (*IntFunc)( const SherpaFloatArray& p, SherpaFloat xlo,
+			    SherpaFloat xhi, SherpaFloat& val )>
+  int expr_int1d( const SherpaFloatArray& p, npy_intp nelem,
+		  const SherpaFloat* const* x, SherpaFloat* val )
+  {
+    int nfail = 0;
+    for ( npy_intp ii = 0; ii < nelem; ii++ )
+      nfail += ( EXIT_SUCCESS != IntFunc( p, x[0][ii], x[1][ii], val[ii] ) );
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+  }
+
+
+  template <int (*PtVec)( const SherpaFloatArray& p, npy_intp nelem,
+			  const SherpaFloat* x, SherpaFloat* val )>
+  int expr_point1d_vec( const SherpaFloatArray& p, npy_intp nelem,
+			const SherpaFloat* const* x, SherpaFloat* val )
+  {
+    return PtVec( p, nelem, x[0], val );
+  }
+
+
+  template <int (*IntVec)( const SherpaFloatArray& p, npy_intp nelem,
+			   const SherpaFloat* xlo, const SherpaFloat* xhi,
+			   SherpaFloat* val )>
+  int expr_int1d_vec( const SherpaFloatArray& p, npy_intp nelem,
+		      const SherpaFloat* const* x, SherpaFloat* val )
+  {
+    return IntVec( p, nelem, x[0], x[1], val );
+  }
+
+
+  template <int (*PtFunc)( const SherpaFloatArray& p, SherpaFloat x0,
+			   SherpaFloat x1, SherpaFloat& val )>
+  int expr_point2d( const SherpaFloatArray& p, npy_intp nelem,
+		    const SherpaFloat* const* x, SherpaFloat* val )
+  {
+    int nfail = 0;
+    for ( npy_intp ii = 0; ii < nelem; ii++ )
+      nfail += ( EXIT_SUCCESS != PtFunc( p, x[0][ii], x[1][ii], val[ii] ) );
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+  }
+
+
+  template <int (*IntFunc)( const SherpaFloatArray& p, SherpaFloat x0lo,
+			    SherpaFloat x0hi, SherpaFloat x1lo,
+			    SherpaFloat x1hi, SherpaFloat& val )>
+  int expr_int2d( const SherpaFloatArray& p, npy_intp nelem,
+		  const SherpaFloat* const* x, SherpaFloat* val )
+  {
+    int nfail = 0;
+    for ( npy_intp ii = 0; ii < nelem; ii++ )
+      nfail += ( EXIT_SUCCESS != IntFunc( p, x[0][ii], x[2][ii], x[1][ii],
+					  x[3][ii], val[ii] ) );
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+  }
+
+
+  template <int (*IntVec)( const SherpaFloatArray& p, npy_intp nelem,
+			   const SherpaFloat* x0lo, const SherpaFloat* x0hi,
+			   const SherpaFloat* x1lo, const SherpaFloat* x1hi,
+			   SherpaFloat* val )>
+  int expr_int2d_vec( const SherpaFloatArray& p, npy_intp nelem,
+		      const SherpaFloat* const* x, SherpaFloat* val )
+  {
+    return IntVec( p, nelem, x[0], x[2], x[1], x[3], val );
+  }
+
+
+  enum ExprOpcode {
+    EXPR_KERNEL,
+    EXPR_CONST,
+    EXPR_ARRAY,
+    EXPR_NEG,
+    EXPR_ABS,
+    EXPR_ADD,
+    EXPR_SUB,
+    EXPR_MUL,
+    EXPR_DIV,
+    EXPR_POW
+  };
+
+
+  struct ExprOp {
+    int code;
+    const ExprKernel* kernel;	// EXPR_KERNEL
+    bool integrate;		// EXPR_KERNEL: use the integrated form
+    npy_intp index;		// EXPR_KERNEL: first parameter,
+				// EXPR_ARRAY: operand number
+    SherpaFloat value;		// EXPR_CONST
+  };
+
+
+  struct ExprProgram {
+    std::vector< ExprOp > ops;
+    int ndim;			// of the kernels; 0 if there are none
+    int depth;			// of the stack
+    npy_intp npars;		// parameters used
+    npy_intp narrays;		// array operands used
+  };
+
+
+  enum { EXPR_TILE = 256 };
+
+  static const char* expr_kernel_desc = "sherpa.models.ExprKernel";
+  static const char* expr_program_desc = "sherpa.models.ExprProgram";
+
+
+  // One evaluation of a program, as handed to the chunks run by
+  // sherpa::threads::parallel_for
+  struct ExprGrid {
+    const ExprProgram* prog;
+    const SherpaFloatArray* pars;	// one parameter view per op
+    std::vector< const SherpaFloat* > arrays;
+    const SherpaFloat* x[4];
+    bool integrate;			// grid has bin edges
+    SherpaFloat* result;
+  };
+
+
+  inline int expr_chunk( void* data, std::ptrdiff_t begin, std::ptrdiff_t end )
+  {
+
+    const ExprGrid& g = *static_cast< const ExprGrid* >( data );
+    const std::vector< ExprOp >& ops = g.prog->ops;
+    std::vector< SherpaFloat > stack( g.prog->depth * EXPR_TILE );
+    int nfail = 0;
+
+    for ( npy_intp lo = begin; lo < end; lo += EXPR_TILE ) {
+
+      npy_intp nelem = std::min( npy_intp( EXPR_TILE ), npy_intp( end ) - lo );
+      const SherpaFloat* x[4];
+      for ( int kk = 0; kk < 4; kk++ )
+	x[kk] = ( g.x[kk] ? g.x[kk] + lo : NULL );
+
+      // top is the topmost of the nstack tiles in use
+      int nstack = 0;
+      SherpaFloat* top = NULL;
+
+      for ( std::size_t jj = 0; jj < ops.size(); jj++ ) {
+
+	const ExprOp& op = ops[jj];
+
+	if ( op.code >= EXPR_ADD ) {
+
+	  SherpaFloat* SHERPA_RESTRICT a = &stack[ ( nstack - 2 ) * EXPR_TILE ];
+	  const SherpaFloat* SHERPA_RESTRICT b = top;
+
+	  switch ( op.code ) {
+	  case EXPR_ADD:
+	    for ( npy_intp ii = 0; ii < nelem; ii++ )
+	      a[ii] += b[ii];
+	    break;
+	  case EXPR_SUB:
+	    for ( npy_intp ii = 0; ii < nelem; ii++ )
+	      a[ii] -= b[ii];
+	    break;
+	  case EXPR_MUL:
+	    for ( npy_intp ii = 0; ii < nelem; ii++ )
+	      a[ii] *= b[ii];
+	    break;
+	  case EXPR_DIV:
+	    for ( npy_intp ii = 0; ii < nelem; ii++ )
+	      a[ii] /= b[ii];
+	    break;
+	  case EXPR_POW:
+	    for ( npy_intp ii = 0; ii < nelem; ii++ )
+	      a[ii] = std::pow( a[ii], b[ii] );
+	    break;
+	  }
+
+	  top = a;
+	  nstack--;
+	  continue;
+
+	}
+
+	if ( EXPR_NEG == op.code ) {
+	  for ( npy_intp ii = 0; ii < nelem; ii++ )
+	    top[ii] = -top[ii];
+	  continue;
+	}
+
+	if ( EXPR_ABS == op.code ) {
+	  for ( npy_intp ii = 0; ii < nelem; ii++ )
+	    top[ii] = std::fabs( top[ii] );
+	  continue;
+	}
+
+	// An operand: push a new tile
+	top = &stack[ nstack * EXPR_TILE ];
+	nstack++;
+
+	if ( EXPR_KERNEL == op.code ) {
+	  expr_kernel_func func = ( ( g.integrate && op.integrate ) ?
+				    op.kernel->integrated :
+				    op.kernel->point );
+	  nfail += ( EXIT_SUCCESS != func( g.pars[jj], nelem, x, top ) );
+	} else if ( EXPR_CONST == op.code )
+	  std::fill( top, top + nelem, op.value );
+	else
+	  std::memcpy( top, g.arrays[ op.index ] + lo,
+		       nelem * sizeof( SherpaFloat ) );
+
+      }
+
+      std::memcpy( g.result + lo, top, nelem * sizeof( SherpaFloat ) );
+
+    }
+
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+  }
+
+
+  //
+  // Module functions
+  //
+
+  // Return a dictionary mapping the name of each kernel in Table, which
+  // ends with a NULL name, to a PyCObject for it
+  template <ExprKernel* Table>
+  PyObject* expr_kernels( PyObject* self, PyObject* args, PyObject *kwds )
+  {
+
+    PyObject* dict = PyDict_New();
+    if ( NULL == dict )
+      return NULL;
+
+    for ( ExprKernel* kernel = Table; NULL != kernel->name; kernel++ ) {
+      PyObject* obj =
+	PyCObject_FromVoidPtrAndDesc( kernel, (void*)expr_kernel_desc, NULL );
+      if ( NULL == obj || 0 != PyDict_SetItemString( dict, kernel->name,
+						     obj ) ) {
+	Py_XDECREF( obj );
+	Py_DECREF( dict );
+	return NULL;
+      }
+      Py_DECREF( obj );
+    }
+
+    return dict;
+
+  }
+
+
+  inline void expr_program_free( void* ptr, void* desc )
+  {
+    delete static_cast< ExprProgram* >( ptr );
+  }
+
+
+  // Return the pointer wrapped by a PyCObject with the given description,
+  // or NULL with a TypeError set
+  inline void* expr_cobject_ptr( PyObject* obj, const char* desc,
+				 const char* what )
+  {
+
+    if ( !PyCObject_Check( obj ) || NULL == PyCObject_GetDesc( obj ) ||
+	 0 != std::strcmp( static_cast< const char* >
+			   ( PyCObject_GetDesc( obj ) ), desc ) ) {
+      std::ostringstream err;
+      err << "expected " << what;
+      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
+      return NULL;
+    }
+
+    return PyCObject_AsVoidPtr( obj );
+
+  }
+
+
+  // Compile a sequence of postfix operations into a program.  Each
+  // operation is a tuple:
+  //
+  //   ('kernel', kernel, first_parameter, integrate)
+  //   ('const', value)
+  //   ('array', operand_number)
+  //   (op,)   with op one of neg, abs, add, sub, mul, div, pow
+  inline PyObject* expr_compile( PyObject* self, PyObject* args,
+				 PyObject *kwds )
+  {
+
+    PyObject* seq = NULL;
+
+    static char *kwlist[] = {(char*)"ops", NULL};
+
+    if ( !PyArg_ParseTupleAndKeywords( args, kwds, (char*)"O", kwlist,
+				       &seq ) )
+      return NULL;
+
+    PyObject* fast = PySequence_Fast( seq, "ops must be a sequence" );
+    if ( NULL == fast )
+      return NULL;
+
+    std::auto_ptr< ExprProgram > prog( new ExprProgram );
+    prog->ndim = 0;
+    prog->depth = 0;
+    prog->npars = 0;
+    prog->narrays = 0;
+
+    static const char* names[] = { "kernel", "const", "array", "neg", "abs",
+				   "add", "sub", "mul", "div", "pow", NULL };
+    int depth = 0;
+    std::ostringstream err;
+
+    for ( Py_ssize_t ii = 0; ii < PySequence_Fast_GET_SIZE( fast ); ii++ ) {
+
+      PyObject* item = PySequence_Fast_GET_ITEM( fast, ii );
+      const char* name = NULL;
+      PyObject* arg = NULL;
+      Py_ssize_t index = 0;
+      int integrate = 0;
+
+      if ( !PyArg_ParseTuple( item, (char*)"s|Oni:expr_compile", &name, &arg,
+			      &index, &integrate ) )
+	break;
+
+      ExprOp op;
+      op.kernel = NULL;
+      op.integrate = false;
+      op.index = 0;
+      op.value = 0.0;
+      for ( op.code = 0; NULL != names[ op.code ]; op.code++ )
+	if ( 0 == std::strcmp( name, names[ op.code ] ) )
+	  break;
+
+      if ( EXPR_KERNEL == op.code ) {
+
+	op.kernel = static_cast< const ExprKernel* >
+	  ( expr_cobject_ptr( arg, expr_kernel_desc, "a model kernel" ) );
+	if ( NULL == op.kernel )
+	  break;
+	if ( prog->ndim && ( prog->ndim != op.kernel->ndim ) ) {
+	  err << "cannot combine 1D and 2D model kernels";
+	  break;
+	}
+	if ( index < 0 ) {
+	  err << "negative parameter index for kernel " << op.kernel->name;
+	  break;
+	}
+	prog->ndim = op.kernel->ndim;
+	op.integrate = bool( integrate );
+	op.index = index;
+	prog->npars = std::max( prog->npars, op.index + op.kernel->npars );
+	depth++;
+
+      } else if ( EXPR_CONST == op.code ) {
+
+	if ( NULL == arg ) {
+	  err << "missing value for const";
+	  break;
+	}
+	op.value = PyFloat_AsDouble( arg );
+	if ( PyErr_Occurred() )
+	  break;
+	depth++;
+
+      } else if ( EXPR_ARRAY == op.code ) {
+
+	if ( NULL == arg ) {
+	  err << "missing operand number for array";
+	  break;
+	}
+	op.index = PyInt_AsSsize_t( arg );
+	if ( PyErr_Occurred() )
+	  break;
+	if ( op.index < 0 ) {
+	  err << "negative array operand number";
+	  break;
+	}
+	prog->narrays = std::max( prog->narrays, op.index + 1 );
+	depth++;
+
+      } else if ( EXPR_NEG == op.code || EXPR_ABS == op.code ) {
+
+	if ( depth < 1 ) {
+	  err << "missing operand for " << name;
+	  break;
+	}
+
+      } else if ( NULL != names[ op.code ] ) {
+
+	if ( depth < 2 ) {
+	  err << "missing operand for " << name;
+	  break;
+	}
+	depth--;
+
+      } else {
+
+	err << "unknown operation '" << name << "'";
+	break;
+
+      }
+
+      prog->depth = std::max( prog->depth, depth );
+      prog->ops.push_back( op );
+
+    }
+
+    Py_ssize_t nops = PySequence_Fast_GET_SIZE( fast );
+    Py_DECREF( fast );
+
+    if ( !err.str().empty() ) {
+      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
+      return NULL;
+    }
+    if ( PyErr_Occurred() )
+      return NULL;
+
+    if ( Py_ssize_t( prog->ops.size() ) != nops || 1 != depth ) {
+      PyErr_SetString( PyExc_TypeError,
+		       (char*)"expression does not reduce to a single value" );
+      return NULL;
+    }
+
+    PyObject* obj = PyCObject_FromVoidPtrAndDesc( prog.get(),
+						  (void*)expr_program_desc,
+						  expr_program_free );
+    if ( NULL != obj )
+      prog.release();
+
+    return obj;
+
+  }
+
+
+  // Evaluate a compiled program for the full parameter list pars, with
+  // the given sequence of array operands, on the grid x0 [, x1 [, x2, x3]]
+  inline PyObject* expr_eval( PyObject* self, PyObject* args,
+			      PyObject *kwds )
+  {
+
+    PyObject* progobj = NULL;
+    SherpaFloatArray pars;
+    PyObject* arrobj = NULL;
+    SherpaFloatArray x[4];
+
+    static char *kwlist[] = {(char*)"prog", (char*)"pars", (char*)"arrays",
+			     (char*)"x0", (char*)"x1", (char*)"x2",
+			     (char*)"x3", NULL};
+
+    if ( !PyArg_ParseTupleAndKeywords
+	 ( args, kwds, (char*)"OO&OO&|O&O&O&", kwlist,
+	   &progobj,
+	   (converter)convert_to_contig_array< SherpaFloatArray >, &pars,
+	   &arrobj,
+	   (converter)convert_to_contig_array< SherpaFloatArray >, &x[0],
+	   (converter)convert_to_contig_array< SherpaFloatArray >, &x[1],
+	   (converter)convert_to_contig_array< SherpaFloatArray >, &x[2],
+	   (converter)convert_to_contig_array< SherpaFloatArray >, &x[3] ) )
+      return NULL;
+
+    const ExprProgram* prog = static_cast< const ExprProgram* >
+      ( expr_cobject_ptr( progobj, expr_program_desc,
+			  "a compiled model expression" ) );
+    if ( NULL == prog )
+      return NULL;
+
+    int ngrid = 1;
+    while ( ngrid < 4 && x[ ngrid ] )
+      ngrid++;
+
+    int ndim = ( prog->ndim ? prog->ndim : ( 4 == ngrid ? 2 : 1 ) );
+    if ( ( ngrid != ndim ) && ( ngrid != 2 * ndim ) ) {
+      std::ostringstream err;
+      err << "expected " << ndim << " or " << 2 * ndim
+	  << " grid arrays for a " << ndim << "D expression, got " << ngrid;
+      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
+      return NULL;
+    }
+
+    npy_intp nelem = x[0].get_size();
+    for ( int ii = 1; ii < ngrid; ii++ )
+      if ( x[ ii ].get_size() != nelem ) {
+	PyErr_SetString( PyExc_TypeError,
+			 (char*)"model evaluation input array sizes do not match" );
+	return NULL;
+      }
+
+    if ( pars.get_size() < prog->npars ) {
+      std::ostringstream err;
+      err << "expected at least " << prog->npars << " parameters, got "
+	  << pars.get_size();
+      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
+      return NULL;
+    }
+
+    PyObject* fast = PySequence_Fast( arrobj, "arrays must be a sequence" );
+    if ( NULL == fast )
+      return NULL;
+    if ( PySequence_Fast_GET_SIZE( fast ) < prog->narrays ) {
+      Py_DECREF( fast );
+      PyErr_SetString( PyExc_TypeError,
+		       (char*)"not enough array operands for the expression" );
+      return NULL;
+    }
+
+    std::vector< SherpaFloatArray > arrays( prog->narrays );
+    for ( npy_intp ii = 0; ii < prog->narrays; ii++ ) {
+      if ( EXIT_SUCCESS != arrays[ ii ].from_obj
+	   ( PySequence_Fast_GET_ITEM( fast, ii ), true ) ) {
+	Py_DECREF( fast );
+	return NULL;
+      }
+      if ( arrays[ ii ].get_size() != nelem ) {
+	Py_DECREF( fast );
+	PyErr_SetString( PyExc_TypeError,
+			 (char*)"array operand size does not match the grid" );
+	return NULL;
+      }
+    }
+    Py_DECREF( fast );
+
+    // Parameter views for the kernels
+    std::vector< SherpaFloatArray > views( prog->ops.size() );
+    for ( std::size_t ii = 0; ii < prog->ops.size(); ii++ ) {
+      const ExprOp& op = prog->ops[ ii ];
+      if ( EXPR_KERNEL == op.code ) {
+	npy_intp npars = op.kernel->npars;
+	if ( EXIT_SUCCESS != views[ ii ].create
+	     ( 1, &npars, pars.get_data() + op.index ) )
+	  return NULL;
+      }
+    }
+
+    SherpaFloatArray result;
+    if ( EXIT_SUCCESS != result.create( x[0].get_ndim(), x[0].get_dims() ) )
+      return NULL;
+
+    ExprGrid grid;
+    grid.prog = prog;
+    grid.pars = ( views.empty() ? NULL : &views[0] );
+    for ( npy_intp ii = 0; ii < prog->narrays; ii++ )
+      grid.arrays.push_back( arrays[ ii ].get_data() );
+    for ( int ii = 0; ii < 4; ii++ )
+      grid.x[ ii ] = ( ii < ngrid ? x[ ii ].get_data() : NULL );
+    grid.integrate = ( ngrid == 2 * ndim );
+    grid.result = result.get_data();
+
+    if ( EXIT_SUCCESS != eval_model_grid( expr_chunk, grid, nelem ) ) {
+      PyErr_SetString( PyExc_ValueError,
+		       (char*)"model evaluation failed" );
+      return NULL;
+    }
+
+    return result.return_new_ref();
+
+  }
+
+
+}  }  /* namespace models, namespace sherpa */
+
+
+#define EXPRKERNEL1D(name, npars) \
+  { #name, 1, npars, \
+    sherpa::models::expr_point1d< _MODELFCTPTR(name##_point) >, \
+    sherpa::models::expr_int1d< _MODELFCTPTR(name##_integrated) > }
+
+#define EXPRKERNEL1D_NOINT(name, npars) \
+  { #name, 1, npars, \
+    sherpa::models::expr_point1d< _MODELFCTPTR(name##_point) >, \
+    sherpa::models::expr_int1d_vec \
+      < sherpa::quadrature::integrate_bins1d< SherpaFloat, SherpaFloatArray, \
+                                              npy_intp, \
+                                              _MODELFCTPTR(name##_point) > > }
+
+#define EXPRKERNEL1D_VEC(name, npars) \
+  { #name, 1, npars, \
+    sherpa::models::expr_point1d_vec< _MODELFCTPTR(name##_point_vec) >, \
+    sherpa::models::expr_int1d_vec< _MODELFCTPTR(name##_integrated_vec) > }
+
+#define EXPRKERNEL2D(name, npars) \
+  { #name, 2, npars, \
+    sherpa::models::expr_point2d< _MODELFCTPTR(name##_point) >, \
+    sherpa::models::expr_int2d< _MODELFCTPTR(name##_integrated) > }
+
+#define EXPRKERNEL2D_NOINT(name, npars) \
+  { #name, 2, npars, \
+    sherpa::models::expr_point2d< _MODELFCTPTR(name##_point) >, \
+    sherpa::models::expr_int2d_vec \
+      < sherpa::quadrature::integrate_pixels2d< SherpaFloat, SherpaFloatArray, \
+                                                npy_intp, \
+                                                _MODELFCTPTR(name##_point) > > }
+
+#define EXPRKERNEL2D_SEP(name, npars) \
+  { #name, 2, npars, \
+    sherpa::models::expr_point2d< _MODELFCTPTR(name##_point) >, \
+    sherpa::models::expr_int2d_vec \
+      < sherpa::quadrature::integrate_separable2d \
+          < SherpaFloat, SherpaFloatArray, npy_intp, \
+            _MODELFCTPTR(name##_point), _MODELFCTPTR(name##_separable), \
+            _MODELFCTPTR(name##_integrated) > > }
+
+#define MODELEXPR_KERNELS(table) \
+  MODSPEC_INT("expr_kernels", sherpa::models::expr_kernels< table >, \
+              "expr_kernels()\n\n" \
+              "Return a dictionary of the model kernels of this module " \
+              "that\ncompiled model expressions may use")
+
+#define MODELEXPR_ENGINE \
+  MODSPEC_INT("expr_compile", sherpa::models::expr_compile, \
+              "expr_compile(ops)\n\n" \
+              "Compile a postfix sequence of model expression operations"), \
+  MODSPEC_INT("expr_eval", sherpa::models::expr_eval, \
+              "expr_eval(prog, pars, arrays, x0 [, x1 [, x2, x3]])\n\n" \
+              "Evaluate a compiled model expression on a grid")
+
+#endif /* __sherpa_model_expr_hh__ */
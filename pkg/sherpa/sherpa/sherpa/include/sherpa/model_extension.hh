@@ -22,9 +22,13 @@
 
 #include <sherpa/extension.hh>
 #include <sherpa/integration.hh>
+#include <sherpa/quadrature.hh>
+#include <sherpa/threads.hh>
 #include <sstream>
 #include <iostream>
 #include <limits>
+#include <vector>
+#include <algorithm>
 
 #define TOL (std::numeric_limits< double >::epsilon());
 
@@ -83,8 +87,12 @@ namespace sherpa { namespace models {
       return EXIT_FAILURE;
     }
     
-    // convert pyobject into double array obj
-    CONVERTME(DoubleArray)(rv_obj, &res);
+    // convert pyobject into double array obj, with one value per node
+    if ( !CONVERTME(DoubleArray)(rv_obj, &res) ||
+	 res.get_size() != npy_intp(len) ) {
+      Py_DECREF( rv_obj );
+      return EXIT_FAILURE;
+    }
     
     // fill res pointer
     for( int ii = 0; ii < len; ii++ )
@@ -119,27 +127,27 @@ namespace sherpa { namespace models {
     ArrayType xhi;
     PyObject* model_func = NULL;
     PyObject* logger = NULL;
-    int errflag = 0, maxeval = 10000;
+    int errflag = 0, maxeval = 10000, batch = 0;
     double epsabs = TOL;
     double epsrel = 0.0;
 
     static char *kwlist[] = {(char*)"model", (char*)"pars", (char*)"xlo",
 			     (char*)"xhi", (char*)"errflag", (char*)"epsabs",
 			     (char*)"epsrel", (char*)"maxeval", (char*)"logger",
-			     NULL};
+			     (char*)"batch", NULL};
 
     if ( !PyArg_ParseTupleAndKeywords( args, kwds,
-				       (char*)"OO&O&O&|iddiO:pymodelfct1d_int",
+				       (char*)"OO&O&O&|iddiOi:pymodelfct1d_int",
 				       kwlist,
 				       &model_func,
 				       (converter)convert_to_array< ArrayType >,
 				       &pars,
-				       (converter)convert_to_array< ArrayType >,
+				       (converter)convert_to_contig_array< ArrayType >,
 				       &xlo,
-				       (converter)convert_to_array< ArrayType >,
+				       (converter)convert_to_contig_array< ArrayType >,
 				       &xhi,
 				       &errflag, &epsabs, &epsrel, &maxeval,
-				       &logger) )
+				       &logger, &batch) )
       return NULL;
 
     npy_intp nelem = xlo.get_size();
@@ -162,21 +170,35 @@ namespace sherpa { namespace models {
       return NULL;
     }
     
-    FunctionWithParams<ArrayType> *funcAndPars =		\
-      new FunctionWithParams<ArrayType>(&pars, model_func);
-    
-    for ( npy_intp ii = 0; ii < nelem; ii++ )
-      if ( EXIT_SUCCESS != py_integrated_1d( xlo[ii], xhi[ii],
-					     result[ii], funcAndPars,
-					     errflag, epsabs, epsrel,
-					     (unsigned int)maxeval,
-					     err) ) {
+    FunctionWithParams<ArrayType> funcAndPars(&pars, model_func);
+
+    // In batch mode, which the model has to opt in to since it is then
+    // called on arbitrary nodes from many bins, the model is called on
+    // the nodes of all the bins at once, and again for the bins that
+    // need refining, rather than once or more per bin
+    if ( batch ) {
+      if ( EXIT_SUCCESS !=
+	   py_integrate_1d_batch( (integrand_1d_vec)(integrand_1d_cb),
+				  (void*)&funcAndPars, std::size_t( nelem ),
+				  xlo.get_data(), xhi.get_data(),
+				  (unsigned int)maxeval, epsabs, epsrel,
+				  result.get_data(), errflag, err ) ) {
 	PyErr_SetString( PyExc_ValueError,
 			 (char*)"model evaluation failed" );
 	return NULL;
       }
-
-    delete funcAndPars;
+    } else {
+      for ( npy_intp ii = 0; ii < nelem; ii++ )
+	if ( EXIT_SUCCESS != py_integrated_1d( xlo[ii], xhi[ii],
+					       result[ii], &funcAndPars,
+					       errflag, epsabs, epsrel,
+					       (unsigned int)maxeval,
+					       err) ) {
+	  PyErr_SetString( PyExc_ValueError,
+			   (char*)"model evaluation failed" );
+	  return NULL;
+	}
+    }
     
     
     if( logger && err.str() != "" ) {
@@ -192,15 +214,23 @@ namespace sherpa { namespace models {
   }
 
 
+  // The parameters of integrand_model1d and integrand_model2d; a kernel
+  // failure at any point fails the whole bin, as in sherpa::quadrature
+  struct ModelIntegrand {
+    const DoubleArray* pars;
+    int status;
+  };
+
+
   template <int (*PtFunc)( const DoubleArray& p, double x, double& val )>
   double integrand_model1d( double x, void* params )
   {
 
-    DoubleArray& p = *( static_cast< DoubleArray* >( params ) );
+    ModelIntegrand& m = *( static_cast< ModelIntegrand* >( params ) );
     double val = 0.0;
 
-    // FIXME: do something with function return value
-    PtFunc( p, x, val );
+    if ( EXIT_SUCCESS != PtFunc( *m.pars, x, val ) )
+      m.status = EXIT_FAILURE;
 
     return val;
 
@@ -218,10 +248,15 @@ namespace sherpa { namespace models {
     unsigned int maxeval = 10000;
 
     double abserr = 0.0;
+    ModelIntegrand m = { &p, EXIT_SUCCESS };
+
+    if ( EXIT_SUCCESS !=
+	 integrate_1d( (integrand_1d)(integrand_model1d< PtFunc >),
+		       (void*)&m, xlo, xhi, maxeval,
+		       epsabs, epsrel, val, abserr ) )
+      return EXIT_FAILURE;
 
-    return integrate_1d( (integrand_1d)(integrand_model1d< PtFunc >),
-			 (void*)&p, xlo, xhi, maxeval,
-			 epsabs, epsrel, val, abserr );
+    return m.status;
 
   }
 
@@ -231,13 +266,13 @@ namespace sherpa { namespace models {
   double integrand_model2d( unsigned int ndim, const double* x, void* params )
   {
 
-    DoubleArray& p = *( static_cast< DoubleArray* >( params ) );
+    ModelIntegrand& m = *( static_cast< ModelIntegrand* >( params ) );
     double val = 0.0;
 
     // FIXME: throw error if ndim != 2
 
-    // FIXME: do something with function return value
-    PtFunc( p, x[0], x[1], val );
+    if ( EXIT_SUCCESS != PtFunc( *m.pars, x[0], x[1], val ) )
+      m.status = EXIT_FAILURE;
 
     return val;
 
@@ -263,213 +298,1848 @@ namespace sherpa { namespace models {
     xhi[1] = x1hi;
 
     double abserr = 0.0;
+    ModelIntegrand m = { &p, EXIT_SUCCESS };
+
+    if ( EXIT_SUCCESS !=
+	 integrate_Nd( (integrand_Nd)(integrand_model2d< PtFunc >),
+		       (void*)&m, 2, xlo, xhi, maxeval,
+		       epsabs, epsrel, val, abserr ) )
+      return EXIT_FAILURE;
+
+    return m.status;
+
+  }
+
+
+  // The single precision counterparts of integrated_model1d and
+  // integrated_model2d, for a bin that is not part of a contiguous grid;
+  // the integration routines above only work in double precision, so
+  // these take a single bin of sherpa::quadrature instead
+
+  template <int (*PtFunc)( const FloatArray& p, float x, float& val )>
+  int integrated_model1d( const FloatArray& p, float xlo, float xhi,
+			  float &val )
+  {
+    return sherpa::quadrature::integrate_bins1d< float, FloatArray,
+						 npy_intp, PtFunc >
+      ( p, 1, &xlo, &xhi, &val );
+  }
+
+
+  template <int (*PtFunc)( const FloatArray& p, float x0, float x1,
+			   float& val )>
+  int integrated_model2d( const FloatArray& p, float x0lo, float x0hi,
+			  float x1lo, float x1hi, float &val )
+  {
+    return sherpa::quadrature::integrate_pixels2d< float, FloatArray,
+						   npy_intp, PtFunc >
+      ( p, 1, &x0lo, &x0hi, &x1lo, &x1hi, &val );
+  }
+
+
+  //
+  // Gradients of the models without an analytic integral: the value and
+  // each derivative in turn are integrated over the bin, with the same
+  // settings as integrated_model1d and integrated_model2d.
+  //
+
+  struct GradIntegrand {
+    const DoubleArray* pars;
+    npy_intp component;		// -1 for the value itself
+    int status;			// EXIT_FAILURE once the kernel has failed
+  };
+
+
+  template <npy_intp NumPars,
+	    int (*PtGrad)( const DoubleArray& p, double x, double& val,
+			   double* grad )>
+  double integrand_grad1d( double x, void* params )
+  {
+
+    GradIntegrand& g = *( static_cast< GradIntegrand* >( params ) );
+    double val = 0.0;
+    double grad[ NumPars ];
+    std::fill( grad, grad + NumPars, 0.0 );
+
+    if ( EXIT_SUCCESS != PtGrad( *g.pars, x, val, grad ) )
+      g.status = EXIT_FAILURE;
+
+    return ( g.component < 0 ) ? val : grad[ g.component ];
+
+  }
+
+
+  template <npy_intp NumPars,
+	    int (*PtGrad)( const DoubleArray& p, double x, double& val,
+			   double* grad )>
+  int integrated_grad1d( const DoubleArray& p, double xlo, double xhi,
+			 double& val, double* grad )
+  {
+
+    double epsabs = TOL;
+    double epsrel = 0.0;
+    unsigned int maxeval = 10000;
+
+    double abserr = 0.0;
+    GradIntegrand g = { &p, -1, EXIT_SUCCESS };
+
+    for ( ; g.component < NumPars; g.component++ )
+      if ( EXIT_SUCCESS !=
+	   integrate_1d( (integrand_1d)(integrand_grad1d< NumPars, PtGrad >),
+			 (void*)&g, xlo, xhi, maxeval, epsabs, epsrel,
+			 ( g.component < 0 ) ? val : grad[ g.component ],
+			 abserr ) )
+	return EXIT_FAILURE;
+
+    return g.status;
+
+  }
+
+
+  template <npy_intp NumPars,
+	    int (*PtGrad)( const DoubleArray& p, double x0, double x1,
+			   double& val, double* grad )>
+  double integrand_grad2d( unsigned int ndim, const double* x, void* params )
+  {
+
+    GradIntegrand& g = *( static_cast< GradIntegrand* >( params ) );
+    double val = 0.0;
+    double grad[ NumPars ];
+    std::fill( grad, grad + NumPars, 0.0 );
+
+    if ( EXIT_SUCCESS != PtGrad( *g.pars, x[0], x[1], val, grad ) )
+      g.status = EXIT_FAILURE;
+
+    return ( g.component < 0 ) ? val : grad[ g.component ];
+
+  }
+
+
+  template <npy_intp NumPars,
+	    int (*PtGrad)( const DoubleArray& p, double x0, double x1,
+			   double& val, double* grad )>
+  int integrated_grad2d( const DoubleArray& p, double x0lo, double x0hi,
+			 double x1lo, double x1hi, double& val, double* grad )
+  {
+
+    double epsabs = TOL;
+    double epsrel = 0.0;
+    unsigned int maxeval = 100000;
+
+    double xlo[2];
+    double xhi[2];
+    xlo[0] = x0lo;
+    xlo[1] = x1lo;
+    xhi[0] = x0hi;
+    xhi[1] = x1hi;
+
+    double abserr = 0.0;
+    GradIntegrand g = { &p, -1, EXIT_SUCCESS };
+
+    for ( ; g.component < NumPars; g.component++ )
+      if ( EXIT_SUCCESS !=
+	   integrate_Nd( (integrand_Nd)(integrand_grad2d< NumPars, PtGrad >),
+			 (void*)&g, 2, xlo, xhi, maxeval, epsabs, epsrel,
+			 ( g.component < 0 ) ? val : grad[ g.component ],
+			 abserr ) )
+	return EXIT_FAILURE;
 
-    return integrate_Nd( (integrand_Nd)(integrand_model2d< PtFunc >),
-			 (void*)&p, 2, xlo, xhi, maxeval,
-			 epsabs, epsrel, val, abserr );
+    return g.status;
+
+  }
+
+
+  //
+  // Evaluation loops shared by modelfct1d and modelfct2d, over elements
+  // [begin, end) of the grid.  When every grid array and the result are
+  // C-contiguous and aligned, the kernels are run over raw pointers with
+  // a unit stride and without an early exit, so the compiler is free to
+  // vectorize the loop; any failing element still makes the whole
+  // evaluation fail.  Strided arrays take the element-by-element path
+  // through Array::operator[].
+  //
+
+  template <typename ArrayType,
+	    typename DataType,
+	    int (*PtFunc)( const ArrayType& p, DataType x, DataType& val )>
+  int model1d_point_loop( const ArrayType& pars, npy_intp begin,
+			  npy_intp end, const ArrayType& x,
+			  ArrayType& result )
+  {
+
+    if ( x.is_contiguous() && result.is_contiguous() ) {
+
+      const DataType* SHERPA_RESTRICT xptr = x.get_data();
+      DataType* SHERPA_RESTRICT res = result.get_data();
+      int nfail = 0;
+
+      for ( npy_intp ii = begin; ii < end; ii++ )
+	nfail += ( EXIT_SUCCESS != PtFunc( pars, xptr[ii], res[ii] ) );
+
+      return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+    }
+
+    for ( npy_intp ii = begin; ii < end; ii++ )
+      if ( EXIT_SUCCESS != PtFunc( pars, x[ii], result[ii] ) )
+	return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
 
   }
 
 
   template <typename ArrayType,
 	    typename DataType,
-	    npy_intp NumPars,
-	    int (*PtFunc)( const ArrayType& p, DataType x, DataType& val ),
 	    int (*IntFunc)( const ArrayType& p, DataType xlo, DataType xhi,
 			    DataType& val )>
-  PyObject* modelfct1d( PyObject* self, PyObject* args, PyObject *kwds)
+  int model1d_int_loop( const ArrayType& pars, npy_intp begin, npy_intp end,
+			const ArrayType& xlo, const ArrayType& xhi,
+			ArrayType& result )
   {
 
-    ArrayType pars;
-    ArrayType xlo;
-    ArrayType xhi;
-    int integrate = 1;
+    if ( xlo.is_contiguous() && xhi.is_contiguous() &&
+	 result.is_contiguous() ) {
 
-    static char *kwlist[] = {(char*)"pars",(char*)"xlo",(char*)"xhi",(char*)"integrate", NULL};
+      const DataType* SHERPA_RESTRICT loptr = xlo.get_data();
+      const DataType* SHERPA_RESTRICT hiptr = xhi.get_data();
+      DataType* SHERPA_RESTRICT res = result.get_data();
+      int nfail = 0;
 
-    if ( !PyArg_ParseTupleAndKeywords(args, kwds, (char*)"O&O&|O&i", kwlist,
-			   (converter)convert_to_array< ArrayType >, &pars,
-			   (converter)convert_to_array< ArrayType >, &xlo,
-			   (converter)convert_to_array< ArrayType >, &xhi,
-			   &integrate) )
-      return NULL;
-    
-    npy_intp npars = pars.get_size();
+      for ( npy_intp ii = begin; ii < end; ii++ )
+	nfail += ( EXIT_SUCCESS != IntFunc( pars, loptr[ii], hiptr[ii],
+					    res[ii] ) );
+
+      return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
 
-    if ( NumPars != npars ) {
-      std::ostringstream err;
-      err << "expected " << NumPars << " parameters, got " << npars;
-      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
-      return NULL;
     }
 
-    npy_intp nelem = xlo.get_size();
+    for ( npy_intp ii = begin; ii < end; ii++ )
+      if ( EXIT_SUCCESS != IntFunc( pars, xlo[ii], xhi[ii], result[ii] ) )
+	return EXIT_FAILURE;
 
-    if ( xhi && ( xhi.get_size() != nelem ) ) {
-      std::ostringstream err;
-      err << "1D model evaluation input array sizes do not match, "
-	  << "xlo: " << nelem << " vs xhi: " << xhi.get_size();
-      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
-      return NULL;
-    }
+    return EXIT_SUCCESS;
 
-    ArrayType result;
-    if ( EXIT_SUCCESS != result.create( xlo.get_ndim(), xlo.get_dims() ) )
-      return NULL;
+  }
 
 
-    if ( !(xhi && integrate) ) {
+  template <typename ArrayType,
+	    typename DataType,
+	    int (*PtFunc)( const ArrayType& p, DataType x0, DataType x1,
+			   DataType& val )>
+  int model2d_point_loop( const ArrayType& pars, npy_intp begin,
+			  npy_intp end, const ArrayType& x0,
+			  const ArrayType& x1, ArrayType& result )
+  {
 
-      for ( npy_intp ii = 0; ii < nelem; ii++ )
-	if ( EXIT_SUCCESS != PtFunc( pars, xlo[ii], result[ii] ) ) {
-	  PyErr_SetString( PyExc_ValueError,
-			   (char*)"model evaluation failed" );
-	  return NULL;
-	}
+    if ( x0.is_contiguous() && x1.is_contiguous() &&
+	 result.is_contiguous() ) {
 
-    } else {
+      const DataType* SHERPA_RESTRICT x0ptr = x0.get_data();
+      const DataType* SHERPA_RESTRICT x1ptr = x1.get_data();
+      DataType* SHERPA_RESTRICT res = result.get_data();
+      int nfail = 0;
 
-      for ( npy_intp ii = 0; ii < nelem; ii++ )
-	if ( EXIT_SUCCESS != IntFunc( pars, xlo[ii], xhi[ii], result[ii] ) ) {
-	  PyErr_SetString( PyExc_ValueError,
-			   (char*)"model evaluation failed" );
-	  return NULL;
-	}
+      for ( npy_intp ii = begin; ii < end; ii++ )
+	nfail += ( EXIT_SUCCESS != PtFunc( pars, x0ptr[ii], x1ptr[ii],
+					   res[ii] ) );
+
+      return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
 
     }
 
+    for ( npy_intp ii = begin; ii < end; ii++ )
+      if ( EXIT_SUCCESS != PtFunc( pars, x0[ii], x1[ii], result[ii] ) )
+	return EXIT_FAILURE;
 
-    return result.return_new_ref();
+    return EXIT_SUCCESS;
 
   }
 
 
   template <typename ArrayType,
 	    typename DataType,
-	    npy_intp NumPars,
-	    int (*PtFunc)( const ArrayType& p, DataType x0, DataType x1,
-			   DataType& val ),
 	    int (*IntFunc)( const ArrayType& p, DataType x0lo, DataType x0hi,
 			    DataType x1lo, DataType x1hi, DataType& val )>
-  PyObject* modelfct2d( PyObject* self, PyObject* args, PyObject *kwds )
+  int model2d_int_loop( const ArrayType& pars, npy_intp begin, npy_intp end,
+			const ArrayType& x0lo, const ArrayType& x0hi,
+			const ArrayType& x1lo, const ArrayType& x1hi,
+			ArrayType& result )
   {
 
-    ArrayType pars;
-    ArrayType x0lo;
-    ArrayType x1lo;
-    ArrayType x0hi;
-    ArrayType x1hi;
+    if ( x0lo.is_contiguous() && x0hi.is_contiguous() &&
+	 x1lo.is_contiguous() && x1hi.is_contiguous() &&
+	 result.is_contiguous() ) {
 
-    int integrate = 1;
-    static char *kwlist[] = {(char*)"pars", (char*)"x0lo", (char*)"x1lo",
-			     (char*)"x0hi", (char*)"x1hi", (char*)"integrate", NULL};
-    if ( !PyArg_ParseTupleAndKeywords( args, kwds, (char*)"O&O&O&|O&O&i", kwlist,
-			    (converter)convert_to_array< ArrayType >, &pars,
-			    (converter)convert_to_array< ArrayType >, &x0lo,
-			    (converter)convert_to_array< ArrayType >, &x1lo,
-			    (converter)convert_to_array< ArrayType >, &x0hi,
-			    (converter)convert_to_array< ArrayType >, &x1hi,
-			    &integrate) )
-      return NULL;
+      const DataType* SHERPA_RESTRICT x0loptr = x0lo.get_data();
+      const DataType* SHERPA_RESTRICT x0hiptr = x0hi.get_data();
+      const DataType* SHERPA_RESTRICT x1loptr = x1lo.get_data();
+      const DataType* SHERPA_RESTRICT x1hiptr = x1hi.get_data();
+      DataType* SHERPA_RESTRICT res = result.get_data();
+      int nfail = 0;
 
-    npy_intp npars = pars.get_size();
+      for ( npy_intp ii = begin; ii < end; ii++ )
+	nfail += ( EXIT_SUCCESS != IntFunc( pars, x0loptr[ii], x0hiptr[ii],
+					    x1loptr[ii], x1hiptr[ii],
+					    res[ii] ) );
 
-    if ( NumPars != npars ) {
-      std::ostringstream err;
-      err << "expected " << NumPars << " parameters, got " << npars;
-      PyErr_SetString( PyExc_TypeError, err.str().c_str() );      
-      return NULL;
-    }
+      return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
 
-    if ( x0hi && !x1hi )  {
-      PyErr_SetString( PyExc_TypeError, (char*)"expected 3 or 5 arguments, got 4");
-      return NULL;
     }
 
-    npy_intp nelem = x0lo.get_size();
-
-    if ( ( x1lo.get_size() != nelem ) || 
-	 ( x0hi &&
-	   ( ( x0hi.get_size() != nelem ) ||
-	     ( x1hi.get_size() != nelem ) ) ) ) {
-      PyErr_SetString( PyExc_TypeError,
-		       (char*)"2D model evaluation input array sizes do not match" );
-      return NULL;
-    }
+    for ( npy_intp ii = begin; ii < end; ii++ )
+      if ( EXIT_SUCCESS != IntFunc( pars, x0lo[ii], x0hi[ii], x1lo[ii],
+				    x1hi[ii], result[ii] ) )
+	return EXIT_FAILURE;
 
-    ArrayType result;
-    if ( EXIT_SUCCESS != result.create( x0lo.get_ndim(), x0lo.get_dims() ) )
-      return NULL;
+    return EXIT_SUCCESS;
 
-    if ( !(x0hi && integrate) ) {
+  }
 
-      for ( npy_intp ii = 0; ii < nelem; ii++ )
-	if ( EXIT_SUCCESS != PtFunc( pars, x0lo[ii], x1lo[ii], result[ii] ) ) {
-	  PyErr_SetString( PyExc_ValueError,
-			   (char*)"model evaluation failed" );
-	  return NULL;
-	}
 
-    } else {
+  //
+  // Loops for models that also provide batch kernels (see MODELFCT1D_VEC):
+  // contiguous grids are handed to the batch kernel whole, anything else
+  // goes through the scalar kernel as in modelfct1d.
+  //
 
-      for ( npy_intp ii = 0; ii < nelem; ii++ )
-	if ( EXIT_SUCCESS != IntFunc( pars, x0lo[ii], x0hi[ii], x1lo[ii],
-				      x1hi[ii], result[ii] ) ) {
-	  PyErr_SetString( PyExc_ValueError,
-			   (char*)"model evaluation failed" );
-	  return NULL;
-	}
+  template <typename ArrayType,
+	    typename DataType,
+	    int (*PtFunc)( const ArrayType& p, DataType x, DataType& val ),
+	    int (*PtVec)( const ArrayType& p, npy_intp nelem,
+			  const DataType* x, DataType* val )>
+  int model1d_point_vec_loop( const ArrayType& pars, npy_intp begin,
+			      npy_intp end, const ArrayType& x,
+			      ArrayType& result )
+  {
 
-    }
+    if ( x.is_contiguous() && result.is_contiguous() )
+      return PtVec( pars, end - begin, x.get_data() + begin,
+		    result.get_data() + begin );
 
-    return result.return_new_ref();
+    return model1d_point_loop< ArrayType, DataType, PtFunc >
+      ( pars, begin, end, x, result );
 
   }
 
 
-}  }  /* namespace models, namespace sherpa */
+  template <typename ArrayType,
+	    typename DataType,
+	    int (*IntFunc)( const ArrayType& p, DataType xlo, DataType xhi,
+			    DataType& val ),
+	    int (*IntVec)( const ArrayType& p, npy_intp nelem,
+			   const DataType* xlo, const DataType* xhi,
+			   DataType* val )>
+  int model1d_int_vec_loop( const ArrayType& pars, npy_intp begin,
+			    npy_intp end, const ArrayType& xlo,
+			    const ArrayType& xhi, ArrayType& result )
+  {
 
+    if ( xlo.is_contiguous() && xhi.is_contiguous() &&
+	 result.is_contiguous() )
+      return IntVec( pars, end - begin, xlo.get_data() + begin,
+		     xhi.get_data() + begin, result.get_data() + begin );
 
-#define SHERPAMODELMOD(name, fctlist) \
-PyMODINIT_FUNC \
-init##name(void) \
-{ \
-  import_array(); \
-  if ( -1 == import_integration() ) \
-    return; \
-  Py_InitModule( (char*)#name, fctlist );	\
-}
+    return model1d_int_loop< ArrayType, DataType, IntFunc >
+      ( pars, begin, end, xlo, xhi, result );
 
+  }
 
-// Allow this to be customized on a per-file basis
 
-#define MODSPEC(name, func) \
-  { (char*)#name, (PyCFunction)((PyCFunctionWithKeywords)func), \
-      METH_VARARGS|METH_KEYWORDS, NULL }
+  //
+  // Loops for the models without an analytic integral (see
+  // MODELFCT1D_NOINT): contiguous grids are integrated a tile of bins at
+  // a time by sherpa::quadrature, anything else bin by bin with IntFunc.
+  // 2D pixels follow the pixel_settings of sherpa::quadrature.
+  //
 
-#ifndef _MODELFCTPTR
-#define _MODELFCTPTR(name) \
-  sherpa::models::name< SherpaFloat, SherpaFloatArray >
-#endif
+  template <typename ArrayType,
+	    typename DataType,
+	    int (*PtFunc)( const ArrayType& p, DataType x, DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType xlo, DataType xhi,
+			    DataType& val )>
+  int model1d_quad_loop( const ArrayType& pars, npy_intp begin, npy_intp end,
+			 const ArrayType& xlo, const ArrayType& xhi,
+			 ArrayType& result )
+  {
 
-#define _MODELFCTSPEC(name, ftype, npars) \
-  MODSPEC(name, (sherpa::models::ftype< SherpaFloatArray, SherpaFloat, npars, \
-                                        _MODELFCTPTR(name##_point), \
-                                        _MODELFCTPTR(name##_integrated) >))
+    if ( xlo.is_contiguous() && xhi.is_contiguous() &&
+	 result.is_contiguous() )
+      return sherpa::quadrature::integrate_bins1d< DataType, ArrayType,
+						   npy_intp, PtFunc >
+	( pars, end - begin, xlo.get_data() + begin, xhi.get_data() + begin,
+	  result.get_data() + begin );
 
-#define _MODELFCTSPEC_NOINT(name, ftype, intftype, npars) \
-  MODSPEC(name, \
-          (sherpa::models::ftype< SherpaFloatArray, SherpaFloat, npars, \
-                                  _MODELFCTPTR(name##_point), \
-                                  sherpa::models::intftype \
-                                    < _MODELFCTPTR(name##_point) > >))
+    return model1d_int_loop< ArrayType, DataType, IntFunc >
+      ( pars, begin, end, xlo, xhi, result );
+
+  }
 
-#define MODELFCT1D(name, npars)		_MODELFCTSPEC(name, modelfct1d, npars)
-#define MODELFCT2D(name, npars)		_MODELFCTSPEC(name, modelfct2d, npars)
+
+  template <typename ArrayType,
+	    typename DataType,
+	    int (*PtFunc)( const ArrayType& p, DataType x0, DataType x1,
+			   DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val )>
+  int model2d_quad_loop( const ArrayType& pars, npy_intp begin, npy_intp end,
+			 const ArrayType& x0lo, const ArrayType& x0hi,
+			 const ArrayType& x1lo, const ArrayType& x1hi,
+			 ArrayType& result )
+  {
+
+    if ( x0lo.is_contiguous() && x0hi.is_contiguous() &&
+	 x1lo.is_contiguous() && x1hi.is_contiguous() &&
+	 result.is_contiguous() )
+      return sherpa::quadrature::integrate_pixels2d< DataType, ArrayType,
+						     npy_intp, PtFunc >
+	( pars, end - begin, x0lo.get_data() + begin, x0hi.get_data() + begin,
+	  x1lo.get_data() + begin, x1hi.get_data() + begin,
+	  result.get_data() + begin );
+
+    return model2d_int_loop< ArrayType, DataType, IntFunc >
+      ( pars, begin, end, x0lo, x0hi, x1lo, x1hi, result );
+
+  }
+
+
+  // As model2d_quad_loop, but with the closed form SepFunc whenever
+  // Separable accepts the parameters (see MODELFCT2D_SEP)
+  template <typename ArrayType,
+	    typename DataType,
+	    int (*PtFunc)( const ArrayType& p, DataType x0, DataType x1,
+			   DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val ),
+	    bool (*Separable)( const ArrayType& p ),
+	    int (*SepFunc)( const ArrayType& p, DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val )>
+  int model2d_sep_loop( const ArrayType& pars, npy_intp begin, npy_intp end,
+			const ArrayType& x0lo, const ArrayType& x0hi,
+			const ArrayType& x1lo, const ArrayType& x1hi,
+			ArrayType& result )
+  {
+
+    if ( Separable( pars ) )
+      return model2d_int_loop< ArrayType, DataType, SepFunc >
+	( pars, begin, end, x0lo, x0hi, x1lo, x1hi, result );
+
+    return model2d_quad_loop< ArrayType, DataType, PtFunc, IntFunc >
+      ( pars, begin, end, x0lo, x0hi, x1lo, x1hi, result );
+
+  }
+
+
+  //
+  // The grid of one model evaluation, as handed to the chunks run by
+  // sherpa::threads::parallel_for.  The loops only touch array data, so
+  // they run with the GIL released.
+  //
+
+  // The grid arrays are stored in the argument order of the module
+  // functions: x, or xlo, xhi, or x0, x1, or x0lo, x1lo, x0hi, x1hi
+  template <typename ArrayType>
+  struct ModelGrid {
+    const ArrayType* pars;
+    const ArrayType* x[4];
+    ArrayType* result;
+  };
+
+
+  template <typename ArrayType,
+	    int (*Loop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			 const ArrayType& x, ArrayType& result )>
+  int model_chunk_1( void* data, std::ptrdiff_t begin, std::ptrdiff_t end )
+  {
+    ModelGrid< ArrayType >& g = *static_cast< ModelGrid< ArrayType >* >( data );
+    return Loop( *g.pars, begin, end, *g.x[0], *g.result );
+  }
+
+
+  template <typename ArrayType,
+	    int (*Loop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			 const ArrayType& x0, const ArrayType& x1,
+			 ArrayType& result )>
+  int model_chunk_2( void* data, std::ptrdiff_t begin, std::ptrdiff_t end )
+  {
+    ModelGrid< ArrayType >& g = *static_cast< ModelGrid< ArrayType >* >( data );
+    return Loop( *g.pars, begin, end, *g.x[0], *g.x[1], *g.result );
+  }
+
+
+  template <typename ArrayType,
+	    int (*Loop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			 const ArrayType& x0lo, const ArrayType& x0hi,
+			 const ArrayType& x1lo, const ArrayType& x1hi,
+			 ArrayType& result )>
+  int model_chunk_4( void* data, std::ptrdiff_t begin, std::ptrdiff_t end )
+  {
+    ModelGrid< ArrayType >& g = *static_cast< ModelGrid< ArrayType >* >( data );
+    return Loop( *g.pars, begin, end, *g.x[0], *g.x[2], *g.x[1], *g.x[3],
+		 *g.result );
+  }
+
+
+  // Run chunk over the whole grid, threaded according to the current
+  // sherpa::threads::settings(), or in this thread and holding the GIL
+  // unless threaded
+  template <typename GridType>
+  int eval_model_grid( sherpa::threads::chunk_func chunk, GridType& grid,
+		       npy_intp nelem, bool threaded=true )
+  {
+
+    if ( !threaded )
+      return chunk( &grid, 0, nelem );
+
+    int status;
+
+    Py_BEGIN_ALLOW_THREADS
+    status = sherpa::threads::parallel_for( chunk, &grid, nelem );
+    Py_END_ALLOW_THREADS
+
+    return status;
+
+  }
+
+
+  //
+  // The bins of the double precision models without an analytic integral
+  // that are not part of a contiguous grid, and their gradients, are
+  // integrated by sherpa::integration::integrate_1d.  That keeps static
+  // state, shared with the _integration module, and writes to std::cerr,
+  // so those grids are evaluated serially, holding the GIL.
+  //
+  template <typename DataType> struct adaptive_1d { enum { value = 0 }; };
+  template <> struct adaptive_1d< double > { enum { value = 1 }; };
+
+
+  // Whether the integrated loop of a grid may run on the pool
+  template <typename ArrayType>
+  bool int_threaded( bool adaptive, const ArrayType& xlo,
+		     const ArrayType& xhi )
+  {
+    return !adaptive || ( xlo.is_contiguous() && xhi.is_contiguous() );
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtLoop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			   const ArrayType& x, ArrayType& result ),
+	    int (*IntLoop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			    const ArrayType& xlo, const ArrayType& xhi,
+			    ArrayType& result ),
+	    bool Adaptive>
+  PyObject* modelfct1d_loops( PyObject* self, PyObject* args, PyObject *kwds)
+  {
+
+    ArrayType pars;
+    ArrayType xlo;
+    ArrayType xhi;
+    int integrate = 1;
+
+    static char *kwlist[] = {(char*)"pars",(char*)"xlo",(char*)"xhi",(char*)"integrate", NULL};
+
+    if ( !PyArg_ParseTupleAndKeywords(args, kwds, (char*)"O&O&|O&i", kwlist,
+			   (converter)convert_to_array< ArrayType >, &pars,
+			   (converter)convert_to_array< ArrayType >, &xlo,
+			   (converter)convert_to_array< ArrayType >, &xhi,
+			   &integrate) )
+      return NULL;
+    
+    npy_intp npars = pars.get_size();
+
+    if ( NumPars != npars ) {
+      std::ostringstream err;
+      err << "expected " << NumPars << " parameters, got " << npars;
+      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
+      return NULL;
+    }
+
+    npy_intp nelem = xlo.get_size();
+
+    if ( xhi && ( xhi.get_size() != nelem ) ) {
+      std::ostringstream err;
+      err << "1D model evaluation input array sizes do not match, "
+	  << "xlo: " << nelem << " vs xhi: " << xhi.get_size();
+      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
+      return NULL;
+    }
+
+    ArrayType result;
+    if ( EXIT_SUCCESS != result.create( xlo.get_ndim(), xlo.get_dims() ) )
+      return NULL;
+
+
+    ModelGrid< ArrayType > grid = { &pars, { &xlo, &xhi }, &result };
+    int status;
+
+    if ( !(xhi && integrate) )
+      status = eval_model_grid( model_chunk_1< ArrayType, PtLoop >,
+				grid, nelem );
+    else
+      status = eval_model_grid( model_chunk_2< ArrayType, IntLoop >,
+				grid, nelem,
+				int_threaded( Adaptive, xlo, xhi ) );
+
+    if ( EXIT_SUCCESS != status ) {
+      PyErr_SetString( PyExc_ValueError,
+		       (char*)"model evaluation failed" );
+      return NULL;
+    }
+
+
+    return result.return_new_ref();
+
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtFunc)( const ArrayType& p, DataType x, DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType xlo, DataType xhi,
+			    DataType& val )>
+  PyObject* modelfct1d( PyObject* self, PyObject* args, PyObject *kwds)
+  {
+    return modelfct1d_loops< ArrayType, DataType, NumPars,
+			     model1d_point_loop< ArrayType, DataType, PtFunc >,
+			     model1d_int_loop< ArrayType, DataType, IntFunc >,
+			     false >
+      ( self, args, kwds );
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtFunc)( const ArrayType& p, DataType x, DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType xlo, DataType xhi,
+			    DataType& val ),
+	    int (*PtVec)( const ArrayType& p, npy_intp nelem,
+			  const DataType* x, DataType* val ),
+	    int (*IntVec)( const ArrayType& p, npy_intp nelem,
+			   const DataType* xlo, const DataType* xhi,
+			   DataType* val )>
+  PyObject* modelfct1d_vec( PyObject* self, PyObject* args, PyObject *kwds)
+  {
+    return modelfct1d_loops< ArrayType, DataType, NumPars,
+			     model1d_point_vec_loop< ArrayType, DataType,
+						     PtFunc, PtVec >,
+			     model1d_int_vec_loop< ArrayType, DataType,
+						   IntFunc, IntVec >,
+			     false >
+      ( self, args, kwds );
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtFunc)( const ArrayType& p, DataType x, DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType xlo, DataType xhi,
+			    DataType& val )>
+  PyObject* modelfct1d_noint( PyObject* self, PyObject* args, PyObject *kwds)
+  {
+    return modelfct1d_loops< ArrayType, DataType, NumPars,
+			     model1d_point_loop< ArrayType, DataType, PtFunc >,
+			     model1d_quad_loop< ArrayType, DataType,
+						PtFunc, IntFunc >,
+			     bool( adaptive_1d< DataType >::value ) >
+      ( self, args, kwds );
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtLoop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			   const ArrayType& x0, const ArrayType& x1,
+			   ArrayType& result ),
+	    int (*IntLoop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			    const ArrayType& x0lo, const ArrayType& x0hi,
+			    const ArrayType& x1lo, const ArrayType& x1hi,
+			    ArrayType& result )>
+  PyObject* modelfct2d_loops( PyObject* self, PyObject* args, PyObject *kwds )
+  {
+
+    ArrayType pars;
+    ArrayType x0lo;
+    ArrayType x1lo;
+    ArrayType x0hi;
+    ArrayType x1hi;
+
+    int integrate = 1;
+    static char *kwlist[] = {(char*)"pars", (char*)"x0lo", (char*)"x1lo",
+			     (char*)"x0hi", (char*)"x1hi", (char*)"integrate", NULL};
+    if ( !PyArg_ParseTupleAndKeywords( args, kwds, (char*)"O&O&O&|O&O&i", kwlist,
+			    (converter)convert_to_array< ArrayType >, &pars,
+			    (converter)convert_to_array< ArrayType >, &x0lo,
+			    (converter)convert_to_array< ArrayType >, &x1lo,
+			    (converter)convert_to_array< ArrayType >, &x0hi,
+			    (converter)convert_to_array< ArrayType >, &x1hi,
+			    &integrate) )
+      return NULL;
+
+    npy_intp npars = pars.get_size();
+
+    if ( NumPars != npars ) {
+      std::ostringstream err;
+      err << "expected " << NumPars << " parameters, got " << npars;
+      PyErr_SetString( PyExc_TypeError, err.str().c_str() );      
+      return NULL;
+    }
+
+    if ( x0hi && !x1hi )  {
+      PyErr_SetString( PyExc_TypeError, (char*)"expected 3 or 5 arguments, got 4");
+      return NULL;
+    }
+
+    npy_intp nelem = x0lo.get_size();
+
+    if ( ( x1lo.get_size() != nelem ) || 
+	 ( x0hi &&
+	   ( ( x0hi.get_size() != nelem ) ||
+	     ( x1hi.get_size() != nelem ) ) ) ) {
+      PyErr_SetString( PyExc_TypeError,
+		       (char*)"2D model evaluation input array sizes do not match" );
+      return NULL;
+    }
+
+    ArrayType result;
+    if ( EXIT_SUCCESS != result.create( x0lo.get_ndim(), x0lo.get_dims() ) )
+      return NULL;
+
+    ModelGrid< ArrayType > grid = { &pars, { &x0lo, &x1lo, &x0hi, &x1hi },
+				    &result };
+    int status;
+
+    if ( !(x0hi && integrate) )
+      status = eval_model_grid( model_chunk_2< ArrayType, PtLoop >,
+				grid, nelem );
+    else
+      status = eval_model_grid( model_chunk_4< ArrayType, IntLoop >,
+				grid, nelem );
+
+    if ( EXIT_SUCCESS != status ) {
+      PyErr_SetString( PyExc_ValueError,
+		       (char*)"model evaluation failed" );
+      return NULL;
+    }
+
+    return result.return_new_ref();
+
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtFunc)( const ArrayType& p, DataType x0, DataType x1,
+			   DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val )>
+  PyObject* modelfct2d( PyObject* self, PyObject* args, PyObject *kwds )
+  {
+    return modelfct2d_loops< ArrayType, DataType, NumPars,
+			     model2d_point_loop< ArrayType, DataType, PtFunc >,
+			     model2d_int_loop< ArrayType, DataType, IntFunc > >
+      ( self, args, kwds );
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtFunc)( const ArrayType& p, DataType x0, DataType x1,
+			   DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val )>
+  PyObject* modelfct2d_noint( PyObject* self, PyObject* args, PyObject *kwds )
+  {
+    return modelfct2d_loops< ArrayType, DataType, NumPars,
+			     model2d_point_loop< ArrayType, DataType, PtFunc >,
+			     model2d_quad_loop< ArrayType, DataType,
+						PtFunc, IntFunc > >
+      ( self, args, kwds );
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtFunc)( const ArrayType& p, DataType x0, DataType x1,
+			   DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val ),
+	    bool (*Separable)( const ArrayType& p ),
+	    int (*SepFunc)( const ArrayType& p, DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val )>
+  PyObject* modelfct2d_sep( PyObject* self, PyObject* args, PyObject *kwds )
+  {
+    return modelfct2d_loops< ArrayType, DataType, NumPars,
+			     model2d_point_loop< ArrayType, DataType, PtFunc >,
+			     model2d_sep_loop< ArrayType, DataType, PtFunc,
+					       IntFunc, Separable, SepFunc > >
+      ( self, args, kwds );
+  }
+
+
+  //
+  // Single precision: with single_precision() switched on (see
+  // extension.hh), the name entry point of a model reads its grids and
+  // parameters as float32, evaluates it in float and returns a float32
+  // array.  Otherwise it works in double precision, as before.
+  //
+
+  template <PyObject* (*DoubleFunc)( PyObject* self, PyObject* args,
+				     PyObject* kwds ),
+	    PyObject* (*FloatFunc)( PyObject* self, PyObject* args,
+				    PyObject* kwds )>
+  PyObject* modelfct_float32( PyObject* self, PyObject* args, PyObject *kwds )
+  {
+
+    if ( single_precision() )
+      return FloatFunc( self, args, kwds );
+
+    return DoubleFunc( self, args, kwds );
+
+  }
+
+
+  //
+  // Batch evaluation: the same model on the same grid for every row of a
+  // (nsets x npars) parameter matrix, giving a (nsets x nelem) result.
+  // The grid is converted and checked once, and is walked in tiles small
+  // enough to stay in cache while all of the parameter sets are
+  // evaluated on them.
+  //
+
+  enum { BATCH_TILE = 1024 };
+
+
+  template <typename ArrayType>
+  struct BatchGrid {
+    npy_intp nsets;
+    const ArrayType* pars;	// one view per parameter set
+    ArrayType* result;		// one view per result row
+    const ArrayType* x[4];
+  };
+
+
+  template <typename ArrayType,
+	    int (*Loop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			 const ArrayType& x, ArrayType& result )>
+  int batch_chunk_1( void* data, std::ptrdiff_t begin, std::ptrdiff_t end )
+  {
+
+    BatchGrid< ArrayType >& g = *static_cast< BatchGrid< ArrayType >* >( data );
+    int status = EXIT_SUCCESS;
+
+    for ( npy_intp lo = begin; lo < end; lo += BATCH_TILE ) {
+      npy_intp hi = std::min( lo + npy_intp( BATCH_TILE ), npy_intp( end ) );
+      for ( npy_intp kk = 0; kk < g.nsets; kk++ )
+	if ( EXIT_SUCCESS != Loop( g.pars[kk], lo, hi, *g.x[0],
+				   g.result[kk] ) )
+	  status = EXIT_FAILURE;
+    }
+
+    return status;
+
+  }
+
+
+  template <typename ArrayType,
+	    int (*Loop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			 const ArrayType& x0, const ArrayType& x1,
+			 ArrayType& result )>
+  int batch_chunk_2( void* data, std::ptrdiff_t begin, std::ptrdiff_t end )
+  {
+
+    BatchGrid< ArrayType >& g = *static_cast< BatchGrid< ArrayType >* >( data );
+    int status = EXIT_SUCCESS;
+
+    for ( npy_intp lo = begin; lo < end; lo += BATCH_TILE ) {
+      npy_intp hi = std::min( lo + npy_intp( BATCH_TILE ), npy_intp( end ) );
+      for ( npy_intp kk = 0; kk < g.nsets; kk++ )
+	if ( EXIT_SUCCESS != Loop( g.pars[kk], lo, hi, *g.x[0], *g.x[1],
+				   g.result[kk] ) )
+	  status = EXIT_FAILURE;
+    }
+
+    return status;
+
+  }
+
+
+  template <typename ArrayType,
+	    int (*Loop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			 const ArrayType& x0lo, const ArrayType& x0hi,
+			 const ArrayType& x1lo, const ArrayType& x1hi,
+			 ArrayType& result )>
+  int batch_chunk_4( void* data, std::ptrdiff_t begin, std::ptrdiff_t end )
+  {
+
+    BatchGrid< ArrayType >& g = *static_cast< BatchGrid< ArrayType >* >( data );
+    int status = EXIT_SUCCESS;
+
+    for ( npy_intp lo = begin; lo < end; lo += BATCH_TILE ) {
+      npy_intp hi = std::min( lo + npy_intp( BATCH_TILE ), npy_intp( end ) );
+      for ( npy_intp kk = 0; kk < g.nsets; kk++ )
+	if ( EXIT_SUCCESS != Loop( g.pars[kk], lo, hi, *g.x[0], *g.x[2],
+				   *g.x[1], *g.x[3], g.result[kk] ) )
+	  status = EXIT_FAILURE;
+    }
+
+    return status;
+
+  }
+
+
+  // Convert obj to a C-contiguous (nsets x npars) matrix, flattened into
+  // pars, and make sets[kk] a view of its kk-th row.  The vector holds
+  // empty Arrays until then, which are safe to copy.
+  template <typename ArrayType>
+  int batch_pars( PyObject* obj, npy_intp npars, ArrayType& pars,
+		  std::vector< ArrayType >& sets )
+  {
+
+    PyObject* matrix = PyArray_FROM_O( obj );
+    if ( NULL == matrix )
+      return EXIT_FAILURE;
+
+    if ( ( 2 != PyArray_NDIM( matrix ) ) ||
+	 ( npars != PyArray_DIM( matrix, 1 ) ) ) {
+      std::ostringstream err;
+      err << "expected a 2D array of parameter sets with " << npars
+	  << " columns";
+      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
+      Py_DECREF( matrix );
+      return EXIT_FAILURE;
+    }
+
+    npy_intp nsets = PyArray_DIM( matrix, 0 );
+    PyObject* flat = PyArray_Ravel( (PyArrayObject*)matrix, NPY_CORDER );
+    Py_DECREF( matrix );
+    if ( NULL == flat )
+      return EXIT_FAILURE;
+
+    int rv = pars.from_obj( flat, true );
+    Py_DECREF( flat );
+    if ( EXIT_SUCCESS != rv )
+      return EXIT_FAILURE;
+
+    sets.resize( nsets );
+    for ( npy_intp kk = 0; kk < nsets; kk++ )
+      if ( EXIT_SUCCESS != sets[kk].create( 1, &npars,
+					    pars.get_data() + kk * npars ) )
+	return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  // Allocate the flattened (nsets x nelem) result and one view per row
+  template <typename ArrayType>
+  int batch_result( npy_intp nsets, npy_intp nelem, ArrayType& result,
+		    std::vector< ArrayType >& rows )
+  {
+
+    npy_intp size = nsets * nelem;
+    if ( EXIT_SUCCESS != result.create( 1, &size ) )
+      return EXIT_FAILURE;
+
+    rows.resize( nsets );
+    for ( npy_intp kk = 0; kk < nsets; kk++ )
+      if ( EXIT_SUCCESS != rows[kk].create( 1, &nelem,
+					    result.get_data() + kk * nelem ) )
+	return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename ArrayType>
+  PyObject* batch_return( ArrayType& result, npy_intp nsets, npy_intp nelem )
+  {
+    npy_intp dims[2] = { nsets, nelem };
+    PyArray_Dims shape = { dims, 2 };
+    return PyArray_Newshape( (PyArrayObject*)result.borrowed_ref(), &shape,
+			     NPY_CORDER );
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtLoop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			   const ArrayType& x, ArrayType& result ),
+	    int (*IntLoop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			    const ArrayType& xlo, const ArrayType& xhi,
+			    ArrayType& result ),
+	    bool Adaptive>
+  PyObject* modelfct1d_batch_loops( PyObject* self, PyObject* args,
+				    PyObject *kwds )
+  {
+
+    PyObject* parsobj = NULL;
+    ArrayType xlo;
+    ArrayType xhi;
+    int integrate = 1;
+
+    static char *kwlist[] = {(char*)"pars",(char*)"xlo",(char*)"xhi",(char*)"integrate", NULL};
+
+    if ( !PyArg_ParseTupleAndKeywords(args, kwds, (char*)"OO&|O&i", kwlist,
+			   &parsobj,
+			   (converter)convert_to_array< ArrayType >, &xlo,
+			   (converter)convert_to_array< ArrayType >, &xhi,
+			   &integrate) )
+      return NULL;
+
+    npy_intp nelem = xlo.get_size();
+
+    if ( xhi && ( xhi.get_size() != nelem ) ) {
+      std::ostringstream err;
+      err << "1D model evaluation input array sizes do not match, "
+	  << "xlo: " << nelem << " vs xhi: " << xhi.get_size();
+      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
+      return NULL;
+    }
+
+    ArrayType pars;
+    std::vector< ArrayType > sets;
+    if ( EXIT_SUCCESS != batch_pars( parsobj, NumPars, pars, sets ) )
+      return NULL;
+
+    npy_intp nsets = npy_intp( sets.size() );
+    ArrayType result;
+    std::vector< ArrayType > rows;
+    if ( EXIT_SUCCESS != batch_result( nsets, nelem, result, rows ) )
+      return NULL;
+
+    if ( nsets > 0 ) {
+
+      BatchGrid< ArrayType > grid = { nsets, &sets[0], &rows[0],
+				      { &xlo, &xhi } };
+      int status;
+
+      if ( !(xhi && integrate) )
+	status = eval_model_grid( batch_chunk_1< ArrayType, PtLoop >,
+				  grid, nelem );
+      else
+	status = eval_model_grid( batch_chunk_2< ArrayType, IntLoop >,
+				  grid, nelem,
+				  int_threaded( Adaptive, xlo, xhi ) );
+
+      if ( EXIT_SUCCESS != status ) {
+	PyErr_SetString( PyExc_ValueError,
+			 (char*)"model evaluation failed" );
+	return NULL;
+      }
+
+    }
+
+    return batch_return( result, nsets, nelem );
+
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtFunc)( const ArrayType& p, DataType x, DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType xlo, DataType xhi,
+			    DataType& val )>
+  PyObject* modelfct1d_batch( PyObject* self, PyObject* args, PyObject *kwds)
+  {
+    return modelfct1d_batch_loops< ArrayType, DataType, NumPars,
+				   model1d_point_loop< ArrayType, DataType,
+						       PtFunc >,
+				   model1d_int_loop< ArrayType, DataType,
+						     IntFunc >,
+				   false >
+      ( self, args, kwds );
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtFunc)( const ArrayType& p, DataType x, DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType xlo, DataType xhi,
+			    DataType& val ),
+	    int (*PtVec)( const ArrayType& p, npy_intp nelem,
+			  const DataType* x, DataType* val ),
+	    int (*IntVec)( const ArrayType& p, npy_intp nelem,
+			   const DataType* xlo, const DataType* xhi,
+			   DataType* val )>
+  PyObject* modelfct1d_vec_batch( PyObject* self, PyObject* args,
+				  PyObject *kwds )
+  {
+    return modelfct1d_batch_loops< ArrayType, DataType, NumPars,
+				   model1d_point_vec_loop< ArrayType, DataType,
+							   PtFunc, PtVec >,
+				   model1d_int_vec_loop< ArrayType, DataType,
+							 IntFunc, IntVec >,
+				   false >
+      ( self, args, kwds );
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtFunc)( const ArrayType& p, DataType x, DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType xlo, DataType xhi,
+			    DataType& val )>
+  PyObject* modelfct1d_noint_batch( PyObject* self, PyObject* args,
+				    PyObject *kwds )
+  {
+    return modelfct1d_batch_loops< ArrayType, DataType, NumPars,
+				   model1d_point_loop< ArrayType, DataType,
+						       PtFunc >,
+				   model1d_quad_loop< ArrayType, DataType,
+						      PtFunc, IntFunc >,
+				   bool( adaptive_1d< DataType >::value ) >
+      ( self, args, kwds );
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtLoop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			   const ArrayType& x0, const ArrayType& x1,
+			   ArrayType& result ),
+	    int (*IntLoop)( const ArrayType& p, npy_intp begin, npy_intp end,
+			    const ArrayType& x0lo, const ArrayType& x0hi,
+			    const ArrayType& x1lo, const ArrayType& x1hi,
+			    ArrayType& result )>
+  PyObject* modelfct2d_batch_loops( PyObject* self, PyObject* args,
+				    PyObject *kwds )
+  {
+
+    PyObject* parsobj = NULL;
+    ArrayType x0lo;
+    ArrayType x1lo;
+    ArrayType x0hi;
+    ArrayType x1hi;
+
+    int integrate = 1;
+    static char *kwlist[] = {(char*)"pars", (char*)"x0lo", (char*)"x1lo",
+			     (char*)"x0hi", (char*)"x1hi", (char*)"integrate", NULL};
+    if ( !PyArg_ParseTupleAndKeywords( args, kwds, (char*)"OO&O&|O&O&i", kwlist,
+			    &parsobj,
+			    (converter)convert_to_array< ArrayType >, &x0lo,
+			    (converter)convert_to_array< ArrayType >, &x1lo,
+			    (converter)convert_to_array< ArrayType >, &x0hi,
+			    (converter)convert_to_array< ArrayType >, &x1hi,
+			    &integrate) )
+      return NULL;
+
+    if ( x0hi && !x1hi )  {
+      PyErr_SetString( PyExc_TypeError, (char*)"expected 3 or 5 arguments, got 4");
+      return NULL;
+    }
+
+    npy_intp nelem = x0lo.get_size();
+
+    if ( ( x1lo.get_size() != nelem ) || 
+	 ( x0hi &&
+	   ( ( x0hi.get_size() != nelem ) ||
+	     ( x1hi.get_size() != nelem ) ) ) ) {
+      PyErr_SetString( PyExc_TypeError,
+		       (char*)"2D model evaluation input array sizes do not match" );
+      return NULL;
+    }
+
+    ArrayType pars;
+    std::vector< ArrayType > sets;
+    if ( EXIT_SUCCESS != batch_pars( parsobj, NumPars, pars, sets ) )
+      return NULL;
+
+    npy_intp nsets = npy_intp( sets.size() );
+    ArrayType result;
+    std::vector< ArrayType > rows;
+    if ( EXIT_SUCCESS != batch_result( nsets, nelem, result, rows ) )
+      return NULL;
+
+    if ( nsets > 0 ) {
+
+      BatchGrid< ArrayType > grid = { nsets, &sets[0], &rows[0],
+				      { &x0lo, &x1lo, &x0hi, &x1hi } };
+      int status;
+
+      if ( !(x0hi && integrate) )
+	status = eval_model_grid( batch_chunk_2< ArrayType, PtLoop >,
+				  grid, nelem );
+      else
+	status = eval_model_grid( batch_chunk_4< ArrayType, IntLoop >,
+				  grid, nelem );
+
+      if ( EXIT_SUCCESS != status ) {
+	PyErr_SetString( PyExc_ValueError,
+			 (char*)"model evaluation failed" );
+	return NULL;
+      }
+
+    }
+
+    return batch_return( result, nsets, nelem );
+
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtFunc)( const ArrayType& p, DataType x0, DataType x1,
+			   DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val )>
+  PyObject* modelfct2d_batch( PyObject* self, PyObject* args, PyObject *kwds )
+  {
+    return modelfct2d_batch_loops< ArrayType, DataType, NumPars,
+				   model2d_point_loop< ArrayType, DataType,
+						       PtFunc >,
+				   model2d_int_loop< ArrayType, DataType,
+						     IntFunc > >
+      ( self, args, kwds );
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtFunc)( const ArrayType& p, DataType x0, DataType x1,
+			   DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val )>
+  PyObject* modelfct2d_noint_batch( PyObject* self, PyObject* args,
+				    PyObject *kwds )
+  {
+    return modelfct2d_batch_loops< ArrayType, DataType, NumPars,
+				   model2d_point_loop< ArrayType, DataType,
+						       PtFunc >,
+				   model2d_quad_loop< ArrayType, DataType,
+						      PtFunc, IntFunc > >
+      ( self, args, kwds );
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtFunc)( const ArrayType& p, DataType x0, DataType x1,
+			   DataType& val ),
+	    int (*IntFunc)( const ArrayType& p, DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val ),
+	    bool (*Separable)( const ArrayType& p ),
+	    int (*SepFunc)( const ArrayType& p, DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val )>
+  PyObject* modelfct2d_sep_batch( PyObject* self, PyObject* args,
+				  PyObject *kwds )
+  {
+    return modelfct2d_batch_loops< ArrayType, DataType, NumPars,
+				   model2d_point_loop< ArrayType, DataType,
+						       PtFunc >,
+				   model2d_sep_loop< ArrayType, DataType,
+						     PtFunc, IntFunc,
+						     Separable, SepFunc > >
+      ( self, args, kwds );
+  }
+
+
+  //
+  // Value and Jacobian in one pass: name_grad returns (vals, jac), with
+  // jac[k] the derivative of vals with respect to the k-th parameter.
+  // The grid is made C-contiguous on the way in, and the chunks fill
+  // their slice of every Jacobian row.
+  //
+
+  template <typename ArrayType>
+  struct GradGrid {
+    const ArrayType* pars;
+    const ArrayType* x[4];	// in the order of ModelGrid
+    ArrayType* vals;
+    ArrayType* jac;		// flattened (npars x nelem)
+    npy_intp nelem;
+  };
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtGrad)( const ArrayType& p, DataType x, DataType& val,
+			   DataType* grad )>
+  int grad1d_point_chunk( void* data, std::ptrdiff_t begin,
+			  std::ptrdiff_t end )
+  {
+
+    GradGrid< ArrayType >& g = *static_cast< GradGrid< ArrayType >* >( data );
+    const DataType* x = g.x[0]->get_data();
+    DataType* val = g.vals->get_data();
+    DataType* jac = g.jac->get_data();
+    DataType grad[ NumPars ];
+    int nfail = 0;
+
+    for ( npy_intp ii = begin; ii < end; ii++ ) {
+      std::fill( grad, grad + NumPars, DataType( 0 ) );
+      nfail += ( EXIT_SUCCESS != PtGrad( *g.pars, x[ii], val[ii], grad ) );
+      for ( npy_intp kk = 0; kk < NumPars; kk++ )
+	jac[ kk * g.nelem + ii ] = grad[ kk ];
+    }
+
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*IntGrad)( const ArrayType& p, DataType xlo, DataType xhi,
+			    DataType& val, DataType* grad )>
+  int grad1d_int_chunk( void* data, std::ptrdiff_t begin, std::ptrdiff_t end )
+  {
+
+    GradGrid< ArrayType >& g = *static_cast< GradGrid< ArrayType >* >( data );
+    const DataType* xlo = g.x[0]->get_data();
+    const DataType* xhi = g.x[1]->get_data();
+    DataType* val = g.vals->get_data();
+    DataType* jac = g.jac->get_data();
+    DataType grad[ NumPars ];
+    int nfail = 0;
+
+    for ( npy_intp ii = begin; ii < end; ii++ ) {
+      std::fill( grad, grad + NumPars, DataType( 0 ) );
+      nfail += ( EXIT_SUCCESS != IntGrad( *g.pars, xlo[ii], xhi[ii], val[ii],
+					  grad ) );
+      for ( npy_intp kk = 0; kk < NumPars; kk++ )
+	jac[ kk * g.nelem + ii ] = grad[ kk ];
+    }
+
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtGrad)( const ArrayType& p, DataType x0, DataType x1,
+			   DataType& val, DataType* grad )>
+  int grad2d_point_chunk( void* data, std::ptrdiff_t begin,
+			  std::ptrdiff_t end )
+  {
+
+    GradGrid< ArrayType >& g = *static_cast< GradGrid< ArrayType >* >( data );
+    const DataType* x0 = g.x[0]->get_data();
+    const DataType* x1 = g.x[1]->get_data();
+    DataType* val = g.vals->get_data();
+    DataType* jac = g.jac->get_data();
+    DataType grad[ NumPars ];
+    int nfail = 0;
+
+    for ( npy_intp ii = begin; ii < end; ii++ ) {
+      std::fill( grad, grad + NumPars, DataType( 0 ) );
+      nfail += ( EXIT_SUCCESS != PtGrad( *g.pars, x0[ii], x1[ii], val[ii],
+					 grad ) );
+      for ( npy_intp kk = 0; kk < NumPars; kk++ )
+	jac[ kk * g.nelem + ii ] = grad[ kk ];
+    }
+
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*IntGrad)( const ArrayType& p, DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val,
+			    DataType* grad )>
+  int grad2d_int_chunk( void* data, std::ptrdiff_t begin, std::ptrdiff_t end )
+  {
+
+    GradGrid< ArrayType >& g = *static_cast< GradGrid< ArrayType >* >( data );
+    const DataType* x0lo = g.x[0]->get_data();
+    const DataType* x1lo = g.x[1]->get_data();
+    const DataType* x0hi = g.x[2]->get_data();
+    const DataType* x1hi = g.x[3]->get_data();
+    DataType* val = g.vals->get_data();
+    DataType* jac = g.jac->get_data();
+    DataType grad[ NumPars ];
+    int nfail = 0;
+
+    for ( npy_intp ii = begin; ii < end; ii++ ) {
+      std::fill( grad, grad + NumPars, DataType( 0 ) );
+      nfail += ( EXIT_SUCCESS != IntGrad( *g.pars, x0lo[ii], x0hi[ii],
+					  x1lo[ii], x1hi[ii], val[ii],
+					  grad ) );
+      for ( npy_intp kk = 0; kk < NumPars; kk++ )
+	jac[ kk * g.nelem + ii ] = grad[ kk ];
+    }
+
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+  }
+
+
+  // Allocate the values, shaped like x, and the flattened Jacobian
+  template <typename ArrayType>
+  int grad_result( npy_intp npars, const ArrayType& x, ArrayType& vals,
+		   ArrayType& jac )
+  {
+
+    if ( EXIT_SUCCESS != vals.create( x.get_ndim(), x.get_dims() ) )
+      return EXIT_FAILURE;
+
+    npy_intp size = npars * x.get_size();
+    return jac.create( 1, &size );
+
+  }
+
+
+  template <typename ArrayType>
+  PyObject* grad_return( ArrayType& vals, ArrayType& jac, npy_intp npars,
+			 npy_intp nelem )
+  {
+
+    PyObject* jacobj = batch_return( jac, npars, nelem );
+    if ( NULL == jacobj )
+      return NULL;
+
+    return Py_BuildValue( (char*)"(NN)", vals.return_new_ref(), jacobj );
+
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtGrad)( const ArrayType& p, DataType x, DataType& val,
+			   DataType* grad ),
+	    int (*IntGrad)( const ArrayType& p, DataType xlo, DataType xhi,
+			    DataType& val, DataType* grad )>
+  PyObject* modelfct1d_grad( PyObject* self, PyObject* args, PyObject *kwds )
+  {
+
+    ArrayType pars;
+    ArrayType xlo;
+    ArrayType xhi;
+    int integrate = 1;
+
+    static char *kwlist[] = {(char*)"pars",(char*)"xlo",(char*)"xhi",(char*)"integrate", NULL};
+
+    if ( !PyArg_ParseTupleAndKeywords(args, kwds, (char*)"O&O&|O&i", kwlist,
+			   (converter)convert_to_contig_array< ArrayType >, &pars,
+			   (converter)convert_to_contig_array< ArrayType >, &xlo,
+			   (converter)convert_to_contig_array< ArrayType >, &xhi,
+			   &integrate) )
+      return NULL;
+
+    npy_intp npars = pars.get_size();
+
+    if ( NumPars != npars ) {
+      std::ostringstream err;
+      err << "expected " << NumPars << " parameters, got " << npars;
+      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
+      return NULL;
+    }
+
+    npy_intp nelem = xlo.get_size();
+
+    if ( xhi && ( xhi.get_size() != nelem ) ) {
+      std::ostringstream err;
+      err << "1D model evaluation input array sizes do not match, "
+	  << "xlo: " << nelem << " vs xhi: " << xhi.get_size();
+      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
+      return NULL;
+    }
+
+    ArrayType vals;
+    ArrayType jac;
+    if ( EXIT_SUCCESS != grad_result( NumPars, xlo, vals, jac ) )
+      return NULL;
+
+    GradGrid< ArrayType > grid = { &pars, { &xlo, &xhi }, &vals, &jac,
+				   nelem };
+    int status;
+
+    if ( !(xhi && integrate) )
+      status = eval_model_grid
+	( grad1d_point_chunk< ArrayType, DataType, NumPars, PtGrad >,
+	  grid, nelem );
+    else
+      status = eval_model_grid
+	( grad1d_int_chunk< ArrayType, DataType, NumPars, IntGrad >,
+	  grid, nelem, !adaptive_1d< DataType >::value );
+
+    if ( EXIT_SUCCESS != status ) {
+      PyErr_SetString( PyExc_ValueError,
+		       (char*)"model evaluation failed" );
+      return NULL;
+    }
+
+    return grad_return( vals, jac, NumPars, nelem );
+
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    npy_intp NumPars,
+	    int (*PtGrad)( const ArrayType& p, DataType x0, DataType x1,
+			   DataType& val, DataType* grad ),
+	    int (*IntGrad)( const ArrayType& p, DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val,
+			    DataType* grad )>
+  PyObject* modelfct2d_grad( PyObject* self, PyObject* args, PyObject *kwds )
+  {
+
+    ArrayType pars;
+    ArrayType x0lo;
+    ArrayType x1lo;
+    ArrayType x0hi;
+    ArrayType x1hi;
+
+    int integrate = 1;
+    static char *kwlist[] = {(char*)"pars", (char*)"x0lo", (char*)"x1lo",
+			     (char*)"x0hi", (char*)"x1hi", (char*)"integrate", NULL};
+    if ( !PyArg_ParseTupleAndKeywords( args, kwds, (char*)"O&O&O&|O&O&i", kwlist,
+			    (converter)convert_to_contig_array< ArrayType >, &pars,
+			    (converter)convert_to_contig_array< ArrayType >, &x0lo,
+			    (converter)convert_to_contig_array< ArrayType >, &x1lo,
+			    (converter)convert_to_contig_array< ArrayType >, &x0hi,
+			    (converter)convert_to_contig_array< ArrayType >, &x1hi,
+			    &integrate) )
+      return NULL;
+
+    npy_intp npars = pars.get_size();
+
+    if ( NumPars != npars ) {
+      std::ostringstream err;
+      err << "expected " << NumPars << " parameters, got " << npars;
+      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
+      return NULL;
+    }
+
+    if ( x0hi && !x1hi )  {
+      PyErr_SetString( PyExc_TypeError, (char*)"expected 3 or 5 arguments, got 4");
+      return NULL;
+    }
+
+    npy_intp nelem = x0lo.get_size();
+
+    if ( ( x1lo.get_size() != nelem ) ||
+	 ( x0hi &&
+	   ( ( x0hi.get_size() != nelem ) ||
+	     ( x1hi.get_size() != nelem ) ) ) ) {
+      PyErr_SetString( PyExc_TypeError,
+		       (char*)"2D model evaluation input array sizes do not match" );
+      return NULL;
+    }
+
+    ArrayType vals;
+    ArrayType jac;
+    if ( EXIT_SUCCESS != grad_result( NumPars, x0lo, vals, jac ) )
+      return NULL;
+
+    GradGrid< ArrayType > grid = { &pars, { &x0lo, &x1lo, &x0hi, &x1hi },
+				   &vals, &jac, nelem };
+    int status;
+
+    if ( !(x0hi && integrate) )
+      status = eval_model_grid
+	( grad2d_point_chunk< ArrayType, DataType, NumPars, PtGrad >,
+	  grid, nelem );
+    else
+      status = eval_model_grid
+	( grad2d_int_chunk< ArrayType, DataType, NumPars, IntGrad >,
+	  grid, nelem );
+
+    if ( EXIT_SUCCESS != status ) {
+      PyErr_SetString( PyExc_ValueError,
+		       (char*)"model evaluation failed" );
+      return NULL;
+    }
+
+    return grad_return( vals, jac, NumPars, nelem );
+
+  }
+
+
+  //
+  // Module functions to query and change the threading of the model
+  // evaluation loops.  Each extension module has its own settings.
+  //
+
+  inline PyObject* set_threads( PyObject* self, PyObject* args, PyObject *kwds )
+  {
+
+    sherpa::threads::Settings opts = sherpa::threads::settings();
+    int nthreads = opts.nthreads;
+    Py_ssize_t chunksize = Py_ssize_t( opts.chunksize );
+
+    static char *kwlist[] = {(char*)"nthreads", (char*)"chunksize", NULL};
+
+    if ( !PyArg_ParseTupleAndKeywords( args, kwds, (char*)"|in", kwlist,
+				       &nthreads, &chunksize ) )
+      return NULL;
+
+    if ( nthreads < 1 || chunksize < 1 ) {
+      PyErr_SetString( PyExc_ValueError,
+		       (char*)"nthreads and chunksize must be positive" );
+      return NULL;
+    }
+
+    opts.nthreads = nthreads;
+    opts.chunksize = std::ptrdiff_t( chunksize );
+    sherpa::threads::set_settings( opts );
+
+    Py_RETURN_NONE;
+
+  }
+
+
+  inline PyObject* get_threads( PyObject* self, PyObject* args, PyObject *kwds )
+  {
+
+    const sherpa::threads::Settings opts = sherpa::threads::settings();
+
+    return Py_BuildValue( (char*)"(in)", opts.nthreads,
+			  Py_ssize_t( opts.chunksize ) );
+
+  }
+
+
+  inline PyObject* set_pixel_integration( PyObject* self, PyObject* args,
+					  PyObject *kwds )
+  {
+
+    sherpa::quadrature::PixelSettings opts =
+      sherpa::quadrature::pixel_settings();
+    int oversample = opts.oversample;
+    double core = opts.core;
+
+    static char *kwlist[] = {(char*)"oversample", (char*)"core", NULL};
+
+    if ( !PyArg_ParseTupleAndKeywords( args, kwds, (char*)"|id", kwlist,
+				       &oversample, &core ) )
+      return NULL;
+
+    if ( oversample < 0 || oversample > sherpa::quadrature::MAX_OVERSAMPLE ||
+	 !( core >= 0.0 ) ) {
+      std::ostringstream err;
+      err << "oversample must be between 0 and "
+	  << int( sherpa::quadrature::MAX_OVERSAMPLE )
+	  << " and core must not be negative";
+      PyErr_SetString( PyExc_ValueError, err.str().c_str() );
+      return NULL;
+    }
+
+    opts.oversample = oversample;
+    opts.core = core;
+    sherpa::quadrature::set_pixel_settings( opts );
+
+    Py_RETURN_NONE;
+
+  }
+
+
+  inline PyObject* get_pixel_integration( PyObject* self, PyObject* args,
+					  PyObject *kwds )
+  {
+
+    const sherpa::quadrature::PixelSettings opts =
+      sherpa::quadrature::pixel_settings();
+
+    return Py_BuildValue( (char*)"(id)", opts.oversample, opts.core );
+
+  }
+
+
+}  }  /* namespace models, namespace sherpa */
+
+
+#define SHERPAMODELMOD(name, fctlist) \
+PyMODINIT_FUNC \
+init##name(void) \
+{ \
+  import_array(); \
+  if ( -1 == import_integration() ) \
+    return; \
+  Py_InitModule( (char*)#name, fctlist );	\
+}
+
+
+// Allow this to be customized on a per-file basis
+
+#define MODSPEC(name, func) \
+  { (char*)#name, (PyCFunction)((PyCFunctionWithKeywords)func), \
+      METH_VARARGS|METH_KEYWORDS, NULL }
+
+#ifndef _MODELFCTNS
+#define _MODELFCTNS sherpa::models
+#endif
+
+#ifndef _MODELFCTPTR
+#define _MODELFCTPTR(name) \
+  _MODELFCTNS::name< SherpaFloat, SherpaFloatArray >
+#endif
+
+#ifndef _MODELFCTPTR32
+#define _MODELFCTPTR32(name) \
+  _MODELFCTNS::name< SherpaFloat32, SherpaFloat32Array >
+#endif
+
+// The module function ftype for the kernels of name, instantiated for
+// atype and dtype, with ptr naming the kernels
+#define _MODELFCTFUNC(name, ftype, npars, atype, dtype, ptr) \
+  sherpa::models::ftype< atype, dtype, npars, \
+                         ptr(name##_point), ptr(name##_integrated) >
+
+#define _MODELFCTFUNC_NOINT(name, ftype, intftype, npars, atype, dtype, ptr) \
+  sherpa::models::ftype< atype, dtype, npars, ptr(name##_point), \
+                         sherpa::models::intftype< ptr(name##_point) > >
+
+// Models with batch kernels name_point_vec and name_integrated_vec
+#define _MODELFCTFUNC_VEC(name, ftype, npars, atype, dtype, ptr) \
+  sherpa::models::ftype< atype, dtype, npars, \
+                         ptr(name##_point), ptr(name##_integrated), \
+                         ptr(name##_point_vec), ptr(name##_integrated_vec) >
+
+// Models whose pixel integral name_integrated is exact whenever
+// name_separable accepts the parameters, and is integrated numerically
+// otherwise
+#define _MODELFCTFUNC_SEP(name, ftype, npars, atype, dtype, ptr) \
+  sherpa::models::ftype< atype, dtype, npars, ptr(name##_point), \
+                         sherpa::models::integrated_model2d \
+                           < ptr(name##_point) >, \
+                         ptr(name##_separable), ptr(name##_integrated) >
+
+#define _MODELFCTSPEC_AS(pyname, name, ftype, npars) \
+  MODSPEC(pyname, (_MODELFCTFUNC(name, ftype, npars, SherpaFloatArray, \
+                                 SherpaFloat, _MODELFCTPTR)))
+
+#define _MODELFCTSPEC_NOINT_AS(pyname, name, ftype, intftype, npars) \
+  MODSPEC(pyname, (_MODELFCTFUNC_NOINT(name, ftype, intftype, npars, \
+                                       SherpaFloatArray, SherpaFloat, \
+                                       _MODELFCTPTR)))
+
+#define _MODELFCTSPEC_VEC_AS(pyname, name, ftype, npars) \
+  MODSPEC(pyname, (_MODELFCTFUNC_VEC(name, ftype, npars, SherpaFloatArray, \
+                                     SherpaFloat, _MODELFCTPTR)))
+
+#define _MODELFCTSPEC_SEP_AS(pyname, name, ftype, npars) \
+  MODSPEC(pyname, (_MODELFCTFUNC_SEP(name, ftype, npars, SherpaFloatArray, \
+                                     SherpaFloat, _MODELFCTPTR)))
+
+// Gradients, from name_point_grad and name_integrated_grad
+#define _MODELFCTSPEC_GRAD_AS(pyname, name, ftype, npars) \
+  MODSPEC(pyname, (sherpa::models::ftype< SherpaFloatArray, SherpaFloat, npars, \
+                                          _MODELFCTPTR(name##_point_grad), \
+                                          _MODELFCTPTR(name##_integrated_grad) >))
+
+#define _MODELFCTSPEC_GRAD_NOINT_AS(pyname, name, ftype, intftype, npars) \
+  MODSPEC(pyname, \
+          (sherpa::models::ftype< SherpaFloatArray, SherpaFloat, npars, \
+                                  _MODELFCTPTR(name##_point_grad), \
+                                  sherpa::models::intftype \
+                                    < npars, _MODELFCTPTR(name##_point_grad) > >))
+
+// The name entry points, in double precision or, with single precision
+// switched on, in float (see modelfct_float32)
+#define _MODELFCTSPEC(name, ftype, npars) \
+  MODSPEC(name, (sherpa::models::modelfct_float32 \
+                 < _MODELFCTFUNC(name, ftype, npars, SherpaFloatArray, \
+                                 SherpaFloat, _MODELFCTPTR), \
+                   _MODELFCTFUNC(name, ftype, npars, SherpaFloat32Array, \
+                                 SherpaFloat32, _MODELFCTPTR32) >))
+#define _MODELFCTSPEC_NOINT(name, ftype, intftype, npars) \
+  MODSPEC(name, (sherpa::models::modelfct_float32 \
+                 < _MODELFCTFUNC_NOINT(name, ftype, intftype, npars, \
+                                       SherpaFloatArray, SherpaFloat, \
+                                       _MODELFCTPTR), \
+                   _MODELFCTFUNC_NOINT(name, ftype, intftype, npars, \
+                                       SherpaFloat32Array, SherpaFloat32, \
+                                       _MODELFCTPTR32) >))
+#define _MODELFCTSPEC_VEC(name, ftype, npars) \
+  MODSPEC(name, (sherpa::models::modelfct_float32 \
+                 < _MODELFCTFUNC_VEC(name, ftype, npars, SherpaFloatArray, \
+                                     SherpaFloat, _MODELFCTPTR), \
+                   _MODELFCTFUNC_VEC(name, ftype, npars, SherpaFloat32Array, \
+                                     SherpaFloat32, _MODELFCTPTR32) >))
+#define _MODELFCTSPEC_SEP(name, ftype, npars) \
+  MODSPEC(name, (sherpa::models::modelfct_float32 \
+                 < _MODELFCTFUNC_SEP(name, ftype, npars, SherpaFloatArray, \
+                                     SherpaFloat, _MODELFCTPTR), \
+                   _MODELFCTFUNC_SEP(name, ftype, npars, SherpaFloat32Array, \
+                                     SherpaFloat32, _MODELFCTPTR32) >))
+
+// Each model gets three module functions: name, for a single parameter
+// set, name_batch, for a (nsets x npars) matrix of them, and name_grad,
+// for the values and their derivatives with respect to the parameters
+#define MODELFCT1D(name, npars) \
+  _MODELFCTSPEC(name, modelfct1d, npars), \
+  _MODELFCTSPEC_AS(name##_batch, name, modelfct1d_batch, npars), \
+  _MODELFCTSPEC_GRAD_AS(name##_grad, name, modelfct1d_grad, npars)
+#define MODELFCT2D(name, npars) \
+  _MODELFCTSPEC(name, modelfct2d, npars), \
+  _MODELFCTSPEC_AS(name##_batch, name, modelfct2d_batch, npars), \
+  _MODELFCTSPEC_GRAD_AS(name##_grad, name, modelfct2d_grad, npars)
 #define MODELFCT1D_NOINT(name, npars) \
-  _MODELFCTSPEC_NOINT(name, modelfct1d, integrated_model1d, npars)
+  _MODELFCTSPEC_NOINT(name, modelfct1d_noint, integrated_model1d, npars), \
+  _MODELFCTSPEC_NOINT_AS(name##_batch, name, modelfct1d_noint_batch, \
+                         integrated_model1d, npars), \
+  _MODELFCTSPEC_GRAD_NOINT_AS(name##_grad, name, modelfct1d_grad, \
+                              integrated_grad1d, npars)
 #define MODELFCT2D_NOINT(name, npars) \
-  _MODELFCTSPEC_NOINT(name, modelfct2d, integrated_model2d, npars)
+  _MODELFCTSPEC_NOINT(name, modelfct2d_noint, integrated_model2d, npars), \
+  _MODELFCTSPEC_NOINT_AS(name##_batch, name, modelfct2d_noint_batch, \
+                         integrated_model2d, npars), \
+  _MODELFCTSPEC_GRAD_NOINT_AS(name##_grad, name, modelfct2d_grad, \
+                              integrated_grad2d, npars)
+#define MODELFCT2D_SEP(name, npars) \
+  _MODELFCTSPEC_SEP(name, modelfct2d_sep, npars), \
+  _MODELFCTSPEC_SEP_AS(name##_batch, name, modelfct2d_sep_batch, npars), \
+  _MODELFCTSPEC_GRAD_NOINT_AS(name##_grad, name, modelfct2d_grad, \
+                              integrated_grad2d, npars)
+#define MODELFCT1D_VEC(name, npars) \
+  _MODELFCTSPEC_VEC(name, modelfct1d_vec, npars), \
+  _MODELFCTSPEC_VEC_AS(name##_batch, name, modelfct1d_vec_batch, npars), \
+  _MODELFCTSPEC_GRAD_AS(name##_grad, name, modelfct1d_grad, npars)
+
+#define MODELFCT_THREADS \
+  MODSPEC_INT("set_threads", sherpa::models::set_threads, \
+              "set_threads([nthreads [, chunksize]])\n\n" \
+              "Set the number of threads and the number of grid points " \
+              "per chunk\nused by the model functions of this module"), \
+  MODSPEC_INT("get_threads", sherpa::models::get_threads, \
+              "get_threads()\n\n" \
+              "Return the (nthreads, chunksize) used by the model " \
+              "functions of\nthis module"), \
+  PRECISIONFCTS
+
+#define MODELFCT_PIXELS \
+  MODSPEC_INT("set_pixel_integration", \
+              sherpa::models::set_pixel_integration, \
+              "set_pixel_integration([oversample [, core]])\n\n" \
+              "Set how the 2D models without an analytic integral are " \
+              "integrated\nover a pixel: adaptively if oversample is 0, " \
+              "else from oversample x\noversample subpixels, with the " \
+              "pixels within core pixel widths of\nthe model centre still " \
+              "integrated adaptively"), \
+  MODSPEC_INT("get_pixel_integration", \
+              sherpa::models::get_pixel_integration, \
+              "get_pixel_integration()\n\n" \
+              "Return the (oversample, core) used to integrate the 2D " \
+              "models of\nthis module over a pixel")
 
 #define MODSPEC_INT(name, func, doc) \
   { (char*)name, (PyCFunction)((PyCFunctionWithKeywords)func), METH_VARARGS|METH_KEYWORDS, \
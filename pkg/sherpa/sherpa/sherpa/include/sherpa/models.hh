@@ -23,6 +23,7 @@
 #include <algorithm>
 #include <sherpa/utils.hh>
 #include <sherpa/constants.hh>
+#include <sherpa/vecmath.hh>
 
 
 namespace sherpa { namespace models {
@@ -78,6 +79,49 @@ namespace sherpa { namespace models {
   }
 
 
+  //
+  // Each *_grad function below returns the same value as the model
+  // function it follows, along with the derivatives of that value with
+  // respect to every parameter in grad[0] .. grad[npars-1].  At the edges
+  // of the step models, where the derivative is a delta function, it is
+  // taken to be zero.
+  //
+
+  template <typename DataType, typename ConstArrayType>
+  inline int box1d_point_grad( const ConstArrayType& p, DataType x,
+			       DataType& val, DataType* grad )
+  {
+
+    grad[0] = grad[1] = 0.0;
+    grad[2] = ( x < p[0] || x > p[1] ) ? 0.0 : 1.0;
+    return box1d_point( p, x, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int box1d_integrated_grad( const ConstArrayType& p,
+				    DataType xlo, DataType xhi,
+				    DataType& val, DataType* grad )
+  {
+
+    grad[0] = grad[1] = grad[2] = 0.0;
+    if ( EXIT_SUCCESS != box1d_integrated( p, xlo, xhi, val ) )
+      return EXIT_FAILURE;
+    if ( p[1] <= xlo || p[0] >= xhi )
+      return EXIT_SUCCESS;
+
+    register DataType denom = xhi - xlo;
+    if ( p[0] > xlo )
+      grad[0] = - p[2] / denom;
+    if ( p[1] < xhi )
+      grad[1] = p[2] / denom;
+    grad[2] = (std::min(xhi,p[1]) - std::max(xlo,p[0]) ) / denom;
+    return EXIT_SUCCESS;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int const1d_point( const ConstArrayType& p, DataType x,
 			    DataType& val )
@@ -100,6 +144,31 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int const1d_point_grad( const ConstArrayType& p, DataType x,
+				 DataType& val, DataType* grad )
+  {
+
+    val = p[0];
+    grad[0] = 1.0;
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int const1d_integrated_grad( const ConstArrayType& p,
+				      DataType xlo, DataType xhi,
+				      DataType& val, DataType* grad )
+  {
+
+    val = p[0]*(xhi-xlo);
+    grad[0] = xhi-xlo;
+    return EXIT_SUCCESS;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int cos_point( const ConstArrayType& p, DataType x, DataType& val )
   {
@@ -132,6 +201,50 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int cos_point_grad( const ConstArrayType& p, DataType x,
+			     DataType& val, DataType* grad )
+  {
+
+    if ( 0.0 == p[0] ) {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+    register DataType tmp = TWOPI*(x-p[1])/p[0];
+    register DataType c = COS(tmp);
+    register DataType s = SIN(tmp);
+    val = p[2]*c;
+    grad[0] = p[2]*s*tmp/p[0];
+    grad[1] = p[2]*s*TWOPI/p[0];
+    grad[2] = c;
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int cos_integrated_grad( const ConstArrayType& p,
+				  DataType xlo, DataType xhi,
+				  DataType& val, DataType* grad )
+  {
+
+    if ( 0.0 == p[0] ) {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+    register DataType tmp1 = TWOPI*(xlo-p[1])/p[0];
+    register DataType tmp2 = TWOPI*(xhi-p[1])/p[0];
+    register DataType c1 = COS(tmp1);
+    register DataType c2 = COS(tmp2);
+    val = p[2]*p[0]*(SIN(tmp2)-SIN(tmp1))/TWOPI;
+    grad[0] = val/p[0] - p[2]*(tmp2*c2-tmp1*c1)/TWOPI;
+    grad[1] = -p[2]*(c2-c1);
+    grad[2] = p[0]*(SIN(tmp2)-SIN(tmp1))/TWOPI;
+    return EXIT_SUCCESS;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int delta1d_point( const ConstArrayType& p, DataType x,
 			    DataType& val )
@@ -162,6 +275,31 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int delta1d_point_grad( const ConstArrayType& p, DataType x,
+				 DataType& val, DataType* grad )
+  {
+
+    grad[0] = 0.0;
+    grad[1] = ( x == p[0] ) ? 1.0 : 0.0;
+    return delta1d_point( p, x, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int delta1d_integrated_grad( const ConstArrayType& p,
+				      DataType xlo, DataType xhi,
+				      DataType& val, DataType* grad )
+  {
+
+    grad[0] = 0.0;
+    grad[1] = ( p[0] >= xlo && p[0] < xhi ) ? 1.0 : 0.0;
+    return delta1d_integrated( p, xlo, xhi, val );
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int erf_point( const ConstArrayType& p, DataType x, DataType& val )
   {
@@ -241,6 +379,56 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int erf_point_grad( const ConstArrayType& p, DataType x,
+			     DataType& val, DataType* grad )
+  {
+
+    if ( EXIT_SUCCESS != erf_point( p, x, val ) )
+      return EXIT_FAILURE;
+
+    if ( 0.0 != p[2] ) {
+      register DataType arg = ( x - p[1] ) / p[2];
+      register DataType dval = 2.0 * p[0] * EXP( -arg*arg ) /
+	constants::sqrt_pi< DataType >();
+      grad[0] = ERF( arg );
+      grad[1] = - dval / p[2];
+      grad[2] = - dval * arg / p[2];
+    } else {
+      grad[0] = ( x > p[1] ) ? 1.0 : -1.0;
+      grad[1] = grad[2] = 0.0;
+    }
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int erf_integrated_grad( const ConstArrayType& p,
+				  DataType xlo, DataType xhi,
+				  DataType& val, DataType* grad )
+  {
+
+    if ( EXIT_SUCCESS != erf_integrated( p, xlo, xhi, val ) )
+      return EXIT_FAILURE;
+
+    if ( 0.0 != p[2] ) {
+      register DataType arg1 = ( xlo - p[1] ) / p[2];
+      register DataType arg2 = ( xhi - p[1] ) / p[2];
+      grad[0] = p[2] * ( _erf_sub1( p, xhi ) - _erf_sub1( p, xlo ) );
+      grad[1] = - p[0] * ( ERF( arg2 ) - ERF( arg1 ) );
+      grad[2] = p[0] * ( EXP( -arg2*arg2 ) - EXP( -arg1*arg1 ) ) /
+	constants::sqrt_pi< DataType >();
+    } else {
+      grad[0] = grad[1] = grad[2] = 0.0;
+    }
+
+    return EXIT_SUCCESS;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int erfc_point( const ConstArrayType& p, DataType x, DataType& val )
   {
@@ -319,6 +507,56 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int erfc_point_grad( const ConstArrayType& p, DataType x,
+			      DataType& val, DataType* grad )
+  {
+
+    if ( EXIT_SUCCESS != erfc_point( p, x, val ) )
+      return EXIT_FAILURE;
+
+    if ( 0.0 != p[2] ) {
+      register DataType arg = ( x - p[1] ) / p[2];
+      register DataType dval = 2.0 * p[0] * EXP( -arg*arg ) /
+	constants::sqrt_pi< DataType >();
+      grad[0] = ERFC( arg );
+      grad[1] = dval / p[2];
+      grad[2] = dval * arg / p[2];
+    } else {
+      grad[0] = ( x > p[1] ) ? 0.0 : 2.0;
+      grad[1] = grad[2] = 0.0;
+    }
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int erfc_integrated_grad( const ConstArrayType& p,
+				   DataType xlo, DataType xhi,
+				   DataType& val, DataType* grad )
+  {
+
+    if ( EXIT_SUCCESS != erfc_integrated( p, xlo, xhi, val ) )
+      return EXIT_FAILURE;
+
+    if ( 0.0 != p[2] ) {
+      register DataType arg1 = ( xlo - p[1] ) / p[2];
+      register DataType arg2 = ( xhi - p[1] ) / p[2];
+      grad[0] = p[2] * ( _erfc_sub1( p, xhi ) - _erfc_sub1( p, xlo ) );
+      grad[1] = - p[0] * ( ERFC( arg2 ) - ERFC( arg1 ) );
+      grad[2] = - p[0] * ( EXP( -arg2*arg2 ) - EXP( -arg1*arg1 ) ) /
+	constants::sqrt_pi< DataType >();
+    } else {
+      grad[0] = grad[1] = grad[2] = 0.0;
+    }
+
+    return EXIT_SUCCESS;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int exp_point( const ConstArrayType& p, DataType x, DataType& val )
   {
@@ -347,6 +585,45 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int exp_point_grad( const ConstArrayType& p, DataType x,
+			     DataType& val, DataType* grad )
+  {
+
+    register DataType e = EXP( p[1] * (x - p[0]));
+    val = p[2] * e;
+    grad[0] = - p[1] * val;
+    grad[1] = (x - p[0]) * val;
+    grad[2] = e;
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int exp_integrated_grad( const ConstArrayType& p,
+				  DataType xlo, DataType xhi,
+				  DataType& val, DataType* grad )
+  {
+
+    if ( p[1] != 0.0 ) {
+      register DataType e2 = EXP(p[1]*(xhi-p[0]));
+      register DataType e1 = EXP(p[1]*(xlo-p[0]));
+      val = (p[2]/p[1])*(e2-e1);
+      grad[0] = -p[2]*(e2-e1);
+      grad[1] = -val/p[1] + (p[2]/p[1])*((xhi-p[0])*e2-(xlo-p[0])*e1);
+      grad[2] = (e2-e1)/p[1];
+    } else {
+      val = p[2]*(xhi-xlo);
+      grad[0] = 0.0;
+      grad[1] = p[2]*((xhi-p[0])*(xhi-p[0])-(xlo-p[0])*(xlo-p[0]))/2.0;
+      grad[2] = xhi-xlo;
+    }
+    return EXIT_SUCCESS;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int exp10_point( const ConstArrayType& p, DataType x,
 			  DataType& val )
@@ -376,6 +653,46 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int exp10_point_grad( const ConstArrayType& p, DataType x,
+			       DataType& val, DataType* grad )
+  {
+
+    register DataType e = POW(10.0, p[1] * (x - p[0]));
+    val = p[2] * e;
+    grad[0] = - LOGTEN * p[1] * val;
+    grad[1] = LOGTEN * (x - p[0]) * val;
+    grad[2] = e;
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int exp10_integrated_grad( const ConstArrayType& p,
+				    DataType xlo, DataType xhi,
+				    DataType& val, DataType* grad )
+  {
+
+    if ( p[1] != 0.0 ) {
+      register DataType e2 = EXP(LOGTEN*p[1]*(xhi-p[0]));
+      register DataType e1 = EXP(LOGTEN*p[1]*(xlo-p[0]));
+      val = (p[2]/p[1]/LOGTEN)*(e2-e1);
+      grad[0] = -p[2]*(e2-e1);
+      grad[1] = -val/p[1] + (p[2]/p[1])*((xhi-p[0])*e2-(xlo-p[0])*e1);
+      grad[2] = (e2-e1)/p[1]/LOGTEN;
+    } else {
+      val = p[2]*(xhi-xlo);
+      grad[0] = 0.0;
+      grad[1] =
+	LOGTEN*p[2]*((xhi-p[0])*(xhi-p[0])-(xlo-p[0])*(xlo-p[0]))/2.0;
+      grad[2] = xhi-xlo;
+    }
+    return EXIT_SUCCESS;
+
+  }
+
+
   //                                                      2
   //                                    GFACTOR (x - p[1])
   //                         p[2] exp(- -------------------)
@@ -421,6 +738,57 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int gauss1d_point_grad( const ConstArrayType& p, DataType x,
+				 DataType& val, DataType* grad )
+  {
+
+    if ( p[0] == 0.0 ) {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+
+    register DataType e =
+      EXP( - GFACTOR * ( x - p[1] ) * ( x - p[1] ) / p[0] / p[0] );
+    val = p[2] * e;
+    grad[1] = 2.0 * GFACTOR * ( x - p[1] ) / p[0] / p[0] * val;
+    grad[0] = grad[1] * ( x - p[1] ) / p[0];
+    grad[2] = e;
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int gauss1d_integrated_grad( const ConstArrayType& p,
+				      DataType xlo, DataType xhi,
+				      DataType& val, DataType* grad )
+  {
+
+    if ( p[0] == 0.0 ) {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+
+    register DataType z2 = SQRT_GFACTOR * ( xhi - p[1] ) / p[0];
+    register DataType z1 = SQRT_GFACTOR * ( xlo - p[1] ) / p[0];
+    register DataType e2 = EXP( -z2*z2 );
+    register DataType e1 = EXP( -z1*z1 );
+    register DataType norm = SQRT_PI * ( ERF(z2) - ERF(z1) ) /
+      ( 2. * SQRT_GFACTOR );
+
+    val =
+      p[2] * p[0] * SQRT_PI * ( ERF(z2) - ERF(z1) ) / ( 2. * SQRT_GFACTOR );
+    grad[0] = p[2] * norm - p[2] * ( z2*e2 - z1*e1 ) / SQRT_GFACTOR;
+    grad[1] = - p[2] * ( e2 - e1 );
+    grad[2] = p[0] * norm;
+
+    return EXIT_SUCCESS;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int log_point( const ConstArrayType& p, DataType x, DataType& val )
   {
@@ -459,6 +827,45 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int log_point_grad( const ConstArrayType& p, DataType x,
+			     DataType& val, DataType* grad )
+  {
+
+    register DataType y = p[1] * (x - p[0]);
+    if ( y > 0.0 ) {
+      val = p[2] * LOG( y );
+      grad[0] = - p[2] * p[1] / y;
+      grad[1] = p[2] / p[1];
+      grad[2] = LOG( y );
+      return EXIT_SUCCESS;
+    } else {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int log_integrated_grad( const ConstArrayType& p,
+				  DataType xlo, DataType xhi,
+				  DataType& val, DataType* grad )
+  {
+
+    if ( EXIT_SUCCESS != log_integrated( p, xlo, xhi, val ) )
+      return EXIT_FAILURE;
+
+    register DataType y1 = p[1]*(xlo-p[0]);
+    register DataType y2 = p[1]*(xhi-p[0]);
+    grad[0] = -p[2]*(LOG(y2)-LOG(y1));
+    grad[1] = p[2]*(y2-y1)/(p[1]*p[1]);
+    grad[2] = (y2*LOG(y2)-y1*LOG(y1)-y2+y1)/p[1];
+    return EXIT_SUCCESS;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int log10_point( const ConstArrayType& p, DataType x,
 			  DataType& val )
@@ -501,38 +908,122 @@ namespace sherpa { namespace models {
 
 
   template <typename DataType, typename ConstArrayType>
-  inline int ngauss1d_point( const ConstArrayType& p, DataType x,
-			     DataType& val )
+  inline int log10_point_grad( const ConstArrayType& p, DataType x,
+			       DataType& val, DataType* grad )
   {
-  
-    if( p[0] == 0.0 ) {
+
+    register DataType y = p[1] * (x - p[0]);
+    if ( y > 0.0 ) {
+      val = p[2] * LOG10( y );
+      grad[0] = - p[2] * p[1] / y / LOGTEN;
+      grad[1] = p[2] / p[1] / LOGTEN;
+      grad[2] = LOG10( y );
+      return EXIT_SUCCESS;
+    } else {
       // val = NAN;
       return EXIT_FAILURE;
     }
 
-    register DataType norm = SQRT(PI/GFACTOR)*p[0];
-    val = (p[2]/norm)*EXP(-GFACTOR*(x-p[1])*(x-p[1])/p[0]/p[0]);
-    return EXIT_SUCCESS;
-
   }
 
 
   template <typename DataType, typename ConstArrayType>
-  inline int ngauss1d_integrated( const ConstArrayType& p,
-				  DataType xlo, DataType xhi, DataType& val )
+  inline int log10_integrated_grad( const ConstArrayType& p,
+				    DataType xlo, DataType xhi,
+				    DataType& val, DataType* grad )
   {
 
-    if( p[0] == 0.0 )
-      // val = NAN
+    if ( EXIT_SUCCESS != log10_integrated( p, xlo, xhi, val ) )
       return EXIT_FAILURE;
-    else {
-      register DataType z2 = SQRT_GFACTOR*((xhi-p[1])/p[0]);
-      register DataType z1 = SQRT_GFACTOR*((xlo-p[1])/p[0]);
-      val = (p[2]*(ERF(z2)-ERF(z1))/2.0);
-      return EXIT_SUCCESS;
-    }
 
-  }
+    register DataType y1 = p[1]*(xlo-p[0]);
+    register DataType y2 = p[1]*(xhi-p[0]);
+    grad[0] = -p[2]*(LOG(y2)-LOG(y1))/LOG(10.0);
+    grad[1] = p[2]*(y2-y1)/(p[1]*p[1])/LOG(10.0);
+    grad[2] = (y2*LOG(y2)-y1*LOG(y1)-y2+y1)/p[1]/LOG(10.0);
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int ngauss1d_point( const ConstArrayType& p, DataType x,
+			     DataType& val )
+  {
+  
+    if( p[0] == 0.0 ) {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+
+    register DataType norm = SQRT(PI/GFACTOR)*p[0];
+    val = (p[2]/norm)*EXP(-GFACTOR*(x-p[1])*(x-p[1])/p[0]/p[0]);
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int ngauss1d_integrated( const ConstArrayType& p,
+				  DataType xlo, DataType xhi, DataType& val )
+  {
+
+    if( p[0] == 0.0 )
+      // val = NAN
+      return EXIT_FAILURE;
+    else {
+      register DataType z2 = SQRT_GFACTOR*((xhi-p[1])/p[0]);
+      register DataType z1 = SQRT_GFACTOR*((xlo-p[1])/p[0]);
+      val = (p[2]*(ERF(z2)-ERF(z1))/2.0);
+      return EXIT_SUCCESS;
+    }
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int ngauss1d_point_grad( const ConstArrayType& p, DataType x,
+				  DataType& val, DataType* grad )
+  {
+
+    if( p[0] == 0.0 ) {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+
+    register DataType norm = SQRT(PI/GFACTOR)*p[0];
+    register DataType e = EXP(-GFACTOR*(x-p[1])*(x-p[1])/p[0]/p[0]);
+    val = (p[2]/norm)*e;
+    grad[1] = 2.0*GFACTOR*(x-p[1])/p[0]/p[0]*val;
+    grad[0] = grad[1]*(x-p[1])/p[0] - val/p[0];
+    grad[2] = e/norm;
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int ngauss1d_integrated_grad( const ConstArrayType& p,
+				       DataType xlo, DataType xhi,
+				       DataType& val, DataType* grad )
+  {
+
+    if( p[0] == 0.0 )
+      // val = NAN
+      return EXIT_FAILURE;
+    else {
+      register DataType z2 = SQRT_GFACTOR*((xhi-p[1])/p[0]);
+      register DataType z1 = SQRT_GFACTOR*((xlo-p[1])/p[0]);
+      register DataType e2 = EXP(-z2*z2);
+      register DataType e1 = EXP(-z1*z1);
+      val = (p[2]*(ERF(z2)-ERF(z1))/2.0);
+      grad[0] = -p[2]*(z2*e2-z1*e1)/(SQRT_PI*p[0]);
+      grad[1] = -p[2]*SQRT_GFACTOR*(e2-e1)/(SQRT_PI*p[0]);
+      grad[2] = (ERF(z2)-ERF(z1))/2.0;
+      return EXIT_SUCCESS;
+    }
+
+  }
 
 
   template <typename DataType, typename ConstArrayType>
@@ -563,6 +1054,20 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int poisson_point_grad( const ConstArrayType& p, DataType x,
+				 DataType& val, DataType* grad )
+  {
+
+    return sherpa::utils::fd_point_grad
+      ( 2, poisson_point< DataType,
+			  sherpa::utils::shifted_pars< ConstArrayType,
+						       DataType > >,
+	p, x, val, grad );
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int poly1d_point( const ConstArrayType& p, DataType x, DataType& val )
   {
@@ -599,6 +1104,55 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int poly1d_point_grad( const ConstArrayType& p, DataType x,
+				DataType& val, DataType* grad )
+  {
+
+    register DataType xtemp = x - p[9];
+    register DataType retval = p[8];
+    register DataType deriv = 0.0;
+    register DataType xpow = 1.0;
+    int ii;
+    for ( ii = 7; ii >= 0; ii--) {
+      deriv = deriv*xtemp + retval;
+      retval = retval*xtemp + p[ii];
+    }
+    for ( ii = 0; ii <= 8; ii++) {
+      grad[ii] = xpow;
+      xpow *= xtemp;
+    }
+    grad[9] = -deriv;
+    val = retval;
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int poly1d_integrated_grad( const ConstArrayType& p,
+				     DataType xlo, DataType xhi,
+				     DataType& val, DataType* grad )
+  {
+
+    register DataType xtemp1 = xlo - p[9];
+    register DataType xtemp2 = xhi - p[9];
+    register DataType retval = 0.0;
+    register DataType deriv = 0.0;
+    int ii;
+    for( ii = 0; ii <= 8; ii++) {
+      register DataType pexp = (DataType)(ii+1);
+      grad[ii] = (POW(xtemp2,pexp)-POW(xtemp1,pexp))/pexp;
+      retval += p[ii]*grad[ii];
+      deriv += p[ii]*(POW(xtemp2,pexp-1.0)-POW(xtemp1,pexp-1.0));
+    }
+    grad[9] = -deriv;
+    val = retval;
+    return EXIT_SUCCESS;
+
+  }
+
+
   //
   //                                    /  x \(- p[0])
   //                               p[2] |----|
@@ -654,6 +1208,61 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int powlaw_point_grad( const ConstArrayType& p, DataType x,
+				DataType& val, DataType* grad )
+  {
+
+    grad[0] = grad[1] = grad[2] = 0.0;
+    if ( EXIT_SUCCESS != powlaw_point( p, x, val ) )
+      return EXIT_FAILURE;
+
+    grad[2] = POW( x / p[ 1 ], - p[ 0 ] );
+    // The log term vanishes with the value at x = 0
+    if ( 0.0 != val )
+      grad[0] = - val * LOG( x / p[ 1 ] );
+    grad[1] = val * p[ 0 ] / p[ 1 ];
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int powlaw_integrated_grad( const ConstArrayType& p,
+				     DataType xlo, DataType xhi,
+				     DataType& val, DataType* grad )
+  {
+
+    grad[0] = grad[1] = grad[2] = 0.0;
+    if ( EXIT_SUCCESS != powlaw_integrated( p, xlo, xhi, val ) )
+      return EXIT_FAILURE;
+
+    if ( p[0] == 1.0 ) {
+      if ( !( xlo > 0.0 ) )
+	xlo = SMP_MIN;
+      register DataType llo = LOG(xlo);
+      register DataType lhi = LOG(xhi);
+      grad[0] = val * LOG(p[1]) - p[2] * p[1] * ( lhi*lhi - llo*llo ) / 2.0;
+      grad[2] = p[1] * ( lhi - llo );
+    } else {
+      register DataType e = 1.0-p[0];
+      register DataType plo = POW( xlo, e );
+      register DataType phi = POW( xhi, e );
+      register DataType norm = p[2] / POW( p[1], -p[0] );
+      // x^e log(x) vanishes at x = 0 for the e > 0 that keep val finite
+      register DataType llo = ( xlo > 0.0 ) ? plo * LOG(xlo) : 0.0;
+      register DataType lhi = ( xhi > 0.0 ) ? phi * LOG(xhi) : 0.0;
+      grad[0] = val * LOG(p[1]) +
+	norm * ( ( phi - plo ) / ( e * e ) - ( lhi - llo ) / e );
+      grad[2] = ( phi / e - plo / e ) / POW( p[1], -p[0] );
+    }
+    grad[1] = val * p[0] / p[1];
+
+    return EXIT_SUCCESS;
+
+  }
+
+
   //
   //                                    /  x \ - p[1] - p[2] * log10(x/p[0])
   //                               p[3] |----|
@@ -680,6 +1289,33 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int logparabola_point_grad( const ConstArrayType& p, DataType x,
+				     DataType& val, DataType* grad )
+  {
+
+    if ( p[0] != 0 ) {
+
+      register DataType frac = (x / p[0]);
+
+      if ( frac > 0.0 ) {
+	register DataType lfrac = LOG10( frac );
+	register DataType f = POW( frac, - p[1] - p[2] * lfrac );
+	val = p[3] * f;
+	grad[0] = val * ( p[1] + 2.0 * p[2] * lfrac ) / p[0];
+	grad[1] = - val * LOG( frac );
+	grad[2] = - val * LOG( frac ) * lfrac;
+	grad[3] = f;
+	return EXIT_SUCCESS;
+      }
+
+    }
+
+    val = 0.0;
+    return EXIT_FAILURE;
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int sin_point( const ConstArrayType& p, DataType x, DataType& val )
   {
@@ -712,6 +1348,50 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int sin_point_grad( const ConstArrayType& p, DataType x,
+			     DataType& val, DataType* grad )
+  {
+
+    if ( 0.0 == p[0] ) {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+    register DataType tmp = TWOPI*(x-p[1])/p[0];
+    register DataType c = COS(tmp);
+    register DataType s = SIN(tmp);
+    val = p[2]*s;
+    grad[0] = -p[2]*c*tmp/p[0];
+    grad[1] = -p[2]*c*TWOPI/p[0];
+    grad[2] = s;
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int sin_integrated_grad( const ConstArrayType& p,
+				  DataType xlo, DataType xhi,
+				  DataType& val, DataType* grad )
+  {
+
+    if ( 0.0 == p[0] ) {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+    register DataType tmp1 = TWOPI*(xlo-p[1])/p[0];
+    register DataType tmp2 = TWOPI*(xhi-p[1])/p[0];
+    register DataType s1 = SIN(tmp1);
+    register DataType s2 = SIN(tmp2);
+    val = -1.0*p[2]*p[0]*(COS(tmp2)-COS(tmp1))/TWOPI;
+    grad[0] = val/p[0] - p[2]*(tmp2*s2-tmp1*s1)/TWOPI;
+    grad[1] = -p[2]*(s2-s1);
+    grad[2] = -1.0*p[0]*(COS(tmp2)-COS(tmp1))/TWOPI;
+    return EXIT_SUCCESS;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int sqrt_point( const ConstArrayType& p, DataType x, DataType& val )
   {
@@ -747,6 +1427,47 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int sqrt_point_grad( const ConstArrayType& p, DataType x,
+			      DataType& val, DataType* grad )
+  {
+
+    if ( (x-p[0]) < 0.0 ) {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+
+    register DataType s = SQRT(x-p[0]);
+    val = p[1]*s;
+    // The slope is infinite at x = p[0]
+    grad[0] = ( 0.0 == s ) ? 0.0 : -p[1]/(2.0*s);
+    grad[1] = s;
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int sqrt_integrated_grad( const ConstArrayType& p,
+				   DataType xlo, DataType xhi,
+				   DataType& val, DataType* grad )
+  {
+
+    if( (xlo-p[0]) < 0.0 || (xhi-p[0]) < 0.0 ) {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+
+    register DataType tmp1 = POW(xlo-p[0], 1.50);
+    register DataType tmp2 = POW(xhi-p[0], 1.50);
+    val = 2.0*p[1]*(tmp2-tmp1)/3.0;
+    grad[0] = -p[1]*(SQRT(xhi-p[0])-SQRT(xlo-p[0]));
+    grad[1] = 2.0*(tmp2-tmp1)/3.0;
+    return EXIT_SUCCESS;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int stephi1d_point( const ConstArrayType& p, DataType x,
 			     DataType& val )
@@ -785,6 +1506,40 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int stephi1d_point_grad( const ConstArrayType& p, DataType x,
+				  DataType& val, DataType* grad )
+  {
+
+    grad[0] = 0.0;
+    grad[1] = ( x >= p[0] ) ? 1.0 : 0.0;
+    return stephi1d_point( p, x, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int stephi1d_integrated_grad( const ConstArrayType& p,
+				       DataType xlo, DataType xhi,
+				       DataType& val, DataType* grad )
+  {
+
+    if( xlo <= p[0] && xhi >= p[0] ) {
+      grad[0] = -p[1];
+      grad[1] = xhi - p[0];
+    }
+    else if( xlo > p[0] ) {
+      grad[0] = 0.0;
+      grad[1] = xhi - xlo;
+    }
+    else {
+      grad[0] = grad[1] = 0.0;
+    }
+    return stephi1d_integrated( p, xlo, xhi, val );
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int steplo1d_point( const ConstArrayType& p, DataType x,
 			     DataType& val )
@@ -823,6 +1578,40 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int steplo1d_point_grad( const ConstArrayType& p, DataType x,
+				  DataType& val, DataType* grad )
+  {
+
+    grad[0] = 0.0;
+    grad[1] = ( x <= p[0] ) ? 1.0 : 0.0;
+    return steplo1d_point( p, x, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int steplo1d_integrated_grad( const ConstArrayType& p,
+				       DataType xlo, DataType xhi,
+				       DataType& val, DataType* grad )
+  {
+
+    if( xlo <= p[0] && xhi >= p[0] ) {
+      grad[0] = p[1];
+      grad[1] = p[0] - xlo;
+    }
+    else if( xhi < p[0] ) {
+      grad[0] = 0.0;
+      grad[1] = xhi - xlo;
+    }
+    else {
+      grad[0] = grad[1] = 0.0;
+    }
+    return steplo1d_integrated( p, xlo, xhi, val );
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int tan_point( const ConstArrayType& p, DataType x, DataType& val )
   {
@@ -855,17 +1644,60 @@ namespace sherpa { namespace models {
   }
 
 
-  // =============================================================
-
-
   template <typename DataType, typename ConstArrayType>
-  inline int box2d_point( const ConstArrayType& p,
-			  DataType x0, DataType x1, DataType& val )
+  inline int tan_point_grad( const ConstArrayType& p, DataType x,
+			     DataType& val, DataType* grad )
   {
-  
-    if ( p[1] <= x0 || p[0] >= x0 || p[3] <= x1 || p[2] >= x1 )
-      val = 0.0;
-    else
+
+    if ( 0.0 == p[0] ) {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+    register DataType tmp = TWOPI*(x-p[1])/p[0];
+    register DataType t = TAN(tmp);
+    val = p[2]*t;
+    grad[0] = -p[2]*(1.0+t*t)*tmp/p[0];
+    grad[1] = -p[2]*(1.0+t*t)*TWOPI/p[0];
+    grad[2] = t;
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int tan_integrated_grad( const ConstArrayType& p,
+				  DataType xlo, DataType xhi,
+				  DataType& val, DataType* grad )
+  {
+
+    if ( 0.0 == p[0] ) {
+      // val = NAN;
+      return EXIT_FAILURE;
+    }
+    register DataType tmp1 = TWOPI*(xlo-p[1])/p[0];
+    register DataType tmp2 = TWOPI*(xhi-p[1])/p[0];
+    register DataType t1 = TAN(tmp1);
+    register DataType t2 = TAN(tmp2);
+    val = -1.0*p[2]*p[0]*(LOG(COS(tmp2))-LOG(COS(tmp1)))/TWOPI;
+    grad[0] = val/p[0] - p[2]*(tmp2*t2-tmp1*t1)/TWOPI;
+    grad[1] = -p[2]*(t2-t1);
+    grad[2] = -1.0*p[0]*(LOG(COS(tmp2))-LOG(COS(tmp1)))/TWOPI;
+    return EXIT_SUCCESS;
+
+  }
+
+
+  // =============================================================
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int box2d_point( const ConstArrayType& p,
+			  DataType x0, DataType x1, DataType& val )
+  {
+  
+    if ( p[1] <= x0 || p[0] >= x0 || p[3] <= x1 || p[2] >= x1 )
+      val = 0.0;
+    else
       val = p[4];
     return EXIT_SUCCESS;
 
@@ -891,6 +1723,50 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int box2d_point_grad( const ConstArrayType& p,
+			       DataType x0, DataType x1, DataType& val,
+			       DataType* grad )
+  {
+
+    grad[0] = grad[1] = grad[2] = grad[3] = 0.0;
+    grad[4] = ( p[1] <= x0 || p[0] >= x0 || p[3] <= x1 || p[2] >= x1 ) ?
+      0.0 : 1.0;
+    return box2d_point( p, x0, x1, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int box2d_integrated_grad( const ConstArrayType& p,
+				    DataType x0lo, DataType x0hi,
+				    DataType x1lo, DataType x1hi,
+				    DataType& val, DataType* grad )
+  {
+
+    grad[0] = grad[1] = grad[2] = grad[3] = grad[4] = 0.0;
+    if ( p[1] <= x0lo || p[0] >= x0hi || p[3] <= x1lo || p[2] >= x1hi ) {
+      val = 0.0;
+      return EXIT_SUCCESS;
+    } else {
+      register DataType x0frac = (std::min(x0hi,p[1])-std::max(x0lo,p[0]))/(x0hi-x0lo);
+      register DataType x1frac = (std::min(x1hi,p[3])-std::max(x1lo,p[2]))/(x1hi-x1lo);
+      val = p[4]*x0frac*x1frac;
+      if ( p[0] > x0lo )
+	grad[0] = -p[4]*x1frac/(x0hi-x0lo);
+      if ( p[1] < x0hi )
+	grad[1] = p[4]*x1frac/(x0hi-x0lo);
+      if ( p[2] > x1lo )
+	grad[2] = -p[4]*x0frac/(x1hi-x1lo);
+      if ( p[3] < x1hi )
+	grad[3] = p[4]*x0frac/(x1hi-x1lo);
+      grad[4] = x0frac*x1frac;
+      return EXIT_SUCCESS;
+    }
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int const2d_point( const ConstArrayType& p,
 			    DataType x0, DataType x1, DataType& val )
@@ -916,6 +1792,35 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int const2d_point_grad( const ConstArrayType& p,
+				 DataType x0, DataType x1, DataType& val,
+				 DataType* grad )
+  {
+
+    (void)x0;
+    (void)x1;
+    val = p[0];
+    grad[0] = 1.0;
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int const2d_integrated_grad( const ConstArrayType& p,
+				      DataType x0lo, DataType x0hi,
+				      DataType x1lo, DataType x1hi,
+				      DataType& val, DataType* grad )
+  {
+
+    val = p[0]*(x1hi-x1lo)*(x0hi-x0lo);
+    grad[0] = (x1hi-x1lo)*(x0hi-x0lo);
+    return EXIT_SUCCESS;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int delta2d_point( const ConstArrayType& p,
 			    DataType x0, DataType x1, DataType& val )
@@ -947,6 +1852,35 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int delta2d_point_grad( const ConstArrayType& p,
+				 DataType x0, DataType x1, DataType& val,
+				 DataType* grad )
+  {
+
+    grad[0] = grad[1] = 0.0;
+    grad[2] = ( p[0] == x0 && p[1] == x1 ) ? 1.0 : 0.0;
+    return delta2d_point( p, x0, x1, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int delta2d_integrated_grad( const ConstArrayType& p,
+				      DataType x0lo, DataType x0hi,
+				      DataType x1lo, DataType x1hi,
+				      DataType& val, DataType* grad )
+  {
+
+    grad[0] = grad[1] = 0.0;
+    grad[2] =
+      ( p[0] >= x0lo && p[0] < x0hi && p[1] >= x1lo && p[1] < x1hi ) ?
+      1.0 : 0.0;
+    return delta2d_integrated( p, x0lo, x0hi, x1lo, x1hi, val );
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int gauss2d_point( const ConstArrayType& p,
 			    DataType x0, DataType x1, DataType& val )
@@ -967,63 +1901,72 @@ namespace sherpa { namespace models {
   }
 
 
-  // FIXME: work the analytic part of this back in
-  /*
+  template <typename DataType, typename ConstArrayType>
+  inline int gauss2d_point_grad( const ConstArrayType& p,
+				 DataType x0, DataType x1, DataType& val,
+				 DataType* grad )
+  {
+
+    register DataType r = 0.0;
+
+    if( EXIT_SUCCESS != sherpa::utils::radius2_grad(p, x0, x1, r,
+						    grad + 1)) {
+      return EXIT_FAILURE;
+    }
+    if( p[0] == 0.0 )
+      return EXIT_FAILURE;
+    else {
+      register DataType e = EXP(-r/(p[0]*p[0])*GFACTOR);
+      val = p[5]*e;
+      register DataType dr = -GFACTOR/(p[0]*p[0])*val;
+      grad[0] = 2.0*GFACTOR*r/(p[0]*p[0]*p[0])*val;
+      for ( int ii = 1; ii <= 4; ii++ )
+	grad[ii] *= dr;
+      grad[5] = e;
+      return EXIT_SUCCESS;
+    }
+
+  }
+
+
+  // The integral of exp(-GFACTOR ((x - mid) / width)^2) over [lo, hi]
+  template <typename DataType>
+  inline DataType gauss_integral( DataType lo, DataType hi, DataType mid,
+				  DataType width )
+  {
+    return width*SQRT(PI/GFACTOR)/2.0*
+      sherpa::utils::erf_difference(SQRT_GFACTOR*(lo-mid)/width,
+				    SQRT_GFACTOR*(hi-mid)/width);
+  }
+
+
+  // The elliptical Gaussians integrate in closed form over a pixel when
+  // their axes lie along the grid (see radius2_axes); other parameter
+  // values are left to sherpa::quadrature
+  template <typename DataType, typename ConstArrayType>
+  inline bool gauss2d_separable( const ConstArrayType& p )
+  {
+    DataType scale0, scale1;
+    return ( p[0] != 0.0 &&
+	     sherpa::utils::radius2_axes(p, scale0, scale1) );
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int gauss2d_integrated( const ConstArrayType& p,
 				 DataType x0lo, DataType x0hi,
 				 DataType x1lo, DataType x1hi, DataType& val )
   {
 
-    if ( p[3] == 0 ) {
-      if ( 0 == p[0] ) {
-	return EXIT_FAILURE;
-      } else {
-	DataType prefix = p[5]*p[0]*p[0]*PI/(4.0*GFACTOR);
-	DataType zx2 = SQRT_GFACTOR*((x0hi-p[1])/p[0]);
-	DataType zx1 = SQRT_GFACTOR*((x0lo-p[1])/p[0]);
-	DataType zy2 = SQRT_GFACTOR*((x1hi-p[2])/p[0]);
-	DataType zy1 = SQRT_GFACTOR*((x1lo-p[2])/p[0]);
-	val = prefix*(ERF(zx2)-ERF(zx1))*(ERF(zy2)-ERF(zy1));
-	return EXIT_SUCCESS;
-      }
-    } else {
-      DataType lolft;
-      DataType lorgt;
-      DataType hilft;
-      DataType hirgt;
-
-      if( EXIT_SUCCESS != gauss2d_point(p,x0lo,x1lo, lolft)) {
-	return EXIT_FAILURE;
-      }
-    
-      if( EXIT_SUCCESS != gauss2d_point(p,x0hi,x1lo, lorgt)) {
-	return EXIT_FAILURE;
-      }
-    
-      if( EXIT_SUCCESS != gauss2d_point(p,x0lo,x1hi, hilft)) {
-	return EXIT_FAILURE;
-      }
-    
-      if( EXIT_SUCCESS != gauss2d_point(p,x0hi,x1hi, hirgt)) {
-	return EXIT_FAILURE;
-      }
-      if( EXIT_SUCCESS !=
-	  sherpa::utils::numerical_integration2d
-	  ( gauss2d_point< DataType, ConstArrayType >,
-	    p, x0lo, x0hi, x1lo, x1hi, lolft, lorgt,
-	    hilft, hirgt, val )) {
-	return EXIT_FAILURE;
-      }
-      else
-	return EXIT_SUCCESS;
-    }
+    DataType scale0, scale1;
+    if( p[0] == 0.0 || !sherpa::utils::radius2_axes(p, scale0, scale1) )
+      return EXIT_FAILURE;
 
-    val = 0.0;
+    val = p[5]*gauss_integral(x0lo, x0hi, DataType(p[1]), p[0]*scale0)*
+      gauss_integral(x1lo, x1hi, DataType(p[2]), p[0]*scale1);
     return EXIT_SUCCESS;
 
   }
-  */
 
 
   template <typename DataType, typename ConstArrayType>
@@ -1047,6 +1990,59 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int ngauss2d_point_grad( const ConstArrayType& p,
+				  DataType x0, DataType x1, DataType& val,
+				  DataType* grad )
+  {
+
+    register DataType r = 0.0;
+
+    if( EXIT_SUCCESS != sherpa::utils::radius2_grad(p, x0, x1, r,
+						    grad + 1)) {
+      return EXIT_FAILURE;
+    }
+    if( p[0] == 0.0 )
+      return EXIT_FAILURE;
+    else {
+      register DataType norm = (PI/GFACTOR)*p[0]*p[0]*SQRT(1.0 - (p[3]*p[3]));
+      register DataType e = EXP(-r/(p[0]*p[0])*GFACTOR);
+      val = (p[5]/norm)*e;
+      register DataType dr = -GFACTOR/(p[0]*p[0])*val;
+      grad[0] = (2.0*GFACTOR*r/(p[0]*p[0]) - 2.0)/p[0]*val;
+      for ( int ii = 1; ii <= 4; ii++ )
+	grad[ii] *= dr;
+      // the ellipticity also enters the normalization
+      grad[3] += val*p[3]/(1.0 - (p[3]*p[3]));
+      grad[5] = e/norm;
+      return EXIT_SUCCESS;
+    }
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline bool ngauss2d_separable( const ConstArrayType& p )
+  {
+    return gauss2d_separable< DataType, ConstArrayType >( p );
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int ngauss2d_integrated( const ConstArrayType& p,
+				  DataType x0lo, DataType x0hi,
+				  DataType x1lo, DataType x1hi, DataType& val )
+  {
+
+    if( EXIT_SUCCESS != gauss2d_integrated(p, x0lo, x0hi, x1lo, x1hi, val) )
+      return EXIT_FAILURE;
+
+    val /= (PI/GFACTOR)*p[0]*p[0]*SQRT(1.0 - (p[3]*p[3]));
+    return EXIT_SUCCESS;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int poly2d_point( const ConstArrayType& p,
 			   DataType x0, DataType x1, DataType& val )
@@ -1094,6 +2090,436 @@ namespace sherpa { namespace models {
   }
 
 
+  template <typename DataType, typename ConstArrayType>
+  inline int poly2d_point_grad( const ConstArrayType& p,
+				DataType x0, DataType x1, DataType& val,
+				DataType* grad )
+  {
+
+    register int ix;
+    register int iy;
+    register DataType retval = 0.0;
+    for ( ix = 0 ; ix < 3 ; ix++ ) {
+      for ( iy = 0 ; iy < 3 ; iy++ ) {
+	grad[3*ix+iy] = POW(x0,(DataType)ix)*POW(x1,(DataType)iy);
+	retval += grad[3*ix+iy]*p[3*ix+iy];
+      }
+    }
+    val = retval;
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int poly2d_integrated_grad( const ConstArrayType& p,
+				     DataType x0lo, DataType x0hi,
+				     DataType x1lo, DataType x1hi,
+				     DataType& val, DataType* grad )
+  {
+
+    register int ix;
+    register int iy;
+    register DataType retval = 0.0;
+    register DataType u[3];
+    register DataType v[3];
+    u[0] = x0hi - x0lo;
+    u[1] = (POW(x0hi,2.0)/2.0) - (POW(x0lo,2.0)/2.0);
+    u[2] = (POW(x0hi,3.0)/3.0) - (POW(x0lo,3.0)/3.0);
+    v[0] = x1hi - x1lo;
+    v[1] = (POW(x1hi,2.0)/2.0) - (POW(x1lo,2.0)/2.0);
+    v[2] = (POW(x1hi,3.0)/3.0) - (POW(x1lo,3.0)/3.0);
+    for ( ix = 0 ; ix < 3 ; ix++ ) {
+      for ( iy = 0 ; iy < 3 ; iy++ ) {
+	grad[3*ix+iy] = u[ix]*v[iy];
+	retval += u[ix]*v[iy]*p[3*ix+iy];
+      }
+    }
+    val = retval;
+    return EXIT_SUCCESS;
+
+  }
+
+
+  //
+  // Batch versions of the most heavily used 1D kernels, registered with
+  // MODELFCT1D_VEC.  Each one evaluates a whole contiguous grid with the
+  // vector routines in vecmath.hh, and runs the scalar kernel above over
+  // the grid instead when there is no vector unit or for parameter values
+  // the vector code does not cover.
+  //
+
+SHERPA_VEC_BEGIN
+
+  struct gauss_point_kernel {
+
+    gauss_point_kernel( double x0, double c, double a )
+      : pos( x0 ), scale( c ), ampl( a ) { }
+
+    template <typename V, typename M>
+    SHERPA_VEC_INLINE V operator()( V x, M& fail ) const
+    {
+      V dx = x - pos;
+      return ampl * vecmath::vexp( - scale * dx * dx );
+    }
+
+    double pos, scale, ampl;
+
+  };
+
+
+  struct gauss_integrated_kernel {
+
+    gauss_integrated_kernel( double x0, double c, double a )
+      : pos( x0 ), scale( c ), ampl( a ) { }
+
+    template <typename V, typename M>
+    SHERPA_VEC_INLINE V operator()( V xlo, V xhi, M& fail ) const
+    {
+      return ampl * ( vecmath::verf( ( xhi - pos ) * scale ) -
+		      vecmath::verf( ( xlo - pos ) * scale ) );
+    }
+
+    double pos, scale, ampl;
+
+  };
+
+
+  template <typename DataType, typename ConstArrayType, typename IndexType>
+  inline int gauss1d_point_vec( const ConstArrayType& p, IndexType nelem,
+				const DataType* x, DataType* val )
+  {
+
+    if ( p[0] != 0.0 ) {
+      IndexType nfail = vecmath::apply
+	( gauss_point_kernel( p[1], GFACTOR / p[0] / p[0], p[2] ),
+	  nelem, x, val );
+      if ( nfail >= 0 )
+	return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+    }
+
+    return vecmath::scalar_point_loop
+      < DataType, ConstArrayType, IndexType,
+	gauss1d_point< DataType, ConstArrayType > >( p, nelem, x, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType, typename IndexType>
+  inline int gauss1d_integrated_vec( const ConstArrayType& p, IndexType nelem,
+				     const DataType* xlo, const DataType* xhi,
+				     DataType* val )
+  {
+
+    if ( p[0] != 0.0 ) {
+      IndexType nfail = vecmath::apply
+	( gauss_integrated_kernel( p[1], SQRT_GFACTOR / p[0],
+				   p[2] * p[0] * SQRT_PI /
+				   ( 2. * SQRT_GFACTOR ) ),
+	  nelem, xlo, xhi, val );
+      if ( nfail >= 0 )
+	return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+    }
+
+    return vecmath::scalar_integrated_loop
+      < DataType, ConstArrayType, IndexType,
+	gauss1d_integrated< DataType, ConstArrayType > >( p, nelem,
+							  xlo, xhi, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType, typename IndexType>
+  inline int ngauss1d_point_vec( const ConstArrayType& p, IndexType nelem,
+				 const DataType* x, DataType* val )
+  {
+
+    if ( p[0] != 0.0 ) {
+      IndexType nfail = vecmath::apply
+	( gauss_point_kernel( p[1], GFACTOR / p[0] / p[0],
+			      p[2] / ( SQRT(PI/GFACTOR) * p[0] ) ),
+	  nelem, x, val );
+      if ( nfail >= 0 )
+	return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+    }
+
+    return vecmath::scalar_point_loop
+      < DataType, ConstArrayType, IndexType,
+	ngauss1d_point< DataType, ConstArrayType > >( p, nelem, x, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType, typename IndexType>
+  inline int ngauss1d_integrated_vec( const ConstArrayType& p,
+				      IndexType nelem, const DataType* xlo,
+				      const DataType* xhi, DataType* val )
+  {
+
+    if ( p[0] != 0.0 ) {
+      IndexType nfail = vecmath::apply
+	( gauss_integrated_kernel( p[1], SQRT_GFACTOR / p[0], p[2] / 2.0 ),
+	  nelem, xlo, xhi, val );
+      if ( nfail >= 0 )
+	return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+    }
+
+    return vecmath::scalar_integrated_loop
+      < DataType, ConstArrayType, IndexType,
+	ngauss1d_integrated< DataType, ConstArrayType > >( p, nelem,
+							   xlo, xhi, val );
+
+  }
+
+
+  struct erf_point_kernel {
+
+    erf_point_kernel( double x0, double w, double a )
+      : pos( x0 ), width( w ), ampl( a ) { }
+
+    template <typename V, typename M>
+    SHERPA_VEC_INLINE V operator()( V x, M& fail ) const
+    {
+      return ampl * vecmath::verf( ( x - pos ) / width );
+    }
+
+    double pos, width, ampl;
+
+  };
+
+
+  struct erf_integrated_kernel {
+
+    erf_integrated_kernel( double x0, double w, double a )
+      : pos( x0 ), width( w ), ampl( a ) { }
+
+    // See _erf_sub1()
+    template <typename V>
+    SHERPA_VEC_INLINE V sub( V x ) const
+    {
+      V arg = ( x - pos ) / width;
+      return arg * vecmath::verf( arg ) + vecmath::vexp( - arg * arg ) /
+	constants::sqrt_pi< double >();
+    }
+
+    template <typename V, typename M>
+    SHERPA_VEC_INLINE V operator()( V xlo, V xhi, M& fail ) const
+    {
+      return ( sub( xhi ) - sub( xlo ) ) * ampl;
+    }
+
+    double pos, width, ampl;
+
+  };
+
+
+  template <typename DataType, typename ConstArrayType, typename IndexType>
+  inline int erf_point_vec( const ConstArrayType& p, IndexType nelem,
+			    const DataType* x, DataType* val )
+  {
+
+    if ( 0.0 != p[2] ) {
+      IndexType nfail = vecmath::apply( erf_point_kernel( p[1], p[2], p[0] ),
+					nelem, x, val );
+      if ( nfail >= 0 )
+	return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+    }
+
+    return vecmath::scalar_point_loop
+      < DataType, ConstArrayType, IndexType,
+	erf_point< DataType, ConstArrayType > >( p, nelem, x, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType, typename IndexType>
+  inline int erf_integrated_vec( const ConstArrayType& p, IndexType nelem,
+				 const DataType* xlo, const DataType* xhi,
+				 DataType* val )
+  {
+
+    if ( 0.0 != p[2] ) {
+      IndexType nfail = vecmath::apply
+	( erf_integrated_kernel( p[1], p[2], p[0] * p[2] ),
+	  nelem, xlo, xhi, val );
+      if ( nfail >= 0 )
+	return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+    }
+
+    return vecmath::scalar_integrated_loop
+      < DataType, ConstArrayType, IndexType,
+	erf_integrated< DataType, ConstArrayType > >( p, nelem,
+						      xlo, xhi, val );
+
+  }
+
+
+  struct exp_point_kernel {
+
+    exp_point_kernel( double x0, double k, double a )
+      : offset( x0 ), coeff( k ), ampl( a ) { }
+
+    template <typename V, typename M>
+    SHERPA_VEC_INLINE V operator()( V x, M& fail ) const
+    {
+      return ampl * vecmath::vexp( coeff * ( x - offset ) );
+    }
+
+    double offset, coeff, ampl;
+
+  };
+
+
+  struct exp_integrated_kernel {
+
+    exp_integrated_kernel( double x0, double k, double a )
+      : offset( x0 ), coeff( k ), ampl( a ) { }
+
+    template <typename V, typename M>
+    SHERPA_VEC_INLINE V operator()( V xlo, V xhi, M& fail ) const
+    {
+      return ( ampl / coeff ) * ( vecmath::vexp( coeff * ( xhi - offset ) ) -
+				  vecmath::vexp( coeff * ( xlo - offset ) ) );
+    }
+
+    double offset, coeff, ampl;
+
+  };
+
+
+  template <typename DataType, typename ConstArrayType, typename IndexType>
+  inline int exp_point_vec( const ConstArrayType& p, IndexType nelem,
+			    const DataType* x, DataType* val )
+  {
+
+    IndexType nfail = vecmath::apply( exp_point_kernel( p[0], p[1], p[2] ),
+				      nelem, x, val );
+    if ( nfail >= 0 )
+      return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+    return vecmath::scalar_point_loop
+      < DataType, ConstArrayType, IndexType,
+	exp_point< DataType, ConstArrayType > >( p, nelem, x, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType, typename IndexType>
+  inline int exp_integrated_vec( const ConstArrayType& p, IndexType nelem,
+				 const DataType* xlo, const DataType* xhi,
+				 DataType* val )
+  {
+
+    if ( p[1] != 0.0 ) {
+      IndexType nfail = vecmath::apply
+	( exp_integrated_kernel( p[0], p[1], p[2] ), nelem, xlo, xhi, val );
+      if ( nfail >= 0 )
+	return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+    }
+
+    return vecmath::scalar_integrated_loop
+      < DataType, ConstArrayType, IndexType,
+	exp_integrated< DataType, ConstArrayType > >( p, nelem,
+						      xlo, xhi, val );
+
+  }
+
+
+  struct powlaw_point_kernel {
+
+    powlaw_point_kernel( double g, double r, double a )
+      : gamma( g ), ref( r ), ampl( a ) { }
+
+    template <typename V, typename M>
+    SHERPA_VEC_INLINE V operator()( V x, M& fail ) const
+    {
+      M neg = x < 0.0;
+      fail |= neg;
+      return vecmath::select( neg, V(),
+			      ampl * vecmath::vpow( x / ref, - gamma ) );
+    }
+
+    double gamma, ref, ampl;
+
+  };
+
+
+  struct powlaw_integrated_kernel {
+
+    // For gamma == 1 the integral is ampl * ( log(xhi) - log(xlo) )
+    powlaw_integrated_kernel( double g, double a )
+      : gamma( g ), ampl( a ) { }
+
+    template <typename V, typename M>
+    SHERPA_VEC_INLINE V operator()( V xlo, V xhi, M& fail ) const
+    {
+
+      M neg = xlo < 0.0;
+      fail |= neg;
+
+      V val;
+      if ( gamma == 1.0 ) {
+	xlo = vecmath::select( xlo > 0.0, xlo,
+			       V() + constants::smp_min< double >() );
+	val = ampl * ( vecmath::vlog( xhi ) - vecmath::vlog( xlo ) );
+      } else {
+	val = ampl * ( vecmath::vpow( xhi, 1.0 - gamma ) -
+		       vecmath::vpow( xlo, 1.0 - gamma ) );
+      }
+
+      return vecmath::select( neg, V(), val );
+
+    }
+
+    double gamma, ampl;
+
+  };
+
+
+  template <typename DataType, typename ConstArrayType, typename IndexType>
+  inline int powlaw_point_vec( const ConstArrayType& p, IndexType nelem,
+			       const DataType* x, DataType* val )
+  {
+
+    IndexType nfail = vecmath::apply( powlaw_point_kernel( p[0], p[1], p[2] ),
+				      nelem, x, val );
+    if ( nfail >= 0 )
+      return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+    return vecmath::scalar_point_loop
+      < DataType, ConstArrayType, IndexType,
+	powlaw_point< DataType, ConstArrayType > >( p, nelem, x, val );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType, typename IndexType>
+  inline int powlaw_integrated_vec( const ConstArrayType& p, IndexType nelem,
+				    const DataType* xlo, const DataType* xhi,
+				    DataType* val )
+  {
+
+    DataType ampl;
+    if ( p[0] == 1.0 )
+      ampl = p[2] * p[1];
+    else
+      ampl = p[2] / POW( p[1], -p[0] ) / ( 1.0 - p[0] );
+
+    IndexType nfail = vecmath::apply( powlaw_integrated_kernel( p[0], ampl ),
+				      nelem, xlo, xhi, val );
+    if ( nfail >= 0 )
+      return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+    return vecmath::scalar_integrated_loop
+      < DataType, ConstArrayType, IndexType,
+	powlaw_integrated< DataType, ConstArrayType > >( p, nelem,
+							 xlo, xhi, val );
+
+  }
+
+SHERPA_VEC_END
+
+
 }  }  /* namespace models, namespace sherpa */
 
 
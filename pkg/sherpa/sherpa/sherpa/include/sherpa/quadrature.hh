@@ -0,0 +1,972 @@
+//
+//  Copyright (C) 2013  Smithsonian Astrophysical Observatory
+//
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with this program; if not, write to the Free Software Foundation, Inc.,
+//  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __sherpa_quadrature_hh__
+#define __sherpa_quadrature_hh__
+
+//
+// Batched Gauss-Kronrod integration of a model point kernel over many
+// bins (1D) or pixels (2D) at once, for the models without an analytic
+// integral.
+//
+// A tile of bins is handled together: the nodes of every bin are laid
+// out node-major, so the kernel runs over one unit-stride array and the
+// weighted sums vectorize across bins.  1D bins use the 21-point Kronrod
+// rule of qng (with its embedded 10-point Gauss rule as the error
+// estimate), 2D pixels the tensor product of the 15-point Kronrod rule.
+// Only the bins whose error estimate fails are refined: they are halved
+// (or quartered) and the pieces of every failing bin of the tile are
+// batched again for the next pass.  Each bin has a budget of rule
+// applications that keeps it within the old per-bin limits of 10000 (1D)
+// and 100000 (2D) evaluations; a bin that runs out keeps its current
+// estimate.  Refinement around a cusp or a step only splits the few
+// pieces that contain it, so those can go many levels deep.
+//
+// The error estimate is the QUADPACK one (see rescale_error in
+// utils/src/gsl/err.c), and a piece is accepted once it is below
+// EPSREL * |result| (or 100 machine epsilons for a float DataType, which
+// could never reach EPSREL), or below the absolute floor EPSABS, the
+// epsabs of integrated_model1d.  A bin is failed if the kernel fails at
+// any of its nodes; the node still contributes its value as left by the
+// kernel, starting from zero, and the other bins are integrated anyway.
+//
+// Pixels may instead be sampled on a k x k grid of subpixel centres,
+// which is much cheaper and accurate enough for most images once k is a
+// few; only the pixels within a few pixel widths of the model centre
+// (p[1], p[2], as for every 2D model with a radius), where the profile
+// may be too sharp to sample, are still integrated adaptively.  The
+// choice is a per process setting (see pixel_settings) read by
+// integrate_pixels2d.  Models whose pixel integral factors into two 1D
+// integrals for some parameter values use integrate_separable2d, which
+// takes the closed form whenever it applies.
+//
+
+#include <pthread.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+namespace sherpa { namespace quadrature {
+
+  enum {
+    GK21_N = 21,
+    GK15_N = 15,
+    TILE_1D = 256,	// pieces per pass of the 1D rule
+    TILE_2D = 16,	// pieces per pass of the 2D rule
+    MAXRULE_1D = 476,	// rule applications per bin, 10000 / 21 points
+    MAXRULE_2D = 444,	// rule applications per pixel, 100000 / 225 points
+    TILE_OVERSAMPLE = 64,	// pixels per pass of the subpixel sampling
+    MAX_OVERSAMPLE = 32
+  };
+
+  const double EPSREL = 1.0e-10;
+  const double EPSABS = DBL_EPSILON;
+
+
+  // Nodes on [-1, 1] with the Kronrod weights and the weights of the
+  // embedded Gauss rule (zero on the Kronrod-only nodes)
+
+  static const double GK21_X[21] = {
+    -0.995657163025808080735527280689003,
+    -0.973906528517171720077964012084452,
+    -0.930157491355708226001207180059508,
+    -0.865063366688984510732096688423493,
+    -0.780817726586416897063717578345042,
+    -0.679409568299024406234327365114874,
+    -0.562757134668604683339000099272694,
+    -0.433395394129247190799265943165784,
+    -0.294392862701460198131126603103866,
+    -0.148874338981631210884826001129720,
+    0.0,
+    0.148874338981631210884826001129720,
+    0.294392862701460198131126603103866,
+    0.433395394129247190799265943165784,
+    0.562757134668604683339000099272694,
+    0.679409568299024406234327365114874,
+    0.780817726586416897063717578345042,
+    0.865063366688984510732096688423493,
+    0.930157491355708226001207180059508,
+    0.973906528517171720077964012084452,
+    0.995657163025808080735527280689003
+  };
+  static const double GK21_WK[21] = {
+
+    0.011694638867371874278064396062192,
+    0.032558162307964727478818972459390,
+    0.054755896574351996031381300244580,
+    0.075039674810919952767043140916190,
+    0.093125454583697605535065465083366,
+    0.109387158802297641899210590325805,
+    0.123491976262065851077958109831074,
+    0.134709217311473325928054001771707,
+    0.142775938577060080797094273138717,
+    0.147739104901338491374841515972068,
+    0.149445554002916905664936468389821,
+    0.147739104901338491374841515972068,
+    0.142775938577060080797094273138717,
+    0.134709217311473325928054001771707,
+    0.123491976262065851077958109831074,
+    0.109387158802297641899210590325805,
+    0.093125454583697605535065465083366,
+    0.075039674810919952767043140916190,
+    0.054755896574351996031381300244580,
+    0.032558162307964727478818972459390,
+    0.011694638867371874278064396062192
+  };
+  static const double GK21_WG[21] = {
+    0.0,
+    0.066671344308688137593568809893332,
+    0.0,
+    0.149451349150580593145776339657697,
+    0.0,
+    0.219086362515982043995534934228163,
+    0.0,
+    0.269266719309996355091226921569469,
+    0.0,
+    0.295524224714752870173892994651338,
+    0.0,
+    0.295524224714752870173892994651338,
+    0.0,
+    0.269266719309996355091226921569469,
+    0.0,
+    0.219086362515982043995534934228163,
+    0.0,
+    0.149451349150580593145776339657697,
+    0.0,
+    0.066671344308688137593568809893332,
+    0.0
+  };
+  static const double GK15_X[15] = {
+    -0.991455371120812639206854697526329,
+    -0.949107912342758524526189684047851,
+    -0.864864423359769072789712788640926,
+    -0.741531185599394439863864773280788,
+    -0.586087235467691130294144845693013,
+    -0.405845151377397166906606412076961,
+    -0.207784955007898467600689403773245,
+    0.0,
+    0.207784955007898467600689403773245,
+    0.405845151377397166906606412076961,
+    0.586087235467691130294144845693013,
+    0.741531185599394439863864773280788,
+    0.864864423359769072789712788640926,
+    0.949107912342758524526189684047851,
+    0.991455371120812639206854697526329
+  };
+  static const double GK15_WK[15] = {
+    0.022935322010529224963732008058970,
+    0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518,
+    0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550,
+    0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649,
+    0.209482141084727828012999174891714,
+    0.204432940075298892414161999234649,
+    0.190350578064785409913256402421014,
+    0.169004726639267902826583426598550,
+    0.140653259715525918745189590510238,
+    0.104790010322250183839876322541518,
+    0.063092092629978553290700663189204,
+    0.022935322010529224963732008058970
+  };
+  static const double GK15_WG[15] = {
+    0.0,
+    0.129484966168869693270611432679082,
+    0.0,
+    0.279705391489276667901467771423780,
+    0.0,
+    0.381830050505118944950369775488975,
+    0.0,
+    0.417959183673469387755102040816327,
+    0.0,
+    0.381830050505118944950369775488975,
+    0.0,
+    0.279705391489276667901467771423780,
+    0.0,
+    0.129484966168869693270611432679082,
+    0.0
+  };
+
+
+  // The sums of a rule are kept in double whatever DataType is; DataType
+  // only sets the roundoff floor of the error and the tolerance
+  template <typename DataType>
+  inline double rescale_error( double err, double resabs, double resasc )
+  {
+
+    err = std::fabs( err );
+
+    if ( 0 != resasc && 0 != err ) {
+      double scale = std::pow( 200 * err / resasc, 1.5 );
+      err = ( scale < 1 ) ? resasc * scale : resasc;
+    }
+
+    const double eps = std::numeric_limits< DataType >::epsilon();
+    if ( resabs > std::numeric_limits< DataType >::min() / ( 50 * eps ) )
+      err = std::max( err, 50 * eps * resabs );
+
+    return err;
+
+  }
+
+
+  template <typename DataType>
+  inline bool converged( double result, double err )
+  {
+    const double epsrel =
+      std::max( EPSREL, 100 * double( std::numeric_limits< DataType >::epsilon() ) );
+    return ( err <= std::max( EPSABS, epsrel * std::fabs( result ) ) );
+  }
+
+
+  // oversample is the number of subpixels along each axis, or 0 for the
+  // adaptive rule everywhere; the pixels within core pixel widths of the
+  // model centre are integrated adaptively in either case
+  struct PixelSettings {
+    int oversample;
+    double core;
+  };
+
+
+  // As for sherpa::threads::settings(), the settings are read with the
+  // GIL released, so they are only accessed under a mutex
+
+  inline pthread_mutex_t& pixel_settings_mutex()
+  {
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    return mutex;
+  }
+
+
+  inline PixelSettings& current_pixel_settings()
+  {
+    static PixelSettings current = { 0, 2.0 };
+    return current;
+  }
+
+
+  inline PixelSettings pixel_settings()
+  {
+    pthread_mutex_lock( &pixel_settings_mutex() );
+    PixelSettings opts = current_pixel_settings();
+    pthread_mutex_unlock( &pixel_settings_mutex() );
+    return opts;
+  }
+
+
+  inline void set_pixel_settings( const PixelSettings& opts )
+  {
+    pthread_mutex_lock( &pixel_settings_mutex() );
+    current_pixel_settings() = opts;
+    pthread_mutex_unlock( &pixel_settings_mutex() );
+  }
+
+
+  template <typename DataType, typename IndexType>
+  struct Piece1d {
+    DataType lo;
+    DataType hi;
+    IndexType bin;
+  };
+
+
+  template <typename DataType, typename IndexType>
+  struct Piece2d {
+    DataType x0lo;
+    DataType x0hi;
+    DataType x1lo;
+    DataType x1hi;
+    IndexType bin;
+  };
+
+
+  // Scratch space of one pass, reused from pass to pass
+  template <typename DataType>
+  struct Workspace {
+
+    std::vector< DataType > x0;		// nodes, node-major
+    std::vector< DataType > x1;
+    std::vector< DataType > f;		// kernel values at the nodes
+    std::vector< double > resk;		// per piece sums on [-1, 1]
+    std::vector< double > resg;
+    std::vector< double > resabs;
+    std::vector< double > resasc;
+
+    void resize( std::size_t nnodes, std::size_t npiece, int ndim )
+    {
+      x0.resize( nnodes * npiece );
+      if ( 2 == ndim )
+	x1.resize( nnodes * npiece );
+      f.resize( nnodes * npiece );
+      resk.assign( npiece, 0.0 );
+      resg.assign( npiece, 0.0 );
+      resabs.assign( npiece, 0.0 );
+      resasc.assign( npiece, 0.0 );
+    }
+
+  };
+
+
+  // Apply the 21-point rule to piece[0 .. npiece), adding the accepted
+  // pieces to val and the halves of the others to next.  budget holds
+  // the rule applications left to each bin, counted from bin first.
+  // Returns the number of kernel failures.
+  template <typename DataType,
+	    typename ConstArrayType,
+	    typename IndexType,
+	    int (*PtFunc)( const ConstArrayType& p, DataType x, DataType& val )>
+  int gk21_pass( const ConstArrayType& p,
+		  const Piece1d< DataType, IndexType >* piece,
+		  std::size_t npiece, IndexType first, int* budget,
+		  Workspace< DataType >& ws, DataType* val,
+		  std::vector< Piece1d< DataType, IndexType > >& next )
+  {
+
+    ws.resize( GK21_N, npiece, 1 );
+    DataType* x = &ws.x0[0];
+    DataType* f = &ws.f[0];
+    double* resk = &ws.resk[0];
+    double* resg = &ws.resg[0];
+    double* resabs = &ws.resabs[0];
+    double* resasc = &ws.resasc[0];
+    const std::size_t nnodes = GK21_N * npiece;
+
+    for ( int kk = 0; kk < GK21_N; kk++ )
+      for ( std::size_t ii = 0; ii < npiece; ii++ ) {
+	DataType center = ( piece[ ii ].lo + piece[ ii ].hi ) / 2;
+	DataType half = ( piece[ ii ].hi - piece[ ii ].lo ) / 2;
+	x[ kk * npiece + ii ] = center + half * DataType( GK21_X[ kk ] );
+      }
+
+    int nfail = 0;
+    for ( std::size_t jj = 0; jj < nnodes; jj++ ) {
+      f[ jj ] = 0;
+      nfail += ( EXIT_SUCCESS != PtFunc( p, x[ jj ], f[ jj ] ) );
+    }
+
+    for ( int kk = 0; kk < GK21_N; kk++ ) {
+      const DataType* fk = f + kk * npiece;
+      const double wk = GK21_WK[ kk ];
+      const double wg = GK21_WG[ kk ];
+      for ( std::size_t ii = 0; ii < npiece; ii++ ) {
+	resk[ ii ] += wk * fk[ ii ];
+	resg[ ii ] += wg * fk[ ii ];
+	resabs[ ii ] += wk * std::fabs( fk[ ii ] );
+      }
+    }
+
+    for ( int kk = 0; kk < GK21_N; kk++ ) {
+      const DataType* fk = f + kk * npiece;
+      const double wk = GK21_WK[ kk ];
+      for ( std::size_t ii = 0; ii < npiece; ii++ )
+	resasc[ ii ] += wk * std::fabs( fk[ ii ] - resk[ ii ] / 2 );
+    }
+
+    for ( std::size_t ii = 0; ii < npiece; ii++ ) {
+
+      const Piece1d< DataType, IndexType >& pc = piece[ ii ];
+      double half = ( double( pc.hi ) - pc.lo ) / 2;
+      double abshalf = std::fabs( half );
+      double result = resk[ ii ] * half;
+      double err = rescale_error< DataType >( ( resk[ ii ] - resg[ ii ] ) * half,
+					      resabs[ ii ] * abshalf,
+					      resasc[ ii ] * abshalf );
+
+      int& left_over = budget[ pc.bin - first ];
+      if ( left_over < 2 || converged< DataType >( result, err ) ) {
+	val[ pc.bin ] += DataType( result );
+	continue;
+      }
+      left_over -= 2;
+
+      DataType center = DataType( pc.lo + half );
+      Piece1d< DataType, IndexType > left = { pc.lo, center, pc.bin };
+      Piece1d< DataType, IndexType > right = { center, pc.hi, pc.bin };
+      next.push_back( left );
+      next.push_back( right );
+
+    }
+
+    return nfail;
+
+  }
+
+
+  // Apply the 15 x 15 point rule to piece[0 .. npiece), adding the
+  // accepted pieces to val and the quarters of the others to next.
+  // Returns the number of kernel failures.
+  template <typename DataType,
+	    typename ConstArrayType,
+	    typename IndexType,
+	    int (*PtFunc)( const ConstArrayType& p, DataType x0, DataType x1,
+			   DataType& val )>
+  int gk15x15_pass( const ConstArrayType& p,
+		     const Piece2d< DataType, IndexType >* piece,
+		     std::size_t npiece, IndexType first, int* budget,
+		     Workspace< DataType >& ws, DataType* val,
+		     std::vector< Piece2d< DataType, IndexType > >& next )
+  {
+
+    ws.resize( GK15_N * GK15_N, npiece, 2 );
+    DataType* x0 = &ws.x0[0];
+    DataType* x1 = &ws.x1[0];
+    DataType* f = &ws.f[0];
+    double* resk = &ws.resk[0];
+    double* resg = &ws.resg[0];
+    double* resabs = &ws.resabs[0];
+    double* resasc = &ws.resasc[0];
+    const std::size_t nnodes = GK15_N * GK15_N * npiece;
+
+    for ( int kk = 0; kk < GK15_N; kk++ )
+      for ( int ll = 0; ll < GK15_N; ll++ ) {
+	const std::size_t offset = ( kk * GK15_N + ll ) * npiece;
+	for ( std::size_t ii = 0; ii < npiece; ii++ ) {
+	  const Piece2d< DataType, IndexType >& pc = piece[ ii ];
+	  x0[ offset + ii ] = ( pc.x0lo + pc.x0hi ) / 2 +
+	    ( pc.x0hi - pc.x0lo ) / 2 * DataType( GK15_X[ kk ] );
+	  x1[ offset + ii ] = ( pc.x1lo + pc.x1hi ) / 2 +
+	    ( pc.x1hi - pc.x1lo ) / 2 * DataType( GK15_X[ ll ] );
+	}
+      }
+
+    int nfail = 0;
+    for ( std::size_t jj = 0; jj < nnodes; jj++ ) {
+      f[ jj ] = 0;
+      nfail += ( EXIT_SUCCESS != PtFunc( p, x0[ jj ], x1[ jj ], f[ jj ] ) );
+    }
+
+    for ( int kk = 0; kk < GK15_N; kk++ )
+      for ( int ll = 0; ll < GK15_N; ll++ ) {
+	const DataType* fk = f + ( kk * GK15_N + ll ) * npiece;
+	const double wk = GK15_WK[ kk ] * GK15_WK[ ll ];
+	const double wg = GK15_WG[ kk ] * GK15_WG[ ll ];
+	for ( std::size_t ii = 0; ii < npiece; ii++ ) {
+	  resk[ ii ] += wk * fk[ ii ];
+	  resg[ ii ] += wg * fk[ ii ];
+	  resabs[ ii ] += wk * std::fabs( fk[ ii ] );
+	}
+      }
+
+    for ( int kk = 0; kk < GK15_N; kk++ )
+      for ( int ll = 0; ll < GK15_N; ll++ ) {
+	const DataType* fk = f + ( kk * GK15_N + ll ) * npiece;
+	const double wk = GK15_WK[ kk ] * GK15_WK[ ll ];
+	for ( std::size_t ii = 0; ii < npiece; ii++ )
+	  resasc[ ii ] += wk * std::fabs( fk[ ii ] - resk[ ii ] / 4 );
+      }
+
+    for ( std::size_t ii = 0; ii < npiece; ii++ ) {
+
+      const Piece2d< DataType, IndexType >& pc = piece[ ii ];
+      double area = ( double( pc.x0hi ) - pc.x0lo ) *
+	( double( pc.x1hi ) - pc.x1lo ) / 4;
+      double absarea = std::fabs( area );
+      double result = resk[ ii ] * area;
+      double err = rescale_error< DataType >( ( resk[ ii ] - resg[ ii ] ) * area,
+					      resabs[ ii ] * absarea,
+					      resasc[ ii ] * absarea );
+
+      int& left_over = budget[ pc.bin - first ];
+      if ( left_over < 4 || converged< DataType >( result, err ) ) {
+	val[ pc.bin ] += DataType( result );
+	continue;
+      }
+      left_over -= 4;
+
+      DataType x0mid = ( pc.x0lo + pc.x0hi ) / 2;
+      DataType x1mid = ( pc.x1lo + pc.x1hi ) / 2;
+      Piece2d< DataType, IndexType > quarter[ 4 ] = {
+	{ pc.x0lo, x0mid, pc.x1lo, x1mid, pc.bin },
+	{ x0mid, pc.x0hi, pc.x1lo, x1mid, pc.bin },
+	{ pc.x0lo, x0mid, x1mid, pc.x1hi, pc.bin },
+	{ x0mid, pc.x0hi, x1mid, pc.x1hi, pc.bin }
+      };
+      next.insert( next.end(), quarter, quarter + 4 );
+
+    }
+
+    return nfail;
+
+  }
+
+
+  // Refine the pieces in work, which all belong to bins from first on,
+  // until every one of them has been added to val; returns the number of
+  // kernel failures
+  template <typename DataType,
+	    typename ConstArrayType,
+	    typename IndexType,
+	    int (*PtFunc)( const ConstArrayType& p, DataType x0, DataType x1,
+			   DataType& val )>
+  int refine2d( const ConstArrayType& p,
+		 std::vector< Piece2d< DataType, IndexType > >& work,
+		 std::vector< Piece2d< DataType, IndexType > >& next,
+		 IndexType first, std::vector< int >& budget,
+		 Workspace< DataType >& ws, DataType* val )
+  {
+
+    int nfail = 0;
+
+    while ( !work.empty() ) {
+      next.clear();
+      for ( std::size_t lo = 0; lo < work.size(); lo += TILE_2D )
+	nfail += gk15x15_pass< DataType, ConstArrayType, IndexType, PtFunc >
+	  ( p, &work[ lo ], std::min( std::size_t( TILE_2D ), work.size() - lo ),
+	    first, &budget[ 0 ], ws, val, next );
+      work.swap( next );
+    }
+
+    return nfail;
+
+  }
+
+
+  // Integrate the point kernel PtFunc over the bins [xlo[ii], xhi[ii]]
+  // of a contiguous grid; the signature matches the batch kernels of
+  // vecmath.hh
+  template <typename DataType,
+	    typename ConstArrayType,
+	    typename IndexType,
+	    int (*PtFunc)( const ConstArrayType& p, DataType x, DataType& val )>
+  int integrate_bins1d( const ConstArrayType& p, IndexType nelem,
+			const DataType* xlo, const DataType* xhi,
+			DataType* val )
+  {
+
+    typedef Piece1d< DataType, IndexType > Piece;
+
+    Workspace< DataType > ws;
+    std::vector< Piece > work;
+    std::vector< Piece > next;
+    std::vector< int > budget;
+    int nfail = 0;
+
+    for ( IndexType start = 0; start < nelem; start += TILE_1D ) {
+
+      IndexType stop = std::min( start + IndexType( TILE_1D ), nelem );
+      budget.assign( stop - start, MAXRULE_1D - 1 );
+
+      work.clear();
+      for ( IndexType ii = start; ii < stop; ii++ ) {
+	Piece pc = { xlo[ ii ], xhi[ ii ], ii };
+	work.push_back( pc );
+	val[ ii ] = 0;
+      }
+
+      while ( !work.empty() ) {
+	next.clear();
+	for ( std::size_t lo = 0; lo < work.size(); lo += TILE_1D )
+	  nfail += gk21_pass< DataType, ConstArrayType, IndexType, PtFunc >
+	    ( p, &work[ lo ],
+	      std::min( std::size_t( TILE_1D ), work.size() - lo ),
+	      start, &budget[ 0 ], ws, val, next );
+	work.swap( next );
+      }
+
+    }
+
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+  }
+
+
+  // Integrate the point kernel PtFunc over the pixels
+  // [x0lo[ii], x0hi[ii]] x [x1lo[ii], x1hi[ii]] of a contiguous grid
+  template <typename DataType,
+	    typename ConstArrayType,
+	    typename IndexType,
+	    int (*PtFunc)( const ConstArrayType& p, DataType x0, DataType x1,
+			   DataType& val )>
+  int integrate_bins2d( const ConstArrayType& p, IndexType nelem,
+			const DataType* x0lo, const DataType* x0hi,
+			const DataType* x1lo, const DataType* x1hi,
+			DataType* val )
+  {
+
+    typedef Piece2d< DataType, IndexType > Piece;
+
+    Workspace< DataType > ws;
+    std::vector< Piece > work;
+    std::vector< Piece > next;
+    std::vector< int > budget;
+    int nfail = 0;
+
+    for ( IndexType start = 0; start < nelem; start += TILE_2D ) {
+
+      IndexType stop = std::min( start + IndexType( TILE_2D ), nelem );
+      budget.assign( stop - start, MAXRULE_2D - 1 );
+
+      work.clear();
+      for ( IndexType ii = start; ii < stop; ii++ ) {
+	Piece pc = { x0lo[ ii ], x0hi[ ii ], x1lo[ ii ], x1hi[ ii ], ii };
+	work.push_back( pc );
+	val[ ii ] = 0;
+      }
+
+      nfail += refine2d< DataType, ConstArrayType, IndexType, PtFunc >
+	( p, work, next, start, budget, ws, val );
+
+    }
+
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+  }
+
+
+  // Sample the pixels pixel[0 .. npixel) at the centres of k x k
+  // subpixels, setting val to the mean value times the pixel area;
+  // returns the number of kernel failures
+  template <typename DataType,
+	    typename ConstArrayType,
+	    typename IndexType,
+	    int (*PtFunc)( const ConstArrayType& p, DataType x0, DataType x1,
+			   DataType& val )>
+  int oversample_pass( const ConstArrayType& p, const IndexType* pixel,
+			std::size_t npixel, int k,
+			const DataType* x0lo, const DataType* x0hi,
+			const DataType* x1lo, const DataType* x1hi,
+			Workspace< DataType >& ws, DataType* val )
+  {
+
+    ws.resize( k * k, npixel, 2 );
+    DataType* x0 = &ws.x0[0];
+    DataType* x1 = &ws.x1[0];
+    DataType* f = &ws.f[0];
+    double* sum = &ws.resk[0];
+    const std::size_t nnodes = std::size_t( k * k ) * npixel;
+
+    for ( int kk = 0; kk < k; kk++ )
+      for ( int ll = 0; ll < k; ll++ ) {
+	const std::size_t offset = ( kk * k + ll ) * npixel;
+	const DataType t0 = ( kk + DataType( 0.5 ) ) / k;
+	const DataType t1 = ( ll + DataType( 0.5 ) ) / k;
+	for ( std::size_t ii = 0; ii < npixel; ii++ ) {
+	  const IndexType pix = pixel[ ii ];
+	  x0[ offset + ii ] = x0lo[ pix ] + ( x0hi[ pix ] - x0lo[ pix ] ) * t0;
+	  x1[ offset + ii ] = x1lo[ pix ] + ( x1hi[ pix ] - x1lo[ pix ] ) * t1;
+	}
+      }
+
+    int nfail = 0;
+    for ( std::size_t jj = 0; jj < nnodes; jj++ ) {
+      f[ jj ] = 0;
+      nfail += ( EXIT_SUCCESS != PtFunc( p, x0[ jj ], x1[ jj ], f[ jj ] ) );
+    }
+
+    for ( std::size_t kk = 0; kk < std::size_t( k * k ); kk++ ) {
+      const DataType* fk = f + kk * npixel;
+      for ( std::size_t ii = 0; ii < npixel; ii++ )
+	sum[ ii ] += fk[ ii ];
+    }
+
+    for ( std::size_t ii = 0; ii < npixel; ii++ ) {
+      const IndexType pix = pixel[ ii ];
+      val[ pix ] = DataType( sum[ ii ] / ( k * k ) *
+			     ( double( x0hi[ pix ] ) - x0lo[ pix ] ) *
+			     ( double( x1hi[ pix ] ) - x1lo[ pix ] ) );
+    }
+
+    return nfail;
+
+  }
+
+
+  // As integrate_bins2d, but only for the pixels within core pixel widths
+  // of (p[1], p[2]); the others are sampled on k x k subpixels
+  template <typename DataType,
+	    typename ConstArrayType,
+	    typename IndexType,
+	    int (*PtFunc)( const ConstArrayType& p, DataType x0, DataType x1,
+			   DataType& val )>
+  int oversample_bins2d( const ConstArrayType& p, IndexType nelem,
+			 const DataType* x0lo, const DataType* x0hi,
+			 const DataType* x1lo, const DataType* x1hi,
+			 DataType* val, int k, double core )
+  {
+
+    typedef Piece2d< DataType, IndexType > Piece;
+
+    Workspace< DataType > ws;
+    std::vector< Piece > work;
+    std::vector< Piece > next;
+    std::vector< int > budget;
+    std::vector< IndexType > sampled;
+    int nfail = 0;
+
+    const DataType x0mid = p[1];
+    const DataType x1mid = p[2];
+    const DataType reach = DataType( 0.5 + core );
+
+    for ( IndexType start = 0; start < nelem; start += TILE_OVERSAMPLE ) {
+
+      IndexType stop = std::min( start + IndexType( TILE_OVERSAMPLE ), nelem );
+      budget.assign( stop - start, MAXRULE_2D - 1 );
+
+      work.clear();
+      sampled.clear();
+      for ( IndexType ii = start; ii < stop; ii++ ) {
+	val[ ii ] = 0;
+	if ( std::fabs( x0mid - ( x0lo[ ii ] + x0hi[ ii ] ) / 2 ) <=
+	     reach * std::fabs( x0hi[ ii ] - x0lo[ ii ] ) &&
+	     std::fabs( x1mid - ( x1lo[ ii ] + x1hi[ ii ] ) / 2 ) <=
+	     reach * std::fabs( x1hi[ ii ] - x1lo[ ii ] ) ) {
+	  Piece pc = { x0lo[ ii ], x0hi[ ii ], x1lo[ ii ], x1hi[ ii ], ii };
+	  work.push_back( pc );
+	} else
+	  sampled.push_back( ii );
+      }
+
+      if ( !sampled.empty() )
+	nfail += oversample_pass< DataType, ConstArrayType, IndexType, PtFunc >
+	  ( p, &sampled[0], sampled.size(), k, x0lo, x0hi, x1lo, x1hi, ws,
+	    val );
+
+      nfail += refine2d< DataType, ConstArrayType, IndexType, PtFunc >
+	( p, work, next, start, budget, ws, val );
+
+    }
+
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+  }
+
+
+  // Integrate PtFunc over the pixels of a contiguous grid as set by
+  // pixel_settings
+  template <typename DataType,
+	    typename ConstArrayType,
+	    typename IndexType,
+	    int (*PtFunc)( const ConstArrayType& p, DataType x0, DataType x1,
+			   DataType& val )>
+  int integrate_pixels2d( const ConstArrayType& p, IndexType nelem,
+			  const DataType* x0lo, const DataType* x0hi,
+			  const DataType* x1lo, const DataType* x1hi,
+			  DataType* val )
+  {
+
+    const PixelSettings opts = pixel_settings();
+
+    if ( opts.oversample < 1 )
+      return integrate_bins2d< DataType, ConstArrayType, IndexType, PtFunc >
+	( p, nelem, x0lo, x0hi, x1lo, x1hi, val );
+
+    return oversample_bins2d< DataType, ConstArrayType, IndexType, PtFunc >
+      ( p, nelem, x0lo, x0hi, x1lo, x1hi, val, opts.oversample, opts.core );
+
+  }
+
+
+  // As integrate_pixels2d, but with the closed form SepFunc for the
+  // parameter values that Separable accepts
+  template <typename DataType,
+	    typename ConstArrayType,
+	    typename IndexType,
+	    int (*PtFunc)( const ConstArrayType& p, DataType x0, DataType x1,
+			   DataType& val ),
+	    bool (*Separable)( const ConstArrayType& p ),
+	    int (*SepFunc)( const ConstArrayType& p,
+			    DataType x0lo, DataType x0hi,
+			    DataType x1lo, DataType x1hi, DataType& val )>
+  int integrate_separable2d( const ConstArrayType& p, IndexType nelem,
+			     const DataType* x0lo, const DataType* x0hi,
+			     const DataType* x1lo, const DataType* x1hi,
+			     DataType* val )
+  {
+
+    if ( !Separable( p ) )
+      return integrate_pixels2d< DataType, ConstArrayType, IndexType,
+				 PtFunc >
+	( p, nelem, x0lo, x0hi, x1lo, x1hi, val );
+
+    int nfail = 0;
+    for ( IndexType ii = 0; ii < nelem; ii++ )
+      nfail += ( EXIT_SUCCESS != SepFunc( p, x0lo[ ii ], x0hi[ ii ],
+					  x1lo[ ii ], x1hi[ ii ], val[ ii ] ) );
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+  }
+
+
+}  }  /* namespace quadrature, namespace sherpa */
+
+
+#ifdef testQuadrature
+
+#include <cstdio>
+
+typedef std::vector< double > Pars;
+
+static int gauss1d( const Pars& p, double x, double& val )
+{
+  val = std::exp( -( x - p[0] ) * ( x - p[0] ) / ( 2 * p[1] * p[1] ) );
+  return EXIT_SUCCESS;
+}
+
+static int cusp1d( const Pars& p, double x, double& val )
+{
+  val = std::exp( -std::sqrt( std::fabs( x - p[0] ) / p[1] ) );
+  return EXIT_SUCCESS;
+}
+
+static int gauss2d( const Pars& p, double x0, double x1, double& val )
+{
+  val = std::exp( -( ( x0 - p[0] ) * ( x0 - p[0] ) +
+		     ( x1 - p[0] ) * ( x1 - p[0] ) ) / ( 2 * p[1] * p[1] ) );
+  return EXIT_SUCCESS;
+}
+
+// Centred on (p[1], p[2]), like the models
+static int gauss2d_centred( const Pars& p, double x0, double x1, double& val )
+{
+  val = std::exp( -( ( x0 - p[1] ) * ( x0 - p[1] ) +
+		     ( x1 - p[2] ) * ( x1 - p[2] ) ) / ( 2 * p[0] * p[0] ) );
+  return EXIT_SUCCESS;
+}
+
+// Fails for x < p[0], like a model outside its domain
+static int halfline1d( const Pars& p, double x, double& val )
+{
+  if ( x < p[0] )
+    return EXIT_FAILURE;
+  val = 1.0;
+  return EXIT_SUCCESS;
+}
+
+static double gauss_int( const Pars& p, double lo, double hi )
+{
+  double s = p[1] * std::sqrt( 2.0 );
+  return std::sqrt( M_PI / 2 ) * p[1] *
+    ( ::erf( ( hi - p[0] ) / s ) - ::erf( ( lo - p[0] ) / s ) );
+}
+
+// exp(-sqrt(u)) integrates to -2 (1 + sqrt(u)) exp(-sqrt(u))
+static double cusp_int( const Pars& p, double lo, double hi )
+{
+  double val = 0.0;
+  double a[2] = { lo - p[0], hi - p[0] };
+  for ( int ii = 0; ii < 2; ii++ ) {
+    double s = std::sqrt( std::fabs( a[ ii ] ) / p[1] );
+    double prim = p[1] * ( 2.0 - 2.0 * ( 1.0 + s ) * std::exp( -s ) );
+    val += ( ii ? 1.0 : -1.0 ) * ( a[ ii ] < 0 ? -prim : prim );
+  }
+  return val;
+}
+
+// The errors are relative to the largest bin, since the references lose
+// accuracy in the tails
+int main( int argc, char* argv[] )
+{
+
+  const long n = 1000;
+  Pars p( 2 );
+  p[0] = 0.123;
+  p[1] = 0.7;
+  std::vector< double > lo( n ), hi( n ), val( n );
+  for ( long ii = 0; ii < n; ii++ ) {
+    lo[ ii ] = -5.0 + 10.0 * ii / n;
+    hi[ ii ] = -5.0 + 10.0 * ( ii + 1 ) / n;
+  }
+
+  double maxerr = 0.0;
+  sherpa::quadrature::integrate_bins1d< double, Pars, long, gauss1d >
+    ( p, n, &lo[0], &hi[0], &val[0] );
+  for ( long ii = 0; ii < n; ii++ )
+    maxerr = std::max( maxerr, std::fabs( val[ ii ] -
+					  gauss_int( p, lo[ ii ], hi[ ii ] ) ) /
+		       *std::max_element( val.begin(), val.end() ) );
+  std::printf( "gauss1d  max rel error %.3g\n", maxerr );
+
+  maxerr = 0.0;
+  sherpa::quadrature::integrate_bins1d< double, Pars, long, cusp1d >
+    ( p, n, &lo[0], &hi[0], &val[0] );
+  for ( long ii = 0; ii < n; ii++ )
+    maxerr = std::max( maxerr, std::fabs( val[ ii ] -
+					  cusp_int( p, lo[ ii ], hi[ ii ] ) ) /
+		       *std::max_element( val.begin(), val.end() ) );
+  std::printf( "cusp1d   max rel error %.3g\n", maxerr );
+
+  // Kernel failures fail the integration, which still fills every bin
+  int status = sherpa::quadrature::integrate_bins1d< double, Pars, long,
+						     halfline1d >
+    ( p, n, &lo[0], &hi[0], &val[0] );
+  std::printf( "halfline %s, last bin %.3g\n",
+	       ( EXIT_SUCCESS == status ) ? "succeeded" : "failed",
+	       val[ n - 1 ] );
+
+  const long npix = 40;
+  std::vector< double > x0lo, x0hi, x1lo, x1hi;
+  for ( long ii = 0; ii < npix; ii++ )
+    for ( long jj = 0; jj < npix; jj++ ) {
+      x0lo.push_back( -2.0 + 4.0 * jj / npix );
+      x0hi.push_back( -2.0 + 4.0 * ( jj + 1 ) / npix );
+      x1lo.push_back( -2.0 + 4.0 * ii / npix );
+      x1hi.push_back( -2.0 + 4.0 * ( ii + 1 ) / npix );
+    }
+  val.resize( npix * npix );
+
+  maxerr = 0.0;
+  sherpa::quadrature::integrate_bins2d< double, Pars, long, gauss2d >
+    ( p, npix * npix, &x0lo[0], &x0hi[0], &x1lo[0], &x1hi[0], &val[0] );
+  for ( long ii = 0; ii < npix * npix; ii++ )
+    maxerr = std::max( maxerr, std::fabs( val[ ii ] -
+					  gauss_int( p, x0lo[ ii ],
+						     x0hi[ ii ] ) *
+					  gauss_int( p, x1lo[ ii ],
+						     x1hi[ ii ] ) ) /
+		       *std::max_element( val.begin(), val.end() ) );
+  std::printf( "gauss2d  max rel error %.3g\n", maxerr );
+
+  // Subpixel sampling away from the centre, adaptive refinement near it
+  Pars q( 3 );
+  q[0] = 0.7;
+  q[1] = 0.123;
+  q[2] = 0.123;
+  for ( int k = 2; k <= 8; k *= 2 ) {
+    maxerr = 0.0;
+    sherpa::quadrature::oversample_bins2d< double, Pars, long,
+					   gauss2d_centred >
+      ( q, npix * npix, &x0lo[0], &x0hi[0], &x1lo[0], &x1hi[0], &val[0],
+	k, 2.0 );
+    for ( long ii = 0; ii < npix * npix; ii++ )
+      maxerr = std::max( maxerr, std::fabs( val[ ii ] -
+					    gauss_int( p, x0lo[ ii ],
+						       x0hi[ ii ] ) *
+					    gauss_int( p, x1lo[ ii ],
+						       x1hi[ ii ] ) ) /
+			 *std::max_element( val.begin(), val.end() ) );
+    std::printf( "gauss2d  %dx%d subpixels max rel error %.3g\n", k, k,
+		 maxerr );
+  }
+
+  return 0;
+
+}
+
+#endif
+
+//
+// cp quadrature.hh tmp.cc; g++ -I.. -g -Wall -O3 -DtestQuadrature tmp.cc; rm tmp.cc; a.out
+//
+
+#endif /* __sherpa_quadrature_hh__ */
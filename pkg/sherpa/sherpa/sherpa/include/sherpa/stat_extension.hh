@@ -21,6 +21,9 @@
 #define __sherpa_stat_extension_hh__
 
 #include <sherpa/extension.hh>
+#include <sherpa/stats.hh>
+#include <cstring>
+#include <sstream>
 
 namespace sherpa { namespace stats {
 
@@ -164,6 +167,714 @@ namespace sherpa { namespace stats {
   }
 
 
+  //
+  // The statistic alone, from the scalar-only form of StatFunc (see
+  // stats.hh): takes the same arguments as statfct but returns a float,
+  // and allocates no deviations array
+  //
+  template <typename ArrayType,
+	    typename DataType,
+	    int (*StatFunc)( npy_intp num, const ArrayType& yraw,
+			     const ArrayType& model,
+			     const ArrayType& staterror,
+			     const ArrayType& syserror,
+			     const ArrayType& weight,
+			     DataType& val, DataType& trunc_value )>
+  PyObject* statfct_scalar( PyObject* self, PyObject* args )
+  {
+
+    ArrayType yraw;
+    ArrayType model;
+    ArrayType staterror;
+    ArrayType syserror;
+    ArrayType weight;
+    double trunc_value = -1.0;
+
+    if ( !PyArg_ParseTuple( args, (char*)"O&O&O&O&O&d",
+			    (converter)convert_to_array< ArrayType >, &yraw,
+			    (converter)convert_to_array< ArrayType >, &model,
+			    (converter)convert_to_array< ArrayType >,
+			    &staterror,
+			    (converter)array_or_none< ArrayType >, &syserror,
+			    (converter)array_or_none< ArrayType >, &weight,
+			    &trunc_value) )
+      return NULL;
+
+    npy_intp nelem = yraw.get_size();
+
+    if ( ( model.get_size() != nelem ) ||
+	 ( staterror.get_size() != nelem ) ||
+	 ( syserror && ( syserror.get_size() != nelem ) ) ||
+	 ( weight && ( weight.get_size() != nelem ) ) ) {
+      PyErr_SetString( PyExc_TypeError,
+		       (char*)"statistic input array sizes do not match" );
+      return NULL;
+    }
+
+    DataType val = 0.0;
+
+    if ( EXIT_SUCCESS != StatFunc( nelem, yraw, model, staterror, syserror,
+				   weight, val, trunc_value ) ) {
+      PyErr_SetString( PyExc_ValueError, (char*)"statistic calculation failed");
+      return NULL;
+    }
+
+    return PyFloat_FromDouble( val );
+
+  }
+
+
+  //
+  // Prepared statistics (see PreparedStat in stats.hh), handed to Python
+  // as an opaque handle:
+  //
+  //   handle = prepare_stat(name, yraw, staterror, syserror, weight,
+  //                         trunc_value)
+  //   stat = calc_prepared_stat(handle, model[, model_sum])
+  //
+  // where name is one of cash, cstat, chi2, chi2modvar, lsq, sparse_cash
+  // or sparse_cstat and staterror, syserror and weight may be None
+  // (staterror is needed by chi2 only).  model_sum, the sum of weight *
+  // model, is used by the sparse likelihoods only.
+  //
+
+  static const char* prepared_stat_desc = "sherpa.stats.PreparedStat";
+
+
+  inline void free_prepared_stat( void* prep, void* desc )
+  {
+    delete static_cast< PreparedStat< SherpaFloat >* >( prep );
+  }
+
+
+  inline PyObject* prepare_stat( PyObject* self, PyObject* args )
+  {
+
+    typedef PreparedStat< SherpaFloat > Prep;
+
+    const char* name = NULL;
+    DoubleArray yraw;
+    DoubleArray staterror;
+    DoubleArray syserror;
+    DoubleArray weight;
+    double trunc_value = -1.0;
+
+    if ( !PyArg_ParseTuple( args, (char*)"sO&O&O&O&d",
+			    &name,
+			    (converter)convert_to_array< DoubleArray >, &yraw,
+			    (converter)array_or_none< DoubleArray >,
+			    &staterror,
+			    (converter)array_or_none< DoubleArray >, &syserror,
+			    (converter)array_or_none< DoubleArray >, &weight,
+			    &trunc_value) )
+      return NULL;
+
+    static const char* names[] = { "cash", "cstat", "chi2", "chi2modvar",
+				   "lsq", "sparse_cash", "sparse_cstat" };
+    static const int kinds[] = { Prep::CASH, Prep::CSTAT, Prep::CHI2,
+				 Prep::CHI2MODVAR, Prep::LSQ,
+				 Prep::SPARSE_CASH, Prep::SPARSE_CSTAT };
+    int kind = -1;
+    for ( int ii = 0; ii < int( sizeof( kinds ) / sizeof( kinds[ 0 ] ) );
+	  ii++ )
+      if ( 0 == std::strcmp( name, names[ ii ] ) )
+	kind = kinds[ ii ];
+
+    if ( -1 == kind ) {
+      PyErr_Format( PyExc_ValueError,
+		    (char*)"no prepared form of statistic '%s'", name );
+      return NULL;
+    }
+
+    npy_intp nelem = yraw.get_size();
+
+    if ( ( staterror && ( staterror.get_size() != nelem ) ) ||
+	 ( syserror && ( syserror.get_size() != nelem ) ) ||
+	 ( weight && ( weight.get_size() != nelem ) ) ) {
+      PyErr_SetString( PyExc_TypeError,
+		       (char*)"statistic input array sizes do not match" );
+      return NULL;
+    }
+
+    Prep* prep = new Prep;
+
+    if ( EXIT_SUCCESS != prepare_stat( kind, nelem, yraw, staterror,
+				       syserror, weight,
+				       SherpaFloat( trunc_value ), *prep ) ) {
+      delete prep;
+      PyErr_SetString( PyExc_ValueError,
+		       (char*)"statistic preparation failed" );
+      return NULL;
+    }
+
+    PyObject* handle =
+      PyCObject_FromVoidPtrAndDesc( prep, (void*)prepared_stat_desc,
+				    free_prepared_stat );
+    if ( NULL == handle )
+      delete prep;
+
+    return handle;
+
+  }
+
+
+  // The prepared statistic behind a handle from prepare_stat, or NULL
+  // with a Python error set
+  inline const PreparedStat< SherpaFloat >* prepared_from_handle
+  ( PyObject* handle )
+  {
+
+    if ( !PyCObject_Check( handle ) || NULL == PyCObject_GetDesc( handle ) ||
+	 0 != std::strcmp( static_cast< const char* >
+			   ( PyCObject_GetDesc( handle ) ),
+			   prepared_stat_desc ) ) {
+      PyErr_SetString( PyExc_TypeError,
+		       (char*)"expected a prepared statistic" );
+      return NULL;
+    }
+
+    return static_cast< PreparedStat< SherpaFloat >* >
+      ( PyCObject_AsVoidPtr( handle ) );
+
+  }
+
+
+  inline PyObject* calc_prepared_stat( PyObject* self, PyObject* args )
+  {
+
+    PyObject* handle = NULL;
+    DoubleArray model;
+    PyObject* model_sum_obj = Py_None;
+
+    if ( !PyArg_ParseTuple( args, (char*)"OO&|O",
+			    &handle,
+			    (converter)convert_to_array< DoubleArray >,
+			    &model, &model_sum_obj ) )
+      return NULL;
+
+    SherpaFloat model_sum = 0.0;
+    if ( Py_None != model_sum_obj ) {
+      model_sum = PyFloat_AsDouble( model_sum_obj );
+      if ( -1.0 == model_sum && PyErr_Occurred() )
+	return NULL;
+    }
+
+    const PreparedStat< SherpaFloat >* pprep = prepared_from_handle( handle );
+    if ( NULL == pprep )
+      return NULL;
+    const PreparedStat< SherpaFloat >& prep = *pprep;
+
+    if ( npy_intp( prep.nbins ) != model.get_size() ) {
+      PyErr_SetString( PyExc_TypeError,
+		       (char*)"statistic input array sizes do not match" );
+      return NULL;
+    }
+
+    SherpaFloat val = 0.0;
+
+    if ( EXIT_SUCCESS !=
+	 calc_prepared_stat( prep, model.get_size(), model, val,
+			     ( Py_None == model_sum_obj ) ? NULL : &model_sum ) ) {
+      PyErr_SetString( PyExc_ValueError, (char*)"statistic calculation failed");
+      return NULL;
+    }
+
+    return PyFloat_FromDouble( val );
+
+  }
+
+
+  //
+  // Segmented statistics, for simultaneous fits: the statistic over
+  // several data sets, each with its own arrays, without joining them
+  // into one:
+  //
+  //   (stat, stats) = name_segments(yraws, models, staterrors, syserrors,
+  //                                 weights, trunc_value)
+  //   (stat, stats) = calc_prepared_stat_segments(handles, models)
+  //
+  // take sequences with an array (or prepared statistic) per data set;
+  // syserrors and weights may be None, or hold None for some data sets.
+  // stats holds the statistic of each data set and stat is their
+  // compensated sum, which agrees with the statistic of the joined
+  // arrays to rounding.
+  //
+
+  // Convert the items of seq, which must have nseg of them, into
+  // arrays[0..nseg); seq may be None if optional, and so may its items
+  template <typename ArrayType>
+  int segment_arrays( PyObject* seq, npy_intp nseg, bool optional,
+		      std::vector< ArrayType >& arrays )
+  {
+
+    arrays.resize( nseg );
+
+    if ( optional && Py_None == seq )
+      return EXIT_SUCCESS;
+
+    PyObject* items = PySequence_Fast( seq, "expected a sequence of arrays" );
+    if ( NULL == items )
+      return EXIT_FAILURE;
+
+    int status = EXIT_SUCCESS;
+
+    if ( PySequence_Fast_GET_SIZE( items ) != nseg ) {
+      PyErr_SetString( PyExc_TypeError,
+		       (char*)"statistic input sequence sizes do not match" );
+      status = EXIT_FAILURE;
+    }
+
+    for ( npy_intp kk = 0; EXIT_SUCCESS == status && kk < nseg; kk++ ) {
+      PyObject* item = PySequence_Fast_GET_ITEM( items, kk );
+      if ( optional ?
+	   !array_or_none< ArrayType >( item, &arrays[ kk ] ) :
+	   !convert_to_array< ArrayType >( item, &arrays[ kk ] ) )
+	status = EXIT_FAILURE;
+    }
+
+    Py_DECREF( items );
+    return status;
+
+  }
+
+
+  template <typename DataType>
+  PyObject* segments_return( const std::vector< DataType >& stats )
+  {
+
+    npy_intp nseg = npy_intp( stats.size() );
+    DoubleArray result;
+    if ( EXIT_SUCCESS != result.create( 1, &nseg ) )
+      return NULL;
+
+    sherpa::utils::compensated_sum< DataType > total;
+    for ( npy_intp kk = 0; kk < nseg; kk++ ) {
+      result[ kk ] = stats[ kk ];
+      total.add( stats[ kk ] );
+    }
+
+    return Py_BuildValue( (char*)"(dN)", double( total.result() ),
+			  result.return_new_ref() );
+
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    int (*StatFunc)( npy_intp num, const ArrayType& yraw,
+			     const ArrayType& model,
+			     const ArrayType& staterror,
+			     const ArrayType& syserror,
+			     const ArrayType& weight,
+			     DataType& val, DataType& trunc_value )>
+  PyObject* statfct_segments( PyObject* self, PyObject* args )
+  {
+
+    PyObject* yrawobj = NULL;
+    PyObject* modelobj = NULL;
+    PyObject* staterrobj = NULL;
+    PyObject* syserrobj = NULL;
+    PyObject* weightobj = NULL;
+    double trunc_value = -1.0;
+
+    if ( !PyArg_ParseTuple( args, (char*)"OOOOOd", &yrawobj, &modelobj,
+			    &staterrobj, &syserrobj, &weightobj,
+			    &trunc_value ) )
+      return NULL;
+
+    Py_ssize_t nseg = PySequence_Size( yrawobj );
+    if ( nseg < 0 )
+      return NULL;
+
+    std::vector< ArrayType > yraw;
+    std::vector< ArrayType > model;
+    std::vector< ArrayType > staterror;
+    std::vector< ArrayType > syserror;
+    std::vector< ArrayType > weight;
+
+    if ( ( EXIT_SUCCESS != segment_arrays( yrawobj, nseg, false, yraw ) ) ||
+	 ( EXIT_SUCCESS != segment_arrays( modelobj, nseg, false, model ) ) ||
+	 ( EXIT_SUCCESS != segment_arrays( staterrobj, nseg, false,
+					   staterror ) ) ||
+	 ( EXIT_SUCCESS != segment_arrays( syserrobj, nseg, true,
+					   syserror ) ) ||
+	 ( EXIT_SUCCESS != segment_arrays( weightobj, nseg, true, weight ) ) )
+      return NULL;
+
+    std::vector< DataType > stats( nseg );
+
+    for ( Py_ssize_t kk = 0; kk < nseg; kk++ ) {
+
+      npy_intp nelem = yraw[ kk ].get_size();
+
+      if ( ( model[ kk ].get_size() != nelem ) ||
+	   ( staterror[ kk ].get_size() != nelem ) ||
+	   ( syserror[ kk ] && ( syserror[ kk ].get_size() != nelem ) ) ||
+	   ( weight[ kk ] && ( weight[ kk ].get_size() != nelem ) ) ) {
+	PyErr_SetString( PyExc_TypeError,
+			 (char*)"statistic input array sizes do not match" );
+	return NULL;
+      }
+
+      DataType trunc = DataType( trunc_value );
+      if ( EXIT_SUCCESS != StatFunc( nelem, yraw[ kk ], model[ kk ],
+				     staterror[ kk ], syserror[ kk ],
+				     weight[ kk ], stats[ kk ], trunc ) ) {
+	PyErr_SetString( PyExc_ValueError,
+			 (char*)"statistic calculation failed" );
+	return NULL;
+      }
+
+    }
+
+    return segments_return( stats );
+
+  }
+
+
+  inline PyObject* calc_prepared_stat_segments( PyObject* self,
+						PyObject* args )
+  {
+
+    PyObject* handleobj = NULL;
+    PyObject* modelobj = NULL;
+
+    if ( !PyArg_ParseTuple( args, (char*)"OO", &handleobj, &modelobj ) )
+      return NULL;
+
+    PyObject* handles = PySequence_Fast( handleobj,
+					 "expected a sequence of prepared "
+					 "statistics" );
+    if ( NULL == handles )
+      return NULL;
+
+    Py_ssize_t nseg = PySequence_Fast_GET_SIZE( handles );
+    std::vector< const PreparedStat< SherpaFloat >* > preps( nseg );
+    std::vector< DoubleArray > model;
+    int status = segment_arrays( modelobj, nseg, false, model );
+
+    for ( Py_ssize_t kk = 0; EXIT_SUCCESS == status && kk < nseg; kk++ ) {
+      preps[ kk ] =
+	prepared_from_handle( PySequence_Fast_GET_ITEM( handles, kk ) );
+      if ( NULL == preps[ kk ] )
+	status = EXIT_FAILURE;
+      else if ( npy_intp( preps[ kk ]->nbins ) != model[ kk ].get_size() ) {
+	PyErr_SetString( PyExc_TypeError,
+			 (char*)"statistic input array sizes do not match" );
+	status = EXIT_FAILURE;
+      }
+    }
+
+    // the handles hold the prepared statistics alive until here
+    std::vector< SherpaFloat > stats( nseg );
+
+    for ( Py_ssize_t kk = 0; EXIT_SUCCESS == status && kk < nseg; kk++ )
+      if ( EXIT_SUCCESS != calc_prepared_stat( *preps[ kk ],
+					       model[ kk ].get_size(),
+					       model[ kk ], stats[ kk ] ) ) {
+	PyErr_SetString( PyExc_ValueError,
+			 (char*)"statistic calculation failed" );
+	status = EXIT_FAILURE;
+      }
+
+    Py_DECREF( handles );
+
+    if ( EXIT_SUCCESS != status )
+      return NULL;
+
+    return segments_return( stats );
+
+  }
+
+
+  //
+  // Batch evaluation: the statistic for every row of a (nsets x nelem)
+  // model matrix against the same data, for optimizers that evaluate a
+  // population at a time:
+  //
+  //   stats = name_batch(yraw, models, staterror, syserror, weight,
+  //                      trunc_value[, fvec])
+  //
+  // returns the nsets statistics, or with fvec true the tuple (stats,
+  // devs) with the (nsets x nelem) deviations.  The data are checked
+  // once, and without fvec a statistic with a prepared form (Kind >= 0)
+  // works out its data-only terms once for all of the rows.  The rows
+  // are shared out over the thread pool with the GIL released.
+  //
+
+  template <typename ArrayType, typename DataType>
+  struct StatBatch {
+    npy_intp nelem;
+    const ArrayType* yraw;
+    const ArrayType* staterror;
+    const ArrayType* syserror;
+    const ArrayType* weight;
+    const ArrayType* models;		// one view per row
+    ArrayType* devs;			// one view per row, or NULL
+    const PreparedStat< DataType >* prep;	// or NULL
+    DataType trunc_value;
+    DataType* stats;
+  };
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    int (*StatFunc)( npy_intp num, const ArrayType& yraw,
+			     const ArrayType& model,
+			     const ArrayType& staterror,
+			     const ArrayType& syserror,
+			     const ArrayType& weight,
+			     ArrayType& dev, DataType& val,
+			     DataType& trunc_value )>
+  int stat_batch_rows( void* data, std::ptrdiff_t begin, std::ptrdiff_t end )
+  {
+
+    StatBatch< ArrayType, DataType >& b =
+      *static_cast< StatBatch< ArrayType, DataType >* >( data );
+    int status = EXIT_SUCCESS;
+
+    for ( std::ptrdiff_t kk = begin; kk < end; kk++ ) {
+
+      int rv;
+
+      if ( b.prep )
+	rv = calc_prepared_stat( *b.prep, b.nelem, b.models[ kk ],
+				 b.stats[ kk ] );
+      else {
+	DataType trunc_value = b.trunc_value;
+	rv = StatFunc( b.nelem, *b.yraw, b.models[ kk ], *b.staterror,
+		       *b.syserror, *b.weight, b.devs[ kk ], b.stats[ kk ],
+		       trunc_value );
+      }
+
+      if ( EXIT_SUCCESS != rv )
+	status = EXIT_FAILURE;
+
+    }
+
+    return status;
+
+  }
+
+
+  // Make rows[kk] a view of row kk of flat, a (nrows x ncols) matrix;
+  // the vector holds empty Arrays until then, which are safe to copy
+  template <typename ArrayType>
+  int stat_batch_views( ArrayType& flat, npy_intp nrows, npy_intp ncols,
+			std::vector< ArrayType >& rows )
+  {
+
+    rows.resize( nrows );
+    for ( npy_intp kk = 0; kk < nrows; kk++ )
+      if ( EXIT_SUCCESS != rows[ kk ].create( 1, &ncols,
+					      flat.get_data() + kk * ncols ) )
+	return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename ArrayType,
+	    typename DataType,
+	    int (*StatFunc)( npy_intp num, const ArrayType& yraw,
+			     const ArrayType& model,
+			     const ArrayType& staterror,
+			     const ArrayType& syserror,
+			     const ArrayType& weight,
+			     ArrayType& dev, DataType& val,
+			     DataType& trunc_value ),
+	    int Kind>
+  PyObject* statfct_batch( PyObject* self, PyObject* args )
+  {
+
+    ArrayType yraw;
+    PyObject* modelobj = NULL;
+    ArrayType staterror;
+    ArrayType syserror;
+    ArrayType weight;
+    double trunc_value = -1.0;
+    int want_fvec = 0;
+
+    if ( !PyArg_ParseTuple( args, (char*)"O&OO&O&O&d|i",
+			    (converter)convert_to_array< ArrayType >, &yraw,
+			    &modelobj,
+			    (converter)convert_to_array< ArrayType >,
+			    &staterror,
+			    (converter)array_or_none< ArrayType >, &syserror,
+			    (converter)array_or_none< ArrayType >, &weight,
+			    &trunc_value, &want_fvec ) )
+      return NULL;
+
+    npy_intp nelem = yraw.get_size();
+
+    if ( ( staterror.get_size() != nelem ) ||
+	 ( syserror && ( syserror.get_size() != nelem ) ) ||
+	 ( weight && ( weight.get_size() != nelem ) ) ) {
+      PyErr_SetString( PyExc_TypeError,
+		       (char*)"statistic input array sizes do not match" );
+      return NULL;
+    }
+
+    // The model matrix, as a C-contiguous copy if need be
+    PyObject* matrix = PyArray_FROM_O( modelobj );
+    if ( NULL == matrix )
+      return NULL;
+
+    if ( ( 2 != PyArray_NDIM( matrix ) ) ||
+	 ( nelem != PyArray_DIM( matrix, 1 ) ) ) {
+      std::ostringstream err;
+      err << "expected a 2D array of models with " << nelem << " columns";
+      PyErr_SetString( PyExc_TypeError, err.str().c_str() );
+      Py_DECREF( matrix );
+      return NULL;
+    }
+
+    npy_intp nsets = PyArray_DIM( matrix, 0 );
+    PyObject* flat = PyArray_Ravel( (PyArrayObject*)matrix, NPY_CORDER );
+    Py_DECREF( matrix );
+    if ( NULL == flat )
+      return NULL;
+
+    ArrayType models;
+    int rv = models.from_obj( flat, true );
+    Py_DECREF( flat );
+    if ( EXIT_SUCCESS != rv )
+      return NULL;
+
+    std::vector< ArrayType > modelrows;
+    if ( EXIT_SUCCESS != stat_batch_views( models, nsets, nelem, modelrows ) )
+      return NULL;
+
+    ArrayType stats;
+    if ( EXIT_SUCCESS != stats.create( 1, &nsets ) )
+      return NULL;
+
+    ArrayType devs;
+    std::vector< ArrayType > devrows;
+    PreparedStat< DataType > prep;
+    bool prepared = ( !want_fvec && Kind >= 0 );
+
+    if ( prepared ) {
+      if ( EXIT_SUCCESS != prepare_stat( Kind, nelem, yraw, staterror,
+					 syserror, weight,
+					 DataType( trunc_value ), prep ) ) {
+	PyErr_SetString( PyExc_ValueError,
+			 (char*)"statistic calculation failed" );
+	return NULL;
+      }
+    } else {
+      // the deviations are needed for temporary storage in any case
+      npy_intp dims[ 2 ] = { nsets, nelem };
+      if ( ( EXIT_SUCCESS != devs.create( 2, dims ) ) ||
+	   ( EXIT_SUCCESS != stat_batch_views( devs, nsets, nelem,
+					       devrows ) ) )
+	return NULL;
+    }
+
+    if ( nsets > 0 ) {
+
+      StatBatch< ArrayType, DataType > batch =
+	{ nelem, &yraw, &staterror, &syserror, &weight, &modelrows[ 0 ],
+	  prepared ? NULL : &devrows[ 0 ], prepared ? &prep : NULL,
+	  DataType( trunc_value ), stats.get_data() };
+
+      // Whole rows go to a thread, as many as make up a pool chunk
+      const int nthreads = reduction_threads();
+      std::ptrdiff_t perchunk =
+	sherpa::threads::settings().chunksize / ( nelem > 0 ? nelem : 1 );
+      if ( perchunk < 1 )
+	perchunk = 1;
+
+      int status;
+
+      Py_BEGIN_ALLOW_THREADS
+      if ( nthreads < 2 || nsets < 2 * perchunk )
+	status = stat_batch_rows< ArrayType, DataType, StatFunc >
+	  ( &batch, 0, nsets );
+      else
+	status = sherpa::threads::ThreadPool::instance().run
+	  ( stat_batch_rows< ArrayType, DataType, StatFunc >, &batch, nsets,
+	    perchunk, nthreads );
+      Py_END_ALLOW_THREADS
+
+      if ( EXIT_SUCCESS != status ) {
+	PyErr_SetString( PyExc_ValueError,
+			 (char*)"statistic calculation failed" );
+	return NULL;
+      }
+
+    }
+
+    if ( !want_fvec )
+      return stats.return_new_ref();
+
+    return Py_BuildValue( (char*)"(NN)", stats.return_new_ref(),
+			  devs.return_new_ref() );
+
+  }
+
+
+  //
+  // Module functions to query and change how the statistics are summed
+  // (see reproducible_sums in stats.hh) and how many threads sum them
+  // (reduction_threads, which leaves the model threading alone)
+  //
+
+  inline PyObject* set_reduction( PyObject* self, PyObject* args )
+  {
+
+    int reproducible = reproducible_sums();
+    int nthreads = reduction_threads();
+
+    if ( !PyArg_ParseTuple( args, (char*)"i|i", &reproducible, &nthreads ) )
+      return NULL;
+
+    if ( nthreads < 1 ) {
+      PyErr_SetString( PyExc_ValueError,
+		       (char*)"nthreads must be positive" );
+      return NULL;
+    }
+
+    set_reproducible_sums( 0 != reproducible );
+    set_reduction_threads( nthreads );
+
+    Py_RETURN_NONE;
+
+  }
+
+
+  inline PyObject* get_reduction( PyObject* self, PyObject* args )
+  {
+
+    return Py_BuildValue( (char*)"(Ni)",
+			  PyBool_FromLong( reproducible_sums() ),
+			  reduction_threads() );
+
+  }
+
+
+  //
+  // Single precision: with single_precision() switched on (see
+  // extension.hh), every array is read as float32 and the errors or
+  // deviations are returned as float32.  The terms are still worked out
+  // and summed in double precision, so only the stored per-bin values
+  // are rounded.
+  //
+
+  template <PyObject* (*DoubleFunc)( PyObject* self, PyObject* args ),
+	    PyObject* (*FloatFunc)( PyObject* self, PyObject* args )>
+  PyObject* statfct_float32( PyObject* self, PyObject* args )
+  {
+
+    if ( single_precision() )
+      return FloatFunc( self, args );
+
+    return DoubleFunc( self, args );
+
+  }
+
+
 }  }  /* namespace stats, namespace sherpa */
 
 
@@ -171,13 +882,65 @@ namespace sherpa { namespace stats {
   sherpa::stats::name< SherpaFloatArray, SherpaFloatArray, SherpaFloat, \
                        npy_intp >
 
-#define _STATFCTSPEC(name, ftype) \
-  FCTSPEC(name, (sherpa::stats::ftype< SherpaFloatArray, SherpaFloat, \
-                                       _STATFCTPTR(name) >))
+#define _STATFCTPTR32(name) \
+  sherpa::stats::name< SherpaFloat32Array, SherpaFloat32Array, SherpaFloat, \
+                       npy_intp >
 
+#define _STATFCTSPEC(name, ftype) \
+  FCTSPEC(name, (sherpa::stats::statfct_float32 \
+                 < sherpa::stats::ftype< SherpaFloatArray, SherpaFloat, \
+                                         _STATFCTPTR(name) >, \
+                   sherpa::stats::ftype< SherpaFloat32Array, SherpaFloat, \
+                                         _STATFCTPTR32(name) > >))
+
+#define _STATSCALARPTR(name) \
+  sherpa::stats::name< SherpaFloatArray, SherpaFloat, npy_intp >
+
+#define _STATSCALARPTR32(name) \
+  sherpa::stats::name< SherpaFloat32Array, SherpaFloat, npy_intp >
+
+#define _STATFCTSPEC_SEGMENTS(name) \
+  FCTSPEC(name##_segments, \
+          (sherpa::stats::statfct_segments< SherpaFloatArray, SherpaFloat, \
+                                            _STATSCALARPTR(name##_scalar) >))
+
+#define _STATFCTSPEC_SCALAR(name) \
+  FCTSPEC(name##_scalar, \
+          (sherpa::stats::statfct_float32 \
+           < sherpa::stats::statfct_scalar< SherpaFloatArray, SherpaFloat, \
+                                            _STATSCALARPTR(name##_scalar) >, \
+             sherpa::stats::statfct_scalar< SherpaFloat32Array, SherpaFloat, \
+                                            _STATSCALARPTR32(name##_scalar) > >))
+
+// Each statistic gets four module functions: name, returning the
+// statistic and the per-bin deviations, name_scalar, returning the
+// statistic alone, name_segments, for several data sets at once, and
+// name_grad, returning the statistic and its derivatives with respect
+// to the model values
 #define STATERRFCT(name)	_STATFCTSPEC(name, staterrfct)
-#define STATFCT(name)		_STATFCTSPEC(name, statfct)
+#define STATFCT(name)		_STATFCTSPEC(name, statfct), \
+				_STATFCTSPEC_SCALAR(name), \
+				_STATFCTSPEC_SEGMENTS(name), \
+				_STATFCTSPEC(name##_grad, statfct)
 #define STATFCT_NOERR(name)	_STATFCTSPEC(name, statfct_noerr)
 
+// name_batch, with the kind of prepared statistic used for the rows
+// when the deviations are not wanted (-1 for none)
+#define STATFCT_BATCH(name, kind) \
+  FCTSPEC(name##_batch, \
+          (sherpa::stats::statfct_batch< SherpaFloatArray, SherpaFloat, \
+                                         _STATFCTPTR(name), kind >))
+
+#define STATFCT_REDUCTION \
+  FCTSPEC(set_reduction, sherpa::stats::set_reduction), \
+  FCTSPEC(get_reduction, sherpa::stats::get_reduction), \
+  PRECISIONFCTS
+
+#define STATFCT_PREPARED \
+  FCTSPEC(prepare_stat, sherpa::stats::prepare_stat), \
+  FCTSPEC(calc_prepared_stat, sherpa::stats::calc_prepared_stat), \
+  FCTSPEC(calc_prepared_stat_segments, \
+          sherpa::stats::calc_prepared_stat_segments)
+
 
 #endif /* __sherpa_stat_extension_hh__ */
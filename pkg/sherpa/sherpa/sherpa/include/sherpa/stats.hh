@@ -22,13 +22,200 @@
 
 #include <cstdlib>
 #include <cmath>
+#include <vector>
 
 #include <sherpa/utils.hh>
+#include <sherpa/threads.hh>
 
 
 namespace sherpa { namespace stats {
 
 
+  //
+  // The sums behind the statistics.  By default they are the serial
+  // kahan_sum and enorm2 of utils.hh.  With reproducible sums switched
+  // on (SHERPA_STAT_REPRODUCIBLE=1, or set_reduction from Python) the
+  // terms are cut into blocks of REDUCTION_BLOCK, each block is summed
+  // on its own (on the thread pool when reduction_threads() is more
+  // than one), and the block sums are merged along
+  // a fixed tree with compensated merges.  Neither the blocks nor the
+  // tree depend on the thread count or the pool's chunk size, so the
+  // statistic is the same bit for bit however many threads work on it.
+  //
+
+  enum { REDUCTION_BLOCK = 4096 };
+
+
+  //
+  // Whether the sums are reproducible, and the number of threads used
+  // by the statistics, for the reproducible sums and the batch
+  // statistics.  The thread count is kept apart from the model
+  // threading of sherpa::threads::settings(), whose chunk size is still
+  // used, and starts from SHERPA_STAT_THREADS.  Like those settings
+  // both are read with the GIL released, so they are only accessed
+  // under reduction_mutex().
+  //
+
+  inline pthread_mutex_t& reduction_mutex()
+  {
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    return mutex;
+  }
+
+
+  inline bool& current_reproducible_sums()
+  {
+    static bool on =
+      ( 0 != sherpa::threads::env_setting( "SHERPA_STAT_REPRODUCIBLE", 0 ) );
+    return on;
+  }
+
+
+  inline bool reproducible_sums()
+  {
+    pthread_mutex_lock( &reduction_mutex() );
+    bool on = current_reproducible_sums();
+    pthread_mutex_unlock( &reduction_mutex() );
+    return on;
+  }
+
+
+  inline void set_reproducible_sums( bool on )
+  {
+    pthread_mutex_lock( &reduction_mutex() );
+    current_reproducible_sums() = on;
+    pthread_mutex_unlock( &reduction_mutex() );
+  }
+
+
+  inline int& current_reduction_threads()
+  {
+    static int nthreads =
+      int( sherpa::threads::env_setting( "SHERPA_STAT_THREADS", 1 ) );
+    return nthreads;
+  }
+
+
+  inline int reduction_threads()
+  {
+    pthread_mutex_lock( &reduction_mutex() );
+    int nthreads = current_reduction_threads();
+    pthread_mutex_unlock( &reduction_mutex() );
+    return nthreads;
+  }
+
+
+  inline void set_reduction_threads( int nthreads )
+  {
+    pthread_mutex_lock( &reduction_mutex() );
+    current_reduction_threads() = nthreads;
+    pthread_mutex_unlock( &reduction_mutex() );
+  }
+
+
+  template <typename ConstArrayType, typename DataType, typename IndexType>
+  struct BlockReduction {
+
+    const ConstArrayType* vals;
+    IndexType num;
+    bool squares;
+    std::vector< sherpa::utils::compensated_sum< DataType > > parts;
+
+    // Sum blocks [begin, end); squares are summed in the scaled form of
+    // enorm2 within a block, as the serial norm is
+    static int run( void* data, std::ptrdiff_t begin, std::ptrdiff_t end )
+    {
+
+      BlockReduction* job = static_cast< BlockReduction* >( data );
+      const ConstArrayType& vals = *job->vals;
+
+      for ( std::ptrdiff_t block = begin; block < end; block++ ) {
+
+	IndexType first = IndexType( block * REDUCTION_BLOCK );
+	IndexType last = first + IndexType( REDUCTION_BLOCK );
+	if ( last > job->num )
+	  last = job->num;
+
+	if ( job->squares ) {
+	  sherpa::utils::enorm2_accumulator< DataType > norm( job->num );
+	  for ( IndexType ii = first; ii < last; ii++ )
+	    norm.add( vals[ ii ] );
+	  job->parts[ block ].add( norm.result() );
+	} else {
+	  sherpa::utils::compensated_sum< DataType >& sum = job->parts[ block ];
+	  for ( IndexType ii = first; ii < last; ii++ )
+	    sum.add( vals[ ii ] );
+	}
+
+      }
+
+      return EXIT_SUCCESS;
+
+    }
+
+  };
+
+
+  template <typename ConstArrayType, typename DataType, typename IndexType>
+  inline DataType reproducible_sum( IndexType num, const ConstArrayType& vals,
+				    bool squares ) {
+
+    typedef BlockReduction< ConstArrayType, DataType, IndexType > Job;
+
+    Job job;
+    job.vals = &vals;
+    job.num = num;
+    job.squares = squares;
+
+    std::ptrdiff_t nblocks =
+      ( std::ptrdiff_t( num ) + REDUCTION_BLOCK - 1 ) / REDUCTION_BLOCK;
+    job.parts.resize( nblocks );
+
+    const int nthreads = reduction_threads();
+    std::ptrdiff_t perchunk =
+      sherpa::threads::settings().chunksize / REDUCTION_BLOCK;
+    if ( perchunk < 1 )
+      perchunk = 1;
+
+    if ( nthreads < 2 || nblocks < 2 * perchunk )
+      Job::run( &job, 0, nblocks );
+    else
+      sherpa::threads::ThreadPool::instance().run( Job::run, &job, nblocks,
+						   perchunk, nthreads );
+
+    return sherpa::utils::merge_pairwise( job.parts );
+
+  }
+
+
+  // The sum of vals[0..num)
+  template <typename ConstArrayType, typename DataType, typename IndexType>
+  inline DataType stat_sum( IndexType num, const ConstArrayType& vals ) {
+
+    if ( reproducible_sums() )
+      return reproducible_sum< ConstArrayType, DataType, IndexType >
+	( num, vals, false );
+
+    return sherpa::utils::kahan_sum< ConstArrayType, DataType, IndexType >
+      ( num, vals );
+
+  }
+
+
+  // The sum of the squares of vals[0..num)
+  template <typename ConstArrayType, typename DataType, typename IndexType>
+  inline DataType stat_norm2( IndexType num, const ConstArrayType& vals ) {
+
+    if ( reproducible_sums() )
+      return reproducible_sum< ConstArrayType, DataType, IndexType >
+	( num, vals, true );
+
+    return sherpa::utils::enorm2< ConstArrayType, DataType, IndexType >
+      ( num, vals );
+
+  }
+
+
   //#define MODELFUDGEVAL 1.0e-25
 
   //
@@ -70,7 +257,7 @@ namespace sherpa { namespace stats {
     }
  
     stat = 2.0 *
-      sherpa::utils::kahan_sum< ArrayType, DataType, IndexType >( num, fvec );
+      stat_sum< ArrayType, DataType, IndexType >( num, fvec );
 
     DataType sqrt2 = std::sqrt( 2.0 );
     for ( IndexType ii = num - 1; ii >= 0; --ii )
@@ -117,7 +304,7 @@ namespace sherpa { namespace stats {
     }
  
     stat = 2.0 *
-      sherpa::utils::kahan_sum< ArrayType, DataType, IndexType >( num, fvec );
+      stat_sum< ArrayType, DataType, IndexType >( num, fvec );
 
     {
       DataType junkcstat;
@@ -165,7 +352,7 @@ namespace sherpa { namespace stats {
 	else
 	  return EXIT_FAILURE;
 
-    stat = sherpa::utils::enorm2< ArrayType, DataType, IndexType >( num, fvec );    
+    stat = stat_norm2< ArrayType, DataType, IndexType >( num, fvec );    
     /*
     stat = 0.0;
     for ( IndexType ii = num - 1; ii >= 0; --ii )
@@ -223,7 +410,7 @@ namespace sherpa { namespace stats {
   inline int calc_chi2constvar_errors( IndexType num, const ConstArrayType& yraw,
 				ArrayType& err ) {
 
-    DataType mu = sherpa::utils::kahan_sum< ArrayType, DataType, IndexType >
+    DataType mu = stat_sum< ArrayType, DataType, IndexType >
       ( num, yraw );
 
     if ( mu < 0.0 )
@@ -332,7 +519,848 @@ namespace sherpa { namespace stats {
     for ( IndexType ii = num - 1; ii >= 0; --ii )
       fvec[ ii ] = model[ ii ] - yraw[ ii ];
 
-    stat = sherpa::utils::enorm2< ArrayType, DataType, IndexType >( num, fvec );
+    stat = stat_norm2< ArrayType, DataType, IndexType >( num, fvec );
+    return EXIT_SUCCESS;
+
+  }
+
+
+  //
+  // Scalar-only forms of the statistics above, for callers that need the
+  // statistic but not the per-bin deviations (every optimizer but
+  // LevMar): one pass over the bins and nothing stored.  The terms are
+  // the ones the vector forms store in fvec, summed in the same order, so
+  // in double precision the statistic is the same bit for bit; each
+  // fails on the same input as its vector form.  With reproducible sums
+  // they hand over to the vector forms, which block the sum.
+  //
+
+  template <typename ConstArrayType, typename DataType, typename IndexType>
+  inline int calc_cstat_stat_scalar( IndexType num, const ConstArrayType& yraw,
+				     const ConstArrayType& model,
+				     const ConstArrayType& error,
+				     const ConstArrayType& syserror,
+				     const ConstArrayType& weight,
+				     DataType& stat, DataType& trunc_value ) {
+
+    if ( reproducible_sums() ) {
+      std::vector< DataType > fvec( num );
+      return calc_cstat_stat( num, yraw, model, error, syserror, weight, fvec,
+			     stat, trunc_value );
+    }
+
+    sherpa::utils::kahan_accumulator< DataType > sum;
+    DataType mymodel, d;
+
+    for ( IndexType ii = 0; ii < num; ii++ ) {
+
+      if ( model[ ii ] > 0.0) 
+	mymodel = model[ ii ];
+      else {
+	if (trunc_value > 0)
+	  mymodel = trunc_value;
+	else
+	  return EXIT_FAILURE;
+      }
+
+      if( yraw[ ii ] > 0.0 )
+	d = mymodel - yraw[ ii ] + yraw[ ii ] * ( std::log( yraw[ ii ] / mymodel ) );
+      else if ( yraw[ ii ] == 0.0 )
+	d = mymodel;
+      else
+	return EXIT_FAILURE;
+
+      if ( weight )
+	d *= weight[ ii ];
+
+      sum.add( d );
+
+    }
+
+    stat = 2.0 * sum.result();
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename ConstArrayType, typename DataType, typename IndexType>
+  inline int calc_cash_stat_scalar( IndexType num, const ConstArrayType& yraw,
+				    const ConstArrayType& model,
+				    const ConstArrayType& error,
+				    const ConstArrayType& syserror,
+				    const ConstArrayType& weight,
+				    DataType& stat, DataType& trunc_value ) {
+
+    if ( reproducible_sums() ) {
+      std::vector< DataType > fvec( num );
+      return calc_cash_stat( num, yraw, model, error, syserror, weight, fvec,
+			    stat, trunc_value );
+    }
+
+    sherpa::utils::kahan_accumulator< DataType > sum;
+    DataType mymodel, d;
+
+    for ( IndexType ii = 0; ii < num; ii++ ) {
+
+      if ( model[ ii ] > 0.0) 
+	mymodel = model[ ii ];
+      else {
+	if (trunc_value > 0)
+	  mymodel = trunc_value;
+	else
+	  return EXIT_FAILURE;
+      }
+
+      // calc_cash_stat rejects negative counts when it works out the
+      // cstat deviations
+      if ( yraw[ ii ] < 0.0 )
+	return EXIT_FAILURE;
+
+      if ( 0.0 == yraw[ ii ] )
+	d = mymodel;
+      else
+	d = mymodel - ( yraw[ ii ] * std::log( mymodel ) );
+
+      if ( weight )
+	d *= weight[ ii ];
+
+      sum.add( d );
+
+    }
+
+    stat = 2.0 * sum.result();
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename ConstArrayType, typename DataType, typename IndexType>
+  inline int calc_chi2_stat_scalar( IndexType num, const ConstArrayType& yraw,
+				    const ConstArrayType& model,
+				    const ConstArrayType& error,
+				    const ConstArrayType& syserror,
+				    const ConstArrayType& weight,
+				    DataType& stat, DataType& trunc_value ) {
+
+    if ( reproducible_sums() ) {
+      std::vector< DataType > fvec( num );
+      return calc_chi2_stat( num, yraw, model, error, syserror, weight, fvec,
+			    stat, trunc_value );
+    }
+
+    sherpa::utils::enorm2_accumulator< DataType > sum( num );
+
+    for ( IndexType ii = 0; ii < num; ii++ ) {
+
+      DataType d = model[ ii ] - yraw[ ii ];
+
+      DataType err = error[ ii ];
+
+      if ( syserror ) {
+	err *= error[ ii ];
+	err += syserror[ ii ] * syserror[ ii ];
+	err = std::sqrt( err );
+      }
+
+      // the error for Chi2 is 0, so a sanity check is required.
+      if ( 0.0 != err )
+	d /= err;
+
+      if ( weight ) {
+	if ( weight[ ii ] >= 0.0 )
+	  d *= std::sqrt( weight[ ii ] );
+	else
+	  return EXIT_FAILURE;
+      }
+
+      sum.add( d );
+
+    }
+
+    stat = sum.result();
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename ConstArrayType, typename DataType, typename IndexType>
+  inline int calc_chi2modvar_stat_scalar( IndexType num,
+					  const ConstArrayType& yraw,
+					  const ConstArrayType& model,
+					  const ConstArrayType& error,
+					  const ConstArrayType& syserror,
+					  const ConstArrayType& weight,
+					  DataType& stat, DataType& trunc_value ) {
+
+    if ( reproducible_sums() ) {
+      std::vector< DataType > fvec( num );
+      return calc_chi2modvar_stat( num, yraw, model, error, syserror,
+				   weight, fvec, stat, trunc_value );
+    }
+
+    sherpa::utils::enorm2_accumulator< DataType > sum( num );
+
+    for ( IndexType ii = 0; ii < num; ii++ ) {
+
+      DataType d = yraw[ ii ] - model[ ii ];
+
+      DataType err_sqr = model[ ii ];
+      if ( err_sqr < 1.0 )
+	err_sqr = 1.0;
+
+      if ( syserror )
+	err_sqr += syserror[ ii ] * syserror[ ii ];
+
+      d /= std::sqrt( err_sqr );
+
+      if ( weight ) {
+	if ( weight[ ii ] >= 0.0 )
+	  d *= std::sqrt( weight[ ii ] );
+	else
+	  return EXIT_FAILURE;
+      }
+
+      sum.add( d );
+
+    }
+
+    stat = sum.result();
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename ConstArrayType, typename DataType, typename IndexType>
+  inline int calc_lsq_stat_scalar( IndexType num, const ConstArrayType& yraw,
+				   const ConstArrayType& model,
+				   const ConstArrayType& error,
+				   const ConstArrayType& syserror,
+				   const ConstArrayType& weight,
+				   DataType& stat, DataType& trunc_value ) {
+
+    if ( reproducible_sums() ) {
+      std::vector< DataType > fvec( num );
+      return calc_lsq_stat( num, yraw, model, error, syserror, weight, fvec,
+			   stat, trunc_value );
+    }
+
+    sherpa::utils::enorm2_accumulator< DataType > sum( num );
+
+    for ( IndexType ii = 0; ii < num; ii++ )
+      sum.add( model[ ii ] - yraw[ ii ] );
+
+    stat = sum.result();
+    return EXIT_SUCCESS;
+
+  }
+
+
+  // The model value a likelihood uses in a bin: the model itself if
+  // positive, otherwise the truncation value if there is one
+  template <typename DataType>
+  inline bool likelihood_model( DataType model, DataType trunc_value,
+				DataType& mymodel ) {
+
+    if ( model > 0.0 )
+      mymodel = model;
+    else if ( trunc_value > 0 )
+      mymodel = trunc_value;
+    else
+      return false;
+
+    return true;
+
+  }
+
+
+  //
+  // The statistics with their derivatives with respect to the model:
+  // grad[ ii ] = d stat / d model[ ii ], for the chain rule with the
+  // model parameter gradients (gradient-based optimizers, the Fisher
+  // information).  The statistic is the one the scalar form gives.  In a
+  // bin where a likelihood uses the truncation value in place of the
+  // model, the statistic does not depend on the model and the derivative
+  // is zero.
+  //
+  //   cash, cstat:  2 w ( 1 - y / m )
+  //   chi2:         2 w ( m - y ) / ( err^2 + syserr^2 )
+  //   chi2modvar:  -2 w ( y - m ) / V - w ( y - m )^2 / V^2 for m >= 1,
+  //                where V = m + syserr^2, and the first term alone below
+  //   lsq:          2 ( m - y )
+  //
+
+  template <typename ArrayType, typename ConstArrayType, typename DataType,
+	    typename IndexType>
+  inline int calc_likelihood_grad( IndexType num, const ConstArrayType& yraw,
+				   const ConstArrayType& model,
+				   const ConstArrayType& weight,
+				   ArrayType& grad, DataType trunc_value ) {
+
+    for ( IndexType ii = 0; ii < num; ii++ ) {
+
+      DataType mymodel;
+      if ( !likelihood_model( DataType( model[ ii ] ), trunc_value,
+			      mymodel ) || yraw[ ii ] < 0.0 )
+	return EXIT_FAILURE;
+
+      DataType d = 0.0;
+      if ( model[ ii ] > 0.0 )
+	d = 2.0 * ( 1.0 - yraw[ ii ] / mymodel );
+      if ( weight )
+	d *= weight[ ii ];
+
+      grad[ ii ] = d;
+
+    }
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename ArrayType, typename ConstArrayType, typename DataType,
+	    typename IndexType>
+  inline int calc_cash_stat_grad( IndexType num, const ConstArrayType& yraw,
+				  const ConstArrayType& model,
+				  const ConstArrayType& error,
+				  const ConstArrayType& syserror,
+				  const ConstArrayType& weight,
+				  ArrayType& grad, DataType& stat,
+				  DataType& trunc_value ) {
+
+    if ( EXIT_SUCCESS !=
+	 calc_cash_stat_scalar( num, yraw, model, error, syserror, weight,
+				stat, trunc_value ) )
+      return EXIT_FAILURE;
+
+    return calc_likelihood_grad( num, yraw, model, weight, grad,
+				 trunc_value );
+
+  }
+
+
+  template <typename ArrayType, typename ConstArrayType, typename DataType,
+	    typename IndexType>
+  inline int calc_cstat_stat_grad( IndexType num, const ConstArrayType& yraw,
+				   const ConstArrayType& model,
+				   const ConstArrayType& error,
+				   const ConstArrayType& syserror,
+				   const ConstArrayType& weight,
+				   ArrayType& grad, DataType& stat,
+				   DataType& trunc_value ) {
+
+    if ( EXIT_SUCCESS !=
+	 calc_cstat_stat_scalar( num, yraw, model, error, syserror, weight,
+				 stat, trunc_value ) )
+      return EXIT_FAILURE;
+
+    return calc_likelihood_grad( num, yraw, model, weight, grad,
+				 trunc_value );
+
+  }
+
+
+  template <typename ArrayType, typename ConstArrayType, typename DataType,
+	    typename IndexType>
+  inline int calc_chi2_stat_grad( IndexType num, const ConstArrayType& yraw,
+				  const ConstArrayType& model,
+				  const ConstArrayType& error,
+				  const ConstArrayType& syserror,
+				  const ConstArrayType& weight,
+				  ArrayType& grad, DataType& stat,
+				  DataType& trunc_value ) {
+
+    if ( EXIT_SUCCESS !=
+	 calc_chi2_stat_scalar( num, yraw, model, error, syserror, weight,
+				stat, trunc_value ) )
+      return EXIT_FAILURE;
+
+    for ( IndexType ii = 0; ii < num; ii++ ) {
+
+      DataType err_sqr = error[ ii ] * error[ ii ];
+      if ( syserror )
+	err_sqr += syserror[ ii ] * syserror[ ii ];
+
+      // as in calc_chi2_stat, a zero error counts as one
+      DataType d = 2.0 * ( model[ ii ] - yraw[ ii ] );
+      if ( 0.0 != err_sqr )
+	d /= err_sqr;
+      if ( weight )
+	d *= weight[ ii ];
+
+      grad[ ii ] = d;
+
+    }
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename ArrayType, typename ConstArrayType, typename DataType,
+	    typename IndexType>
+  inline int calc_chi2modvar_stat_grad( IndexType num,
+					const ConstArrayType& yraw,
+					const ConstArrayType& model,
+					const ConstArrayType& error,
+					const ConstArrayType& syserror,
+					const ConstArrayType& weight,
+					ArrayType& grad, DataType& stat,
+					DataType& trunc_value ) {
+
+    if ( EXIT_SUCCESS !=
+	 calc_chi2modvar_stat_scalar( num, yraw, model, error, syserror,
+				      weight, stat, trunc_value ) )
+      return EXIT_FAILURE;
+
+    for ( IndexType ii = 0; ii < num; ii++ ) {
+
+      DataType resid = yraw[ ii ] - model[ ii ];
+
+      DataType var = model[ ii ];
+      bool floor = ( var < 1.0 );
+      if ( floor )
+	var = 1.0;
+      if ( syserror )
+	var += syserror[ ii ] * syserror[ ii ];
+
+      DataType d = -2.0 * resid / var;
+      if ( !floor )
+	d -= ( resid / var ) * ( resid / var );
+      if ( weight )
+	d *= weight[ ii ];
+
+      grad[ ii ] = d;
+
+    }
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename ArrayType, typename ConstArrayType, typename DataType,
+	    typename IndexType>
+  inline int calc_lsq_stat_grad( IndexType num, const ConstArrayType& yraw,
+				 const ConstArrayType& model,
+				 const ConstArrayType& error,
+				 const ConstArrayType& syserror,
+				 const ConstArrayType& weight,
+				 ArrayType& grad, DataType& stat,
+				 DataType& trunc_value ) {
+
+    if ( EXIT_SUCCESS !=
+	 calc_lsq_stat_scalar( num, yraw, model, error, syserror, weight,
+			       stat, trunc_value ) )
+      return EXIT_FAILURE;
+
+    for ( IndexType ii = 0; ii < num; ii++ )
+      grad[ ii ] = 2.0 * ( model[ ii ] - yraw[ ii ] );
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  //
+  // A statistic prepared once for a data set, so that each evaluation
+  // during a fit is a single pass over the model values: the data and
+  // everything that depends only on the data and its errors (the log of
+  // the counts for cstat, the combined chi-square scale, the squared
+  // systematic errors, the weights) are worked out by prepare_stat and
+  // kept in contiguous buffers.  Bins with no counts are flagged so that
+  // the likelihoods skip their logs.  Input that would make the
+  // statistic fail on every evaluation (negative counts or weights) is
+  // rejected when preparing.
+  //
+  // The value agrees with the scalar form to rounding: cash gives the
+  // same terms, while cstat and the chi-square statistics are refactored
+  // around the cached quantities.
+  //
+  // The sparse likelihoods are for data that are mostly empty bins, such
+  // as X-ray images.  Only the bins with counts are kept, by index, and
+  // the empty bins contribute through the sum of the model alone:
+  //
+  //   cash  = 2 [ sum_all w m - sum_occupied w y log(m) ]
+  //   cstat = 2 [ sum_all w m + sum_occupied w y ( log(y) - log(m) - 1 ) ]
+  //
+  // so logs are taken at the occupied bins only.  The caller may pass
+  // the sum of weight * model when it has it for free (a normalized
+  // model, say); then the empty bins are not read at all, and the
+  // truncation value is applied at the occupied bins only.
+  //
+  template <typename DataType>
+  struct PreparedStat {
+
+    enum Kind { CASH, CSTAT, CHI2, CHI2MODVAR, LSQ, SPARSE_CASH,
+		SPARSE_CSTAT };
+
+    int kind;
+    DataType trunc_value;
+    std::ptrdiff_t nbins;
+    std::vector< DataType > yraw;	// sparse: the occupied bins only
+    std::vector< DataType > term;	// cstat: log(yraw), chi2: the scale
+					// sqrt(weight) / error, chi2modvar:
+					// syserror^2
+    std::vector< DataType > weight;	// cash, cstat: weight,
+					// chi2modvar: sqrt(weight),
+					// sparse: weight of every bin, or
+					// empty if unweighted
+    std::vector< char > nonzero;	// cash, cstat: yraw != 0
+    std::vector< std::ptrdiff_t > index;	// sparse: the occupied bins
+
+  };
+
+
+  template <typename ConstArrayType, typename DataType, typename IndexType>
+  inline int prepare_stat( int kind, IndexType num,
+			   const ConstArrayType& yraw,
+			   const ConstArrayType& error,
+			   const ConstArrayType& syserror,
+			   const ConstArrayType& weight,
+			   DataType trunc_value,
+			   PreparedStat< DataType >& prep ) {
+
+    typedef PreparedStat< DataType > Prep;
+
+    prep.kind = kind;
+    prep.trunc_value = trunc_value;
+    prep.nbins = std::ptrdiff_t( num );
+    prep.yraw.resize( num );
+    prep.term.clear();
+    prep.weight.clear();
+    prep.nonzero.clear();
+    prep.index.clear();
+
+    for ( IndexType ii = 0; ii < num; ii++ )
+      prep.yraw[ ii ] = yraw[ ii ];
+
+    switch ( kind ) {
+
+    case Prep::CASH:
+    case Prep::CSTAT:
+      if ( Prep::CSTAT == kind )
+	prep.term.resize( num );
+      prep.weight.resize( num );
+      prep.nonzero.resize( num );
+      for ( IndexType ii = 0; ii < num; ii++ ) {
+	if ( yraw[ ii ] < 0.0 )
+	  return EXIT_FAILURE;
+	prep.nonzero[ ii ] = ( yraw[ ii ] != 0.0 );
+	if ( Prep::CSTAT == kind )
+	  prep.term[ ii ] = prep.nonzero[ ii ] ? std::log( yraw[ ii ] ) : 0.0;
+	prep.weight[ ii ] = weight ? weight[ ii ] : 1.0;
+      }
+      break;
+
+    case Prep::CHI2:
+      if ( !error )
+	return EXIT_FAILURE;
+      prep.term.resize( num );
+      for ( IndexType ii = 0; ii < num; ii++ ) {
+	DataType err = error[ ii ];
+	if ( syserror ) {
+	  err *= error[ ii ];
+	  err += syserror[ ii ] * syserror[ ii ];
+	  err = std::sqrt( err );
+	}
+	DataType scale = 1.0;
+	if ( weight ) {
+	  if ( weight[ ii ] < 0.0 )
+	    return EXIT_FAILURE;
+	  scale = std::sqrt( weight[ ii ] );
+	}
+	// the error for Chi2 is 0, so a sanity check is required.
+	prep.term[ ii ] = ( 0.0 != err ) ? scale / err : scale;
+      }
+      break;
+
+    case Prep::CHI2MODVAR:
+      prep.term.resize( num );
+      prep.weight.resize( num );
+      for ( IndexType ii = 0; ii < num; ii++ ) {
+	prep.term[ ii ] = syserror ? syserror[ ii ] * syserror[ ii ] : 0.0;
+	if ( weight && weight[ ii ] < 0.0 )
+	  return EXIT_FAILURE;
+	prep.weight[ ii ] = weight ? std::sqrt( weight[ ii ] ) : 1.0;
+      }
+      break;
+
+    case Prep::LSQ:
+      break;
+
+    case Prep::SPARSE_CASH:
+    case Prep::SPARSE_CSTAT:
+      prep.yraw.clear();
+      for ( IndexType ii = 0; ii < num; ii++ ) {
+	if ( yraw[ ii ] < 0.0 )
+	  return EXIT_FAILURE;
+	if ( yraw[ ii ] != 0.0 ) {
+	  prep.index.push_back( std::ptrdiff_t( ii ) );
+	  prep.yraw.push_back( yraw[ ii ] );
+	  if ( Prep::SPARSE_CSTAT == kind )
+	    prep.term.push_back( std::log( yraw[ ii ] ) );
+	}
+      }
+      if ( weight ) {
+	prep.weight.resize( num );
+	for ( IndexType ii = 0; ii < num; ii++ )
+	  prep.weight[ ii ] = weight[ ii ];
+      }
+      break;
+
+    default:
+      return EXIT_FAILURE;
+
+    }
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  //
+  // The sum of weight * model over every bin for the sparse likelihoods.
+  // There are no logs to hide the latency of a compensated sum here, so
+  // blocks of bins are summed four ways and only the block sums go to
+  // sum; a block with a model value that is not positive is summed again
+  // bin by bin with the truncation value.
+  //
+  enum { SPARSE_BLOCK = 256 };
+
+  template <typename ConstArrayType, typename DataType, typename IndexType,
+	    typename SumType>
+  inline int sparse_model_sum( IndexType num, const ConstArrayType& model,
+			       const DataType* weight, DataType trunc_value,
+			       SumType& sum ) {
+
+    for ( IndexType first = 0; first < num; first += SPARSE_BLOCK ) {
+
+      IndexType last = first + IndexType( SPARSE_BLOCK );
+      if ( last > num )
+	last = num;
+
+      DataType part[ 4 ] = { 0.0, 0.0, 0.0, 0.0 };
+      bool positive = true;
+      IndexType ii = first;
+
+      for ( ; ii + 3 < last; ii += 4 )
+	for ( int jj = 0; jj < 4; jj++ ) {
+	  DataType mm = model[ ii + jj ];
+	  positive = positive && ( mm > 0.0 );
+	  part[ jj ] += weight ? mm * weight[ ii + jj ] : mm;
+	}
+      for ( ; ii < last; ii++ ) {
+	DataType mm = model[ ii ];
+	positive = positive && ( mm > 0.0 );
+	part[ 0 ] += weight ? mm * weight[ ii ] : mm;
+      }
+
+      if ( positive ) {
+	sum.add( ( part[ 0 ] + part[ 1 ] ) + ( part[ 2 ] + part[ 3 ] ) );
+	continue;
+      }
+
+      for ( ii = first; ii < last; ii++ ) {
+	DataType mymodel;
+	if ( !likelihood_model( DataType( model[ ii ] ), trunc_value,
+				mymodel ) )
+	  return EXIT_FAILURE;
+	sum.add( weight ? mymodel * weight[ ii ] : mymodel );
+      }
+
+    }
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  // Stores the terms in order, to be summed afterwards
+  template <typename DataType>
+  class term_recorder {
+
+  public:
+
+    explicit term_recorder( std::vector< DataType >& terms )
+      : first( terms.empty() ? NULL : &terms[ 0 ] ), next( first ) { }
+
+    void add( DataType val ) { *next++ = val; }
+
+    std::ptrdiff_t size() const { return next - first; }
+
+  private:
+
+    DataType* first;
+    DataType* next;
+
+  };
+
+
+  // Pass the terms of a prepared statistic to sum (the likelihoods) or
+  // norm (the chi-square statistics); model_sum, if not NULL, is the sum
+  // of weight * model for a sparse likelihood
+  template <typename ConstArrayType, typename DataType, typename IndexType,
+	    typename SumType, typename NormType>
+  inline int accumulate_prepared_stat( const PreparedStat< DataType >& prep,
+				       IndexType num,
+				       const ConstArrayType& model,
+				       const DataType* model_sum,
+				       SumType& sum, NormType& norm ) {
+
+    typedef PreparedStat< DataType > Prep;
+
+    const DataType* yraw = prep.yraw.empty() ? NULL : &prep.yraw[ 0 ];
+
+    switch ( prep.kind ) {
+
+    case Prep::CASH:
+    case Prep::CSTAT: {
+      const DataType* weight = num ? &prep.weight[ 0 ] : NULL;
+      const char* nonzero = num ? &prep.nonzero[ 0 ] : NULL;
+      const DataType* logy =
+	( Prep::CSTAT == prep.kind && num ) ? &prep.term[ 0 ] : NULL;
+      for ( IndexType ii = 0; ii < num; ii++ ) {
+	DataType mymodel = model[ ii ];
+	if ( !( mymodel > 0.0 ) ) {
+	  if ( prep.trunc_value > 0 )
+	    mymodel = prep.trunc_value;
+	  else
+	    return EXIT_FAILURE;
+	}
+	DataType d = mymodel;
+	if ( nonzero[ ii ] ) {
+	  if ( logy )
+	    d = mymodel - yraw[ ii ] +
+	      yraw[ ii ] * ( logy[ ii ] - std::log( mymodel ) );
+	  else
+	    d = mymodel - ( yraw[ ii ] * std::log( mymodel ) );
+	}
+	sum.add( d * weight[ ii ] );
+      }
+      break;
+    }
+
+    case Prep::CHI2: {
+      const DataType* scale = num ? &prep.term[ 0 ] : NULL;
+      for ( IndexType ii = 0; ii < num; ii++ )
+	norm.add( ( model[ ii ] - yraw[ ii ] ) * scale[ ii ] );
+      break;
+    }
+
+    case Prep::CHI2MODVAR: {
+      const DataType* syserr2 = num ? &prep.term[ 0 ] : NULL;
+      const DataType* sqrtw = num ? &prep.weight[ 0 ] : NULL;
+      for ( IndexType ii = 0; ii < num; ii++ ) {
+	DataType err_sqr = model[ ii ];
+	if ( err_sqr < 1.0 )
+	  err_sqr = 1.0;
+	err_sqr += syserr2[ ii ];
+	norm.add( ( yraw[ ii ] - model[ ii ] ) / std::sqrt( err_sqr ) *
+		  sqrtw[ ii ] );
+      }
+      break;
+    }
+
+    case Prep::LSQ: {
+      for ( IndexType ii = 0; ii < num; ii++ )
+	norm.add( model[ ii ] - yraw[ ii ] );
+      break;
+    }
+
+    case Prep::SPARSE_CASH:
+    case Prep::SPARSE_CSTAT: {
+      const DataType* weight = prep.weight.empty() ? NULL : &prep.weight[ 0 ];
+      const std::ptrdiff_t* index =
+	prep.index.empty() ? NULL : &prep.index[ 0 ];
+      const DataType* logy =
+	( Prep::SPARSE_CSTAT == prep.kind && index ) ? &prep.term[ 0 ] : NULL;
+      IndexType nocc = IndexType( prep.index.size() );
+      DataType mymodel;
+
+      // Every bin contributes its model value...
+      if ( model_sum )
+	sum.add( *model_sum );
+      else if ( EXIT_SUCCESS !=
+		sparse_model_sum( num, model, weight, prep.trunc_value, sum ) )
+	return EXIT_FAILURE;
+
+      // ...and the bins with counts their logs
+      for ( IndexType jj = 0; jj < nocc; jj++ ) {
+	IndexType ii = IndexType( index[ jj ] );
+	if ( !likelihood_model( DataType( model[ ii ] ), prep.trunc_value,
+				mymodel ) )
+	  return EXIT_FAILURE;
+	DataType d;
+	if ( logy )
+	  d = yraw[ jj ] * ( logy[ jj ] - std::log( mymodel ) ) - yraw[ jj ];
+	else
+	  d = -yraw[ jj ] * std::log( mymodel );
+	// a model sum from the caller has the untruncated value
+	if ( model_sum )
+	  d += mymodel - model[ ii ];
+	sum.add( weight ? d * weight[ ii ] : d );
+      }
+      break;
+    }
+
+    default:
+      return EXIT_FAILURE;
+
+    }
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  // model_sum is used by the sparse likelihoods only (see PreparedStat)
+  template <typename ConstArrayType, typename DataType, typename IndexType>
+  inline int calc_prepared_stat( const PreparedStat< DataType >& prep,
+				 IndexType num, const ConstArrayType& model,
+				 DataType& stat,
+				 const DataType* model_sum = NULL ) {
+
+    typedef PreparedStat< DataType > Prep;
+
+    if ( std::ptrdiff_t( num ) != prep.nbins )
+      return EXIT_FAILURE;
+
+    bool likelihood = ( Prep::CASH == prep.kind ||
+			Prep::CSTAT == prep.kind ||
+			Prep::SPARSE_CASH == prep.kind ||
+			Prep::SPARSE_CSTAT == prep.kind );
+
+    if ( reproducible_sums() ) {
+
+      std::vector< DataType > terms( num + prep.index.size() + 1 );
+      term_recorder< DataType > record( terms );
+      if ( EXIT_SUCCESS !=
+	   accumulate_prepared_stat( prep, num, model, model_sum, record,
+				     record ) )
+	return EXIT_FAILURE;
+
+      IndexType nterms = IndexType( record.size() );
+      if ( likelihood )
+	stat = 2.0 * stat_sum< std::vector< DataType >, DataType, IndexType >
+	  ( nterms, terms );
+      else
+	stat = stat_norm2< std::vector< DataType >, DataType, IndexType >
+	  ( nterms, terms );
+
+    } else {
+
+      sherpa::utils::kahan_accumulator< DataType > sum;
+      sherpa::utils::enorm2_accumulator< DataType > norm( num );
+      if ( EXIT_SUCCESS !=
+	   accumulate_prepared_stat( prep, num, model, model_sum, sum,
+				     norm ) )
+	return EXIT_FAILURE;
+
+      stat = likelihood ? DataType( 2.0 * sum.result() ) : norm.result();
+
+    }
+
     return EXIT_SUCCESS;
 
   }
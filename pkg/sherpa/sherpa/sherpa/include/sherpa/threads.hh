@@ -0,0 +1,374 @@
+//
+//  Copyright (C) 2013  Smithsonian Astrophysical Observatory
+//
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with this program; if not, write to the Free Software Foundation, Inc.,
+//  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __sherpa_threads_hh__
+#define __sherpa_threads_hh__
+
+//
+// A small pthreads pool for splitting a loop over [0, nelem) into chunks.
+//
+// The calling thread works on chunks alongside the pool threads, which are
+// started on first use and then sleep between jobs.  The pool is per
+// process, with one job at a time: a caller that finds it busy (say, a
+// second Python thread evaluating a model with the GIL released) simply
+// runs its loop serially.  After a fork() the child starts over with an
+// empty pool, since the parent's threads do not exist there.
+//
+// The thread count and chunk size default to the environment variables
+// SHERPA_MODEL_THREADS (default 1, i.e. serial) and SHERPA_MODEL_CHUNKSIZE,
+// and may be changed at runtime through set_settings().
+//
+
+#include <pthread.h>
+#include <unistd.h>
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+
+namespace sherpa { namespace threads {
+
+  // Process elements [begin, end) of the job described by data, returning
+  // EXIT_SUCCESS or EXIT_FAILURE
+  typedef int (*chunk_func)( void* data, std::ptrdiff_t begin,
+			     std::ptrdiff_t end );
+
+
+  enum {
+    DEFAULT_CHUNKSIZE = 16384,
+    MAX_THREADS = 256
+  };
+
+
+  struct Settings {
+    int nthreads;
+    std::ptrdiff_t chunksize;
+  };
+
+
+  inline long env_setting( const char* name, long defval )
+  {
+    const char* str = std::getenv( name );
+    if ( NULL == str || '\0' == *str )
+      return defval;
+    char* end = NULL;
+    long val = std::strtol( str, &end, 10 );
+    if ( '\0' != *end || val < 1 )
+      return defval;
+    return val;
+  }
+
+
+  // The settings are read by loops running with the GIL released while
+  // another Python thread may be changing them, so they are only
+  // accessed under settings_mutex() through settings() and set_settings()
+
+  inline pthread_mutex_t& settings_mutex()
+  {
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    return mutex;
+  }
+
+
+  inline Settings& current_settings()
+  {
+    static Settings current = {
+      int( env_setting( "SHERPA_MODEL_THREADS", 1 ) ),
+      std::ptrdiff_t( env_setting( "SHERPA_MODEL_CHUNKSIZE",
+				   DEFAULT_CHUNKSIZE ) )
+    };
+    return current;
+  }
+
+
+  inline Settings settings()
+  {
+    pthread_mutex_lock( &settings_mutex() );
+    Settings opts = current_settings();
+    pthread_mutex_unlock( &settings_mutex() );
+    return opts;
+  }
+
+
+  inline void set_settings( const Settings& opts )
+  {
+    pthread_mutex_lock( &settings_mutex() );
+    current_settings() = opts;
+    pthread_mutex_unlock( &settings_mutex() );
+  }
+
+
+  class ThreadPool {
+
+  public:
+
+    static ThreadPool& instance()
+    {
+      static ThreadPool pool;
+      if ( getpid() != pool.owner )
+	pool.reset();
+      return pool;
+    }
+
+    // Run func over [0, nelem) in chunks of chunksize elements with up
+    // to nthreads threads, the caller included.  Every chunk is run even
+    // if some fail, so the outcome does not depend on the scheduling.
+    int run( chunk_func func, void* data, std::ptrdiff_t nelem,
+	     std::ptrdiff_t chunksize, int nthreads )
+    {
+
+      if ( chunksize < 1 )
+	chunksize = 1;
+      std::ptrdiff_t nchunks = ( nelem + chunksize - 1 ) / chunksize;
+      if ( nthreads > MAX_THREADS )
+	nthreads = MAX_THREADS;
+      if ( nchunks < nthreads )
+	nthreads = int( nchunks );
+
+      if ( nthreads < 2 || 0 != pthread_mutex_trylock( &busy ) )
+	return func( data, 0, nelem );
+
+      pthread_mutex_lock( &mutex );
+
+      while ( int( workers.size() ) < nthreads - 1 ) {
+	pthread_t thread;
+	if ( 0 != pthread_create( &thread, NULL, worker_main, this ) )
+	  break;
+	pthread_detach( thread );
+	workers.push_back( thread );
+      }
+
+      job_func = func;
+      job_data = data;
+      job_nelem = nelem;
+      job_chunksize = chunksize;
+      next = 0;
+      nfail = 0;
+      slots = int( workers.size() );
+      if ( slots > nthreads - 1 )
+	slots = nthreads - 1;
+      ++generation;
+      pthread_cond_broadcast( &work_cond );
+
+      pthread_mutex_unlock( &mutex );
+
+      int status = work();
+
+      // Every chunk has been handed out by now; stop late workers from
+      // joining and wait for the ones still busy
+      pthread_mutex_lock( &mutex );
+      slots = 0;
+      if ( EXIT_SUCCESS != status )
+	++nfail;
+      while ( active > 0 )
+	pthread_cond_wait( &done_cond, &mutex );
+      status = ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+      pthread_mutex_unlock( &mutex );
+
+      pthread_mutex_unlock( &busy );
+
+      return status;
+
+    }
+
+  private:
+
+    ThreadPool()
+    {
+      init();
+    }
+
+    // Never destroyed: the workers are still blocked on the condition
+    // variables at exit
+
+    void init()
+    {
+      pthread_mutex_init( &busy, NULL );
+      pthread_mutex_init( &mutex, NULL );
+      pthread_cond_init( &work_cond, NULL );
+      pthread_cond_init( &done_cond, NULL );
+      workers.clear();
+      generation = 0;
+      slots = 0;
+      active = 0;
+      owner = getpid();
+    }
+
+    // In a forked child the mutexes may have been copied in a locked
+    // state and the workers are gone; the old objects are abandoned
+    void reset()
+    {
+      init();
+    }
+
+    static void* worker_main( void* arg )
+    {
+
+      ThreadPool* pool = static_cast< ThreadPool* >( arg );
+      unsigned long seen = 0;
+
+      pthread_mutex_lock( &pool->mutex );
+
+      for ( ; ; ) {
+
+	while ( seen == pool->generation )
+	  pthread_cond_wait( &pool->work_cond, &pool->mutex );
+	seen = pool->generation;
+
+	if ( pool->slots < 1 )
+	  continue;
+	--pool->slots;
+	++pool->active;
+
+	pthread_mutex_unlock( &pool->mutex );
+	int status = pool->work();
+	pthread_mutex_lock( &pool->mutex );
+
+	if ( EXIT_SUCCESS != status )
+	  ++pool->nfail;
+	if ( 0 == --pool->active )
+	  pthread_cond_signal( &pool->done_cond );
+
+      }
+
+      return NULL;
+
+    }
+
+    // Claim and run chunks of the current job until there are none left
+    int work()
+    {
+
+      int status = EXIT_SUCCESS;
+
+      for ( ; ; ) {
+
+	pthread_mutex_lock( &mutex );
+	std::ptrdiff_t begin = next;
+	next += job_chunksize;
+	pthread_mutex_unlock( &mutex );
+
+	if ( begin >= job_nelem )
+	  break;
+
+	std::ptrdiff_t end = begin + job_chunksize;
+	if ( end > job_nelem )
+	  end = job_nelem;
+
+	if ( EXIT_SUCCESS != job_func( job_data, begin, end ) )
+	  status = EXIT_FAILURE;
+
+      }
+
+      return status;
+
+    }
+
+    pthread_mutex_t busy;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    std::vector< pthread_t > workers;
+    pid_t owner;
+
+    // The current job; guarded by mutex
+    chunk_func job_func;
+    void* job_data;
+    std::ptrdiff_t job_nelem;
+    std::ptrdiff_t job_chunksize;
+    std::ptrdiff_t next;
+    unsigned long generation;
+    int slots;
+    int active;
+    int nfail;
+
+  };
+
+
+  // Run func over [0, nelem) with the current settings; loops shorter
+  // than two chunks are not worth waking the pool for
+  inline int parallel_for( chunk_func func, void* data, std::ptrdiff_t nelem )
+  {
+
+    const Settings opts = settings();
+
+    if ( opts.nthreads < 2 || nelem < 2 * opts.chunksize )
+      return func( data, 0, nelem );
+
+    return ThreadPool::instance().run( func, data, nelem, opts.chunksize,
+				       opts.nthreads );
+
+  }
+
+
+}  }  /* namespace threads, namespace sherpa */
+
+
+#ifdef testThreads
+
+#include <algorithm>
+#include <cstdio>
+
+static int fill_chunk( void* data, std::ptrdiff_t begin, std::ptrdiff_t end )
+{
+  double* x = static_cast< double* >( data );
+  int status = EXIT_SUCCESS;
+  for ( std::ptrdiff_t ii = begin; ii < end; ii++ ) {
+    x[ ii ] = 2.0 * ii;
+    if ( 12345 == ii )
+      status = EXIT_FAILURE;
+  }
+  return status;
+}
+
+int main( int argc, char* argv[] )
+{
+
+  const std::ptrdiff_t nelem = 1000000;
+  std::vector< double > x( nelem );
+
+  for ( int nthreads = 1; nthreads <= 8; nthreads *= 2 ) {
+    for ( int rep = 0; rep < 100; rep++ ) {
+      std::fill( x.begin(), x.end(), -1.0 );
+      int status = sherpa::threads::ThreadPool::instance().run
+	( fill_chunk, &x[0], nelem, 1000, nthreads );
+      for ( std::ptrdiff_t ii = 0; ii < nelem; ii++ )
+	if ( 2.0 * ii != x[ ii ] ) {
+	  std::printf( "nthreads=%d: element %ld not filled\n", nthreads,
+		       long( ii ) );
+	  return EXIT_FAILURE;
+	}
+      if ( EXIT_FAILURE != status ) {
+	std::printf( "nthreads=%d: failure not reported\n", nthreads );
+	return EXIT_FAILURE;
+      }
+    }
+    std::printf( "nthreads=%d ok\n", nthreads );
+  }
+
+  return EXIT_SUCCESS;
+
+}
+
+#endif
+
+//
+// cp threads.hh tmp.cc; g++ -g -Wall -DtestThreads tmp.cc -lpthread; rm tmp.cc; a.out
+//
+
+#endif /* __sherpa_threads_hh__ */
@@ -29,6 +29,7 @@
 #define NAN quiet_nan(0)
 #endif
 
+#include <algorithm>
 #include <vector>
 #include <limits>
 
@@ -68,6 +69,18 @@ namespace sherpa { namespace utils {
   }
 
 
+  // erf(b) - erf(a), from erfc when a and b are in the same tail, where
+  // the erf values would both round to +-1
+  inline double erf_difference( double a, double b )
+  {
+    if ( a >= 0 && b >= 0 )
+      return ::erfc( a ) - ::erfc( b );
+    if ( a <= 0 && b <= 0 )
+      return ::erfc( -b ) - ::erfc( -a );
+    return ::erf( b ) - ::erf( a );
+  }
+
+
   inline double lgamma( double x )
   {
     return ::lgamma( x );
@@ -113,34 +126,35 @@ namespace sherpa { namespace utils {
    *
    *     **********
    */
-  template <typename ConstArrayType, typename DataType, typename IndexType>
-  inline DataType enorm2( IndexType n, const ConstArrayType& x ) {
+  //
+  // enorm2 one component at a time, for callers that work out the
+  // components as they go and never store them: n is the number of
+  // components that will be added.  Adding the same components in the
+  // same order as enorm2 reads them gives the same sum bit for bit.
+  //
+  template <typename DataType>
+  class enorm2_accumulator {
+
+  public:
+
+    explicit enorm2_accumulator( DataType n )
+      : agiant( DataType( 1.304e19 ) / n ),
+	s1( 0.0 ), s2( 0.0 ), s3( 0.0 ), x1max( 0.0 ), x3max( 0.0 ) { }
+
+    void add( DataType x ) {
+
+      const DataType rdwarf = 3.834e-20;
+      const DataType zero = 0.0;
+      const DataType one = 1.0;
+      DataType temp;
+      DataType xabs = std::fabs(x);
 
-    // int i;
-    DataType agiant, floatn, s1, s2, s3, xabs, x1max, x3max;
-    DataType ans, temp;
-    static DataType rdwarf = 3.834e-20;
-    static DataType rgiant = 1.304e19;
-    static DataType zero = 0.0;
-    static DataType one = 1.0;
-    /*double fabs(), sqrt();*/
-
-    s1 = zero;
-    s2 = zero;
-    s3 = zero;
-    x1max = zero;
-    x3max = zero;
-    floatn = n;
-    agiant = rgiant / floatn;
-
-    for (IndexType i = 0; i < n; i++) {
-      xabs = std::fabs(x[i]);
       if ((xabs > rdwarf) && (xabs < agiant)) {
 	/*
 	 *	    sum for intermediate components.
 	 */
 	s2 += xabs * xabs;
-	continue;
+	return;
       }
 
       if (xabs > rdwarf) {
@@ -155,7 +169,7 @@ namespace sherpa { namespace utils {
 	  temp = xabs / x1max;
 	  s1 += temp * temp;
 	}
-	continue;
+	return;
       }
       /*
        *	       sum for small components.
@@ -170,28 +184,55 @@ namespace sherpa { namespace utils {
 	  s3 += temp * temp;
 	}
       }
+
     }
-    /*
-     *     calculation of norm.
-     */
-    if (s1 != zero) {
-      temp = s1 + (s2 / x1max) / x1max;
-      // ans = x1max * sqrt(temp);
-      ans = x1max * temp;
+
+    DataType result() const {
+
+      const DataType zero = 0.0;
+      const DataType one = 1.0;
+      DataType ans, temp;
+
+      /*
+       *     calculation of norm.
+       */
+      if (s1 != zero) {
+	temp = s1 + (s2 / x1max) / x1max;
+	// ans = x1max * sqrt(temp);
+	ans = x1max * temp;
+	return (ans);
+      }
+      if (s2 != zero) {
+	if (s2 >= x3max)
+	  temp = s2 * (one + (x3max / s2) * (x3max * s3));
+	else
+	  temp = x3max * ((s2 / x3max) + (x3max * s3));
+	// ans = sqrt(temp);
+	ans = temp;
+      } else {
+	// ans = x3max * sqrt(s3);
+	ans = x3max * s3;
+      }
       return (ans);
+
     }
-    if (s2 != zero) {
-      if (s2 >= x3max)
-	temp = s2 * (one + (x3max / s2) * (x3max * s3));
-      else
-	temp = x3max * ((s2 / x3max) + (x3max * s3));
-      // ans = sqrt(temp);
-      ans = temp;
-    } else {
-      // ans = x3max * sqrt(s3);
-      ans = x3max * s3;
-    }
-    return (ans);
+
+  private:
+
+    DataType agiant, s1, s2, s3, x1max, x3max;
+
+  };
+
+
+  template <typename ConstArrayType, typename DataType, typename IndexType>
+  inline DataType enorm2( IndexType n, const ConstArrayType& x ) {
+
+    enorm2_accumulator< DataType > sum( n );
+
+    for (IndexType i = 0; i < n; i++)
+      sum.add( x[i] );
+
+    return sum.result();
     /*
      *     last card of function enorm2.
      */
@@ -211,6 +252,99 @@ namespace sherpa { namespace utils {
   }
 
 
+  //
+  // kahan_sum one term at a time; adding finite terms in order gives
+  // the same sum as kahan_sum bit for bit
+  //
+  template <typename DataType>
+  class kahan_accumulator {
+
+  public:
+
+    kahan_accumulator() : sum( 0.0 ), correction( 0.0 ) { }
+
+    void add( DataType val ) {
+
+      DataType y = val - correction;
+      DataType t = sum + y;
+      correction = t - sum - y;
+      sum = t;
+
+    }
+
+    DataType result() const { return sum; }
+
+  private:
+
+    DataType sum;
+    DataType correction;
+
+  };
+
+
+  //
+  // A compensated sum that carries its correction separately
+  // (Neumaier's form of Kahan summation), so that two partial sums can
+  // be merged without losing either correction: the rounding error of
+  // adding the two sums is recovered exactly (Knuth's two-sum) and kept
+  // with the corrections.
+  //
+  template <typename DataType>
+  class compensated_sum {
+
+  public:
+
+    compensated_sum() : sum( 0.0 ), correction( 0.0 ) { }
+
+    void add( DataType val ) {
+
+      DataType t = sum + val;
+      DataType v = t - sum;
+      correction += ( sum - ( t - v ) ) + ( val - v );
+      sum = t;
+
+    }
+
+    void merge( const compensated_sum& other ) {
+
+      add( other.sum );
+      correction += other.correction;
+
+    }
+
+    DataType result() const { return sum + correction; }
+
+  private:
+
+    DataType sum;
+    DataType correction;
+
+  };
+
+
+  //
+  // Merge the partial sums parts[0..n) into parts[0] along a fixed
+  // binary tree: neighbours first, then pairs of pairs, and so on.  The
+  // tree depends on n alone, so the result does too.
+  //
+  template <typename DataType>
+  inline DataType merge_pairwise( std::vector< compensated_sum< DataType > >&
+				  parts ) {
+
+    std::size_t n = parts.size();
+
+    if ( 0 == n )
+      return 0.0;
+
+    for ( std::size_t stride = 1; stride < n; stride *= 2 )
+      for ( std::size_t ii = 0; ii + stride < n; ii += 2 * stride )
+	parts[ ii ].merge( parts[ ii + stride ] );
+
+    return parts[ 0 ].result();
+
+  }
+
+
   template <typename ConstArrayType, typename DataType, typename IndexType>
   inline DataType kahan_sum( IndexType num, const ConstArrayType& vals ) {
 
@@ -268,6 +402,39 @@ namespace sherpa { namespace utils {
   }
 
 
+  // Return whether the ellipse of radius2 has its axes along x0 and x1,
+  // so that radius2 is ((x0 - p[1]) / scale0)^2 + ((x1 - p[2]) / scale1)^2
+  template <typename DataType, typename ConstArrayType>
+  inline bool radius2_axes( const ConstArrayType& p,
+			    DataType& scale0, DataType& scale1 )
+  {
+
+    scale0 = scale1 = 1.0;
+    if( p[3] == 0 )
+      return true;
+    if( p[3] == 1 )
+      return false;
+
+    register DataType p_four = p[4];
+    while( p_four >= 2*PI ) {
+      p_four -= 2*PI;
+    }
+    while( p_four < 0.0 ) {
+      p_four += 2*PI;
+    }
+
+    const DataType eps = 4 * std::numeric_limits< DataType >::epsilon();
+    if( FABS( SIN(p_four) ) <= eps )
+      scale1 = 1. - p[3];
+    else if( FABS( COS(p_four) ) <= eps )
+      scale0 = 1. - p[3];
+    else
+      return false;
+    return true;
+
+  }
+
+
   template <typename DataType, typename ConstArrayType>
   inline int radius( const ConstArrayType& p,
 		     DataType x0, DataType x1, DataType& val )
@@ -283,6 +450,154 @@ namespace sherpa { namespace utils {
     
   }
 
+
+  // radius2 and its derivatives with respect to p[1] .. p[4] (the
+  // position, ellipticity and angle) in grad[0] .. grad[3]
+  template <typename DataType, typename ConstArrayType>
+  inline int radius2_grad( const ConstArrayType& p,
+			   DataType x0, DataType x1, DataType& val,
+			   DataType* grad )
+  {
+
+    if( EXIT_SUCCESS != radius2( p, x0, x1, val ) ) {
+      return EXIT_FAILURE;
+    }
+
+    register DataType deltaX = x0 - p[1];
+    register DataType deltaY = x1 - p[2];
+    register DataType cosTheta = COS(p[4]);
+    register DataType sinTheta = SIN(p[4]);
+    register DataType newX = deltaX * cosTheta + deltaY * sinTheta;
+    register DataType newY = deltaY * cosTheta - deltaX * sinTheta;
+    register DataType ellip2 = (1. - p[3]) * (1. - p[3]);
+
+    grad[0] = -2.0 * ( newX * cosTheta - newY * sinTheta / ellip2 );
+    grad[1] = -2.0 * ( newX * sinTheta + newY * cosTheta / ellip2 );
+    grad[2] = 2.0 * newY * newY / ( ellip2 * (1. - p[3]) );
+    grad[3] = 2.0 * newX * newY * ( 1.0 - 1.0 / ellip2 );
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  // radius and its derivatives as for radius2_grad; the derivatives are
+  // taken to be zero at the centre, where they are undefined
+  template <typename DataType, typename ConstArrayType>
+  inline int radius_grad( const ConstArrayType& p,
+			  DataType x0, DataType x1, DataType& val,
+			  DataType* grad )
+  {
+
+    if( EXIT_SUCCESS != radius2_grad( p, x0, x1, val, grad ) ) {
+      return EXIT_FAILURE;
+    }
+
+    val = SQRT( val );
+
+    for ( int ii = 0; ii < 4; ii++ )
+      grad[ ii ] = ( 0.0 == val ) ? 0.0 : grad[ ii ] / ( 2.0 * val );
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  //
+  // Central difference gradients, for the models whose derivatives are
+  // not worth writing out: each parameter is stepped in turn through a
+  // shifted_pars view of the parameter array.
+  //
+
+  template <typename ConstArrayType, typename DataType>
+  class shifted_pars {
+
+  public:
+
+    explicit shifted_pars( const ConstArrayType& p, int index=-1,
+			   DataType delta=0.0 )
+      : pars( p ), shifted( index ), step( delta ) { }
+
+    DataType operator[]( int ii ) const
+    {
+      return ( ii == shifted ) ? pars[ ii ] + step : pars[ ii ];
+    }
+
+  private:
+
+    const ConstArrayType& pars;
+    int shifted;
+    DataType step;
+
+  };
+
+
+  // About the cube root of the machine epsilon, relative to the
+  // parameter value
+  template <typename DataType>
+  inline DataType fd_step( DataType x )
+  {
+    return 6.0554544523933395e-06 * std::max( DataType( FABS( x ) ),
+					      DataType( 1.0 ) );
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int fd_point_grad( int npars,
+			    int (*func)( const shifted_pars< ConstArrayType,
+					 DataType >& p, DataType x,
+					 DataType& val ),
+			    const ConstArrayType& p, DataType x,
+			    DataType& val, DataType* grad )
+  {
+
+    typedef shifted_pars< ConstArrayType, DataType > Pars;
+
+    if ( EXIT_SUCCESS != func( Pars( p ), x, val ) )
+      return EXIT_FAILURE;
+
+    for ( int ii = 0; ii < npars; ii++ ) {
+      DataType h = fd_step( DataType( p[ ii ] ) );
+      DataType hi, lo;
+      if ( EXIT_SUCCESS != func( Pars( p, ii, h ), x, hi ) ||
+	   EXIT_SUCCESS != func( Pars( p, ii, -h ), x, lo ) )
+	return EXIT_FAILURE;
+      grad[ ii ] = ( hi - lo ) / ( 2.0 * h );
+    }
+
+    return EXIT_SUCCESS;
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType>
+  inline int fd_integrated_grad( int npars,
+				 int (*func)( const shifted_pars
+					      < ConstArrayType, DataType >& p,
+					      DataType xlo, DataType xhi,
+					      DataType& val ),
+				 const ConstArrayType& p, DataType xlo,
+				 DataType xhi, DataType& val, DataType* grad )
+  {
+
+    typedef shifted_pars< ConstArrayType, DataType > Pars;
+
+    if ( EXIT_SUCCESS != func( Pars( p ), xlo, xhi, val ) )
+      return EXIT_FAILURE;
+
+    for ( int ii = 0; ii < npars; ii++ ) {
+      DataType h = fd_step( DataType( p[ ii ] ) );
+      DataType hi, lo;
+      if ( EXIT_SUCCESS != func( Pars( p, ii, h ), xlo, xhi, hi ) ||
+	   EXIT_SUCCESS != func( Pars( p, ii, -h ), xlo, xhi, lo ) )
+	return EXIT_FAILURE;
+      grad[ ii ] = ( hi - lo ) / ( 2.0 * h );
+    }
+
+    return EXIT_SUCCESS;
+
+  }
+
   // {
   
   //   register DataType deltaX = x0 - p[1];
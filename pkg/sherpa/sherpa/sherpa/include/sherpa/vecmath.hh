@@ -0,0 +1,876 @@
+//
+//  Copyright (C) 2013  Smithsonian Astrophysical Observatory
+//
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with this program; if not, write to the Free Software Foundation, Inc.,
+//  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef __sherpa_vecmath_hh__
+#define __sherpa_vecmath_hh__
+
+//
+// Vectorized exp, log, pow and erf in double precision, and drivers that
+// apply an elementwise model kernel over contiguous arrays with AVX2 or
+// AVX-512.
+//
+// The functions are written once with the GCC vector extensions and are
+// instantiated for 4-wide (AVX2 + FMA) and 8-wide (AVX-512F) vectors
+// inside functions carrying the matching target attribute, so the
+// extension modules still build for the baseline architecture.  The
+// instruction set is picked at run time from the CPU; setting the
+// environment variable SHERPA_SIMD to "none" or "avx2" caps it.
+//
+// exp and log use the fdlibm argument reductions and polynomials, pow is
+// exp of a double-double log (so its error grows with |y| rather than
+// with |y log(x)|), and erf uses the fdlibm rational approximations.
+// All are within a few ulp of libm; the testVecMath driver at the end of
+// this file measures the errors.
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#if defined(__GNUC__) && !defined(__clang__) && \
+  !defined(__INTEL_COMPILER) && \
+  ( defined(__x86_64__) || defined(__i386__) ) && \
+  ( ( __GNUC__ > 4 ) || ( ( __GNUC__ == 4 ) && ( __GNUC_MINOR__ >= 9 ) ) )
+#define SHERPA_VECMATH 1
+#endif
+
+//
+// The vector types only ever cross inlined calls, so the ABI notes about
+// passing them by value are noise.  SHERPA_VEC_BEGIN and SHERPA_VEC_END
+// keep them quiet around the vector code only, here and in the kernels;
+// the notes GCC only gives at the end of the file are left to the
+// -Wno-psabi of the modules with vector kernels (see setup.py).
+//
+#ifdef SHERPA_VECMATH
+#define SHERPA_VEC_INLINE inline __attribute__ ((always_inline))
+#define SHERPA_VEC_BEGIN \
+  _Pragma( "GCC diagnostic push" ) \
+  _Pragma( "GCC diagnostic ignored \"-Wpsabi\"" )
+#define SHERPA_VEC_END _Pragma( "GCC diagnostic pop" )
+#else
+#define SHERPA_VEC_INLINE inline
+#define SHERPA_VEC_BEGIN
+#define SHERPA_VEC_END
+#endif
+
+
+namespace sherpa { namespace vecmath {
+
+
+  enum { SCALAR = 0, AVX2 = 1, AVX512 = 2 };
+
+
+  inline int detect_level()
+  {
+
+    int lvl = SCALAR;
+
+#ifdef SHERPA_VECMATH
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+      lvl = AVX2;
+    if ( ( AVX2 == lvl ) && __builtin_cpu_supports( "avx512f" ) )
+      lvl = AVX512;
+#endif
+
+    const char* env = std::getenv( "SHERPA_SIMD" );
+    if ( NULL != env ) {
+      if ( 0 == std::strcmp( env, "none" ) )
+	lvl = SCALAR;
+      else if ( ( 0 == std::strcmp( env, "avx2" ) ) && ( lvl > AVX2 ) )
+	lvl = AVX2;
+    }
+
+    return lvl;
+
+  }
+
+
+  // Instruction set used by apply(); detected once per process
+  inline int level()
+  {
+    static const int lvl = detect_level();
+    return lvl;
+  }
+
+
+  template <typename V> struct vec_traits;
+
+SHERPA_VEC_BEGIN
+
+#ifdef SHERPA_VECMATH
+
+  typedef double v4d __attribute__ ((vector_size (32)));
+  typedef double v8d __attribute__ ((vector_size (64)));
+  typedef __typeof__( v4d() < v4d() ) v4i;
+  typedef __typeof__( v8d() < v8d() ) v8i;
+
+  template <> struct vec_traits< v4d > {
+    typedef v4i mask_type;
+    enum { size = 4 };
+  };
+
+  template <> struct vec_traits< v8d > {
+    typedef v8i mask_type;
+    enum { size = 8 };
+  };
+
+#endif
+
+
+  //
+  // Lanewise helpers.  Comparisons give masks with all bits set in the
+  // lanes where they hold.
+  //
+
+  template <typename V, typename M>
+  SHERPA_VEC_INLINE V select( M mask, V a, V b )
+  {
+    return (V)( ( (M)a & mask ) | ( (M)b & ~mask ) );
+  }
+
+
+  // True if the mask is set in any lane
+  template <typename M>
+  SHERPA_VEC_INLINE bool any( M mask )
+  {
+    M acc = mask;
+    for ( int ii = 1; ii < int( sizeof( M ) / sizeof( acc[0] ) ); ii++ )
+      acc[0] |= mask[ ii ];
+    return 0 != acc[0];
+  }
+
+
+  template <typename V>
+  SHERPA_VEC_INLINE V load( const double* ptr )
+  {
+    V v;
+    std::memcpy( &v, ptr, sizeof( V ) );
+    return v;
+  }
+
+
+  template <typename V>
+  SHERPA_VEC_INLINE void store( double* ptr, V v )
+  {
+    std::memcpy( ptr, &v, sizeof( V ) );
+  }
+
+
+  // 1.5 * 2^52: adding it rounds a double to an integer held in the
+  // low bits of the mantissa
+  inline double shifter() { return 6755399441055744.0; }
+
+
+  // 2^n for integral n (held as a double) in [-1022, 1023]
+  template <typename V>
+  SHERPA_VEC_INLINE V pow2i( V n )
+  {
+    typedef typename vec_traits< V >::mask_type M;
+    M bits = (M)( n + shifter() );
+    return (V)( ( bits + 1023 ) << 52 );
+  }
+
+
+  // Exact product a * b = hi + lo (Dekker)
+  template <typename V>
+  SHERPA_VEC_INLINE V two_prod( V a, V b, V& lo )
+  {
+    const double split = 134217729.0;	// 2^27 + 1
+    V hi = a * b;
+    V ta = split * a;
+    V ahi = ta - ( ta - a );
+    V alo = a - ahi;
+    V tb = split * b;
+    V bhi = tb - ( tb - b );
+    V blo = b - bhi;
+    lo = ( ( ( ahi * bhi - hi ) + ahi * blo ) + alo * bhi ) + alo * blo;
+    return hi;
+  }
+
+
+  //
+  // exp( x + xlo ), with |xlo| much smaller than |x|
+  //
+  template <typename V>
+  SHERPA_VEC_INLINE V vexp( V x, V xlo )
+  {
+
+    const double log2e = 1.44269504088896338700e+00;
+    const double ln2hi = 6.93147180369123816490e-01;
+    const double ln2lo = 1.90821492927058770002e-10;
+    const double o_threshold = 7.09782712893383973096e+02;
+    const double u_threshold = -7.45133219101941108420e+02;
+
+    // x = n ln2 + r, |r| <= ln2 / 2
+    V n = ( x * log2e + shifter() ) - shifter();
+    V r = ( ( x - n * ln2hi ) - n * ln2lo ) + xlo;
+
+    // Taylor series of exp(r) up to r^13 / 13!
+    V p = r * 1.6059043836821614599e-10 + 2.0876756987868098979e-09;
+    p = p * r + 2.5052108385441718775e-08;
+    p = p * r + 2.7557319223985890653e-07;
+    p = p * r + 2.7557319223985890653e-06;
+    p = p * r + 2.4801587301587301587e-05;
+    p = p * r + 1.9841269841269841270e-04;
+    p = p * r + 1.3888888888888888889e-03;
+    p = p * r + 8.3333333333333333333e-03;
+    p = p * r + 4.1666666666666666667e-02;
+    p = p * r + 1.6666666666666666667e-01;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+
+    // Scale in two steps so subnormal results are rounded only once
+    V n1 = ( n * 0.5 + shifter() ) - shifter();
+    V n2 = n - n1;
+    V res = p * pow2i( n1 ) * pow2i( n2 );
+
+    res = select( x > o_threshold,
+		  V() + std::numeric_limits< double >::infinity(), res );
+    res = select( x < u_threshold, V(), res );
+    res = select( x != x, x, res );
+
+    return res;
+
+  }
+
+
+  template <typename V>
+  SHERPA_VEC_INLINE V vexp( V x )
+  {
+    return vexp( x, V() );
+  }
+
+
+  //
+  // log(x) = hi + lo as an unevaluated double-double sum
+  //
+  template <typename V>
+  SHERPA_VEC_INLINE V vlog( V x, V& lo )
+  {
+
+    typedef typename vec_traits< V >::mask_type M;
+
+    const double ln2hi = 6.93147180369123816490e-01;
+    const double ln2lo = 1.90821492927058770002e-10;
+    const double sqrt2 = 1.41421356237309514547e+00;
+    const double Lg1 = 6.666666666666735130e-01;
+    const double Lg2 = 3.999999999940941908e-01;
+    const double Lg3 = 2.857142874366239149e-01;
+    const double Lg4 = 2.222219843214978396e-01;
+    const double Lg5 = 1.818357216161805012e-01;
+    const double Lg6 = 1.531383769920937332e-01;
+    const double Lg7 = 1.479819860511658591e-01;
+
+    // Bring subnormals into the normal range
+    M tiny = x < std::numeric_limits< double >::min();
+    V xs = select( tiny, x * 4503599627370496.0, x );
+
+    // x = 2^e f, sqrt(2)/2 <= f < sqrt(2)
+    M bits = (M)xs;
+    M ebits = ( ( bits >> 52 ) & 0x7ff ) - 1023;
+    V f = (V)( ( bits & 0x000fffffffffffffLL ) | 0x3ff0000000000000LL );
+    M big = f > sqrt2;
+    f = select( big, f * 0.5, f );
+    ebits -= big;
+    V e = (V)( ebits + (M)( V() + shifter() ) ) - shifter();
+    e = select( tiny, e - 52.0, e );
+
+    // log(f) = log(1 + u) = u + corr
+    V u = f - 1.0;
+    V s = u / ( u + 2.0 );
+    V z = s * s;
+    V R = z * ( Lg1 + z * ( Lg2 + z * ( Lg3 + z * ( Lg4 + z * ( Lg5 +
+	  z * ( Lg6 + z * Lg7 ) ) ) ) ) );
+    V hfsq = 0.5 * u * u;
+    V corr = s * ( hfsq + R ) - hfsq;
+
+    // e ln2hi is exact; sum it with u without losing the rounding error
+    V a = e * ln2hi;
+    V hi = a + u;
+    V bb = hi - a;
+    V err = ( a - ( hi - bb ) ) + ( u - bb );
+    V tail = err + ( e * ln2lo + corr );
+    V res = hi + tail;
+    lo = tail - ( res - hi );
+
+    const double inf = std::numeric_limits< double >::infinity();
+    M special = ~( ( x > 0.0 ) & ( x < inf ) );
+    res = select( x == 0.0, V() - inf, res );
+    res = select( x == inf, x, res );
+    res = select( ~( x >= 0.0 ),
+		  V() + std::numeric_limits< double >::quiet_NaN(), res );
+    lo = select( special, V(), lo );
+
+    return res;
+
+  }
+
+
+  template <typename V>
+  SHERPA_VEC_INLINE V vlog( V x )
+  {
+    V lo;
+    V hi = vlog( x, lo );
+    return hi + lo;
+  }
+
+
+  //
+  // x^y for x >= 0; negative x gives NaN
+  //
+  template <typename V>
+  SHERPA_VEC_INLINE V vpow( V x, V y )
+  {
+
+    typedef typename vec_traits< V >::mask_type M;
+
+    const double inf = std::numeric_limits< double >::infinity();
+
+    V llo;
+    V lhi = vlog( x, llo );
+    V plo;
+    V phi = two_prod( y, lhi, plo );
+    V res = vexp( phi, plo + y * llo );
+
+    // x = 0 or inf, where the log is infinite
+    M xzero = ( x == 0.0 );
+    M xinf = ( x == inf );
+    res = select( xzero & ( y > 0.0 ), V(), res );
+    res = select( xzero & ( y < 0.0 ), V() + inf, res );
+    res = select( xinf & ( y > 0.0 ), V() + inf, res );
+    res = select( xinf & ( y < 0.0 ), V(), res );
+    res = select( ( x == 1.0 ) | ( y == 0.0 ), V() + 1.0, res );
+
+    return res;
+
+  }
+
+
+  template <typename V>
+  SHERPA_VEC_INLINE V vpow( V x, double y )
+  {
+    return vpow( x, V() + y );
+  }
+
+
+  //
+  // erf(x), after fdlibm's s_erf.c
+  //
+  template <typename V>
+  SHERPA_VEC_INLINE V verf( V x )
+  {
+
+    typedef typename vec_traits< V >::mask_type M;
+
+    // |x| < 0.84375
+    const double pp0 = 1.28379167095512558561e-01;
+    const double pp1 = -3.25042107247001499370e-01;
+    const double pp2 = -2.84817495755985104766e-02;
+    const double pp3 = -5.77027029648944159157e-03;
+    const double pp4 = -2.37630166566501626084e-05;
+    const double qq1 = 3.97917223959155352819e-01;
+    const double qq2 = 6.50222499887672944485e-02;
+    const double qq3 = 5.08130628187576562776e-03;
+    const double qq4 = 1.32494738004321644526e-04;
+    const double qq5 = -3.96022827877536812320e-06;
+
+    // 0.84375 <= |x| < 1.25
+    const double erx = 8.45062911510467529297e-01;
+    const double pa0 = -2.36211856075265944077e-03;
+    const double pa1 = 4.14856118683748331666e-01;
+    const double pa2 = -3.72207876035701323847e-01;
+    const double pa3 = 3.18346619901161753674e-01;
+    const double pa4 = -1.10894694282396677476e-01;
+    const double pa5 = 3.54783043256182359371e-02;
+    const double pa6 = -2.16637559486879084300e-03;
+    const double qa1 = 1.06420880400844228286e-01;
+    const double qa2 = 5.40397917702171048937e-01;
+    const double qa3 = 7.18286544141962662868e-02;
+    const double qa4 = 1.26171219808761642112e-01;
+    const double qa5 = 1.36370839120290507362e-02;
+    const double qa6 = 1.19844998467991074170e-02;
+
+    // 1.25 <= |x| < 1/0.35
+    const double ra0 = -9.86494403484714822705e-03;
+    const double ra1 = -6.93858572707181764372e-01;
+    const double ra2 = -1.05586262253232909814e+01;
+    const double ra3 = -6.23753324503260060396e+01;
+    const double ra4 = -1.62396669462573470355e+02;
+    const double ra5 = -1.84605092906711035994e+02;
+    const double ra6 = -8.12874355063065934246e+01;
+    const double ra7 = -9.81432934416914548592e+00;
+    const double sa1 = 1.96512716674392571292e+01;
+    const double sa2 = 1.37657754143519042600e+02;
+    const double sa3 = 4.34565877475229228821e+02;
+    const double sa4 = 6.45387271733267880336e+02;
+    const double sa5 = 4.29008140027567833386e+02;
+    const double sa6 = 1.08635005541779435134e+02;
+    const double sa7 = 6.57024977031928170135e+00;
+    const double sa8 = -6.04244152148580987438e-02;
+
+    // 1/0.35 <= |x| < 6
+    const double rb0 = -9.86494292470009928597e-03;
+    const double rb1 = -7.99283237680523006574e-01;
+    const double rb2 = -1.77579549177547519889e+01;
+    const double rb3 = -1.60636384855821916062e+02;
+    const double rb4 = -6.37566443368389627722e+02;
+    const double rb5 = -1.02509513161107724954e+03;
+    const double rb6 = -4.83519191608651397019e+02;
+    const double sb1 = 3.03380607434824582924e+01;
+    const double sb2 = 3.25792512996573918826e+02;
+    const double sb3 = 1.53672958608443695994e+03;
+    const double sb4 = 3.19985821950859553908e+03;
+    const double sb5 = 2.55305040643316442583e+03;
+    const double sb6 = 4.74528541206955367215e+02;
+    const double sb7 = -2.24409524465858183362e+01;
+
+    M absmask = M() + 0x7fffffffffffffffLL;
+    V ax = (V)( (M)x & absmask );
+    M sign = (M)x & ~absmask;
+
+    M finite = ax < 6.0;
+    V one = (V)( (M)( V() + 1.0 ) | sign );
+
+    // Far tails: erf is +-1 to double precision
+    if ( ! any( finite ) )
+      return select( x != x, x, one );
+
+    // Every branch that applies to some lane is evaluated for all of
+    // them, and the results of the ones that do not apply are discarded.
+    // The rational functions of all branches share a single division.
+    M small = ax < 0.84375;
+    M mid = ax < 1.25;
+    M band = ax < 2.85714285714285711748e+00;
+    bool tails = any( finite & ~mid );
+
+    V z = ax * ax;
+    V num = pp0 + z * ( pp1 + z * ( pp2 + z * ( pp3 + z * pp4 ) ) );
+    V den = 1.0 + z * ( qq1 + z * ( qq2 + z * ( qq3 + z * ( qq4 +
+	    z * qq5 ) ) ) );
+
+    V sa = ax - 1.0;
+    V P = pa0 + sa * ( pa1 + sa * ( pa2 + sa * ( pa3 + sa * ( pa4 +
+	  sa * ( pa5 + sa * pa6 ) ) ) ) );
+    V Q = 1.0 + sa * ( qa1 + sa * ( qa2 + sa * ( qa3 + sa * ( qa4 +
+	  sa * ( qa5 + sa * qa6 ) ) ) ) );
+    num = select( small, num, P );
+    den = select( small, den, Q );
+
+    if ( tails ) {
+      V ss = 1.0 / z;
+      V Ra = ra0 + ss * ( ra1 + ss * ( ra2 + ss * ( ra3 + ss * ( ra4 +
+	     ss * ( ra5 + ss * ( ra6 + ss * ra7 ) ) ) ) ) );
+      V Sa = 1.0 + ss * ( sa1 + ss * ( sa2 + ss * ( sa3 + ss * ( sa4 +
+	     ss * ( sa5 + ss * ( sa6 + ss * ( sa7 + ss * sa8 ) ) ) ) ) ) );
+      V Rb = rb0 + ss * ( rb1 + ss * ( rb2 + ss * ( rb3 + ss * ( rb4 +
+	     ss * ( rb5 + ss * rb6 ) ) ) ) );
+      V Sb = 1.0 + ss * ( sb1 + ss * ( sb2 + ss * ( sb3 + ss * ( sb4 +
+	     ss * ( sb5 + ss * ( sb6 + ss * sb7 ) ) ) ) ) );
+      num = select( mid, num, select( band, Ra, Rb ) );
+      den = select( mid, den, select( band, Sa, Sb ) );
+    }
+
+    V q = num / den;
+    V res = select( small, ax + ax * q, erx + q );
+
+    if ( tails ) {
+      // erfc(|x|) = exp( -zt^2 - 0.5625 + ( zt - |x| )( zt + |x| ) + q ) / |x|,
+      // where zt is |x| rounded to 21 bits so that the first two terms
+      // are exact; the sum goes to vexp as a double-double
+      V zt = (V)( (M)ax & ~( M() + 0xffffffffLL ) );
+      V a = - zt * zt - 0.5625;
+      V b = ( zt - ax ) * ( zt + ax ) + q;
+      V hi = a + b;
+      V bb = hi - a;
+      V lo = ( a - ( hi - bb ) ) + ( b - bb );
+      res = select( mid, res, 1.0 - vexp( hi, lo ) / ax );
+    }
+
+    res = select( finite, (V)( (M)res | sign ), one );
+
+    return select( x != x, x, res );
+
+  }
+
+
+  //
+  // Drivers.  A kernel is a class with a member template
+  //
+  //   template <typename V, typename M> V operator()( V x, M& fail ) const
+  //
+  // (or with two arguments, xlo and xhi, for integrated models) that
+  // returns the model values for one vector of grid points and sets the
+  // fail mask in the lanes where the evaluation failed.  apply() runs a
+  // kernel over nelem contiguous elements and returns the number of
+  // failed elements, or -1 if no vector unit is available, in which case
+  // the caller must use its scalar code.  The tail of the array goes
+  // through a padded vector, so every element is computed by the same
+  // instructions regardless of its position.
+  //
+
+  template <typename V, typename M, typename IndexType>
+  SHERPA_VEC_INLINE IndexType count_failed( M nfail )
+  {
+    IndexType n = 0;
+    for ( int ii = 0; ii < vec_traits< V >::size; ii++ )
+      n += nfail[ ii ];
+    return n;
+  }
+
+
+  template <typename V, typename Kernel, typename IndexType>
+  SHERPA_VEC_INLINE IndexType apply_vec( const Kernel& kernel, IndexType nelem,
+					 const double* x, double* val )
+  {
+
+    typedef typename vec_traits< V >::mask_type M;
+    const int width = vec_traits< V >::size;
+
+    M nfail = M();
+    IndexType ii = 0;
+
+    for ( ; ii + width <= nelem; ii += width ) {
+      M fail = M();
+      store( val + ii, kernel( load< V >( x + ii ), fail ) );
+      nfail -= fail;
+    }
+
+    if ( ii < nelem ) {
+      int nleft = int( nelem - ii );
+      double buf[ width ];
+      for ( int jj = 0; jj < width; jj++ )
+	buf[ jj ] = x[ ii + ( jj < nleft ? jj : nleft - 1 ) ];
+      M fail = M();
+      store( buf, kernel( load< V >( buf ), fail ) );
+      for ( int jj = 0; jj < nleft; jj++ ) {
+	val[ ii + jj ] = buf[ jj ];
+	nfail[ jj ] -= fail[ jj ];
+      }
+    }
+
+    return count_failed< V, M, IndexType >( nfail );
+
+  }
+
+
+  template <typename V, typename Kernel, typename IndexType>
+  SHERPA_VEC_INLINE IndexType apply_vec( const Kernel& kernel, IndexType nelem,
+					 const double* xlo, const double* xhi,
+					 double* val )
+  {
+
+    typedef typename vec_traits< V >::mask_type M;
+    const int width = vec_traits< V >::size;
+
+    M nfail = M();
+    IndexType ii = 0;
+
+    for ( ; ii + width <= nelem; ii += width ) {
+      M fail = M();
+      store( val + ii, kernel( load< V >( xlo + ii ), load< V >( xhi + ii ),
+			       fail ) );
+      nfail -= fail;
+    }
+
+    if ( ii < nelem ) {
+      int nleft = int( nelem - ii );
+      double lobuf[ width ];
+      double hibuf[ width ];
+      for ( int jj = 0; jj < width; jj++ ) {
+	IndexType kk = ii + ( jj < nleft ? jj : nleft - 1 );
+	lobuf[ jj ] = xlo[ kk ];
+	hibuf[ jj ] = xhi[ kk ];
+      }
+      M fail = M();
+      store( lobuf, kernel( load< V >( lobuf ), load< V >( hibuf ), fail ) );
+      for ( int jj = 0; jj < nleft; jj++ ) {
+	val[ ii + jj ] = lobuf[ jj ];
+	nfail[ jj ] -= fail[ jj ];
+      }
+    }
+
+    return count_failed< V, M, IndexType >( nfail );
+
+  }
+
+
+#ifdef SHERPA_VECMATH
+
+  template <typename Kernel, typename IndexType>
+  __attribute__ ((target ("avx2,fma")))
+  IndexType apply_avx2( const Kernel& kernel, IndexType nelem,
+			const double* x, double* val )
+  {
+    return apply_vec< v4d >( kernel, nelem, x, val );
+  }
+
+
+  template <typename Kernel, typename IndexType>
+  __attribute__ ((target ("avx512f,avx2,fma")))
+  IndexType apply_avx512( const Kernel& kernel, IndexType nelem,
+			  const double* x, double* val )
+  {
+    return apply_vec< v8d >( kernel, nelem, x, val );
+  }
+
+
+  template <typename Kernel, typename IndexType>
+  __attribute__ ((target ("avx2,fma")))
+  IndexType apply_avx2( const Kernel& kernel, IndexType nelem,
+			const double* xlo, const double* xhi, double* val )
+  {
+    return apply_vec< v4d >( kernel, nelem, xlo, xhi, val );
+  }
+
+
+  template <typename Kernel, typename IndexType>
+  __attribute__ ((target ("avx512f,avx2,fma")))
+  IndexType apply_avx512( const Kernel& kernel, IndexType nelem,
+			  const double* xlo, const double* xhi, double* val )
+  {
+    return apply_vec< v8d >( kernel, nelem, xlo, xhi, val );
+  }
+
+#endif
+
+SHERPA_VEC_END
+
+
+  template <typename Kernel, typename IndexType>
+  inline IndexType apply( const Kernel& kernel, IndexType nelem,
+			  const double* x, double* val )
+  {
+
+#ifdef SHERPA_VECMATH
+    switch ( level() ) {
+    case AVX512:
+      return apply_avx512( kernel, nelem, x, val );
+    case AVX2:
+      return apply_avx2( kernel, nelem, x, val );
+    }
+#endif
+
+    return -1;
+
+  }
+
+
+  template <typename Kernel, typename IndexType>
+  inline IndexType apply( const Kernel& kernel, IndexType nelem,
+			  const double* xlo, const double* xhi, double* val )
+  {
+
+#ifdef SHERPA_VECMATH
+    switch ( level() ) {
+    case AVX512:
+      return apply_avx512( kernel, nelem, xlo, xhi, val );
+    case AVX2:
+      return apply_avx2( kernel, nelem, xlo, xhi, val );
+    }
+#endif
+
+    return -1;
+
+  }
+
+
+  // Only double precision is vectorized
+  template <typename Kernel, typename IndexType, typename DataType>
+  inline IndexType apply( const Kernel& kernel, IndexType nelem,
+			  const DataType* x, DataType* val )
+  {
+    return -1;
+  }
+
+
+  template <typename Kernel, typename IndexType, typename DataType>
+  inline IndexType apply( const Kernel& kernel, IndexType nelem,
+			  const DataType* xlo, const DataType* xhi,
+			  DataType* val )
+  {
+    return -1;
+  }
+
+
+  //
+  // Scalar counterparts of apply(), running a model's point or integrated
+  // kernel over raw arrays for the cases the vector kernels do not handle
+  //
+
+  template <typename DataType, typename ConstArrayType, typename IndexType,
+	    int (*PtFunc)( const ConstArrayType& p, DataType x, DataType& val )>
+  inline int scalar_point_loop( const ConstArrayType& p, IndexType nelem,
+				const DataType* x, DataType* val )
+  {
+
+    int nfail = 0;
+
+    for ( IndexType ii = 0; ii < nelem; ii++ )
+      nfail += ( EXIT_SUCCESS != PtFunc( p, x[ ii ], val[ ii ] ) );
+
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+  }
+
+
+  template <typename DataType, typename ConstArrayType, typename IndexType,
+	    int (*IntFunc)( const ConstArrayType& p, DataType xlo, DataType xhi,
+			    DataType& val )>
+  inline int scalar_integrated_loop( const ConstArrayType& p, IndexType nelem,
+				     const DataType* xlo, const DataType* xhi,
+				     DataType* val )
+  {
+
+    int nfail = 0;
+
+    for ( IndexType ii = 0; ii < nelem; ii++ )
+      nfail += ( EXIT_SUCCESS != IntFunc( p, xlo[ ii ], xhi[ ii ], val[ ii ] ) );
+
+    return ( nfail ? EXIT_FAILURE : EXIT_SUCCESS );
+
+  }
+
+
+}  }  /* namespace vecmath, namespace sherpa */
+
+
+#endif /* __sherpa_vecmath_hh__ */
+
+
+#ifdef testVecMath
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace sherpa::vecmath;
+
+SHERPA_VEC_BEGIN
+
+struct exp_kernel {
+  template <typename V, typename M>
+  SHERPA_VEC_INLINE V operator()( V x, M& fail ) const { return vexp( x ); }
+};
+
+struct log_kernel {
+  template <typename V, typename M>
+  SHERPA_VEC_INLINE V operator()( V x, M& fail ) const { return vlog( x ); }
+};
+
+struct erf_kernel {
+  template <typename V, typename M>
+  SHERPA_VEC_INLINE V operator()( V x, M& fail ) const { return verf( x ); }
+};
+
+struct pow_kernel {
+  template <typename V, typename M>
+  SHERPA_VEC_INLINE V operator()( V x, V y, M& fail ) const
+  {
+    return vpow( x, y );
+  }
+};
+
+// Error of a in units in the last place of the libm result b
+static double ulps( double a, double b ) {
+  if ( a == b || ( a != a && b != b ) )
+    return 0.0;
+  if ( b == 0.0 || std::fabs( b ) == HUGE_VAL )
+    return HUGE_VAL;
+  double ulp = std::nextafter( std::fabs( b ), HUGE_VAL ) - std::fabs( b );
+  return std::fabs( a - b ) / ulp;
+}
+
+static double uniform( double lo, double hi ) {
+  return lo + ( hi - lo ) * ( std::rand() / ( RAND_MAX + 1.0 ) );
+}
+
+template <typename Kernel>
+void check1( const char* name, const Kernel& kernel,
+	     double (*libm)( double ), const std::vector< double >& x ) {
+  long n = long( x.size() );
+  std::vector< double > val( n );
+  for ( int lvl = AVX2; lvl <= level(); lvl++ ) {
+    if ( AVX2 == lvl )
+      apply_avx2( kernel, n, &x[0], &val[0] );
+    else
+      apply_avx512( kernel, n, &x[0], &val[0] );
+    double maxerr = 0.0, arg = 0.0;
+    for ( long ii = 0; ii < n; ii++ ) {
+      double err = ulps( val[ ii ], libm( x[ ii ] ) );
+      if ( err > maxerr ) {
+	maxerr = err;
+	arg = x[ ii ];
+      }
+    }
+    std::printf( "%-4s %-7s max error %6.2f ulp at %.17g\n", name,
+		 AVX2 == lvl ? "avx2" : "avx512", maxerr, arg );
+  }
+}
+
+int main( int argc, char* argv[] ) {
+
+  const long n = 1000003;
+  std::vector< double > x( n ), y( n ), val( n );
+
+  if ( level() < AVX2 ) {
+    std::printf( "no AVX2 on this machine\n" );
+    return 0;
+  }
+
+  for ( long ii = 0; ii < n; ii++ )
+    x[ ii ] = uniform( -745.0, 709.0 );
+  check1( "exp", exp_kernel(), std::exp, x );
+
+  for ( long ii = 0; ii < n; ii++ )
+    x[ ii ] = std::pow( 10.0, uniform( -310.0, 308.0 ) );
+  check1( "log", log_kernel(), std::log, x );
+
+  for ( long ii = 0; ii < n; ii++ )
+    x[ ii ] = uniform( -7.0, 7.0 );
+  check1( "erf", erf_kernel(), ::erf, x );
+
+  for ( long ii = 0; ii < n; ii++ ) {
+    x[ ii ] = std::pow( 10.0, uniform( -4.0, 4.0 ) );
+    y[ ii ] = uniform( -5.0, 5.0 );
+  }
+  for ( int lvl = AVX2; lvl <= level(); lvl++ ) {
+    if ( AVX2 == lvl )
+      apply_avx2( pow_kernel(), n, &x[0], &y[0], &val[0] );
+    else
+      apply_avx512( pow_kernel(), n, &x[0], &y[0], &val[0] );
+    double maxerr = 0.0;
+    for ( long ii = 0; ii < n; ii++ )
+      maxerr = std::max( maxerr, ulps( val[ ii ],
+				       std::pow( x[ ii ], y[ ii ] ) ) );
+    std::printf( "pow  %-7s max error %6.2f ulp\n",
+		 AVX2 == lvl ? "avx2" : "avx512", maxerr );
+  }
+
+  return 0;
+
+}
+
+SHERPA_VEC_END
+
+#endif
+//
+// cp vecmath.hh tmp.cc; g++ -I.. -g -Wall -O3 -DtestVecMath tmp.cc; rm tmp.cc; a.out
+//
@@ -20,7 +20,7 @@
 import numpy
 from parameter import Parameter, tinyval
 from model import ArithmeticModel, modelCacher1d, CompositeModel, \
-    ArithmeticFunctionModel
+    ArithmeticFunctionModel, register_expr_kernels
 from sherpa.utils.err import ModelErr
 from sherpa.utils import *
 import _modelfcts
@@ -416,10 +416,8 @@ class PowLaw1D(ArithmeticModel):
         param_apply_limits(norm, self.ampl, **kwargs)
 
         
-    @modelCacher1d
-    def calc(self, pars, *args, **kwargs):
-        kwargs['integrate']=bool_cast(self.integrate)
-        if kwargs['integrate']:
+    def _fix_pars(self, pars):
+        if bool_cast(self.integrate):
             # avoid numerical issues with C pow() function close to zero,
             # 0.0 +- ~1.e-14.  PowLaw1D integrated has multiple calls to 
             # pow(X, 1.0 - gamma).  So gamma values close to 1.0 +- 1.e-10
@@ -429,6 +427,10 @@ class PowLaw1D(ArithmeticModel):
                 # pars { gamma, ref, ampl }
                 pars[0] = 1.0
 
+    @modelCacher1d
+    def calc(self, pars, *args, **kwargs):
+        kwargs['integrate']=bool_cast(self.integrate)
+        self._fix_pars(pars)
         return _modelfcts.powlaw(pars, *args, **kwargs)
 
 
@@ -887,3 +889,16 @@ class Integrate1D(ArithmeticModel):
                             epsrel=self.epsrel.val,
                             maxeval=int(self.maxeval.val),
                             logger=warning)
+
+
+register_expr_kernels(_modelfcts.expr_kernels(), {
+        Box1D: 'box1d', Const1D: 'const1d', Cos: 'cos', Delta1D: 'delta1d',
+        Erf: 'erf', Erfc: 'erfc', Exp: 'exp', Exp10: 'exp10',
+        Gauss1D: 'gauss1d', Log: 'log', Log10: 'log10',
+        LogParabola: 'logparabola', NormGauss1D: 'ngauss1d',
+        Poisson: 'poisson', Polynom1D: 'poly1d', PowLaw1D: 'powlaw',
+        Scale1D: 'const1d', Sin: 'sin', Sqrt: 'sqrt', StepHi1D: 'stephi1d',
+        StepLo1D: 'steplo1d', Tan: 'tan',
+        Box2D: 'box2d', Const2D: 'const2d', Delta2D: 'delta2d',
+        Gauss2D: 'gauss2d', NormGauss2D: 'ngauss2d', Polynom2D: 'poly2d',
+        Scale2D: 'const2d'})
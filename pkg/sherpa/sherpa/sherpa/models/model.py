@@ -18,14 +18,15 @@
 #
 
 
-from itertools import izip
+from itertools import count, izip
 import logging
 import numpy
-import hashlib
-from sherpa.utils import SherpaFloat, NoNewAttributesAfterInit
+import weakref
+from sherpa.utils import SherpaFloat, NoNewAttributesAfterInit, bool_cast
 from sherpa.utils.err import ModelErr
 
 from parameter import Parameter
+import _modelfcts
 
 warning = logging.getLogger(__name__).warning
 
@@ -33,38 +34,39 @@ warning = logging.getLogger(__name__).warning
 __all__ = ('Model', 'CompositeModel', 'SimulFitModel',
            'ArithmeticConstantModel', 'ArithmeticModel',
            'UnaryOpModel', 'BinaryOpModel', 'FilterModel', 'modelCacher1d',
-           'ArithmeticFunctionModel', 'NestedModel', 'MultigridSumModel')
+           'ArithmeticFunctionModel', 'NestedModel', 'MultigridSumModel',
+           'register_expr_kernels')
+
+# Identifies a model instance in the model value cache of _modelfcts
+_cache_ids = count()
+
 
 def modelCacher1d(func):
 
     def cache_model(cls, pars, xlo, *args, **kwargs):
-        use_caching = cls._use_caching
-        cache = cls._cache
-        queue = cls._queue
+        if not cls._use_caching:
+            return func(cls, pars, xlo, *args, **kwargs)
 
-        digest = ''
-        if use_caching:
+        # The cache hands back the same token for an equal grid, so the
+        # grid is compared with the registered copy rather than hashed
+        grid = [xlo]
+        if args and args[0] is not None:
+            grid.append(args[0])
+        token = _modelfcts.cache_grid(*grid)
 
-            data = [ numpy.array(pars).tostring(), str(kwargs.get('integrate',0)), 
-                     numpy.asarray(xlo).tostring() ]
-            if args:
-                data.append( numpy.asarray(args[0]).tostring() )
+        # calc() may take the integrate setting from either place
+        integrate = (int(bool_cast(kwargs.get('integrate', 0))) |
+                     int(bool_cast(getattr(cls, 'integrate', 0))) << 1)
 
-            token = ''.join(data)
-            digest = hashlib.sha256(token).digest()
-            if digest in cache:
-                return cache[digest]
+        vals = _modelfcts.cache_lookup(cls._cache_id, pars, token, integrate)
+        if vals is not None:
+            return vals
 
         vals = func(cls, pars, xlo, *args, **kwargs)
 
-        if use_caching:
-            # remove first item in queue and remove from cache
-            key = queue.pop(0)
-            cache.pop(key, None)
-
-            # append newest model values to queue
-            queue.append(digest)
-            cache[digest] = vals
+        if isinstance(vals, numpy.ndarray):
+            _modelfcts.cache_store(cls._cache_id, pars, token, integrate,
+                                   vals, int(cls.cache))
 
         return vals
 
@@ -355,11 +357,10 @@ class ArithmeticModel(Model):
         self.integrate=True
 
         # Model caching ability
-        # queue memory of maximum size
+        # maximum number of cached evaluations
         self.cache = 5
         self._use_caching = False  # FIXME: reduce number of variables?
-        self._queue = ['']
-        self._cache = {}
+        self._cache_id = _cache_ids.next()
         Model.__init__(self, name, pars)
 
     # Unary operations
@@ -382,11 +383,10 @@ class ArithmeticModel(Model):
         if not state.has_key('_use_caching'):
             self.__dict__['_use_caching'] = False
 
-        if not state.has_key('_queue'):
-            self.__dict__['_queue'] = ['']
-
-        if not state.has_key('_cache'):
-            self.__dict__['_cache'] = {}
+        # A copy must not share the cached values of the original
+        self.__dict__['_cache_id'] = _cache_ids.next()
+        self.__dict__.pop('_queue', None)
+        self.__dict__.pop('_cache', None)
 
         if not state.has_key('cache'):
             self.__dict__['cache'] = 5
@@ -396,10 +396,8 @@ class ArithmeticModel(Model):
         return FilterModel(self, filter)
 
     def startup(self):
-        self._queue = ['']
-        self._cache = {}
+        _modelfcts.cache_clear(self._cache_id)
         if int(self.cache) > 0:
-            self._queue = ['']*int(self.cache)
             frozen = numpy.array([par.frozen for par in self.pars], dtype=bool)
             if len(frozen) > 0 and frozen.all():
                 self._use_caching = True
@@ -410,6 +408,158 @@ class ArithmeticModel(Model):
     def apply(self, outer, *otherargs, **otherkwargs):
         return NestedModel(outer, self, *otherargs, **otherkwargs)
 
+
+#
+# Compiled model expressions
+#
+# An expression such as (powlaw1d + gauss1d) * atten is compiled into a
+# postfix program for the expression engine in _modelfcts, which
+# evaluates it in a single pass over the grid instead of allocating a
+# numpy temporary for every operation.  The leaves are the kernels of
+# the model classes registered with register_expr_kernels(); any other
+# part of the expression is evaluated by its own calc() and handed to
+# the engine as an array operand.
+#
+
+_expr_kernels = {}
+_expr_programs = weakref.WeakKeyDictionary()
+
+_expr_unops = {numpy.negative: 'neg', numpy.absolute: 'abs'}
+_expr_binops = {numpy.add: 'add', numpy.subtract: 'sub',
+                numpy.multiply: 'mul', numpy.divide: 'div',
+                numpy.true_divide: 'div', numpy.power: 'pow'}
+
+
+def register_expr_kernels(kernels, models):
+    """Make model classes available to compiled model expressions
+
+    kernels is the dictionary returned by the expr_kernels() function of
+    a model module.  models maps each model class to the name of its
+    kernel, or to a (name, integrate) pair for a class whose calc()
+    ignores the integrate attribute.  Subclasses are not covered, since
+    they may override calc().
+    """
+    for cls, name in models.iteritems():
+        integrate = None
+        if isinstance(name, tuple):
+            name, integrate = name
+        _expr_kernels[cls] = (kernels[name], integrate)
+
+
+def _expr_walk(model, offset, ops, arrays, fixes, watched):
+    cls = type(model)
+
+    if cls is ArithmeticConstantModel or cls in _expr_kernels:
+        watched.append(model)
+
+    if cls is ArithmeticConstantModel and numpy.ndim(model.val) == 0:
+        ops.append(('const', float(model.val)))
+
+    elif cls is UnaryOpModel and model.op in _expr_unops:
+        _expr_walk(model.arg, offset, ops, arrays, fixes, watched)
+        ops.append((_expr_unops[model.op],))
+
+    elif cls is BinaryOpModel and model.op in _expr_binops:
+        _expr_walk(model.lhs, offset, ops, arrays, fixes, watched)
+        _expr_walk(model.rhs, offset + len(model.lhs.pars), ops, arrays,
+                   fixes, watched)
+        ops.append((_expr_binops[model.op],))
+
+    elif cls in _expr_kernels and not model._use_caching:
+        kernel, integrate = _expr_kernels[cls]
+        if integrate is None:
+            integrate = bool_cast(model.integrate)
+        ops.append(('kernel', kernel, offset, integrate))
+        if hasattr(cls, '_fix_pars'):
+            fixes.append((model, offset))
+
+    else:
+        ops.append(('array', len(arrays)))
+        arrays.append((model, offset))
+
+
+def _expr_state(watched):
+    # What the program depends on besides the shape of the tree: the
+    # constants, and the integrate and caching settings of the leaves
+    state = []
+    for model in watched:
+        if type(model) is not ArithmeticConstantModel:
+            state.append((model.integrate, model._use_caching))
+        elif numpy.ndim(model.val) == 0:
+            state.append(float(model.val))
+        else:
+            state.append(None)
+    return tuple(state)
+
+
+def _expr_program(model):
+    """Return the compiled program for an expression model
+
+    The tree is walked and compiled on the first call only; later calls
+    just check that no constant or leaf setting it depends on has
+    changed.  Returns (program, arrays, fixes), with a program of None
+    if the expression has no registered kernel.
+    """
+    cached = _expr_programs.get(model)
+    if cached is not None and _expr_state(cached[0]) == cached[1]:
+        return cached[2]
+
+    ops = []
+    arrays = []
+    fixes = []
+    watched = []
+    _expr_walk(model, 0, ops, arrays, fixes, watched)
+
+    program = None
+    if [op for op in ops if op[0] == 'kernel']:
+        program = _modelfcts.expr_compile(tuple(ops))
+
+    cached = (watched, _expr_state(watched), (program, arrays, fixes))
+    _expr_programs[model] = cached
+    return cached[2]
+
+
+def _expr_calc(model, p, args, kwargs):
+    """Evaluate the expression model with the compiled expression engine
+
+    Returns None if the expression or the grid is not suitable, in which
+    case the caller evaluates it operation by operation.
+    """
+    if not (1 <= len(args) <= 4) or [k for k in kwargs if k != 'integrate']:
+        return None
+
+    grid = [numpy.asarray(arg) for arg in args]
+    nelem = len(grid[0]) if grid[0].ndim == 1 else -1
+    for x in grid:
+        if x.ndim != 1 or len(x) != nelem:
+            return None
+
+    program, arrays, fixes = _expr_program(model)
+    if program is None:
+        return None
+
+    pars = numpy.array(p, dtype=SherpaFloat)
+    for leaf, offset in fixes:
+        leaf._fix_pars(pars[offset:offset + len(leaf.pars)])
+
+    vals = []
+    for part, offset in arrays:
+        val = numpy.asarray(part.calc(p[offset:offset + len(part.pars)],
+                                      *args, **kwargs), dtype=SherpaFloat)
+        if val.ndim == 0:
+            val = numpy.repeat(val, nelem)
+        if val.shape != (nelem,):
+            return None
+        vals.append(val)
+
+    try:
+        return _modelfcts.expr_eval(program, pars, vals, *grid)
+    except TypeError:
+        # e.g. a 1D expression on a 2D grid; the operation by operation
+        # evaluation reports the error
+        return None
+
+
 class UnaryOpModel(CompositeModel, ArithmeticModel):
 
     def __init__(self, arg, op, opstr):
@@ -419,6 +569,9 @@ class UnaryOpModel(CompositeModel, ArithmeticModel):
                                 (self.arg,))
 
     def calc(self, p, *args, **kwargs):
+        val = _expr_calc(self, p, args, kwargs)
+        if val is not None:
+            return val
 	return self.op(self.arg.calc(p, *args, **kwargs))
 
 
@@ -453,6 +606,9 @@ class BinaryOpModel(CompositeModel, ArithmeticModel):
 
 
     def calc(self, p, *args, **kwargs):
+        val = _expr_calc(self, p, args, kwargs)
+        if val is not None:
+            return val
 	nlhs = len(self.lhs.pars)
         lhs = self.lhs.calc(p[:nlhs], *args, **kwargs)
         rhs = self.rhs.calc(p[nlhs:], *args, **kwargs)
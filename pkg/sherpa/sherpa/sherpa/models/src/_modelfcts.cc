@@ -18,30 +18,68 @@
 //
 
 #include "sherpa/model_extension.hh"
+#include "sherpa/model_expr.hh"
+#include "sherpa/model_cache.hh"
 #include "sherpa/models.hh"
 
 extern "C" {
   void init_modelfcts();
 }
 
+// Kernels for compiled model expressions
+sherpa::models::ExprKernel ModelExprKernels[] = {
+
+  EXPRKERNEL1D( box1d, 3 ),
+  EXPRKERNEL1D( const1d, 1 ),
+  EXPRKERNEL1D( cos, 3 ),
+  EXPRKERNEL1D( delta1d, 2 ),
+  EXPRKERNEL1D_VEC( erf, 3 ),
+  EXPRKERNEL1D( erfc, 3 ),
+  EXPRKERNEL1D_VEC( exp, 3 ),
+  EXPRKERNEL1D( exp10, 3 ),
+  EXPRKERNEL1D_VEC( gauss1d, 3 ),
+  EXPRKERNEL1D( log, 3 ),
+  EXPRKERNEL1D( log10, 3 ),
+  EXPRKERNEL1D_VEC( ngauss1d, 3 ),
+  EXPRKERNEL1D_NOINT( poisson, 2 ),
+  EXPRKERNEL1D( poly1d, 10 ),
+  EXPRKERNEL1D_NOINT( logparabola, 4 ),
+  EXPRKERNEL1D_VEC( powlaw, 3 ),
+  EXPRKERNEL1D( sin, 3 ),
+  EXPRKERNEL1D( sqrt, 2 ),
+  EXPRKERNEL1D( stephi1d, 2 ),
+  EXPRKERNEL1D( steplo1d, 2 ),
+  EXPRKERNEL1D( tan, 3 ),
+
+  EXPRKERNEL2D( box2d, 5 ),
+  EXPRKERNEL2D( const2d, 1 ),
+  EXPRKERNEL2D( delta2d, 3 ),
+  EXPRKERNEL2D_SEP( gauss2d, 6 ),
+  EXPRKERNEL2D_SEP( ngauss2d, 6 ),
+  EXPRKERNEL2D( poly2d, 9 ),
+
+  { NULL, 0, 0, NULL, NULL }
+
+};
+
 static PyMethodDef ModelFcts[] = {
 
   MODELFCT1D( box1d, 3  ),
   MODELFCT1D( const1d, 1 ),
   MODELFCT1D( cos, 3 ),
   MODELFCT1D( delta1d, 2 ),
-  MODELFCT1D( erf, 3 ),
+  MODELFCT1D_VEC( erf, 3 ),
   MODELFCT1D( erfc, 3 ),
-  MODELFCT1D( exp, 3 ),
+  MODELFCT1D_VEC( exp, 3 ),
   MODELFCT1D( exp10, 3 ),
-  MODELFCT1D( gauss1d, 3 ),
+  MODELFCT1D_VEC( gauss1d, 3 ),
   MODELFCT1D( log, 3 ),
   MODELFCT1D( log10, 3 ),
-  MODELFCT1D( ngauss1d, 3 ),
+  MODELFCT1D_VEC( ngauss1d, 3 ),
   MODELFCT1D_NOINT( poisson, 2 ),
   MODELFCT1D( poly1d, 10 ),
   MODELFCT1D_NOINT( logparabola, 4 ),
-  MODELFCT1D( powlaw, 3 ),
+  MODELFCT1D_VEC( powlaw, 3 ),
   MODELFCT1D( sin, 3 ),
   MODELFCT1D( sqrt, 2 ),
   MODELFCT1D( stephi1d, 2 ),
@@ -51,13 +89,21 @@ static PyMethodDef ModelFcts[] = {
   MODELFCT2D( box2d, 5 ),
   MODELFCT2D( const2d, 1 ),
   MODELFCT2D( delta2d, 3 ),
-  MODELFCT2D_NOINT( gauss2d, 6 ),
-  MODELFCT2D_NOINT( ngauss2d, 6 ),
+  MODELFCT2D_SEP( gauss2d, 6 ),
+  MODELFCT2D_SEP( ngauss2d, 6 ),
   MODELFCT2D( poly2d, 9 ),
   
   PY_MODELFCT1D_INT((char*)"integrate1d",
 		 (char*)"integrate user functions\n\nExample:\n int_array = integrate1d(func, param_array, xlo_array, xhi_array)" ),
 
+  MODELFCT_THREADS,
+  MODELFCT_PIXELS,
+
+  MODELEXPR_KERNELS( ModelExprKernels ),
+  MODELEXPR_ENGINE,
+
+  MODELCACHE_FUNCS,
+
   { NULL, NULL, 0, NULL }
 
 };
@@ -0,0 +1,104 @@
+#
+#  Copyright (C) 2013  Smithsonian Astrophysical Observatory
+#
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License along
+#  with this program; if not, write to the Free Software Foundation, Inc.,
+#  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+
+"""
+Timing of the threaded evaluation of the 2D image models in
+sherpa.models._modelfcts and sherpa.astro.models._modelfcts.
+
+Each model is evaluated on square images of increasing size, first
+serially and then with 2, 4, ... threads up to the number of cores, and
+the speedup over the serial evaluation is printed for every thread
+count.  Grids shorter than two chunks are always evaluated serially, so
+the chunk size sets the smallest image that can gain from threading.
+
+Usage:
+
+  python bench_model_threads.py [chunksize [nrepeat]]
+"""
+
+import sys
+import time
+import numpy
+import multiprocessing
+from sherpa.models import _modelfcts
+from sherpa.astro.models import _modelfcts as _astromodelfcts
+from sherpa.utils import SherpaFloat
+
+
+# (module, function, parameter values)
+models2d = [
+    (_modelfcts, _modelfcts.gauss2d, [20.0, 0.0, 0.0, 0.3, 0.5, 1.0]),
+    (_astromodelfcts, _astromodelfcts.beta2d,
+     [20.0, 0.0, 0.0, 0.3, 0.5, 1.0, 1.5]),
+    (_astromodelfcts, _astromodelfcts.devau, [20.0, 0.0, 0.0, 0.3, 0.5, 1.0]),
+    (_astromodelfcts, _astromodelfcts.sersic,
+     [20.0, 0.0, 0.0, 0.3, 0.5, 1.0, 2.0]),
+    ]
+
+sizes = (32, 64, 128, 256, 512, 1024, 2048)
+
+
+def timeit(func, args, nrepeat):
+    best = None
+    for ii in xrange(nrepeat):
+        start = time.time()
+        func(*args)
+        elapsed = time.time() - start
+        if best is None or elapsed < best:
+            best = elapsed
+    return best
+
+
+def image(npix):
+    x0, x1 = numpy.meshgrid(numpy.arange(npix) - npix / 2.0,
+                            numpy.arange(npix) - npix / 2.0)
+    return (numpy.ascontiguousarray(x0.ravel(), dtype=SherpaFloat),
+            numpy.ascontiguousarray(x1.ravel(), dtype=SherpaFloat))
+
+
+def main(chunksize=16384, nrepeat=5):
+    threads = [1]
+    while threads[-1] * 2 <= multiprocessing.cpu_count():
+        threads.append(threads[-1] * 2)
+
+    print 'chunk size %d, %d cores' % (chunksize,
+                                       multiprocessing.cpu_count())
+    print '%-8s %6s %12s' % ('model', 'npix', 'serial [s]') + \
+        ''.join(['%8s' % ('x%d' % n) for n in threads[1:]])
+
+    for module, func, pars in models2d:
+        pars = numpy.asarray(pars, dtype=SherpaFloat)
+        oldthreads = module.get_threads()
+        try:
+            for npix in sizes:
+                x0, x1 = image(npix)
+                times = []
+                for nthreads in threads:
+                    module.set_threads(nthreads, chunksize)
+                    times.append(timeit(func, (pars, x0, x1), nrepeat))
+                print '%-8s %6d %12.6f' % (func.__name__, npix, times[0]) + \
+                    ''.join(['%8.2f' % (times[0] / max(t, 1e-12))
+                             for t in times[1:]])
+        finally:
+            module.set_threads(*oldthreads)
+        print
+
+
+if __name__ == '__main__':
+    main(*[int(arg) for arg in sys.argv[1:3]])
@@ -0,0 +1,188 @@
+#
+#  Copyright (C) 2013  Smithsonian Astrophysical Observatory
+#
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License along
+#  with this program; if not, write to the Free Software Foundation, Inc.,
+#  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+
+"""
+Timing of the compiled model functions in sherpa.models._modelfcts and
+sherpa.astro.models._modelfcts.
+
+Each model is evaluated on the same grid twice: once from C-contiguous
+arrays, which take the raw-pointer loop in model_extension.hh, and once
+from every-other-element views of a twice as long array, which fall back
+to the strided Array::operator[] loop.  The ratio of the two timings is
+the speedup of the contiguous path for that model.
+
+The models with SIMD kernels in vecmath.hh (erf, exp, gauss1d, ngauss1d,
+powlaw and bpl1d) use them on the contiguous path; run with the
+environment variable SHERPA_SIMD=none to time their scalar loops instead.
+
+The 2D models without an analytic integral (gauss2d, beta2d, devau,
+sersic, ...) are integrated over their pixels by the batched quadrature
+of quadrature.hh on the contiguous path and pixel by pixel with the
+cubature routine on the strided one; as that is slow, the integrated 2D
+passes use a tenth of the pixels.  The circular gauss2d and ngauss2d
+take their closed form on both paths.  The last pass samples the pixels
+on 4 x 4 subpixels instead (see set_pixel_integration).
+
+Usage:
+
+  python bench_modelfcts.py [nbins [nrepeat]]
+"""
+
+import sys
+import time
+import numpy
+from sherpa.models import _modelfcts
+from sherpa.astro.models import _modelfcts as _astromodelfcts
+from sherpa.utils import SherpaFloat
+
+
+# (function, parameter values)
+models1d = [
+    (_modelfcts.box1d, [0.2, 0.8, 1.0]),
+    (_modelfcts.const1d, [1.0]),
+    (_modelfcts.cos, [1.0, 0.0, 1.0]),
+    (_modelfcts.delta1d, [0.5, 1.0]),
+    (_modelfcts.erf, [1.0, 0.5, 0.2]),
+    (_modelfcts.erfc, [1.0, 0.5, 0.2]),
+    (_modelfcts.exp, [0.0, 1.0, 1.0]),
+    (_modelfcts.exp10, [0.0, 1.0, 1.0]),
+    (_modelfcts.gauss1d, [0.1, 0.5, 1.0]),
+    (_modelfcts.log, [0.0, 1.0, 1.0]),
+    (_modelfcts.log10, [0.0, 1.0, 1.0]),
+    (_modelfcts.ngauss1d, [0.1, 0.5, 1.0]),
+    (_modelfcts.poly1d, [1.0, 0.5, 0.2, 0.1, 0., 0., 0., 0., 0., 0.]),
+    (_modelfcts.powlaw, [1.0, 1.0, 1.0]),
+    (_modelfcts.sin, [1.0, 0.0, 1.0]),
+    (_modelfcts.sqrt, [0.0, 1.0]),
+    (_modelfcts.stephi1d, [0.5, 1.0]),
+    (_modelfcts.steplo1d, [0.5, 1.0]),
+    (_modelfcts.tan, [1.0, 0.0, 1.0]),
+    (_astromodelfcts.bpl1d, [1.0, 2.0, 0.5, 1.0, 1.0]),
+    (_astromodelfcts.linebroad, [1.0, 0.5, 1000.0]),
+    (_astromodelfcts.lorentz1d, [0.1, 0.5, 1.0]),
+    (_astromodelfcts.schechter, [1.0, 0.5, 1.0]),
+    ]
+
+models2d = [
+    (_modelfcts.box2d, [0.2, 0.8, 0.2, 0.8, 1.0]),
+    (_modelfcts.const2d, [1.0]),
+    (_modelfcts.delta2d, [0.5, 0.5, 1.0]),
+    (_modelfcts.gauss2d, [0.1, 0.5, 0.5, 0.0, 0.0, 1.0]),
+    (_modelfcts.ngauss2d, [0.1, 0.5, 0.5, 0.0, 0.0, 1.0]),
+    (_modelfcts.poly2d, [1.0, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1]),
+    (_astromodelfcts.beta2d, [0.1, 0.5, 0.5, 0.0, 0.0, 1.0, 1.0]),
+    (_astromodelfcts.devau, [0.1, 0.5, 0.5, 0.0, 0.0, 1.0]),
+    (_astromodelfcts.sersic, [0.1, 0.5, 0.5, 0.0, 0.0, 1.0, 1.0]),
+    (_astromodelfcts.hr, [0.1, 0.5, 0.5, 0.0, 0.0, 1.0]),
+    (_astromodelfcts.lorentz2d, [0.1, 0.5, 0.5, 0.0, 0.0, 1.0]),
+    ]
+
+
+def strided(x):
+    "Return a non-contiguous view with the same values as x"
+    y = numpy.empty(2 * len(x), dtype=SherpaFloat)
+    y[::2] = x
+    return y[::2]
+
+
+def timeit(func, args, kwargs, nrepeat):
+    best = None
+    for ii in xrange(nrepeat):
+        start = time.time()
+        func(*args, **kwargs)
+        elapsed = time.time() - start
+        if best is None or elapsed < best:
+            best = elapsed
+    return best
+
+
+def report(name, tcontig, tstrided):
+    print '%-12s %12.6f %12.6f %8.2f' % (name, tcontig, tstrided,
+                                         tstrided / max(tcontig, 1e-12))
+
+
+def bench1d(nbins, nrepeat, integrate):
+    edges = numpy.linspace(0.1, 1.0, nbins + 1).astype(SherpaFloat)
+    xlo = numpy.ascontiguousarray(edges[:-1])
+    xhi = numpy.ascontiguousarray(edges[1:])
+    sxlo = strided(xlo)
+    sxhi = strided(xhi)
+    kwargs = {'integrate': integrate}
+
+    for func, pars in models1d:
+        pars = numpy.asarray(pars, dtype=SherpaFloat)
+        tc = timeit(func, (pars, xlo, xhi), kwargs, nrepeat)
+        ts = timeit(func, (pars, sxlo, sxhi), kwargs, nrepeat)
+        report(func.__name__, tc, ts)
+
+
+def bench2d(nbins, nrepeat, integrate):
+    npix = int(numpy.sqrt(nbins))
+    x0, x1 = numpy.meshgrid(numpy.linspace(0.1, 1.0, npix),
+                            numpy.linspace(0.1, 1.0, npix))
+    x0 = numpy.ascontiguousarray(x0.ravel(), dtype=SherpaFloat)
+    x1 = numpy.ascontiguousarray(x1.ravel(), dtype=SherpaFloat)
+    delta = 0.9 / npix
+    grid = (x0, x1, x0 + delta, x1 + delta)
+    sgrid = [strided(x) for x in grid]
+    kwargs = {'integrate': integrate}
+
+    for func, pars in models2d:
+        pars = numpy.asarray(pars, dtype=SherpaFloat)
+        # The x0lo, x1lo, x0hi, x1hi argument order of modelfct2d
+        tc = timeit(func, [pars] + list(grid), kwargs, nrepeat)
+        ts = timeit(func, [pars] + list(sgrid), kwargs, nrepeat)
+        report(func.__name__, tc, ts)
+
+
+def main(nbins=100000, nrepeat=10):
+    header = '%-12s %12s %12s %8s' % ('model', 'contig [s]', 'strided [s]',
+                                      'speedup')
+
+    print '1D point models, %d bins' % nbins
+    print header
+    bench1d(nbins, nrepeat, False)
+    print
+    print '1D integrated models, %d bins' % nbins
+    print header
+    bench1d(nbins, nrepeat, True)
+    print
+    print '2D point models, %d pixels' % nbins
+    print header
+    bench2d(nbins, nrepeat, False)
+    print
+    print '2D integrated models, %d pixels' % (nbins // 10)
+    print header
+    bench2d(nbins // 10, nrepeat, True)
+    print
+    print '2D integrated models, 4 x 4 subpixels, %d pixels' % (nbins // 10)
+    print header
+    modules = (_modelfcts, _astromodelfcts)
+    oldpixels = [module.get_pixel_integration() for module in modules]
+    try:
+        for module in modules:
+            module.set_pixel_integration(4)
+        bench2d(nbins // 10, nrepeat, True)
+    finally:
+        for module, old in zip(modules, oldpixels):
+            module.set_pixel_integration(*old)
+
+
+if __name__ == '__main__':
+    main(*[int(arg) for arg in sys.argv[1:3]])
@@ -17,7 +17,8 @@
 #  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 #
 
-from numpy import arange
+from numpy import abs, arange, array, empty, isnan, linspace, meshgrid, \
+    nan, spacing
 import sherpa.models.basic as basic
 from sherpa.utils import SherpaFloat, SherpaTestCase
 from sherpa.models.model import ArithmeticModel
@@ -25,6 +26,33 @@ from sherpa.models.model import ArithmeticModel
 def userfunc(pars, x, *args, **kwargs):
     return x
 
+def strided(a):
+    # Same values as a, but not contiguous, so the models take the
+    # scalar path
+    s = empty(2 * len(a))
+    s[::2] = a
+    return s[::2]
+
+def within_ulp(vals, ref, integrated):
+    # The batch kernels agree with the scalar code to 4 ulp of the
+    # largest value for point evaluation, and to 8 ulp of the summed
+    # absolute values for integrated bins (the antiderivatives are
+    # differenced, so the error scales with them rather than with each
+    # bin)
+    if len(ref) == 0:
+        return True
+    if integrated:
+        tol = 8 * spacing(abs(ref).sum())
+    else:
+        tol = 4 * spacing(abs(ref).max())
+    return ((vals == ref) | (abs(vals - ref) <= tol)).all()
+
+def evaluate_or_error(func, pars, *args):
+    try:
+        return func(pars, *args)
+    except ValueError, e:
+        return str(e)
+
 class test_basic(SherpaTestCase):
 
     def test_create_and_evaluate(self):
@@ -70,3 +98,341 @@ class test_basic(SherpaTestCase):
                 self.assertEqual(out.shape, x.shape)
 
         self.assertEqual(count, 31)
+
+    def test_threaded_evaluation(self):
+        from sherpa.models import _modelfcts
+        x0, x1 = meshgrid(linspace(-5, 5, 301), linspace(-5, 5, 301))
+        x0 = x0.ravel()
+        x1 = x1.ravel()
+        x0hi = x0 + 0.01
+        x1hi = x1 + 0.01
+        pars2d = [2.0, 0.5, -0.5, 0.3, 0.7, 3.0]
+        pars1d = [2.0, 0.5, 3.0]
+
+        def evaluate():
+            return (_modelfcts.gauss2d(pars2d, x0, x1),
+                    _modelfcts.box2d([-1., 1., -1., 1., 2.], x0, x1, x0hi,
+                                     x1hi),
+                    _modelfcts.gauss1d(pars1d, x0, x0hi),
+                    _modelfcts.gauss1d(pars1d, x0[::2], x0hi[::2]),
+                    # Adaptively integrated, so evaluated serially
+                    _modelfcts.poisson([3.0, 2.0], strided(x1[x1 > 0]),
+                                       strided(x1hi[x1 > 0])))
+
+        oldthreads = _modelfcts.get_threads()
+        try:
+            _modelfcts.set_threads(1)
+            serial = evaluate()
+            _modelfcts.set_threads(4, 1000)
+            self.assertEqual(_modelfcts.get_threads(), (4, 1000))
+            threaded = evaluate()
+            self.assertRaises(ValueError, _modelfcts.set_threads, 0)
+        finally:
+            _modelfcts.set_threads(*oldthreads)
+
+        for s, t in zip(serial, threaded):
+            self.assert_((s == t).all())
+
+    def test_box2d_integrated(self):
+        from sherpa.models import _modelfcts
+        # Unit pixels over [-3, 3] x [-2, 2]; the box covers x0 in
+        # [-1, 1.5] and x1 in [0, 1], so it fills two pixels and half of
+        # a third one
+        x0lo, x1lo = meshgrid(arange(-3.0, 3.0), arange(-2.0, 2.0))
+        x0lo = x0lo.ravel()
+        x1lo = x1lo.ravel()
+        box = [-1.0, 1.5, 0.0, 1.0, 4.0]
+        expected = [0.0] * len(x0lo)
+        for ii in range(len(x0lo)):
+            if x1lo[ii] == 0.0 and x0lo[ii] in (-1.0, 0.0):
+                expected[ii] = 4.0
+            elif x1lo[ii] == 0.0 and x0lo[ii] == 1.0:
+                expected[ii] = 2.0
+
+        oldthreads = _modelfcts.get_threads()
+        try:
+            for nthreads, chunksize in ((1, 16384), (4, 5)):
+                _modelfcts.set_threads(nthreads, chunksize)
+                out = _modelfcts.box2d(box, x0lo, x1lo, x0lo + 1.0,
+                                       x1lo + 1.0)
+                self.assertEqual(list(out), expected)
+        finally:
+            _modelfcts.set_threads(*oldthreads)
+
+    def test_batch_evaluation(self):
+        from sherpa.models import _modelfcts
+        x = linspace(0.1, 10.0, 2001)
+        xlo = x[:-1]
+        xhi = x[1:]
+        pars1d = array([[2.0, 5.0, 1.0], [1.0, 3.0, 2.0], [0.5, 7.0, 3.0]])
+        for func, batch in ((_modelfcts.gauss1d, _modelfcts.gauss1d_batch),
+                            (_modelfcts.box1d, _modelfcts.box1d_batch)):
+            for args in ((xlo,), (xlo, xhi)):
+                out = batch(pars1d, *args)
+                self.assertEqual(out.shape, (len(pars1d), len(xlo)))
+                for p, row in zip(pars1d, out):
+                    self.assert_((func(p, *args) == row).all())
+
+        x0, x1 = meshgrid(linspace(-5, 5, 51), linspace(-5, 5, 51))
+        x0 = x0.ravel()
+        x1 = x1.ravel()
+        pars2d = array([[2.0, 0.5, -0.5, 0.3, 0.7, 3.0],
+                        [1.0, 0.0, 0.0, 0.0, 0.0, 1.0]])
+        out = _modelfcts.gauss2d_batch(pars2d, x0, x1)
+        self.assertEqual(out.shape, (len(pars2d), len(x0)))
+        for p, row in zip(pars2d, out):
+            self.assert_((_modelfcts.gauss2d(p, x0, x1) == row).all())
+
+        x0lo, x1lo = meshgrid(arange(-3.0, 3.0), arange(-2.0, 2.0))
+        x0lo = x0lo.ravel()
+        x1lo = x1lo.ravel()
+        boxes = array([[-1.0, 1.5, 0.0, 1.0, 4.0],
+                       [-2.5, 0.5, -1.5, 2.0, 1.0]])
+        args = (x0lo, x1lo, x0lo + 1.0, x1lo + 1.0)
+        out = _modelfcts.box2d_batch(boxes, *args)
+        self.assertEqual(out.shape, (len(boxes), len(x0lo)))
+        for p, row in zip(boxes, out):
+            self.assert_((_modelfcts.box2d(p, *args) == row).all())
+
+        self.assertRaises(TypeError, _modelfcts.gauss1d_batch, pars1d[0], xlo)
+        self.assertRaises(TypeError, _modelfcts.gauss1d_batch, pars2d, xlo)
+
+    def assertMatchesScalar(self, func, pars, *args):
+        # Failures must give the same error and NaN pattern
+        vec = evaluate_or_error(func, pars, *args)
+        sca = evaluate_or_error(func, pars, *[strided(a) for a in args])
+        if isinstance(vec, str) or isinstance(sca, str):
+            self.assertEqual(vec, sca)
+            return
+        self.assert_((isnan(vec) == isnan(sca)).all())
+        good = ~isnan(sca)
+        self.assert_(within_ulp(vec[good], sca[good], len(args) == 2),
+                     "%s(%s) differs from the scalar path by %g" %
+                     (func.__name__, pars, abs(vec - sca)[good].max()))
+
+    def test_vector_kernels(self):
+        from sherpa.models import _modelfcts
+        x = linspace(-5.0, 5.0, 2002)
+        xpos = linspace(0.1, 10.0, 2002)
+        cases = (
+            (_modelfcts.gauss1d, x, ([2.5, 0.3, 3.0], [0.0, 0.3, 3.0],
+                                     [2.5, nan, 3.0])),
+            (_modelfcts.ngauss1d, x, ([2.5, 0.3, 3.0], [0.0, 0.3, 3.0],
+                                      [2.5, 0.3, nan])),
+            (_modelfcts.exp, x, ([0.5, -0.7, 2.0], [0.5, 0.0, 2.0],
+                                 [0.5, nan, 2.0])),
+            (_modelfcts.erf, x, ([3.0, 0.3, 1.5], [3.0, 0.3, 0.0],
+                                 [3.0, nan, 1.5])),
+            (_modelfcts.powlaw, xpos, ([1.7, 1.0, 3.0], [1.0, 1.0, 3.0],
+                                       [1.7, 1.0, nan])),
+            # Negative x is an error for powlaw
+            (_modelfcts.powlaw, x, ([1.7, 1.0, 3.0], [1.0, 1.0, 3.0])),
+            )
+        for func, grid, parsets in cases:
+            for pars in parsets:
+                self.assertMatchesScalar(func, pars, grid)
+                self.assertMatchesScalar(func, pars, grid[:-1], grid[1:])
+
+    def test_noint_integration(self):
+        from sherpa.models import _modelfcts
+        from math import erf, log, pi, sqrt
+
+        # The integral over a bin is the sum of the integrals over its
+        # halves, whether or not the bins need refining
+        x = linspace(0.1, 10.0, 201)
+        for func, pars in ((_modelfcts.poisson, [3.0, 2.0]),
+                           (_modelfcts.logparabola, [1.0, 1.5, 0.2, 2.0])):
+            pars = array(pars)
+            whole = func(pars, x[:-2:2], x[2::2])
+            halves = func(pars, x[:-1], x[1:])
+            self.assert_(abs(whole - halves[::2] - halves[1::2]).max() <
+                         1e-10 * abs(whole).max())
+
+        # A kernel failure at any node fails the evaluation, for
+        # contiguous and strided grids alike
+        x = linspace(-1.0, 10.0, 201)
+        pars = array([1.0, 1.5, 0.2, 2.0])
+        for args in ((x[:-1], x[1:]), (strided(x[:-1]), strided(x[1:]))):
+            self.assertRaises(ValueError, _modelfcts.logparabola, pars,
+                              *args)
+        self.assert_((_modelfcts.logparabola(pars, x[100:-1], x[101:]) >
+                      0).all())
+
+        # A circular gauss2d integrates to a product of erf differences
+        fwhm, xpos, ypos, ampl = 1.5, 0.3, -0.2, 2.0
+        sigma = fwhm / sqrt(8.0 * log(2.0))
+        def gauss(lo, hi, pos):
+            s = sigma * sqrt(2.0)
+            return sqrt(pi / 2.0) * sigma * (erf((hi - pos) / s) -
+                                             erf((lo - pos) / s))
+
+        edges = linspace(-5, 5, 21)
+        x0lo, x1lo = meshgrid(edges[:-1], edges[:-1])
+        x0lo = x0lo.ravel()
+        x1lo = x1lo.ravel()
+        x0hi = x0lo + 0.5
+        x1hi = x1lo + 0.5
+        pars = array([fwhm, xpos, ypos, 0.0, 0.0, ampl])
+        vals = _modelfcts.gauss2d(pars, x0lo, x1lo, x0hi, x1hi)
+        expected = array([ampl * gauss(a, b, xpos) * gauss(c, d, ypos)
+                          for a, b, c, d in zip(x0lo, x0hi, x1lo, x1hi)])
+        self.assert_(abs(vals - expected).max() < 1e-10 * expected.max())
+
+        # Batch rows match the single evaluations exactly
+        out = _modelfcts.gauss2d_batch(array([pars, pars * 1.1]),
+                                       x0lo, x1lo, x0hi, x1hi)
+        self.assert_((out[0] == vals).all())
+
+    def test_pixel_integration(self):
+        from sherpa.models import _modelfcts
+        from sherpa.astro.models import _modelfcts as _astromodelfcts
+        from math import erf, log, pi, sqrt
+
+        edges = linspace(-5, 5, 41)
+        x0lo, x1lo = meshgrid(edges[:-1], edges[:-1])
+        x0lo = x0lo.ravel()
+        x1lo = x1lo.ravel()
+        x0hi = x0lo + 0.25
+        x1hi = x1lo + 0.25
+
+        # An elliptical gauss2d along the grid axes takes the closed form
+        fwhm, xpos, ypos, ellip, ampl = 1.5, 0.3, -0.2, 0.4, 2.0
+        def gauss(lo, hi, pos, width):
+            sigma = width / sqrt(8.0 * log(2.0))
+            s = sigma * sqrt(2.0)
+            return sqrt(pi / 2.0) * sigma * (erf((hi - pos) / s) -
+                                             erf((lo - pos) / s))
+
+        pars = array([fwhm, xpos, ypos, ellip, pi / 2, ampl])
+        vals = _modelfcts.gauss2d(pars, x0lo, x1lo, x0hi, x1hi)
+        expected = array([ampl * gauss(a, b, xpos, fwhm * (1 - ellip)) *
+                          gauss(c, d, ypos, fwhm)
+                          for a, b, c, d in zip(x0lo, x0hi, x1lo, x1hi)])
+        self.assert_(abs(vals - expected).max() < 1e-12 * expected.max())
+
+        # Subpixel sampling stays close to the adaptive integral
+        pars = array([1.0, 0.1, 0.2, 0.3, 0.5, 1.0, 2.0])
+        adaptive = _astromodelfcts.sersic(pars, x0lo, x1lo, x0hi, x1hi)
+        oldpixels = _astromodelfcts.get_pixel_integration()
+        try:
+            _astromodelfcts.set_pixel_integration(8, 1.0)
+            self.assertEqual(_astromodelfcts.get_pixel_integration(),
+                             (8, 1.0))
+            sampled = _astromodelfcts.sersic(pars, x0lo, x1lo, x0hi, x1hi)
+            self.assertRaises(ValueError,
+                              _astromodelfcts.set_pixel_integration, -1)
+            self.assertRaises(ValueError,
+                              _astromodelfcts.set_pixel_integration, 4, -1.0)
+        finally:
+            _astromodelfcts.set_pixel_integration(*oldpixels)
+
+        self.assert_(abs(sampled - adaptive).max() < 1e-3 * adaptive.max())
+
+    def test_gradients(self):
+        from sherpa.models import _modelfcts
+        x = linspace(0.1, 10.0, 101)
+        xlo = x[:-1]
+        xhi = x[1:]
+        x0, x1 = meshgrid(linspace(-5, 5, 11), linspace(-5, 5, 11))
+        x0 = x0.ravel()
+        x1 = x1.ravel()
+
+        tests = ((_modelfcts.gauss1d, [2.0, 5.0, 3.0], (xlo,)),
+                 (_modelfcts.gauss1d, [2.0, 5.0, 3.0], (xlo, xhi)),
+                 (_modelfcts.powlaw, [1.7, 1.0, 2.0], (xlo, xhi)),
+                 (_modelfcts.sin, [4.0, 0.5, 2.0], (xlo, xhi)),
+                 (_modelfcts.logparabola, [1.0, 1.5, 0.2, 2.0], (xlo,)),
+                 (_modelfcts.gauss2d, [2.0, 0.5, -0.5, 0.3, 0.7, 3.0],
+                  (x0, x1)),
+                 (_modelfcts.poly2d, [1., .2, .3, .4, .5, .6, .7, .8, .9],
+                  (x0, x1, x0 + 0.1, x1 + 0.1)))
+
+        for func, pars, args in tests:
+            grad = getattr(_modelfcts, func.__name__ + '_grad')
+            pars = array(pars)
+            vals, jac = grad(pars, *args)
+            # The gradients use the scalar kernels, the values may come
+            # from the batch kernels
+            integrated = (len(args) == 4 or
+                          (len(args) == 2 and '2d' not in func.__name__))
+            self.assert_(within_ulp(vals, func(pars, *args), integrated))
+            self.assertEqual(jac.shape, (len(pars), len(args[0])))
+
+            for ii in xrange(len(pars)):
+                h = 1.0e-6 * max(abs(pars[ii]), 1.0)
+                hi = pars.copy()
+                lo = pars.copy()
+                hi[ii] += h
+                lo[ii] -= h
+                fd = (func(hi, *args) - func(lo, *args)) / (2.0 * h)
+                scale = max(abs(fd).max(), 1.0)
+                self.assert_(abs(jac[ii] - fd).max() < 1e-5 * scale)
+
+    def test_float32_evaluation(self):
+        from sherpa.models import _modelfcts
+        from numpy import float32
+        x = linspace(0.1, 10.0, 1001)
+        xlo = x[:-1]
+        xhi = x[1:]
+        x0, x1 = meshgrid(linspace(-5, 5, 41), linspace(-5, 5, 41))
+        x0 = x0.ravel()
+        x1 = x1.ravel()
+
+        tests = ((_modelfcts.gauss1d, [2.0, 5.0, 3.0], (xlo, xhi)),
+                 (_modelfcts.powlaw, [1.7, 1.0, 2.0], (xlo, xhi)),
+                 (_modelfcts.logparabola, [1.0, 1.5, 0.2, 2.0], (xlo, xhi)),
+                 (_modelfcts.gauss2d, [2.0, 0.5, -0.5, 0.3, 0.7, 3.0],
+                  (x0, x1, x0 + 0.25, x1 + 0.25)))
+
+        # Single precision is off by default, so float32 grids are
+        # evaluated in double precision
+        self.assertEqual(_modelfcts.get_single_precision(), False)
+        for func, pars, args in tests:
+            args32 = [a.astype(float32) for a in args]
+            self.assert_(func(pars, *args32).dtype.type is SherpaFloat)
+
+        # Switched on, the grids are read as float32 whatever their type;
+        # they are rounded first here so that both evaluations see the
+        # same bins
+        try:
+            for func, pars, args in tests:
+                args32 = [a.astype(float32) for a in args]
+                double = func(pars, *[a.astype(SherpaFloat) for a in args32])
+                _modelfcts.set_single_precision(True)
+                for grids in (args32, args):
+                    single = func(pars, *grids)
+                    self.assert_(single.dtype.type is float32)
+                    self.assert_(abs(single - double).max() <
+                                 1e-5 * abs(double).max())
+                _modelfcts.set_single_precision(False)
+        finally:
+            _modelfcts.set_single_precision(False)
+
+    def test_batched_integrate1d(self):
+        from sherpa.models import _modelfcts
+        from numpy import exp
+        x = linspace(-5.0, 5.0, 2001)
+        xlo = x[:-1]
+        xhi = x[1:]
+        pars = array([2.0, 0.3, 0.8])
+        ncalls = [0]
+
+        def gauss(p, x):
+            ncalls[0] += 1
+            return p[0] * exp(-(x - p[1])**2 / p[2])
+
+        # One call for the nodes of every bin, and at most two more for
+        # the bins that need the higher-order rules; the tolerance is
+        # one every bin reaches, so that no fallback is taken
+        batched = _modelfcts.integrate1d(gauss, pars, xlo, xhi, epsabs=1e-10,
+                                         batch=1)
+        self.assert_(ncalls[0] <= 3)
+
+        # Batching is opt-in: by default the model is called per bin
+        ncalls[0] = 0
+        perbin = _modelfcts.integrate1d(gauss, pars, xlo, xhi, epsabs=1e-10)
+        self.assert_(ncalls[0] >= len(xlo))
+        self.assert_((batched == perbin).all())
+
+        self.assertRaises(ValueError, _modelfcts.integrate1d,
+                          lambda p, x: x[:1], pars, xlo, xhi, batch=1)
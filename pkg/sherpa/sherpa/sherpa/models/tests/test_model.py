@@ -23,7 +23,8 @@ import numpy
 from sherpa.utils import SherpaFloat, SherpaTestCase
 from sherpa.utils.err import ModelErr
 from sherpa.models.model import *
-from sherpa.models.basic import Sin, Const1D
+from sherpa.models.basic import Sin, Const1D, Gauss1D, PowLaw1D, Gauss2D, \
+    Const2D
 
 
 def my_sin(pars, x):
@@ -101,6 +102,29 @@ class test_model(SherpaTestCase):
         self.assertEqual(self.m.thawedparhardmaxes,
                          [p.hard_max for p in self.m.pars if not p.frozen])
 
+    def test_cache(self):
+        from sherpa.models import _modelfcts
+        g = Gauss1D('g')
+        for par in g.pars:
+            par.freeze()
+        lo = numpy.linspace(-5, 5, 101)
+        hi = lo + 0.1
+
+        g.startup()
+        try:
+            first = g(lo, hi)
+            hits = _modelfcts.cache_stats()['hits']
+            # An equal grid in new arrays still finds the cached values
+            self.assert_(g(lo.copy(), hi.copy()) is first)
+            self.assertEqual(_modelfcts.cache_stats()['hits'], hits + 1)
+            g.integrate = False
+            self.assert_(g(lo, hi) is not first)
+            g.integrate = True
+            g.pos = 1.0
+            self.assert_((g(lo, hi) != first).any())
+        finally:
+            g.teardown()
+
 
 class test_composite_model(SherpaTestCase):
 
@@ -152,3 +176,74 @@ class test_composite_model(SherpaTestCase):
             m = self.m.apply(func)
             self.assert_(type(m) is NestedModel)
             self.assertEqual(m(self.x), func(self.m(self.x)))
+
+    def test_compiled_expression(self):
+        g = Gauss1D('g')
+        g.pos = 1.5
+        p = PowLaw1D('p')
+        p.gamma = 1.7
+        lo = numpy.linspace(0.5, 3.0, 2001)
+        hi = lo + 0.01
+
+        # Expressions of registered models are evaluated in one pass by
+        # the expression engine; the FilterModel and the array constant
+        # become array operands.  Compare with evaluating the leaves.
+        cmplx = -abs(3 * (p + g) / self.m - g ** 0.5) * self.s
+        arr = numpy.linspace(1.0, 2.0, len(lo))
+        mixed = (g + self.s[:]) * arr - p
+
+        for integrate in (True, False):
+            for m in (p, g, self.m, self.s):
+                m.integrate = integrate
+            for grid in ((lo,), (lo, hi)):
+                pv = p(*grid)
+                gv = g(*grid)
+                mv = self.m(*grid)
+                sv = self.s(*grid)
+                self.assertEqualWithinTol(cmplx(*grid),
+                                          -abs(3 * (pv + gv) / mv -
+                                               gv ** 0.5) * sv, 1e-12)
+                self.assertEqualWithinTol(mixed(*grid),
+                                          (gv + sv) * arr - pv, 1e-12)
+
+        # PowLaw1D snaps gamma to 1 when integrating, here too
+        p.gamma = 1.0 + 1e-12
+        p.integrate = True
+        self.assertEqualWithinTol((p * 2)(lo, hi), 2 * p(lo, hi), 1e-12)
+
+        g2 = Gauss2D('g2')
+        c2 = Const2D('c2')
+        x0, x1 = numpy.meshgrid(numpy.linspace(-1, 1, 40),
+                                numpy.linspace(-1, 1, 50))
+        x0 = x0.ravel()
+        x1 = x1.ravel()
+        self.assertEqualWithinTol((g2 * c2 + 1)(x0, x1),
+                                  g2(x0, x1) * c2(x0, x1) + 1, 1e-12)
+        grid = (x0, x1, x0 + 0.05, x1 + 0.05)
+        self.assertEqualWithinTol((g2 * c2 + 1)(*grid),
+                                  g2(*grid) * c2(*grid) + 1, 1e-12)
+
+
+    def test_compiled_expression_cache(self):
+        import sherpa.models.model as model
+        g = Gauss1D('g')
+        p = PowLaw1D('p')
+        lo = numpy.linspace(0.5, 3.0, 201)
+        hi = lo + 0.01
+        m = 2 * (g + p)
+
+        # The expression is walked and compiled once, and again only
+        # when a leaf setting the program depends on changes
+        m(lo, hi)
+        program = model._expr_programs[m][2][0]
+        self.assert_(program is not None)
+        m(lo, hi)
+        self.assert_(model._expr_programs[m][2][0] is program)
+
+        g.integrate = False
+        self.assertEqualWithinTol(m(lo, hi), 2 * (g(lo, hi) + p(lo, hi)),
+                                  1e-12)
+        self.assert_(model._expr_programs[m][2][0] is not program)
+        g.integrate = True
+        self.assertEqualWithinTol(m(lo, hi), 2 * (g(lo, hi) + p(lo, hi)),
+                                  1e-12)
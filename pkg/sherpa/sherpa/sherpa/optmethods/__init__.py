@@ -32,6 +32,11 @@ __all__ = ('GridSearch', 'OptMethod', 'LevMar', 'MonCar', 'NelderMead')
 
 class OptMethod(NoNewAttributesAfterInit):
 
+    # Whether the optimization function looks at the per-bin deviations
+    # (the second item returned by the statistic callback); if not, the
+    # fit only works out the statistic itself
+    needs_fvec = True
+
     def __init__(self, name, optfunc):        
         self.name = name
 	self._optfunc = optfunc
@@ -94,6 +99,11 @@ class OptMethod(NoNewAttributesAfterInit):
         def cb(pars):
             return statfunc(pars, *statargs, **statkwargs)
 
+        # Pass on the batched form of the callback, if there is one
+        batch = getattr(statfunc, 'batch', None)
+        if batch is not None and not statargs and not statkwargs:
+            cb.batch = batch
+
 	output = self._optfunc(cb, pars, parmins, parmaxes, **self.config)
 
         success = output[0]
@@ -113,6 +123,8 @@ class GridSearch(OptMethod):
     """A simple iterative method to support the template model interface,
     the method can be used for non-template model but it is very ineffecient
     for this purpose."""
+
+    needs_fvec = False
     
     def __init__(self, name='gridsearch'):
 	OptMethod.__init__(self, name, grid_search)
@@ -309,6 +321,8 @@ class LevMar(OptMethod):
 
 class MonCar(OptMethod):
 
+    needs_fvec = False
+
     def __init__(self, name='moncar'):
 	OptMethod.__init__(self, name, montecarlo)
 
@@ -316,6 +330,8 @@ class MonCar(OptMethod):
 # Call Sherpa's Nelder-Mead implementation
 class NelderMead(OptMethod):
 
+    needs_fvec = False
+
     def __init__(self, name='simplex'):
 	OptMethod.__init__(self, name, neldermead)
 
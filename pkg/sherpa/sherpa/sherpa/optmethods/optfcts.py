@@ -28,7 +28,7 @@ import _minpack
 import _minim
 import _saoopt
 
-from sherpa.utils import parallel_map
+from sherpa.utils import parallel_map, ParallelPool
 from sherpa.utils._utils import sao_fcmp
 
 #
@@ -157,6 +157,22 @@ def _same_par(a,b):
         return 1
     return 0
 
+def _difevo_batch(fcn, synchronous, numcores):
+    # The batched callback for the synchronous mode of the difevo
+    # functions: each generation of trial vectors is evaluated by fcn in
+    # one go, with numcores > 1 on a pool of worker processes kept until
+    # batch.close() is called at the end of the fit.  The result for a
+    # given seed does not depend on numcores.
+    if not synchronous:
+        return None
+
+    pool = ParallelPool(fcn, numcores)
+    def batch(points):
+        return numpy.asarray(pool(list(points)), numpy.float_)
+    batch.close = pool.close
+
+    return batch
+
 def _set_limits(x, xmin, xmax):
     below = numpy.nonzero(x < xmin)
     if below.size > 0:
@@ -173,7 +189,7 @@ __all__ = ('difevo', 'difevo_lm', 'difevo_nm', 'grid_search', 'lmdif', 'minim',
 
 def difevo(fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None, verbose=0,
            seed=2005815, population_size=None, xprob=0.9,
-           weighting_factor=0.8):
+           weighting_factor=0.8, synchronous=False, numcores=1):
 
     x, xmin, xmax = _check_args(x0, xmin, xmax)
 
@@ -191,8 +207,14 @@ def difevo(fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None, verbose=0,
     if maxfev is None:
         maxfev = 1024 * x.size
 
-    de = _saoopt.difevo( verbose, maxfev, seed, population_size, ftol, xprob,
-                         weighting_factor, xmin, xmax, x, fcn )
+    batch = _difevo_batch( fcn, synchronous, numcores )
+    try:
+        de = _saoopt.difevo( verbose, maxfev, seed, population_size, ftol,
+                             xprob, weighting_factor, xmin, xmax, x, fcn,
+                             batch )
+    finally:
+        if batch is not None:
+            batch.close()
     fval = de[ 1 ]
     nfev = de[ 2 ]
     ierr = de[ 3 ]
@@ -208,7 +230,10 @@ def difevo(fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None, verbose=0,
 
 def difevo_lm(fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None, verbose=0,
               seed=2005815, population_size=None, xprob=0.9,
-              weighting_factor=0.8):
+              weighting_factor=0.8, synchronous=False, numcores=1):
+
+    def stat_sqr( pars ):
+        return numpy.square( fcn( pars ) ).sum()
 
     x, xmin, xmax = _check_args(x0, xmin, xmax)
 
@@ -226,9 +251,14 @@ def difevo_lm(fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None, verbose=0,
     if maxfev is None:
         maxfev = 1024 * x.size
 
-    de = _saoopt.lm_difevo( verbose, maxfev, seed, population_size, ftol,
-                            xprob, weighting_factor, xmin, xmax,
-                            x, fcn, numpy.asanyarray(fcn(x)).size )
+    batch = _difevo_batch( stat_sqr, synchronous, numcores )
+    try:
+        de = _saoopt.lm_difevo( verbose, maxfev, seed, population_size, ftol,
+                                xprob, weighting_factor, xmin, xmax,
+                                x, fcn, numpy.asanyarray(fcn(x)).size, batch )
+    finally:
+        if batch is not None:
+            batch.close()
     fval = de[ 1 ]
     nfev = de[ 2 ]
     ierr = de[ 3 ]
@@ -241,7 +271,7 @@ def difevo_lm(fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None, verbose=0,
 
 def difevo_nm(fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None, verbose=0,
                seed=741985, population_size=None, xprob=0.9,
-               weighting_factor=0.8):
+               weighting_factor=0.8, synchronous=False, numcores=1):
 
     def stat_cb0( pars ):
         return fcn( pars )[ 0 ]
@@ -262,9 +292,14 @@ def difevo_nm(fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None, verbose=0,
     if maxfev is None:
         maxfev = 1024 * population_size
 
-    de = _saoopt.nm_difevo( verbose, maxfev, seed, population_size,
-                            ftol, xprob, weighting_factor, xmin, xmax,
-                            x, stat_cb0 )
+    batch = _difevo_batch( stat_cb0, synchronous, numcores )
+    try:
+        de = _saoopt.nm_difevo( verbose, maxfev, seed, population_size,
+                                ftol, xprob, weighting_factor, xmin, xmax,
+                                x, stat_cb0, batch )
+    finally:
+        if batch is not None:
+            batch.close()
     fval = de[ 1 ]
     nfev = de[ 2 ]
     ierr = de[ 3 ]
@@ -366,7 +401,8 @@ def grid_search( fcn, x0, xmin, xmax, num=16, sequence=None, numcores=1,
 # Levenberg-Marquardt
 #
 def lmdif(fcn, x0, xmin, xmax, ftol=EPSILON, xtol=EPSILON, gtol=EPSILON,
-          maxfev=None, epsfcn=EPSILON, factor=100.0, verbose=0):
+          maxfev=None, epsfcn=EPSILON, factor=100.0, verbose=0, numcores=1,
+          batch=False):
 
     def par_at_boundary( low, val, high, tol ):
         for par_min, par_val, par_max in izip( low, val, high ):
@@ -406,7 +442,34 @@ def lmdif(fcn, x0, xmin, xmax, ftol=EPSILON, xtol=EPSILON, gtol=EPSILON,
 
         return fvec, iflag
 
-    info, nfev, fval, covarerr = _minpack.mylmdif(stat_cb1, m, x, ftol, xtol, gtol, maxfev, epsfcn, factor, verbose, xmin, xmax)
+    # The columns of the forward-difference jacobian are independent, so
+    # with batch or numcores > 1 they are worked out in one go: by
+    # fcn.batch if the callback has one (a function of the 2D array of
+    # parameter sets returning the statistics and the 2D array of
+    # deviations), which keeps the work and its side effects in this
+    # process, and otherwise by a pool of worker processes kept for the
+    # whole fit
+    fcn_batch = getattr(fcn, 'batch', None)
+    pool = None
+    if fcn_batch is None:
+        pool = ParallelPool(orig_fcn, numcores)
+
+    def jacobian_cb(points):
+        if fcn_batch is not None:
+            return fcn_batch(points)[1]
+        return numpy.array(pool(list(points)))
+
+    if (batch or (numcores is not None and numcores > 1)) and len(x) > 1:
+        try:
+            x, fval, nfev, info, covarerr = \
+                _saoopt.cpp_lmdif(orig_fcn, m, x, ftol, xtol, gtol, maxfev,
+                                  epsfcn, factor, verbose, xmin, xmax,
+                                  jacobian_cb)
+        finally:
+            if pool is not None:
+                pool.close()
+    else:
+        info, nfev, fval, covarerr = _minpack.mylmdif(stat_cb1, m, x, ftol, xtol, gtol, maxfev, epsfcn, factor, verbose, xmin, xmax)
 
     if par_at_boundary( xmin, x, xmax, xtol ):
         nm_result = neldermead( fcn, x, xmin, xmax, ftol=numpy.sqrt(ftol), maxfev=maxfev-nfev, finalsimplex=2, iquad=0, verbose=0 )
@@ -520,7 +583,7 @@ def minim(fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None, step=None,
 #
 def montecarlo(fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None, verbose=0,
                seed=74815, population_size=None, xprob=0.9, 
-               weighting_factor=0.8):
+               weighting_factor=0.8, synchronous=False, numcores=1):
 
     def stat_cb0( pars ):
         return fcn( pars )[ 0 ]
@@ -578,7 +641,8 @@ def montecarlo(fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None, verbose=0,
         mymaxfev = min( maxfev_per_iter, maxfev - nfev )
         result = difevo_nm( myfcn, x, xmin, xmax, ftol=ftol, maxfev=mymaxfev,
                             seed=seed, population_size=pop, xprob=xprob,
-                            weighting_factor=weight )
+                            weighting_factor=weight, synchronous=synchronous,
+                            numcores=numcores )
         nfev += result[4].get( 'nfev' )
         x = numpy.asarray( result[1], numpy.float_ )
         nfval = result[2]
@@ -598,7 +662,8 @@ def montecarlo(fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None, verbose=0,
             result = difevo_nm( myfcn, y, xmin, xmax, ftol=ftol,
                                 maxfev=mymaxfev, seed=seed,
                                 population_size=pop, xprob=xprob,
-                                weighting_factor=weight )
+                                weighting_factor=weight,
+                                synchronous=synchronous, numcores=numcores )
             nfev += result[4].get( 'nfev' )
             if result[2] < nfval:
                 nfval = result[2]
@@ -657,10 +722,15 @@ def montecarlo(fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None, verbose=0,
 #
 def neldermead( fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None,
                 initsimplex=0, finalsimplex=9, step=None, iquad=1,
-                verbose=0 ):
+                verbose=0, cache=0, numstarts=1, numcores=1, seed=2005815,
+                parallel=1, count_hits=False ):
 
     x, xmin, xmax = _check_args(x0, xmin, xmax)
 
+    # the runs of a multi-start hand over one point at a time
+    if numstarts > 1 and parallel > 1:
+        raise TypeError( "numstarts and parallel cannot both be more than 1" )
+
     if step is None or ( numpy.iterable(step) and len(step) != len(x) ):
         step = 1.2*numpy.ones(x.shape, numpy.float_, numpy.isfortran(x))
     elif numpy.isscalar(step):
@@ -726,37 +796,78 @@ def neldermead( fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None,
     if debug:
         print 'opfcts.py neldermead() finalsimplex=%s\tisscalar=%s\titerable=%d' % (finalsimplex,numpy.isscalar(finalsimplex), numpy.iterable(finalsimplex))
 
+    # With numstarts > 1 the first pass runs that many simplices at once,
+    # from x and from points up to step away from it, and keeps the best;
+    # each round of their evaluations is done in one go, with numcores > 1
+    # on a pool of worker processes kept for the whole call.  The starts
+    # share maxfev between them.  The per-start results end up in
+    # starts; a start that was cancelled, since it was clearly worse
+    # than the others, has the info 6.
+    #
+    # With parallel > 1 each iteration moves that many of the worst
+    # vertices at once (Lee & Wiswall), their points being evaluated in
+    # the same way.
+    starts = []
+    pool = ParallelPool(stat_cb0, numcores)
+    def batch(points):
+        return numpy.asarray(pool(list(points)), numpy.float_)
+
     def simplex( verbose, maxfev, init, final, tol, step, xmin, xmax, x,
-                 myfcn, debug, ofval=FUNC_MAX ):
+                 myfcn, debug, ofval=FUNC_MAX, nstarts=1 ):
 
         tmpfinal = final[:]
         if len( final ) >= 3:
             tmpfinal = final[0:-1] # get rid of the last entry in the list
 
-        xx,ff,nf,er = _saoopt.neldermead( verbose, maxfev, init, tmpfinal, tol,
-                                          step, xmin, xmax, x, myfcn )
+        # with cache > 0 the last function values are kept, so that a
+        # point the simplex comes back to is not evaluated again; the
+        # repeats are only counted in nfev with count_hits, but a run
+        # stops once they alone reach maxfev
+        if nstarts > 1:
+            xx,ff,nf,er,hits,misses,runs = \
+                _saoopt.nm_multistart( verbose, maxfev, init, tmpfinal, tol,
+                                       step, xmin, xmax, x, myfcn, nstarts,
+                                       numcores, seed, batch, cache,
+                                       count_hits )
+            for fv, nfev, info, cancelled in runs:
+                starts.append( {'fval': fv, 'nfev': nfev, 'info': info,
+                                'cancelled': cancelled} )
+        else:
+            mybatch = None
+            if parallel > 1:
+                mybatch = batch
+            xx,ff,nf,er,hits,misses = \
+                _saoopt.neldermead( verbose, maxfev, init, tmpfinal, tol,
+                                    step, xmin, xmax, x, myfcn, cache,
+                                    count_hits, parallel, mybatch )
 
         if debug:
             print 'finalsimplex=%s, nfev=%d:\tf%s=%.20e' % (tmpfinal,nf,xx,ff)
 
         if len( final ) >= 3 and ff < 0.995 * ofval and nf < maxfev:
             myfinal = [final[-1]]
-            x,fval,nfev,err = simplex( verbose, maxfev-nf, init, myfinal, tol,
-                                       step, xmin, xmax, x, myfcn, debug,
-                                       ofval=ff )
-            return x,fval,nfev+nf,err
+            x,fval,nfev,err,myhits,mymisses = simplex( verbose, maxfev-nf,
+                                                       init, myfinal, tol,
+                                                       step, xmin, xmax, x,
+                                                       myfcn, debug,
+                                                       ofval=ff )
+            return x,fval,nfev+nf,err,hits+myhits,misses+mymisses
         else:
-            return xx,ff,nf,er
+            return xx,ff,nf,er,hits,misses
 
 
-    x, fval, nfev, ier = simplex( verbose, maxfev, initsimplex, finalsimplex,
-                                  ftol, step, xmin, xmax, x, stat_cb0, debug )
+    try:
+        x, fval, nfev, ier, hits, misses = \
+            simplex( verbose, maxfev, initsimplex, finalsimplex, ftol, step,
+                     xmin, xmax, x, stat_cb0, debug, nstarts=numstarts )
+    finally:
+        pool.close()
     if debug:
         print 'f%s=%f in %d nfev' % ( x, fval, nfev )
     
     info=1
     covarerr=None
-    if len( finalsimplex ) >= 3 and 0 != iquad:
+    if len( finalsimplex ) >= 3 and 0 != iquad and nfev + 12 < maxfev:
         nelmea = minim( fcn, x, xmin, xmax, ftol=10.0*ftol, maxfev=maxfev-nfev-12, iquad=1 )
         nelmea_x = numpy.asarray( nelmea[1], numpy.float_ )
         nelmea_nfev = nelmea[4].get( 'nfev' )
@@ -788,6 +899,11 @@ def neldermead( fcn, x0, xmin, xmax, ftol=EPSILON, maxfev=None,
         rv += (msg, {'covarerr': covarerr, 'info': status, 'nfev': nfev})
     else:
         rv += (msg, {'info': status, 'nfev': nfev})
+    if cache > 0:
+        rv[4]['cache_hits'] = hits
+        rv[4]['cache_misses'] = misses
+    if numstarts > 1:
+        rv[4]['starts'] = starts
     return rv
 
 
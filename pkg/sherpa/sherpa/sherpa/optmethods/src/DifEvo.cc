@@ -87,6 +87,89 @@ void tstde_lm( Init init, FctVec fct, int npar, std::vector<double>& par,
   print_pars( "DifEvo_lm_", fct_name, nfev, fmin, answer, npar, mypar );
 }
 
+//
+// Checks that BestMembers ranks the members as the sort of the whole
+// population orders its rows, and so reaches the same convergence
+// decision as Simplex::check_convergence on the first npar + 1 rows,
+// while random members improve and the population closes in on its
+// center.
+//
+int tst_best_members( int npar, double tol ) {
+
+  const int npop = 16 * npar, nbest = npar + 1, ntrials = 64,
+    nsteps = 4096;
+  MTRand mt( 1357 );
+  int mismatch = 0, nconverged = 0, ndecisions = 0;
+
+  for ( int trial = 0; trial < ntrials; ++trial ) {
+
+    sherpa::Simplex population( npop, npar + 1 ), sorted( npop, npar + 1 );
+    std::vector<double> center( npar ), row( npar + 1 );
+    for ( int jj = 0; jj < npar; ++jj )
+      center[ jj ] = 4.0 * mt.rand( ) - 2.0;
+
+    for ( int ii = 0; ii < npop; ++ii ) {
+      double fval = mt.rand( ) * 1.0e-12;
+      for ( int jj = 0; jj < npar; ++jj ) {
+	population[ ii ][ jj ] = center[ jj ] + mt.rand( ) - 0.5;
+	fval += ( population[ ii ][ jj ] - center[ jj ] ) *
+	  ( population[ ii ][ jj ] - center[ jj ] );
+      }
+      population[ ii ][ npar ] = fval;
+    }
+
+    sherpa::BestMembers best_members( population, nbest );
+    for ( int step = 0; step < nsteps; ++step ) {
+
+      const int member = mt.randInt( npop - 1 );
+      const double shrink = mt.rand( );
+      double fval = mt.rand( ) * 1.0e-12;
+      for ( int jj = 0; jj < npar; ++jj ) {
+	row[ jj ] = center[ jj ] +
+	  shrink * ( population[ member ][ jj ] - center[ jj ] );
+	fval += ( row[ jj ] - center[ jj ] ) * ( row[ jj ] - center[ jj ] );
+      }
+      row[ npar ] = fval;
+      if ( !( fval < population[ member ][ npar ] ) )
+	continue;
+      population.copy_row( row, member );
+      best_members.improved( member );
+
+      for ( int ii = 0; ii < npop; ++ii ) {
+	population.copy_row( ii, row );
+	sorted.copy_row( row, ii );
+      }
+      sorted.sort( );
+      sherpa::Simplex simplex( nbest, npar + 1 );
+      for ( int ii = 0; ii < nbest; ++ii ) {
+	sorted.copy_row( ii, row );
+	simplex.copy_row( row, ii );
+      }
+
+      const bool expected = simplex.check_convergence( tol, tol * tol, 0 );
+      const bool result = best_members.is_converged( tol );
+      ++ndecisions;
+      if ( expected )
+	++nconverged;
+      bool same_order = true;
+      for ( int ii = 0; ii < npop; ++ii )
+	if ( population[ best_members.member( ii ) ][ npar ] !=
+	     sorted[ ii ][ npar ] )
+	  same_order = false;
+      if ( expected != result || !same_order )
+	++mismatch;
+
+    }
+
+  }
+
+  std::cout << "#:BestMembers npar=" << npar << ": " << mismatch
+	    << " mismatches in " << ndecisions << " decisions ("
+	    << nconverged << " converged)\n";
+  return mismatch;
+
+}
+
 int main( int argc, char* argv[] ) {
 
   int c, uncopt = 1, globalopt = 1;
@@ -114,6 +197,8 @@ int main( int argc, char* argv[] ) {
   std::cout << "#:tol=" << tol << '\n';
   std::cout << "#\n# A negative value for the nfev signifies that the "
     "optimization method did not converge\n#\n";
+  if ( tst_best_members( npar, tol ) || tst_best_members( npar + 3, tol ) )
+    return EXIT_FAILURE;
   std::cout << "name\tnfev\tanswer\tstat\tpar\nS\tN\tN\tN\tN\n";
 
 
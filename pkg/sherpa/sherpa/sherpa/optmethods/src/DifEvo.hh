@@ -63,12 +63,125 @@
 //
 
 #include "sherpa/MersenneTwister.h"
+#include "sherpa/threads.hh"
 
 #include "Opt.hh"
 #include "Simplex.hh"
 
 namespace sherpa {
 
+  //
+  // Keeps the members of a DifEvo population ranked by their function
+  // values (the last column), in the order Simplex::sort would leave
+  // the rows in, without moving the rows.  The members only ever
+  // improve, so an improved member is moved up the ranking past the
+  // members that are now worse than it and the others keep their
+  // order.  The first nbest members are the ones the convergence test
+  // looks at.
+  //
+  class BestMembers {
+
+  public:
+
+    BestMembers( const sherpa::Simplex& population, int nbest )
+      : pop( population ), fval_index( population.npars( ) ),
+	nbest( std::min( nbest, population.nrows( ) ) ),
+	ranking( population.nrows( ) ), rank( population.nrows( ) ) {
+
+      const int npop = population.nrows( );
+      for ( int ii = 0; ii < npop; ++ii )
+	ranking[ ii ] = rank[ ii ] = ii;
+
+      // the insertion sort of Simplex::sort
+      for ( int ii = 1; ii < npop; ++ii )
+	improved( ii );
+
+    }
+
+    int best( ) const { return ranking[ 0 ]; }
+
+    // The member at position rr of the ranking, and the whole ranking
+    int member( int rr ) const { return ranking[ rr ]; }
+    const std::vector< int >& members( ) const { return ranking; }
+
+    // The function value of member has just gone down
+    void improved( int member ) {
+
+      const double fmember = fval( member );
+      int rr = rank[ member ];
+      for ( ; rr > 0 && fval( ranking[ rr - 1 ] ) > fmember; --rr ) {
+	ranking[ rr ] = ranking[ rr - 1 ];
+	rank[ ranking[ rr ] ] = rr;
+      }
+      ranking[ rr ] = member;
+      rank[ member ] = rr;
+
+    }
+
+    //
+    // The test of Simplex::check_convergence with finalsimplex = 0 over
+    // the nbest members: the largest squared distance from the best
+    // member is at most tol times the squared norm of the best member
+    // (or tol, if that is less than one)
+    //
+    bool is_converged( double tol ) const {
+
+      const std::vector<double>& xbest = pop[ best( ) ];
+      double max_length = 0.0;
+      for ( int rr = 1; rr < nbest; ++rr ) {
+	const std::vector<double>& xx = pop[ ranking[ rr ] ];
+	double length = 0.0;
+	for ( int jj = 0; jj < fval_index; ++jj )
+	  length += ( xx[ jj ] - xbest[ jj ] ) * ( xx[ jj ] - xbest[ jj ] );
+	max_length = std::max( max_length, length );
+      }
+
+      double norm_min = 0.0;
+      for ( int jj = 0; jj < fval_index; ++jj )
+	norm_min += xbest[ jj ] * xbest[ jj ];
+      norm_min = norm_min > 1.0 ? norm_min : 1.0;
+
+      return max_length <= tol * norm_min;
+
+    }
+
+  private:
+
+    const sherpa::Simplex& pop;
+    const int fval_index;
+    const int nbest;
+    std::vector< int > ranking;       // member indices, best first
+    std::vector< int > rank;          // position of each member in ranking
+
+    double fval( int member ) const { return pop[ member ][ fval_index ]; }
+
+  };                                                       // class BestMembers
+
+  //
+  // The rows of a population as the strategies see them: in the order
+  // of a ranking of the members if there is one, else in their own
+  //
+  class PopulationRows {
+
+  public:
+
+    PopulationRows( const sherpa::Simplex& population,
+		    const std::vector< int >* ranking=NULL )
+      : pop( population ), order( ranking ) { }
+
+    const std::vector<double>& operator[ ]( int ii ) const {
+      return pop[ NULL == order ? ii : ( *order )[ ii ] ];
+    }
+
+    int nrows( ) const { return pop.nrows( ); }
+
+  private:
+
+    const sherpa::Simplex& pop;
+    const std::vector< int >* order;
+
+  };                                                    // class PopulationRows
+
   template < typename Func, typename Data, typename Algo >
   class DifEvo : public sherpa::Opt {
     
@@ -76,16 +189,44 @@ namespace sherpa {
 
     typedef DifEvo<Func,Data,Algo> MyDifEvo;
     typedef void (MyDifEvo::*StrategyFuncPtr)( int, double, double, int,
-					       const sherpa::Simplex&,
+					       const PopulationRows&,
 					       const std::vector<double>&,
 					       MTRand&, std::vector<double>& );
 
+    // Evaluates the npts points stored one after the other in points,
+    // writing the function value of each point to fvals
+    typedef void (*BatchFunc)( int npar, int npts, double* points,
+			       double* fvals, int& ierr, Data xdata );
+
     enum Strategy { Best1Exp, Rand1Exp, RandToBest1Exp, Best2Exp, Rand2Exp,
 		    Best1Bin, Rand1Bin, RandToBest1Bin, Best2Bin, Rand2Bin };
 
     DifEvo( Func func, Data xdata, int mfct=0 )
       : Opt( ), usr_func( func ), usr_data( xdata ),
-	local_opt( func, xdata, mfct ), strategy_func_ptr( 0 ) { }
+	local_opt( func, xdata, mfct ), strategy_func_ptr( 0 ),
+	synchronous( false ), numcores( 1 ), batch_func( NULL ),
+	batch_data( Data( ) ) { }
+
+    //
+    // In the synchronous mode the trial vectors of a whole generation are
+    // built from the previous one and then evaluated together, with up
+    // to numcores threads (usr_func must then be thread safe).  All of
+    // the random numbers are drawn while the trials are built, so the
+    // result for a given seed does not depend on numcores.
+    //
+    void set_synchronous( bool flag, int num=1 ) {
+      synchronous = flag;
+      numcores = num;
+    }
+
+    //
+    // Hand each generation to func in one call instead; this implies the
+    // synchronous mode
+    //
+    void set_batch_func( BatchFunc func, Data xdata ) {
+      batch_func = func;
+      batch_data = xdata;
+    }
 	
     int operator( )( int verbose, int maxnfev, double tol, int population_size,
 		     int seed, double cross_over_probability, 
@@ -145,6 +286,28 @@ namespace sherpa {
     Data usr_data;
     Algo local_opt;
     StrategyFuncPtr strategy_func_ptr;
+    bool synchronous;
+    int numcores;
+    BatchFunc batch_func;
+    Data batch_data;
+
+    struct GenerationJob {
+      Algo* opt;
+      int npar;
+      std::vector< double* >* trials;
+      std::vector< int >* ierrs;
+    };
+
+    static int eval_trials_chunk( void* data, std::ptrdiff_t begin,
+				  std::ptrdiff_t end ) {
+      GenerationJob* job = static_cast< GenerationJob* >( data );
+      for ( std::ptrdiff_t kk = begin; kk < end; ++kk ) {
+	double* trial = ( *job->trials )[ kk ];
+	trial[ job->npar ] =
+	  job->opt->eval_point( job->npar, trial, ( *job->ierrs )[ kk ] );
+      }
+      return EXIT_SUCCESS;
+    }
 
     void choose_strategy( int strategy ) {
 
@@ -216,6 +379,138 @@ namespace sherpa {
    
     }
 
+    //
+    // Evaluate the trial vectors of a generation, counting the ones
+    // within the limits in nfev (the others get the largest double, as
+    // with eval_func).  Running out of evaluations is left to the
+    // caller, so that the generation is not lost.
+    //
+    void eval_generation( const sherpa::Opt::mypair& limits, int npar,
+			  std::vector< std::vector<double> >& trials,
+			  int& nfev ) {
+
+      std::vector< double* > inside;
+      for ( size_t kk = 0; kk < trials.size( ); ++kk )
+	if ( sherpa::Opt::are_pars_outside_limits( npar, limits,
+						   trials[ kk ] ) )
+	  trials[ kk ][ npar ] = std::numeric_limits< double >::max( );
+	else
+	  inside.push_back( &trials[ kk ][ 0 ] );
+
+      const int npts = static_cast< int >( inside.size( ) );
+      if ( 0 == npts )
+	return;
+      nfev += npts;
+
+      if ( NULL != batch_func ) {
+
+	std::vector< double > points( npts * npar ), fvals( npts );
+	for ( int kk = 0; kk < npts; ++kk )
+	  std::copy( inside[ kk ], inside[ kk ] + npar, &points[ kk * npar ] );
+	int ierr = EXIT_SUCCESS;
+	batch_func( npar, npts, &points[ 0 ], &fvals[ 0 ], ierr, batch_data );
+	if ( EXIT_SUCCESS != ierr )
+	  throw sherpa::OptErr( sherpa::OptErr::UsrFunc );
+	for ( int kk = 0; kk < npts; ++kk )
+	  inside[ kk ][ npar ] = fvals[ kk ];
+
+      } else {
+
+	std::vector< int > ierrs( npts, EXIT_SUCCESS );
+	GenerationJob job = { &local_opt, npar, &inside, &ierrs };
+	sherpa::threads::ThreadPool::instance( ).run( eval_trials_chunk, &job,
+						      npts, 1, numcores );
+	for ( int kk = 0; kk < npts; ++kk )
+	  if ( EXIT_SUCCESS != ierrs[ kk ] )
+	    throw sherpa::OptErr( sherpa::OptErr::UsrFunc );
+
+      }
+
+    }
+
+    //
+    // The synchronous form of difevo: each generation uses one of the
+    // strategies in turn, every candidate is replaced by its trial if
+    // that is better, and the local optimizer is started from the best
+    // trial if it improves on par.
+    //
+    int difevo_generations( int verbose, int maxnfev, double tol,
+			    double cross_over_probability,
+			    double scale_factor, int npar,
+			    const sherpa::Opt::mypair& limits,
+			    sherpa::Simplex& population, MTRand& mt_rand,
+			    std::vector<double>& par, int& nfev ) {
+
+      const int population_size = population.nrows( );
+      BestMembers best_members( population, npar + 1 );
+      const PopulationRows rows( population );
+      std::vector< std::vector<double> >
+	trials( population_size, std::vector<double>( npar + 1 ) );
+
+      for ( int generation = 0; nfev < maxnfev; ++generation ) {
+
+	choose_strategy( generation % 10 );
+
+	const int ntrials = std::min( population_size, maxnfev - nfev );
+	trials.resize( ntrials );
+	for ( int candidate = 0; candidate < ntrials; ++candidate ) {
+	  population.copy_row( candidate, trials[ candidate ] );
+	  (this->*strategy_func_ptr)( candidate, cross_over_probability,
+				      scale_factor, npar, rows, par,
+				      mt_rand, trials[ candidate ] );
+	}
+
+	eval_generation( limits, npar, trials, nfev );
+
+	int best = -1;
+	for ( int candidate = 0; candidate < ntrials; ++candidate )
+	  if ( trials[ candidate ][ npar ] <
+	       population[ candidate ][ npar ] ) {
+	    population.copy_row( trials[ candidate ], candidate );
+	    best_members.improved( candidate );
+	    if ( trials[ candidate ][ npar ] < par[ npar ] &&
+		 ( -1 == best ||
+		   trials[ candidate ][ npar ] < trials[ best ][ npar ] ) )
+	      best = candidate;
+	  }
+
+	// The best trial of the generation is kept before the local
+	// optimizer is started from it, so that it is not lost if either
+	// of them uses up maxnfev
+	const bool exhausted = nfev >= maxnfev;
+
+	if ( -1 != best ) {
+
+	  std::vector<double>& trial_solution = trials[ best ];
+	  sherpa::Array2d<double>::copy_vector( npar + 1, trial_solution,
+						par );
+	  if ( !exhausted ) {
+	    int ierr = local_opt.minimize( maxnfev - nfev, limits, tol, npar,
+					   trial_solution,
+					   trial_solution[ npar ], nfev );
+	    if ( EXIT_SUCCESS != ierr )
+	      return ierr;
+	    sherpa::Array2d<double>::copy_vector( npar + 1, trial_solution,
+						  par );
+	  }
+
+	  if ( verbose > 1 )
+	    sherpa::Opt::print_par( std::cout, par );
+
+	}
+
+	if ( exhausted )
+	  throw sherpa::OptErr( sherpa::OptErr::MaxFev );
+
+	if ( best_members.is_converged( tol ) )
+	  return EXIT_SUCCESS;
+
+      }
+
+      return EXIT_SUCCESS;
+
+    }                                                    // difevo_generations
+
     int difevo( int verbose, int maxnfev, double tol, int population_size,
 		int seed, double cross_over_probability, double scale_factor,
 		int npar, const sherpa::Opt::mypair& limits,
@@ -255,36 +550,49 @@ namespace sherpa {
       // allocate an extra element to store the function value
       //
       std::vector<double> trial_solution( npar + 1 );
-      const double tol_sqr = tol * tol;
-      const int simplex_tst = 0;
 
       ierr = local_opt.minimize( maxnfev - nfev, limits, tol, npar, par, 
 				 par[ npar ], nfev );
       if ( EXIT_SUCCESS != ierr )
 	return ierr;
 
+      if ( synchronous || NULL != batch_func )
+	return difevo_generations( verbose, maxnfev, tol,
+				   cross_over_probability, scale_factor, npar,
+				   limits, population, mt_rand, par, nfev );
+
+      //
+      // The candidates, and the members the strategies draw on, are
+      // taken by their rank: the population used to be sorted after
+      // each improvement, and the search depends on that order
+      //
+      BestMembers best_members( population, npar + 1 );
+      const PopulationRows ranked( population, &best_members.members( ) );
+
       for ( ; nfev < maxnfev; ) {
 
 	for ( int candidate=0; candidate < population_size && nfev < maxnfev;
 	      ++candidate ) {
 
-	  population.copy_row( candidate, trial_solution );
+	  population.copy_row( best_members.member( candidate ),
+			       trial_solution );
 
 	  for ( int strategy = 0; strategy < 10; ++strategy ) {
 
 	    choose_strategy( strategy );
 
 	    (this->*strategy_func_ptr)( candidate, cross_over_probability,
-					scale_factor, npar, population, par,
+					scale_factor, npar, ranked, par,
 					mt_rand, trial_solution );
 
 	    trial_solution[ npar ] = 
 	      local_opt.eval_func( maxnfev, limits, npar, trial_solution,
 				   nfev );
 
-	    if ( trial_solution[ npar ] <
-		 population[ candidate ][ npar ] ) {
-	      population.copy_row( trial_solution, candidate );
+	    const int member = best_members.member( candidate );
+	    if ( trial_solution[ npar ] < population[ member ][ npar ] ) {
+	      population.copy_row( trial_solution, member );
+	      best_members.improved( member );
 
 	      if ( trial_solution[ npar ] < par[ npar ] ) {
 
@@ -301,8 +609,7 @@ namespace sherpa {
 
 	      }  // if ( trial_solution[ npar ] < par[ npar ] ) {
 
-	      population.sort( );
-	      if ( population.check_convergence( tol, tol_sqr, simplex_tst ) )
+	      if ( best_members.is_converged( tol ) )
 		return EXIT_SUCCESS;
 
 	    }                  // if ( trial_solution[ npar ] < population( ...
@@ -326,7 +633,7 @@ namespace sherpa {
     // optimization problems where misconvergence occurs.
     //    
     void best1exp( int candidate, double xprob, double sfactor, int npar,
-		   const sherpa::Simplex& population,
+		   const PopulationRows& population,
 		   const std::vector<double>& par, MTRand& mt_rand,
 		   std::vector<double>& trial_solution )  {
 
@@ -349,7 +656,7 @@ namespace sherpa {
     // F=0.7 and CR=0.5 as a first guess.
     //
     void rand1exp( int candidate, double xprob, double sfactor, int npar,
-		   const sherpa::Simplex& population,
+		   const PopulationRows& population,
 		   const std::vector<double>& par, MTRand& mt_rand,
 		   std::vector<double>& trial_solution ) {
 
@@ -373,7 +680,7 @@ namespace sherpa {
     // help you should play around with all three control variables.
     //
     void randtobest1exp( int candidate, double xprob, double sfactor, int npar,
-			 const sherpa::Simplex& population,
+			 const PopulationRows& population,
 			 const std::vector<double>& par, MTRand& mt_rand,
 			 std::vector<double>& trial_solution ) {
 
@@ -391,7 +698,7 @@ namespace sherpa {
     }
 
     void best2exp( int candidate, double xprob, double sfactor, int npar,
-		   const sherpa::Simplex& population,
+		   const PopulationRows& population,
 		   const std::vector<double>& par, MTRand& mt_rand,
 		   std::vector<double>& trial_solution ) {
 
@@ -411,7 +718,7 @@ namespace sherpa {
     }
 
     void rand2exp( int candidate, double xprob, double sfactor, int npar,
-		   const sherpa::Simplex& population,
+		   const PopulationRows& population,
 		   const std::vector<double>& par, MTRand& mt_rand,
 		   std::vector<double>& trial_solution ) {
 
@@ -431,7 +738,7 @@ namespace sherpa {
     }
 
     void best1bin( int candidate, double xprob, double sfactor, int npar,
-			  const sherpa::Simplex& population,
+			  const PopulationRows& population,
 			  const std::vector<double>& par, MTRand& mt_rand,
 			  std::vector<double>& trial_solution ) {
 
@@ -450,7 +757,7 @@ namespace sherpa {
     }
 
     void rand1bin( int candidate, double xprob, double sfactor, int npar,
-		   const sherpa::Simplex& population,
+		   const PopulationRows& population,
 		   const std::vector<double>& par, MTRand& mt_rand,
 		   std::vector<double>& trial_solution ) {
 
@@ -469,7 +776,7 @@ namespace sherpa {
     }
 
     void randtobest1bin( int candidate, double xprob, double sfactor, int npar,
-			 const sherpa::Simplex& population,
+			 const PopulationRows& population,
 			 const std::vector<double>& par, MTRand& mt_rand,
 			 std::vector<double>& trial_solution ) {
 
@@ -489,7 +796,7 @@ namespace sherpa {
     }
 
     void best2bin( int candidate, double xprob, double sfactor, int npar,
-		   const sherpa::Simplex& population,
+		   const PopulationRows& population,
 		   const std::vector<double>& par, MTRand& mt_rand,
 		   std::vector<double>& trial_solution ) {
 
@@ -510,7 +817,7 @@ namespace sherpa {
     }
 
     void rand2bin( int candidate, double xprob, double sfactor, int npar,
-		   const sherpa::Simplex& population,
+		   const PopulationRows& population,
 		   const std::vector<double>& par, MTRand& mt_rand,
 		   std::vector<double>& trial_solution ) {
 
@@ -0,0 +1,453 @@
+#ifndef MultiStart_hh
+#define MultiStart_hh
+
+//
+//  Copyright (C) 2013  Smithsonian Astrophysical Observatory
+//
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with this program; if not, write to the Free Software Foundation, Inc.,
+//  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+
+//
+// Multi-start Nelder-Mead: nstarts independent NelderMead runs, the
+// first from par and the others from copies of par perturbed by up to
+// step (within the limits), each run in a thread of its own.
+//
+// The runs go in lock step.  In each round every run that is still
+// going hands over the point it wants evaluated next, the points are
+// evaluated together, in the order of the runs, either by the batch
+// function or by usr_func with numcores threads, and the runs carry on.
+// The user function is therefore only ever called from the thread that
+// called operator(), or from the thread pool, and the rounds do not
+// depend on the scheduling of the threads: the result for a given seed
+// does not depend on numcores.
+//
+// After each round the best value found so far by any of the runs is
+// compared with the best of each run, and the runs that are clearly
+// worse and no longer getting better are cancelled (see set_dominance).
+//
+// The runs share maxnfev: before a round is evaluated, the runs with the
+// worst best values are stopped, with OptErr::MaxFev, until the points
+// of the round fit in what is left of it.
+//
+// MulDirSearch is not offered as the local method, since it is still
+// written against the old OptFunc interface.
+//
+
+#include <pthread.h>
+#include <cmath>
+
+#include "sherpa/MersenneTwister.h"
+#include "sherpa/threads.hh"
+
+#include "NelderMead.hh"
+
+namespace sherpa {
+
+  template< typename Func, typename Data >
+  class MultiStart {
+
+  public:
+
+    //
+    // Evaluate the npts points of a round, stored one after the other
+    // in points, into fvals; set ierr to anything but EXIT_SUCCESS
+    // on error
+    //
+    typedef void (*BatchFunc)( int npar, int npts, double* points,
+			       double* fvals, int& ierr, Data data );
+
+    struct Start {
+      Start( ) : nfev( 0 ), ierr( EXIT_SUCCESS ), cache_hits( 0 ),
+		 cache_misses( 0 ), cancelled( false ) { }
+      // the best point of the run, with the function value at par[ npar ]
+      std::vector< double > par;
+      int nfev;
+      int ierr;
+      long cache_hits;
+      long cache_misses;
+      bool cancelled;
+    };
+
+    MultiStart( Func func, Data data )
+      : usr_func( func ), usr_data( data ), batch_func( NULL ),
+	batch_data( data ), numcores( 1 ), dominance( 1.0 ),
+	cachesize( 0 ), count_hits( false ) { }
+
+    void set_batch_func( BatchFunc func, Data data ) {
+      batch_func = func;
+      batch_data = data;
+    }
+
+    void set_numcores( int num ) { numcores = num > 1 ? num : 1; }
+
+    //
+    // A run is cancelled when its best value exceeds the best value of
+    // all the runs, f, by more than factor * ( |f| + 1 ) and has not
+    // improved over its last 10 * ( npar + 1 ) evaluations.  With
+    // factor <= 0 the runs are never cancelled.
+    //
+    void set_dominance( double factor ) { dominance = factor; }
+
+    // The evaluation cache of each run (see OptFunc::set_cache)
+    void set_cache( int size, bool count=false ) {
+      cachesize = size;
+      count_hits = count;
+    }
+
+    const std::vector< Start >& get_starts( ) const { return starts; }
+
+    //
+    // Returns the status of the run with the best result, or
+    // OptErr::UsrFunc if the user function failed, in which case all
+    // the runs are stopped.  nfev is the total over all the runs, and it
+    // is at most maxnfev unless cached points are counted (a run may
+    // count its repeats past what is left before it is stopped).  A
+    // cancelled run has the status OptErr::Cancelled.
+    //
+    int operator( )( int verbose, int maxnfev, double tol, int npar,
+		     int nstarts, int seed, int initsimplex,
+		     const std::vector<int>& finalsimplex,
+		     const std::vector<double>& low,
+		     const std::vector<double>& high,
+		     const std::vector<double>& step,
+		     std::vector<double>& par, int& nfev, double& fmin ) {
+
+      if ( nstarts < 1 )
+	nstarts = 1;
+
+      Setup mysetup = { verbose, maxnfev, tol, initsimplex, &finalsimplex,
+			&low, &high, &step };
+      setup = mysetup;
+      usr_failed = false;
+
+      starts.assign( nstarts, Start( ) );
+      std::vector< Run > runs( nstarts );
+
+      MTRand mt_rand( seed );
+      for ( int kk = 0; kk < nstarts; ++kk ) {
+	Run& run = runs[ kk ];
+	run.self = this;
+	run.index = kk;
+	run.nevals = 0;
+	run.improved = 0;
+	run.state = Run::RUNNING;
+	run.stop = OptErr::Success;
+	run.x0.assign( par.begin( ), par.begin( ) + npar );
+	run.point.resize( npar );
+	if ( kk > 0 )
+	  for ( int jj = 0; jj < npar; ++jj ) {
+	    double xx = par[ jj ] +
+	      step[ jj ] * ( 2.0 * mt_rand.randDblExc( ) - 1.0 );
+	    run.x0[ jj ] = std::min( std::max( xx, low[ jj ] ), high[ jj ] );
+	  }
+	starts[ kk ].par = run.x0;
+	starts[ kk ].par.push_back( std::numeric_limits< double >::max( ) );
+      }
+
+      pthread_mutex_init( &mutex, NULL );
+      pthread_cond_init( &main_cond, NULL );
+      pthread_cond_init( &run_cond, NULL );
+
+      std::vector< pthread_t > threads( nstarts );
+      std::vector< bool > started( nstarts, false );
+      for ( int kk = 0; kk < nstarts; ++kk )
+	if ( 0 == pthread_create( &threads[ kk ], NULL, run_start,
+				  &runs[ kk ] ) )
+	  started[ kk ] = true;
+	else {
+	  runs[ kk ].state = Run::DONE;
+	  starts[ kk ].ierr = OptErr::Unknown;
+	}
+
+      run_rounds( npar, runs );
+
+      for ( int kk = 0; kk < nstarts; ++kk )
+	if ( started[ kk ] )
+	  pthread_join( threads[ kk ], NULL );
+
+      pthread_cond_destroy( &run_cond );
+      pthread_cond_destroy( &main_cond );
+      pthread_mutex_destroy( &mutex );
+
+      int best = 0;
+      nfev = 0;
+      for ( int kk = 0; kk < nstarts; ++kk ) {
+	nfev += starts[ kk ].nfev;
+	if ( starts[ kk ].par[ npar ] < starts[ best ].par[ npar ] )
+	  best = kk;
+      }
+
+      for ( int ii = 0; ii < npar; ++ii )
+	par[ ii ] = starts[ best ].par[ ii ];
+      fmin = starts[ best ].par[ npar ];
+
+      if ( usr_failed )
+	return OptErr::UsrFunc;
+      return starts[ best ].ierr;
+
+    }
+
+  private:
+
+    struct Setup {
+      int verbose;
+      int maxnfev;
+      double tol;
+      int initsimplex;
+      const std::vector<int>* finalsimplex;
+      const std::vector<double>* low;
+      const std::vector<double>* high;
+      const std::vector<double>* step;
+    };
+
+    struct Run {
+      enum State { RUNNING, WAITING, DONE };
+      MultiStart* self;
+      int index;
+      int nevals;
+      int improved;    // nevals at the last improvement of the run
+      State state;
+      OptErr::Err stop;  // why the run is to stop, or OptErr::Success
+      std::vector< double > x0;
+      // the point handed over for evaluation, its value and status
+      std::vector< double > point;
+      double fval;
+      int ierr;
+    };
+
+    typedef void (*RunFunc)( int npar, double* par, double& fval, int& ierr,
+			     Run* run );
+
+    struct RoundJob {
+      MultiStart* self;
+      int npar;
+      const std::vector< Run* >* round;
+    };
+
+    Func usr_func;
+    Data usr_data;
+    BatchFunc batch_func;
+    Data batch_data;
+    int numcores;
+    double dominance;
+    int cachesize;
+    bool count_hits;
+    Setup setup;
+    bool usr_failed;
+    std::vector< Start > starts;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t main_cond;
+    pthread_cond_t run_cond;
+
+    MultiStart& operator = (MultiStart const&); // declare but, purposely, not define
+    MultiStart( MultiStart const& );            // declare but, purposely, not define
+
+    //
+    // The function seen by the NelderMead of a run: hand the point over
+    // to the thread running the rounds and wait for its value.  A run
+    // that is to stop gets the reason thrown at it instead.
+    //
+    static void eval_point( int npar, double* par, double& fval, int& ierr,
+			    Run* run ) {
+
+      MultiStart& self = *run->self;
+      pthread_mutex_lock( &self.mutex );
+      std::copy( par, par + npar, run->point.begin( ) );
+      run->state = Run::WAITING;
+      pthread_cond_signal( &self.main_cond );
+      while ( Run::WAITING == run->state )
+	pthread_cond_wait( &self.run_cond, &self.mutex );
+      fval = run->fval;
+      ierr = run->ierr;
+      const OptErr::Err stop = run->stop;
+      pthread_mutex_unlock( &self.mutex );
+
+      if ( OptErr::Success != stop )
+	throw sherpa::OptErr( stop );
+
+    }
+
+    static void* run_start( void* arg ) {
+
+      Run& run = *static_cast< Run* >( arg );
+      MultiStart& self = *run.self;
+      const Setup& setup = self.setup;
+      Start& start = self.starts[ run.index ];
+      const int npar = static_cast< int >( run.x0.size( ) );
+
+      try {
+	NelderMead< RunFunc, Run* > nm( eval_point, &run );
+	nm.set_cache( self.cachesize, self.count_hits );
+	std::vector< double > mypar( run.x0 );
+	double fval;
+	start.ierr = nm( setup.verbose, setup.maxnfev, setup.tol, npar,
+			 setup.initsimplex, *setup.finalsimplex, *setup.low,
+			 *setup.high, *setup.step, mypar, start.nfev, fval );
+	start.cache_hits = nm.get_cache( ).get_hits( );
+	start.cache_misses = nm.get_cache( ).get_misses( );
+      } catch( ... ) {
+	start.ierr = OptErr::Unknown;
+      }
+
+      pthread_mutex_lock( &self.mutex );
+      run.state = Run::DONE;
+      pthread_cond_signal( &self.main_cond );
+      pthread_mutex_unlock( &self.mutex );
+
+      return NULL;
+
+    }
+
+    static int eval_round_chunk( void* data, std::ptrdiff_t begin,
+				 std::ptrdiff_t end ) {
+      const RoundJob& job = *static_cast< RoundJob* >( data );
+      for ( std::ptrdiff_t kk = begin; kk < end; ++kk ) {
+	Run& run = *( *job.round )[ kk ];
+	run.ierr = EXIT_SUCCESS;
+	job.self->usr_func( job.npar, &run.point[ 0 ], run.fval, run.ierr,
+			    job.self->usr_data );
+      }
+      return EXIT_SUCCESS;
+    }
+
+    void eval_round( int npar, const std::vector< Run* >& round ) {
+
+      const int npts = static_cast< int >( round.size( ) );
+
+      if ( NULL != batch_func ) {
+
+	std::vector< double > points( npts * npar ), fvals( npts );
+	for ( int kk = 0; kk < npts; ++kk )
+	  std::copy( round[ kk ]->point.begin( ), round[ kk ]->point.end( ),
+		     &points[ kk * npar ] );
+	int ierr = EXIT_SUCCESS;
+	batch_func( npar, npts, &points[ 0 ], &fvals[ 0 ], ierr, batch_data );
+	for ( int kk = 0; kk < npts; ++kk ) {
+	  round[ kk ]->fval = fvals[ kk ];
+	  round[ kk ]->ierr = ierr;
+	}
+
+      } else {
+
+	RoundJob job = { this, npar, &round };
+	sherpa::threads::ThreadPool::instance( ).run( eval_round_chunk, &job,
+						      npts, 1, numcores );
+
+      }
+
+    }
+
+    //
+    // Wait until every run has either handed over a point or finished,
+    // stop the runs that would go past maxnfev, evaluate the points,
+    // share the best value and cancel the runs that are dominated, until
+    // all the runs are done
+    //
+    void run_rounds( int npar, std::vector< Run >& runs ) {
+
+      const int nstarts = static_cast< int >( runs.size( ) );
+      const int patience = 10 * ( npar + 1 );
+      double best = std::numeric_limits< double >::max( );
+      std::vector< Run* > round;
+
+      pthread_mutex_lock( &mutex );
+
+      for ( ; ; ) {
+
+	round.clear( );
+	int ndone = 0;
+	for ( int kk = 0; kk < nstarts; ++kk )
+	  if ( Run::WAITING == runs[ kk ].state )
+	    round.push_back( &runs[ kk ] );
+	  else if ( Run::DONE == runs[ kk ].state )
+	    ++ndone;
+
+	if ( ndone == nstarts )
+	  break;
+	if ( static_cast< int >( round.size( ) ) + ndone < nstarts ) {
+	  pthread_cond_wait( &main_cond, &mutex );
+	  continue;
+	}
+
+	// The nfev of a waiting run already counts the point it handed over
+	int total = 0;
+	for ( int kk = 0; kk < nstarts; ++kk )
+	  total += starts[ kk ].nfev;
+	while ( total > setup.maxnfev && !round.empty( ) ) {
+	  size_t worst = 0;
+	  for ( size_t kk = 1; kk < round.size( ); ++kk )
+	    if ( starts[ round[ kk ]->index ].par[ npar ] >=
+		 starts[ round[ worst ]->index ].par[ npar ] )
+	      worst = kk;
+	  Run& run = *round[ worst ];
+	  --starts[ run.index ].nfev;
+	  --total;
+	  run.stop = OptErr::MaxFev;
+	  run.state = Run::RUNNING;
+	  round.erase( round.begin( ) + worst );
+	}
+	if ( round.empty( ) ) {
+	  pthread_cond_broadcast( &run_cond );
+	  continue;
+	}
+
+	pthread_mutex_unlock( &mutex );
+	eval_round( npar, round );
+	pthread_mutex_lock( &mutex );
+
+	for ( size_t kk = 0; kk < round.size( ); ++kk ) {
+	  Run& run = *round[ kk ];
+	  if ( EXIT_SUCCESS != run.ierr ) {
+	    usr_failed = true;
+	    continue;
+	  }
+	  ++run.nevals;
+	  std::vector< double >& runbest = starts[ run.index ].par;
+	  if ( run.fval < runbest[ npar ] ) {
+	    std::copy( run.point.begin( ), run.point.end( ), runbest.begin( ) );
+	    runbest[ npar ] = run.fval;
+	    run.improved = run.nevals;
+	  }
+	  best = std::min( best, run.fval );
+	}
+
+	for ( size_t kk = 0; kk < round.size( ); ++kk ) {
+	  Run& run = *round[ kk ];
+	  const double runbest = starts[ run.index ].par[ npar ];
+	  if ( usr_failed )
+	    run.stop = OptErr::UsrFunc;
+	  else if ( dominance > 0.0 && run.nevals - run.improved >= patience &&
+		    runbest - best > dominance * ( std::fabs( best ) + 1.0 ) ) {
+	    starts[ run.index ].cancelled = true;
+	    run.stop = OptErr::Cancelled;
+	  }
+	  run.state = Run::RUNNING;
+	}
+	pthread_cond_broadcast( &run_cond );
+
+      }
+
+      pthread_mutex_unlock( &mutex );
+
+    }
+
+  };                                                      // class MultiStart
+
+}                                                          // namespace sherpa
+
+#endif
@@ -53,6 +53,12 @@
 //  f      ==>  simplex[ npar ][ npar ]
 //   n+1
 //
+// The parallel variant (see set_parallel) follows
+//
+// Donghoon Lee and Matthew Wiswall, "A Parallel Implementation of the
+// Simplex Function Minimization Routine", Computational Economics,
+// Vol. 30, No. 2 (2007), 171-187.
+//
 // Sep 2006 Original version written by D. T. Nguyen
 // Jan 2008 Removed the dependency of an obsolete multi-dimensional
 //          array with one of my own. Modifid code to be called from
@@ -60,6 +66,10 @@
 //          on a few problems sent in by the users.
 //
 
+#include <algorithm>
+
+#include "sherpa/threads.hh"
+
 #include "Opt.hh"
 #include "Simplex.hh"
 #include "PyWrapper.hh"
@@ -70,6 +80,11 @@ namespace sherpa {
   class NelderMead : public sherpa::OptFunc< Func, Data > {
 
   public:
+
+    // Evaluates the npts points stored one after the other in points,
+    // writing the function value of each point to fvals
+    typedef void (*BatchFunc)( int npar, int npts, double* points,
+			       double* fvals, int& ierr, Data xdata );
     
     //
     // The nearly universal choices used in the
@@ -85,12 +100,38 @@ namespace sherpa {
 	contraction_coef( contractcoef ), expansion_coef( expancoef ),
 	reflection_coef( refleccoef ), shrink_coef( shrinkcoef ),
 	rho_gamma( refleccoef * contractcoef ), 
-	rho_chi( refleccoef * expancoef ) {
+	rho_chi( refleccoef * expancoef ), nparallel( 1 ), numcores( 1 ),
+	batch_func( NULL ), batch_data( Data( ) ) {
 
       check_coefficients( );
 
     }
 
+    //
+    // With num_vertices > 1 each iteration moves the num_vertices worst
+    // vertices at once, each against the centroid of the others, and the
+    // points of each step (the reflections, then the expansions and
+    // contractions, or the shrink) are evaluated together with up to
+    // numcores threads (usr_func must then be thread safe).  The simplex
+    // is shrunk only if none of the vertices moved.  At most half of the
+    // npar + 1 vertices are moved, since the centroid of too few of them
+    // soon collapses the simplex.  The evaluation cache is not used in
+    // this mode.
+    //
+    void set_parallel( int num_vertices, int num=1 ) {
+      nparallel = num_vertices > 1 ? num_vertices : 1;
+      numcores = num;
+    }
+
+    //
+    // Hand the points of each step of the parallel variant to func in
+    // one call instead
+    //
+    void set_batch_func( BatchFunc func, Data xdata ) {
+      batch_func = func;
+      batch_data = xdata;
+    }
+
     int operator( )( int verbose, int maxnfev, double tol, int npar,
 		     int initsimplex, const std::vector<int>& finalsimplex,
 		     const std::vector<double>& low,
@@ -120,8 +161,12 @@ namespace sherpa {
 	if ( sherpa::Opt::are_pars_outside_limits( npar, limits, par ) )
 	  throw sherpa::OptErr( sherpa::OptErr::OutOfBound );
 
-	neldermead( verbose, maxnfev, tol, initsimplex, finalsimplex, limits,
-		    step, mypar, nfev );
+	if ( nparallel > 1 )
+	  parallel_neldermead( verbose, maxnfev, tol, initsimplex,
+			       finalsimplex, limits, step, mypar, nfev );
+	else
+	  neldermead( verbose, maxnfev, tol, initsimplex, finalsimplex, limits,
+		      step, mypar, nfev );
 
       } catch( sherpa::OptErr& oe ) {
 
@@ -178,17 +223,33 @@ namespace sherpa {
     const double rho_gamma, rho_chi;
     std::vector<double> centroid, contraction, expansion, reflection;
     sherpa::Simplex simplex;
+    int nparallel;
+    int numcores;
+    BatchFunc batch_func;
+    Data batch_data;
+
+    struct VertexJob {
+      NelderMead* opt;
+      int npar;
+      const std::vector< std::vector< double >* >* points;
+      std::vector< int >* ierrs;
+    };
 
     void calculate_centroid( )  {
+      calculate_centroid( simplex.npars( ) );
+    }
+
+    // The centroid of the nvertex best vertices
+    void calculate_centroid( int nvertex )  {
 
       const int npar = simplex.npars( );
       for ( int ii = 0; ii < npar; ++ii ) {
 	centroid[ ii ] = 0.0;
-	for ( int jj = 0; jj < npar; ++jj ) {
+	for ( int jj = 0; jj < nvertex; ++jj ) {
 	  // The last vextex is to be avoided so ; jj <= npar; would be wrong!
 	  centroid[ ii ] += simplex[ jj ][ ii ];
 	}
-	centroid[ ii ] /= double( npar );
+	centroid[ ii ] /= double( nvertex );
 
       }
       
@@ -333,6 +394,14 @@ namespace sherpa {
 
 	}
 
+      if ( nparallel > 1 ) {
+	std::vector< std::vector< double >* > rows;
+	for ( int ii = 0; ii <= npar; ++ii )
+	  rows.push_back( &simplex[ ii ] );
+	eval_vertices( maxnfev, limits, npar, rows, nfev );
+	return;
+      }
+
       for ( int ii = 0; ii <= npar; ++ii ) {
 	std::vector< double >& rowii = simplex[ ii ];
 	sherpa::OptFunc< Func, Data >::eval_func( maxnfev, limits, npar,
@@ -341,6 +410,76 @@ namespace sherpa {
       
     }                                                      // eval_init_simplex
 
+    static int eval_vertices_chunk( void* data, std::ptrdiff_t begin,
+				    std::ptrdiff_t end ) {
+      VertexJob* job = static_cast< VertexJob* >( data );
+      for ( std::ptrdiff_t kk = begin; kk < end; ++kk ) {
+	std::vector< double >& point = *( *job->points )[ kk ];
+	point[ job->npar ] =
+	  job->opt->eval_point( job->npar, &point[ 0 ], ( *job->ierrs )[ kk ] );
+      }
+      return EXIT_SUCCESS;
+    }
+
+    //
+    // Evaluate the points of a step of the parallel variant together,
+    // counting the ones within the limits in nfev (the others get the
+    // largest double, as with eval_func).  No more points are evaluated
+    // than are left of maxnfev.
+    //
+    void eval_vertices( int maxnfev, const sherpa::Opt::mypair& limits,
+			int npar,
+			const std::vector< std::vector< double >* >& points,
+			int& nfev ) {
+
+      std::vector< std::vector< double >* > inside;
+      for ( size_t kk = 0; kk < points.size( ); ++kk )
+	if ( sherpa::Opt::are_pars_outside_limits( npar, limits,
+						   *points[ kk ] ) )
+	  ( *points[ kk ] )[ npar ] = std::numeric_limits< double >::max( );
+	else
+	  inside.push_back( points[ kk ] );
+
+      const int npts = std::min( static_cast< int >( inside.size( ) ),
+				 std::max( maxnfev - nfev, 0 ) );
+      if ( 0 == npts ) {
+	if ( inside.empty( ) )
+	  return;
+	throw sherpa::OptErr( sherpa::OptErr::MaxFev );
+      }
+      inside.resize( npts );
+      nfev += npts;
+
+      if ( NULL != batch_func ) {
+
+	std::vector< double > xpoints( npts * npar ), fvals( npts );
+	for ( int kk = 0; kk < npts; ++kk )
+	  std::copy( inside[ kk ]->begin( ), inside[ kk ]->begin( ) + npar,
+		     &xpoints[ kk * npar ] );
+	int ierr = EXIT_SUCCESS;
+	batch_func( npar, npts, &xpoints[ 0 ], &fvals[ 0 ], ierr, batch_data );
+	if ( EXIT_SUCCESS != ierr )
+	  throw sherpa::OptErr( sherpa::OptErr::UsrFunc );
+	for ( int kk = 0; kk < npts; ++kk )
+	  ( *inside[ kk ] )[ npar ] = fvals[ kk ];
+
+      } else {
+
+	std::vector< int > ierrs( npts, EXIT_SUCCESS );
+	VertexJob job = { this, npar, &inside, &ierrs };
+	sherpa::threads::ThreadPool::instance( ).run( eval_vertices_chunk, &job,
+						      npts, 1, numcores );
+	for ( int kk = 0; kk < npts; ++kk )
+	  if ( EXIT_SUCCESS != ierrs[ kk ] )
+	    throw sherpa::OptErr( sherpa::OptErr::UsrFunc );
+
+      }
+
+      if ( nfev >= maxnfev )
+	throw sherpa::OptErr( sherpa::OptErr::MaxFev );
+
+    }
+
     // 3.
     void expand( int verbose, int maxnfev, const sherpa::Opt::mypair& limits,
 		 int& nfev ) {
@@ -422,10 +561,7 @@ namespace sherpa {
       // respectively. Then evaluate the function at the new position
       //
       const int npar = simplex.npars( );
-      double coef_plus_1 = 1.0 + coef;
-      for ( int ii = 0; ii < npar; ++ii )
-	new_vertex[ ii ] = coef_plus_1 * xbar[ ii ] - 
-	  coef * simplex[ npar ][ ii ];
+      set_vertex( coef, xbar, npar, new_vertex );
 
       sherpa::OptFunc< Func, Data >::eval_func( maxnfev, limits, npar,
 						new_vertex, nfev );
@@ -434,6 +570,22 @@ namespace sherpa {
 
     }                                                            // move_vertex
 
+    //
+    // The position of move_vertex, for the vertex x     of the simplex,
+    //                                               index
+    // without evaluating the function there
+    //
+    void set_vertex( double coef, const std::vector<double>& xbar, int index,
+		     std::vector< double >& new_vertex ) const {
+
+      const int npar = simplex.npars( );
+      double coef_plus_1 = 1.0 + coef;
+      for ( int ii = 0; ii < npar; ++ii )
+	new_vertex[ ii ] = coef_plus_1 * xbar[ ii ] - 
+	  coef * simplex[ index ][ ii ];
+
+    }                                                             // set_vertex
+
     int neldermead( int verbose, int maxnfev, double tolerance,
 		    int initsimplex, const std::vector<int>& finalsimplex,
 		    const sherpa::Opt::mypair& limits,
@@ -554,6 +706,145 @@ namespace sherpa {
 
     }                                                          // neldermead( )
 
+    //
+    // The parallel variant of neldermead.  Each iteration moves the pp
+    // worst vertices x , j = nkeep, ..., npar, against the centroid of
+    //                 j
+    // the nkeep = npar + 1 - pp best ones, each as in steps 2 to 4, with
+    // f  and f  (the best and the worst of the vertices kept) in place
+    //  1      n
+    // of f  and f .  The reflections are evaluated together, and then
+    //     1      n
+    // the expansions and contractions; a contraction that fails leaves
+    // its vertex where it was.  If none of the vertices moved, shrink.
+    //
+    int parallel_neldermead( int verbose, int maxnfev, double tolerance,
+			     int initsimplex,
+			     const std::vector<int>& finalsimplex,
+			     const sherpa::Opt::mypair& limits,
+			     const std::vector<double>& step,
+			     std::vector<double>& par, int& nfev ) {
+
+      const int npar = simplex.npars( );
+      const int pp = std::max( 1, std::min( nparallel, ( npar + 1 ) / 2 ) );
+      const int nkeep = npar + 1 - pp;
+
+      int num_shrink = 0;
+      int err_status=EXIT_SUCCESS;
+      double tol_sqr = tolerance * tolerance;
+
+      std::vector< std::vector< double > >
+	reflections( pp, std::vector< double >( npar + 1 ) ),
+	moves( pp, std::vector< double >( npar + 1 ) );
+      std::vector< std::vector< double >* > points;
+
+      simplex.init_simplex( initsimplex, par, step );
+      eval_init_simplex( maxnfev, limits, nfev );
+
+      for ( ; ; ) {
+
+	// 1. Order the npar + 1 vertices
+	simplex.sort( );
+	par[ npar ] = simplex[ 0 ][ npar ];
+
+	if ( simplex.check_convergence( tolerance, tol_sqr,
+					finalsimplex[0] ) )
+	  break;
+
+	if ( num_shrink >= 256 )
+	  break;
+
+	if ( verbose ) {
+	  std::cout << "fmin = " << par[ npar ] << '\n';
+	  if ( verbose > 2 )
+	    simplex.print_simplex( );
+	}
+
+	calculate_centroid( nkeep );
+	const double fbest = simplex[ 0 ][ npar ];
+	const double fkeep = simplex[ nkeep - 1 ][ npar ];
+
+	// 2. Reflect the pp worst vertices.
+	points.clear( );
+	for ( int jj = 0; jj < pp; ++jj ) {
+	  set_vertex( reflection_coef, centroid, nkeep + jj, reflections[ jj ] );
+	  points.push_back( &reflections[ jj ] );
+	}
+	eval_vertices( maxnfev, limits, npar, points, nfev );
+
+	// 3. Expand, or 4. contract outside or inside.
+	points.clear( );
+	for ( int jj = 0; jj < pp; ++jj ) {
+	  const double fr = reflections[ jj ][ npar ];
+	  const int vertex = nkeep + jj;
+	  if ( fr < fbest )
+	    set_vertex( rho_chi, centroid, vertex, moves[ jj ] );
+	  else if ( fr < fkeep )
+	    continue;
+	  else if ( fr < simplex[ vertex ][ npar ] )
+	    set_vertex( rho_gamma, centroid, vertex, moves[ jj ] );
+	  else
+	    set_vertex( - contraction_coef, centroid, vertex, moves[ jj ] );
+	  points.push_back( &moves[ jj ] );
+	}
+	eval_vertices( maxnfev, limits, npar, points, nfev );
+
+	bool moved = false;
+	for ( int jj = 0; jj < pp; ++jj ) {
+	  const double fr = reflections[ jj ][ npar ];
+	  const double fm = moves[ jj ][ npar ];
+	  const int vertex = nkeep + jj;
+	  const std::vector< double >* accept = NULL;
+	  if ( fr < fbest )
+	    accept = fm < fr ? &moves[ jj ] : &reflections[ jj ];
+	  else if ( fr < fkeep )
+	    accept = &reflections[ jj ];
+	  else if ( fr < simplex[ vertex ][ npar ] ) {
+	    if ( fm <= fr )
+	      accept = &moves[ jj ];
+	  } else if ( fm < simplex[ vertex ][ npar ] )
+	    accept = &moves[ jj ];
+	  if ( NULL != accept ) {
+	    simplex.copy_row( *accept, vertex );
+	    moved = true;
+	  }
+	}
+
+	if ( moved )
+	  continue;
+
+	// 5. Shrink towards the best vertex.
+	++num_shrink;
+	if ( verbose > 1 )
+	  std::cout << "\tShrink\n";
+	points.clear( );
+	for ( int ii = 1; ii <= npar; ++ii ) {
+	  for ( int jj = 0; jj < npar; ++jj )
+	    simplex[ ii ][ jj ] = shrink_coef * simplex[ ii ][ jj ] +
+	      ( 1.0 - shrink_coef ) * simplex[ 0 ][ jj ];
+	  points.push_back( &simplex[ ii ] );
+	}
+	eval_vertices( maxnfev, limits, npar, points, nfev );
+
+      }
+
+      for ( int ii = 0; ii <= npar; ++ii )
+	par[ ii ] = simplex[ 0 ][ ii ];
+
+      const std::vector<int>::const_iterator current = finalsimplex.begin() + 1;
+      const std::vector<int>::const_iterator the_end = finalsimplex.end();
+
+      if ( current != the_end ) {
+	std::vector< int > myfinalsimplex( current, the_end );
+	err_status = parallel_neldermead( verbose, maxnfev, tolerance,
+					  initsimplex, myfinalsimplex, limits,
+					  step, par, nfev );
+      }
+
+      return err_status;
+
+    }                                                 // parallel_neldermead( )
+
     // 1.
     void reflect( int verbose, int maxnfev, const sherpa::Opt::mypair& limits, int& nfev ) {
 
@@ -22,6 +22,7 @@
 
 
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <vector>
@@ -36,7 +37,8 @@ namespace sherpa {
 
   public:
 
-    enum Err { Success, Input, OutOfBound, MaxFev, UsrFunc, Unknown };
+    enum Err { Success, Input, OutOfBound, MaxFev, UsrFunc, Unknown,
+	       Cancelled };
 
     OptErr( OptErr::Err e ) : err( e ) { }
 
@@ -52,7 +54,8 @@ namespace sherpa {
 	"Parameter is out of bound",
 	"Max number of function evaluation",
 	"User Function error",
-	"Unknown error"
+	"Unknown error",
+	"Cancelled"
       };
 
       os << msg[ err ];
@@ -114,6 +117,81 @@ namespace sherpa {
 
   };                                                               // class Opt
 
+  //
+  // A bounded cache of function values keyed on the exact bits of the
+  // parameter values, for the optimizers that come back to points they
+  // have already been to.  It is direct mapped: a new entry replaces
+  // whatever was in its slot.  By default a hit is not counted as a
+  // function evaluation, but a run still stops once its hits alone reach
+  // maxnfev, so that a simplex that keeps cycling through cached points
+  // cannot go on for ever.
+  //
+  class EvalCache {
+
+  public:
+
+    EvalCache( ) : count_hits( false ), hits( 0 ), misses( 0 ) { }
+
+    // A size of zero turns the cache off
+    void configure( int size, bool count=false ) {
+      table.assign( size > 0 ? size : 0, Entry( ) );
+      count_hits = count;
+      hits = misses = 0;
+    }
+
+    bool enabled( ) const { return !table.empty( ); }
+    bool counts_hits( ) const { return count_hits; }
+    long get_hits( ) const { return hits; }
+    long get_misses( ) const { return misses; }
+
+    bool lookup( int npar, const double* par, double& fval ) {
+      const Entry& entry = table[ slot( npar, par ) ];
+      if ( entry.used && static_cast< int >( entry.par.size( ) ) == npar &&
+	   0 == std::memcmp( &entry.par[ 0 ], par, npar * sizeof( double ) ) ) {
+	fval = entry.fval;
+	++hits;
+	return true;
+      }
+      ++misses;
+      return false;
+    }
+
+    void insert( int npar, const double* par, double fval ) {
+      Entry& entry = table[ slot( npar, par ) ];
+      entry.used = true;
+      entry.par.assign( par, par + npar );
+      entry.fval = fval;
+    }
+
+  private:
+
+    struct Entry {
+      Entry( ) : used( false ), fval( 0.0 ) { }
+      bool used;
+      std::vector< double > par;
+      double fval;
+    };
+
+    std::vector< Entry > table;
+    bool count_hits;
+    long hits;
+    long misses;
+
+    // FNV-1a over the bytes of the parameter values
+    std::size_t slot( int npar, const double* par ) const {
+      const unsigned char* bytes =
+	reinterpret_cast< const unsigned char* >( par );
+      const std::size_t nbytes = npar * sizeof( double );
+      unsigned long hash = 2166136261UL;
+      for ( std::size_t ii = 0; ii < nbytes; ++ii ) {
+	hash ^= bytes[ ii ];
+	hash *= 16777619UL;
+      }
+      return hash % table.size( );
+    }
+
+  };                                                         // class EvalCache
+
   template< typename Func, typename Data >
   class OptFunc : public Opt {
 
@@ -133,12 +211,21 @@ namespace sherpa {
 	return par[ npar ];
       }
 
+      if ( cache.enabled( ) && cache.lookup( npar, &par[0], par[npar] ) ) {
+	if ( cache.counts_hits( ) ? ++nfev >= maxnfev :
+	     cache.get_hits( ) >= maxnfev )
+	  throw sherpa::OptErr( sherpa::OptErr::MaxFev );
+	return par[ npar ];
+      }
+
       ++nfev;
       
       int ierr = EXIT_SUCCESS;
       usr_func( npar, &par[0], par[npar], ierr, usr_data );
       if ( EXIT_SUCCESS != ierr )
 	throw sherpa::OptErr( sherpa::OptErr::UsrFunc );
+      if ( cache.enabled( ) )
+	cache.insert( npar, &par[0], par[npar] );
       if ( nfev >= maxnfev )
 	throw sherpa::OptErr( sherpa::OptErr::MaxFev );
 
@@ -149,6 +236,17 @@ namespace sherpa {
 
     }                                                         // eval_user_func
 
+    //
+    // The function value at par, without counting it in nfev or
+    // checking the limits, so that several points can be evaluated at
+    // once from different threads
+    //
+    double eval_point( int npar, double* par, int& ierr ) {
+      double fval = std::numeric_limits< double >::max( );
+      usr_func( npar, par, fval, ierr, usr_data );
+      return fval;
+    }
+
     int minimize( int maxnfev, const sherpa::Opt::mypair& limits,
 		  double tol, int npar, sherpa::Opt::myvec& par, double& fmin,
 		  int& nfev ) {
@@ -157,6 +255,17 @@ namespace sherpa {
       return ierr;
     }
 
+    //
+    // Keep the last function values (up to size of them) and return the
+    // cached value when eval_func is called at the same point again;
+    // with count_hits those calls still count in nfev
+    //
+    void set_cache( int size, bool count_hits=false ) {
+      cache.configure( size, count_hits );
+    }
+
+    const EvalCache& get_cache( ) const { return cache; }
+
   protected:
 
     Func get_func( ) { return usr_func; }
@@ -167,6 +276,7 @@ namespace sherpa {
     Func usr_func;
     Data usr_data;
     const int mfcts;
+    EvalCache cache;
 
     OptFunc& operator = (OptFunc const&); // declare but, purposely, not define
     OptFunc( OptFunc const& );            // declare but, purposely, not define
@@ -205,6 +315,28 @@ void justdoit( Init init, Func fct, int npar, std::vector<double>& par ) {
 
   }
 
+  //
+  // The same point over and over again, as a cycling simplex would ask
+  // for it: the hits are not counted in nfev but still stop the run
+  //
+  sherpa::OptFunc< Func, void* > cached( fct, NULL );
+  cached.set_cache( 8 );
+  nfev = 0;
+
+  try {
+
+    for ( int ii = 0; ii < 2 * maxnfev + 1; ++ii )
+      fmin = cached.eval_func( maxnfev, limits, npar, par, nfev );
+
+  } catch( sherpa::OptErr& oe ) {
+
+    std::cerr << oe << '\n';
+    std::cerr << "nfev = " << nfev << ", cache hits = "
+	      << cached.get_cache( ).get_hits( ) << ", cache misses = "
+	      << cached.get_cache( ).get_misses( ) << '\n';
+
+  }
+
 }
 
 int main( int argc, char* argv[] ) {
@@ -25,9 +25,15 @@
 #include <sherpa/functor.hh>
 
 #include "DifEvo.hh"
+#include "MultiStart.hh"
 #include "NelderMead.hh"
 
 #include "minpack/LevMar.hh"
+//
+// The Python function behind lmdif and the local optimizer of difevo_lm:
+// a negative ierr, with the Python error set, stops the optimizer (lmdif
+// only stops on a negative iflag)
+//
 static void lmdif_callback_func( int mfct, int npar, double* xpars,
 				 double* fvec, int& ierr, PyObject* py_fcn ) {
 
@@ -36,13 +42,13 @@ static void lmdif_callback_func( int mfct, int npar, double* xpars,
 
   dims[0] = npar;
   if ( EXIT_SUCCESS != pars_array.create( 1, dims, xpars ) ) {
-    ierr = EXIT_FAILURE;
+    ierr = -1;
     return;
   }
 
   PyObject* rv = PyObject_CallFunction( py_fcn, "N", pars_array.new_ref() );
   if ( NULL == rv ) {
-    ierr = EXIT_FAILURE;
+    ierr = -1;
     return;
   }
 
@@ -50,14 +56,14 @@ static void lmdif_callback_func( int mfct, int npar, double* xpars,
   int stat = vals_array.from_obj( rv );
   Py_DECREF( rv );
   if ( EXIT_SUCCESS != stat ) {
-    ierr = EXIT_FAILURE;
+    ierr = -1;
     return;
   }
 
   if ( vals_array.get_size() != mfct ) {
     PyErr_SetString( PyExc_TypeError,
 		     "callback function returned wrong number of values" );
-    ierr = EXIT_FAILURE;
+    ierr = -1;
     return;
   }
 
@@ -67,6 +73,107 @@ static void lmdif_callback_func( int mfct, int npar, double* xpars,
 
 }
 
+//
+// Batched form of lmdif_callback_func: py_batch is handed the npts points
+// as an npts x npar matrix and must return the npts x mfct matrix of
+// function values (anything with that many values, in row order, will
+// do).  A negative ierr stops lmdif with the Python error set.
+//
+static void lmdif_batch_callback_func( int mfct, int npar, int npts,
+				       double* xpars, double* fvecs,
+				       int& ierr, PyObject* py_batch ) {
+
+  npy_intp dims[2];
+
+  dims[0] = npts;
+  dims[1] = npar;
+  PyObject* pars_array = PyArray_SimpleNewFromData( 2, dims, NPY_DOUBLE,
+						     xpars );
+  if ( NULL == pars_array ) {
+    ierr = -1;
+    return;
+  }
+
+  PyObject* rv = PyObject_CallFunction( py_batch, (char*)"N", pars_array );
+  if ( NULL == rv ) {
+    ierr = -1;
+    return;
+  }
+
+  PyObject* vals_array = PyArray_FROMANY( rv, NPY_DOUBLE, 0, 2,
+					  NPY_CARRAY );
+  Py_DECREF( rv );
+  if ( NULL == vals_array ) {
+    ierr = -1;
+    return;
+  }
+
+  if ( PyArray_SIZE( vals_array ) != npts * mfct ) {
+    Py_DECREF( vals_array );
+    PyErr_SetString( PyExc_TypeError,
+		     "batch callback function returned wrong number of "
+		     "values" );
+    ierr = -1;
+    return;
+  }
+
+  const double* vals = static_cast< double* >( PyArray_DATA( vals_array ) );
+  std::copy( vals, vals + npts * mfct, fvecs );
+  Py_DECREF( vals_array );
+
+  return;
+
+}
+
+//
+// Batched callback for the synchronous mode of difevo, and for the rounds
+// of the multi-start and the steps of the parallel neldermead: py_batch is
+// handed the npts trial vectors of a generation (or round, or step) as an
+// npts x npar matrix and must return their npts function values
+//
+static void difevo_batch_callback_func( int npar, int npts, double* xpars,
+					double* fvals, int& ierr,
+					PyObject* py_batch ) {
+
+  npy_intp dims[2];
+
+  dims[0] = npts;
+  dims[1] = npar;
+  PyObject* pars_array = PyArray_SimpleNewFromData( 2, dims, NPY_DOUBLE,
+						     xpars );
+  if ( NULL == pars_array ) {
+    ierr = EXIT_FAILURE;
+    return;
+  }
+
+  PyObject* rv = PyObject_CallFunction( py_batch, (char*)"N", pars_array );
+  if ( NULL == rv ) {
+    ierr = EXIT_FAILURE;
+    return;
+  }
+
+  DoubleArray vals_array;
+  int stat = vals_array.from_obj( rv );
+  Py_DECREF( rv );
+  if ( EXIT_SUCCESS != stat ) {
+    ierr = EXIT_FAILURE;
+    return;
+  }
+
+  if ( vals_array.get_size() != npts ) {
+    PyErr_SetString( PyExc_TypeError,
+		     "batch callback function returned wrong number of "
+		     "values" );
+    ierr = EXIT_FAILURE;
+    return;
+  }
+
+  std::copy( &vals_array[0], &vals_array[0] + npts, fvals );
+
+  return;
+
+}
+
 //*****************************************************************************
 //
 // py_cpp_lmdif:  Python wrapper function for C++ function lmdif
@@ -76,18 +183,20 @@ template< typename Func >
 static PyObject* py_cpp_lmdif( PyObject* self, PyObject* args, Func func ) {
 
   PyObject* py_function=NULL;
+  PyObject* py_batch=NULL;
   DoubleArray par, lb, ub;
   int mfct, maxnfev, nfev, info, verbose;
   double fval, ftol, xtol, gtol, epsfcn, factor;
 
-  if ( !PyArg_ParseTuple( args, (char*) "OiO&dddiddiO&O&",
+  if ( !PyArg_ParseTuple( args, (char*) "OiO&dddiddiO&O&|O",
 			  &py_function,
 			  &mfct,
 			  CONVERTME(DoubleArray), &par,
 			  &ftol, &xtol, &gtol, &maxnfev,
 			  &epsfcn, &factor, &verbose,
 			  CONVERTME(DoubleArray), &lb,
-			  CONVERTME(DoubleArray), &ub ) ) {
+			  CONVERTME(DoubleArray), &ub,
+			  &py_batch ) ) {
     return NULL;
   }
 
@@ -110,6 +219,11 @@ static PyObject* py_cpp_lmdif( PyObject* self, PyObject* args, Func func ) {
   try {
 
     minpack::LevMar< Func, PyObject* > levmar( func, py_function, mfct );
+    // The Python callback cannot be run from the thread pool; any
+    // parallelism is left to py_batch, which gets all of the points
+    // for the jacobian in a single call
+    if ( NULL != py_batch && Py_None != py_batch )
+      levmar.set_batch_func( lmdif_batch_callback_func, py_batch );
     std::vector<double> mylb( &lb[0], &lb[0] + npar );
     std::vector<double> myub( &ub[0], &ub[0] + npar );
     std::vector<double> mypar( &par[0], &par[0] + npar );
@@ -171,11 +285,12 @@ static PyObject* py_difevo_levmar( PyObject* self, PyObject* args,
 				   Func callback_func ) {
 
   PyObject* py_function=NULL;
+  PyObject* py_batch=NULL;
   DoubleArray par, step, lb, ub;
   int verbose, maxnfev, seed, population_size, mfcts, nfev, ierr;
   double fval, tol, xprob, weighting_factor;
 
-  if ( !PyArg_ParseTuple( args, (char*) "iiiidddO&O&O&Oi",
+  if ( !PyArg_ParseTuple( args, (char*) "iiiidddO&O&O&Oi|O",
 			  &verbose,
 			  &maxnfev,
 			  &seed,
@@ -186,7 +301,7 @@ static PyObject* py_difevo_levmar( PyObject* self, PyObject* args,
 			  CONVERTME(DoubleArray), &lb,
 			  CONVERTME(DoubleArray), &ub,
 			  CONVERTME(DoubleArray), &par,
-			  &py_function, &mfcts ) ) {
+			  &py_function, &mfcts, &py_batch ) ) {
     return NULL;
   }
 
@@ -208,6 +323,8 @@ static PyObject* py_difevo_levmar( PyObject* self, PyObject* args,
 
     sherpa::DifEvo< Func, PyObject*, minpack::LevMar< Func, PyObject* > >
       difevo( callback_func, py_function, mfcts );
+    if ( NULL != py_batch && Py_None != py_batch )
+      difevo.set_batch_func( difevo_batch_callback_func, py_batch );
     std::vector<double> mylb( &lb[0], &lb[0] + npar );
     std::vector<double> myub( &ub[0], &ub[0] + npar );
     std::vector<double> mypar( &par[0], &par[0] + npar );
@@ -304,11 +421,12 @@ static PyObject* py_difevo_neldermead( PyObject* self, PyObject* args,
 				       Func func ) {
 
   PyObject* py_function=NULL;
+  PyObject* py_batch=NULL;
   DoubleArray par, step, lb, ub;
   int verbose, maxnfev, seed, population_size, nfev, ierr;
   double fval, tol, xprob, weighting_factor;
 
-  if ( !PyArg_ParseTuple( args, (char*) "iiiidddO&O&O&O",
+  if ( !PyArg_ParseTuple( args, (char*) "iiiidddO&O&O&O|O",
 			  &verbose,
 			  &maxnfev,
 			  &seed,
@@ -319,7 +437,7 @@ static PyObject* py_difevo_neldermead( PyObject* self, PyObject* args,
 			  CONVERTME(DoubleArray), &lb,
 			  CONVERTME(DoubleArray), &ub,
 			  CONVERTME(DoubleArray), &par,
-			  &py_function ) ) {
+			  &py_function, &py_batch ) ) {
     return NULL;
   }
 
@@ -342,6 +460,8 @@ static PyObject* py_difevo_neldermead( PyObject* self, PyObject* args,
 
     sherpa::DifEvo< Func, PyObject*, sherpa::NelderMead< Func, PyObject* > >
       difevo( func, py_function );
+    if ( NULL != py_batch && Py_None != py_batch )
+      difevo.set_batch_func( difevo_batch_callback_func, py_batch );
     std::vector<double> mylb( &lb[0], &lb[0] + npar );
     std::vector<double> myub( &ub[0], &ub[0] + npar );
     std::vector<double> mypar( &par[0], &par[0] + npar );
@@ -401,11 +521,12 @@ template< typename Func >
 static PyObject* py_difevo( PyObject* self, PyObject* args, Func func ) {
 
   PyObject* py_function=NULL;
+  PyObject* py_batch=NULL;
   DoubleArray par, step, lb, ub;
   int verbose, maxnfev, seed, population_size, nfev, ierr;
   double fval, tol, xprob, weighting_factor;
 
-  if ( !PyArg_ParseTuple( args, (char*) "iiiidddO&O&O&O",
+  if ( !PyArg_ParseTuple( args, (char*) "iiiidddO&O&O&O|O",
 			  &verbose,
 			  &maxnfev,
 			  &seed,
@@ -416,7 +537,7 @@ static PyObject* py_difevo( PyObject* self, PyObject* args, Func func ) {
 			  CONVERTME(DoubleArray), &lb,
 			  CONVERTME(DoubleArray), &ub,
 			  CONVERTME(DoubleArray), &par,
-			  &py_function ) ) {
+			  &py_function, &py_batch ) ) {
     return NULL;
   }
 
@@ -438,6 +559,8 @@ static PyObject* py_difevo( PyObject* self, PyObject* args, Func func ) {
 
     sherpa::DifEvo< Func, PyObject*, sherpa::OptFunc< Func, PyObject* > >
       difevo( func, py_function );
+    if ( NULL != py_batch && Py_None != py_batch )
+      difevo.set_batch_func( difevo_batch_callback_func, py_batch );
     std::vector<double> mylb( &lb[0], &lb[0] + npar );
     std::vector<double> myub( &ub[0], &ub[0] + npar );
     std::vector<double> mypar( &par[0], &par[0] + npar );
@@ -498,12 +621,15 @@ static PyObject* py_neldermead( PyObject* self, PyObject* args,
 				Func callback_func ) {
 
   PyObject* py_function=NULL;
+  PyObject* py_batch=NULL;
   DoubleArray par, step, lb, ub;
   IntArray finalsimplex;
-  int verbose, maxnfev, nfev, initsimplex, ierr;
+  int verbose, maxnfev, nfev, initsimplex, ierr, cachesize=0, counthits=0,
+    nparallel=1;
+  long cachehits=0, cachemisses=0;
   double fval, tol;
 
-  if ( !PyArg_ParseTuple( args, (char*) "iiiO&dO&O&O&O&O",
+  if ( !PyArg_ParseTuple( args, (char*) "iiiO&dO&O&O&O&O|iiiO",
 			  &verbose,
 			  &maxnfev,
 			  &initsimplex,
@@ -513,7 +639,8 @@ static PyObject* py_neldermead( PyObject* self, PyObject* args,
 			  CONVERTME(DoubleArray), &lb,
 			  CONVERTME(DoubleArray), &ub,
 			  CONVERTME(DoubleArray), &par,
-			  &py_function ) ) {
+			  &py_function, &cachesize, &counthits, &nparallel,
+			  &py_batch ) ) {
     return NULL;
   }
 
@@ -540,6 +667,12 @@ static PyObject* py_neldermead( PyObject* self, PyObject* args,
   try {
 
     sherpa::NelderMead< Func, PyObject* > nm( callback_func, py_function );
+    nm.set_cache( cachesize, 0 != counthits );
+    // The parallel variant evaluates its points one after the other
+    // unless there is a batch function, which may spread them out
+    nm.set_parallel( nparallel );
+    if ( NULL != py_batch && Py_None != py_batch )
+      nm.set_batch_func( difevo_batch_callback_func, py_batch );
     std::vector<int> myfinalsimplex( &finalsimplex[0], &finalsimplex[0] + 
 				     finalsimplex.get_size( ) );
     std::vector<double> mystep( &step[0], &step[0] + step.get_size( ) );
@@ -548,6 +681,8 @@ static PyObject* py_neldermead( PyObject* self, PyObject* args,
     std::vector<double> mypar( &par[0], &par[0] + npar );
     ierr = nm( verbose, maxnfev, tol, npar, initsimplex, myfinalsimplex, mylb,
 	       myub, mystep, mypar, nfev, fval );
+    cachehits = nm.get_cache( ).get_hits( );
+    cachemisses = nm.get_cache( ).get_misses( );
     for ( int ii = 0; ii < npar; ++ii )
       par[ ii ] = mypar[ ii ];
 
@@ -574,8 +709,8 @@ static PyObject* py_neldermead( PyObject* self, PyObject* args,
     return NULL;
   }
 
-  return Py_BuildValue( (char*)"(Ndii)", par.return_new_ref(), fval, nfev,
-			ierr );
+  return Py_BuildValue( (char*)"(Ndiill)", par.return_new_ref(), fval, nfev,
+			ierr, cachehits, cachemisses );
 
 }
 static PyObject* py_nm( PyObject* self, PyObject* args ) {
@@ -586,6 +721,131 @@ static PyObject* py_nm( PyObject* self, PyObject* args ) {
   //
   return py_neldermead( self, args, sherpa::fct_ptr( sao_callback_func ) );
 
+}
+
+//*****************************************************************************
+//
+// py_nm_multistart: Python wrapper function for the multi-start neldermead
+//
+//*****************************************************************************
+template< typename Func >
+static PyObject* py_neldermead_multistart( PyObject* self, PyObject* args,
+					   Func callback_func ) {
+
+  PyObject* py_function=NULL;
+  PyObject* py_batch=NULL;
+  DoubleArray par, step, lb, ub;
+  IntArray finalsimplex;
+  int verbose, maxnfev, nfev, initsimplex, ierr, numstarts, numcores, seed;
+  int cachesize=0, counthits=0;
+  long cachehits=0, cachemisses=0;
+  double fval, tol, dominance=1.0;
+  PyObject* py_starts=NULL;
+
+  if ( !PyArg_ParseTuple( args, (char*) "iiiO&dO&O&O&O&OiiiO|iid",
+			  &verbose,
+			  &maxnfev,
+			  &initsimplex,
+			  CONVERTME(IntArray), &finalsimplex,
+			  &tol,
+			  CONVERTME(DoubleArray), &step,
+			  CONVERTME(DoubleArray), &lb,
+			  CONVERTME(DoubleArray), &ub,
+			  CONVERTME(DoubleArray), &par,
+			  &py_function, &numstarts, &numcores, &seed,
+			  &py_batch, &cachesize, &counthits, &dominance ) ) {
+    return NULL;
+  }
+
+  const int npar = par.get_size( );
+
+  if ( npar != step.get_size( ) ) {
+    PyErr_Format( PyExc_ValueError, (char*)"len(step)=%d != len(par)=%d",
+		  static_cast<int>( step.get_size( ) ), npar );
+    return NULL;
+  }
+
+  if ( npar != lb.get_size( ) ) {
+    PyErr_Format( PyExc_ValueError, (char*)"len(lb)=%d != len(par)=%d",
+		  static_cast<int>( lb.get_size( ) ), npar);
+    return NULL;
+  }
+    
+  if ( npar != ub.get_size( ) ) {
+    PyErr_Format( PyExc_ValueError, (char*)"len(ub)=%d != len(par)=%d",
+		  static_cast<int>( ub.get_size( ) ), npar );
+    return NULL;
+  }
+
+  try {
+
+    sherpa::MultiStart< Func, PyObject* > ms( callback_func, py_function );
+    // Python is only called from this thread: without a batch function
+    // the rounds are evaluated one point after the other
+    if ( Py_None != py_batch ) {
+      ms.set_batch_func( difevo_batch_callback_func, py_batch );
+      ms.set_numcores( numcores );
+    }
+    ms.set_cache( cachesize, 0 != counthits );
+    ms.set_dominance( dominance );
+    std::vector<int> myfinalsimplex( &finalsimplex[0], &finalsimplex[0] + 
+				     finalsimplex.get_size( ) );
+    std::vector<double> mystep( &step[0], &step[0] + step.get_size( ) );
+    std::vector<double> mylb( &lb[0], &lb[0] + npar );
+    std::vector<double> myub( &ub[0], &ub[0] + npar );
+    std::vector<double> mypar( &par[0], &par[0] + npar );
+    ierr = ms( verbose, maxnfev, tol, npar, numstarts, seed, initsimplex,
+	       myfinalsimplex, mylb, myub, mystep, mypar, nfev, fval );
+    for ( int ii = 0; ii < npar; ++ii )
+      par[ ii ] = mypar[ ii ];
+
+    if ( sherpa::OptErr::UsrFunc == ierr && NULL != PyErr_Occurred() )
+      return NULL;
+
+    typedef typename sherpa::MultiStart< Func, PyObject* >::Start Start;
+    const std::vector< Start >& starts = ms.get_starts( );
+    py_starts = PyList_New( starts.size( ) );
+    if ( NULL == py_starts )
+      return NULL;
+    for ( size_t kk = 0; kk < starts.size( ); ++kk ) {
+      cachehits += starts[ kk ].cache_hits;
+      cachemisses += starts[ kk ].cache_misses;
+      PyObject* item = Py_BuildValue( (char*)"(diiN)",
+				      starts[ kk ].par[ npar ],
+				      starts[ kk ].nfev, starts[ kk ].ierr,
+				      PyBool_FromLong( starts[ kk ].cancelled ) );
+      if ( NULL == item ) {
+	Py_DECREF( py_starts );
+	return NULL;
+      }
+      PyList_SET_ITEM( py_starts, kk, item );
+    }
+
+  } catch( sherpa::OptErr& oe ) {
+    if ( NULL == PyErr_Occurred() )
+      PyErr_SetString( PyExc_RuntimeError,
+		       (char*) "The parameters are out of bounds\n" );
+    return NULL;
+
+  } catch( std::runtime_error& re ) {
+    if ( NULL == PyErr_Occurred() )
+      PyErr_SetString( PyExc_RuntimeError, (char*) re.what() );
+    return NULL;
+  } catch ( ... ) {
+    if ( NULL == PyErr_Occurred() )
+      PyErr_SetString( PyExc_RuntimeError, (char*)"Unknown exception caught" );
+    return NULL;
+  }
+
+  return Py_BuildValue( (char*)"(NdiillN)", par.return_new_ref(), fval, nfev,
+			ierr, cachehits, cachemisses, py_starts );
+
+}
+static PyObject* py_nm_multistart( PyObject* self, PyObject* args ) {
+
+  return py_neldermead_multistart( self, args,
+				   sherpa::fct_ptr( sao_callback_func ) );
+
 }
 //*****************************************************************************
 //
@@ -608,6 +868,7 @@ static PyMethodDef WrapperFcts[] = {
   FCTSPEC(lm_difevo, py_difevo_lm),
   FCTSPEC(cpp_lmdif, py_lmdif),
   FCTSPEC(neldermead, py_nm),
+  FCTSPEC(nm_multistart, py_nm_multistart),
   { NULL, NULL, 0, NULL }
 
 };
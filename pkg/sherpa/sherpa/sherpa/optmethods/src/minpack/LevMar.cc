@@ -54,6 +54,23 @@ void tstlm( Init init, FctVec fct, int npar, std::vector<double>& par,
     print_pars( "lmdif_", fct_name, nfev, fmin, answer, npar, par,
 		&covarerr[0] );
 
+    //
+    // The jacobian columns worked out by several threads are formed
+    // exactly as in the serial loop, so the fit must not change
+    //
+    std::vector<double> mypar( npar ), mylo( npar ), myhi( npar );
+    init( npar, mfcts, answer, &mypar[0], &mylo[0], &myhi[0] );
+    minpack::LevMar< FctVec, void* > lm_mt( fct, NULL, mfcts );
+    lm_mt.set_numcores( 4 );
+    int mynfev;
+    double myfmin=0.0;
+    lm_mt( npar, tol, tol, tol, maxnfev, epsfcn, factor, nprint, mylo, myhi,
+	   mypar, mynfev, myfmin, covarerr );
+    if ( mynfev != nfev || myfmin != fmin ||
+	 !std::equal( mypar.begin( ), mypar.end( ), par.begin( ) ) )
+      print_pars( "lmdif_numcores_differs_", fct_name, mynfev, myfmin,
+		  answer, npar, mypar );
+
   } catch( const sherpa::OptErr& oe ) {
     
     std::cerr << oe << '\n';
@@ -63,6 +63,7 @@
 */
 
 #include <cmath>
+#include <sherpa/threads.hh>
 #include "../Opt.hh"
 namespace minpack {
 
@@ -81,8 +82,32 @@ namespace minpack {
     
   public:
 
+    // Evaluates the npts points stored one after the other in points,
+    // writing the m function values of each point to fvecs in turn
+    typedef void (*BatchFunc)( int m, int n, int npts, double* points,
+			       double* fvecs, int& iflag, Data xdata );
+
     LevMar( Func func, Data xdata, int mfct )
-      : sherpa::Opt( ), usr_func( func ), usr_data( xdata ), myfvec( mfct ) { }
+      : sherpa::Opt( ), usr_func( func ), usr_data( xdata ), myfvec( mfct ),
+	numcores( 1 ), batch_func( NULL ), batch_data( Data( ) ) { }
+
+    //
+    // With numcores > 1 the n columns of the forward-difference jacobian
+    // are evaluated concurrently, calling usr_func from up to numcores
+    // threads; it must then be thread safe.
+    //
+    void set_numcores( int num ) {
+      numcores = num;
+    }
+
+    //
+    // Hand all of the perturbed points for the jacobian to func in one
+    // call instead, e.g. when each call of usr_func has a high fixed cost
+    //
+    void set_batch_func( BatchFunc func, Data xdata ) {
+      batch_func = func;
+      batch_data = xdata;
+    }
 
     int operator( )( int n, double ftol, double xtol,
 		     double gtol, int maxfev, double epsfcn,
@@ -171,6 +196,20 @@ namespace minpack {
 
     }
 
+    //
+    // As eval_func, but with a vector of residuals of its own and without
+    // counting nfev or checking the limits, so that several points can
+    // be evaluated at once from different threads
+    //
+    double eval_point( int npar, double* par, int& ierr ) {
+
+      std::vector< double > fvec( myfvec.size( ) );
+      usr_func( static_cast<int>( fvec.size( ) ), npar, par, &fvec[0], ierr,
+		usr_data );
+      return pow( enorm( fvec.size( ), &fvec[0] ), 2.0 );
+
+    }
+
 
     // de
     int minimize( int maxnfev, const sherpa::Opt::mypair& limits,
@@ -538,6 +577,95 @@ namespace minpack {
     Func usr_func;
     Data usr_data;
     std::vector< double > myfvec;
+    int numcores;
+    BatchFunc batch_func;
+    Data batch_data;
+
+    struct PointsJob {
+      Func fcn;
+      int m;
+      int n;
+      double* points;
+      double* fvecs;
+      int* iflags;
+      Data xptr;
+    };
+
+    static int eval_points_chunk( void* data, std::ptrdiff_t begin,
+				  std::ptrdiff_t end ) {
+      PointsJob* job = static_cast< PointsJob* >( data );
+      for ( std::ptrdiff_t kk = begin; kk < end; ++kk )
+	job->fcn( job->m, job->n, job->points + kk * job->n,
+		  job->fvecs + kk * job->m, job->iflags[ kk ], job->xptr );
+      return EXIT_SUCCESS;
+    }
+
+    //
+    // Evaluate fcn at the npts points, each one with its own iflag; the
+    // most negative iflag is returned so that any failure stops lmdif
+    //
+    int eval_points( Func fcn, int m, int n, int npts, double* points,
+		     double* fvecs, Data xptr ) {
+
+      int iflag = 0;
+
+      if ( NULL != batch_func ) {
+	batch_func( m, n, npts, points, fvecs, iflag, batch_data );
+	return iflag;
+      }
+
+      std::vector< int > iflags( npts, 0 );
+      PointsJob job = { fcn, m, n, points, fvecs, &iflags[ 0 ], xptr };
+      sherpa::threads::ThreadPool::instance( ).run( eval_points_chunk, &job,
+						    npts, 1, numcores );
+      for ( int kk = 0; kk < npts; ++kk )
+	iflag = std::min( iflag, iflags[ kk ] );
+
+      return iflag;
+
+    }
+
+    //
+    // fdjac2 with the perturbed points worked out up front, using the
+    // same steps (including the backward difference at the upper
+    // boundary), and then evaluated together by eval_points.  The
+    // columns are formed exactly as in the serial loop.
+    //
+    int fdjac2_points( Func fcn, int m, int n, const double *x,
+		       const double *fvec, double *fjac, int ldfjac,
+		       double epsfcn, Data xptr,
+		       const std::vector<double>& high ) {
+
+      const double epsmch = std::numeric_limits< double >::epsilon( );
+      const double eps = sqrt( std::max( epsfcn, epsmch ) );
+
+      std::vector< double > steps( n ), points( n * n ), fvecs( m * n );
+      for ( int jj = 0; jj < n; ++jj ) {
+	double h = eps * fabs( x[ jj ] );
+	if ( 0.0 == h )
+	  h = eps;
+	if ( x[ jj ] + h > high[ jj ] )
+	  h = - h;
+	steps[ jj ] = h;
+	double* point = &points[ jj * n ];
+	std::copy( x, x + n, point );
+	point[ jj ] = x[ jj ] + h;
+      }
+
+      int iflag = eval_points( fcn, m, n, n, &points[ 0 ], &fvecs[ 0 ],
+			       xptr );
+      if ( iflag < 0 )
+	return iflag;
+
+      for ( int jj = 0; jj < n; ++jj ) {
+	const double* wa = &fvecs[ jj * m ];
+	for ( int ii = 0; ii < m; ++ii )
+	  fjac[ ii + jj * ldfjac ] = ( wa[ ii ] - fvec[ ii ] ) / steps[ jj ];
+      }
+
+      return iflag;
+
+    }
 
     //
     // c     **********
@@ -632,6 +760,10 @@ namespace minpack {
     int iflag=0;
     // dtn
 
+    if ( NULL != batch_func || ( numcores > 1 && n > 1 ) )
+      return fdjac2_points( fcn, m, n, x, fvec, fjac, ldfjac, epsfcn, xptr,
+			    high );
+
     // Parameter adjustments
     --wa;
     --fvec;
@@ -1285,10 +1417,11 @@ namespace minpack {
       //     termination, either normal or user imposed.
 
       if (iflag < 0) {
+	// the function failed, and may have left an error to report, so
+	// it is not called again to print the final iterate
 	info = iflag;
-      }
-      iflag = 0;
-      if (nprint > 0) {
+      } else if (nprint > 0) {
+	iflag = 0;
 	fcn(m, n, &x[1], &fvec[1], iflag, xptr);
       }
       return info;
@@ -17,6 +17,7 @@
 #  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 #
 
+import os
 from math import sqrt
 from sherpa.utils import SherpaTestCase
 from sherpa.optmethods import optfcts
@@ -298,6 +299,233 @@ class test_optmethods(SherpaTestCase):
         x0, xmin, xmax, fmin = _tstoptfct.init( name, npar )
         self.tst_all( name, _tstoptfct.chebyquad, fmin, x0, xmin, xmax )
 
+    def test_lmdif_numcores(self):
+        name = 'rosenbrock'
+        npar = 4
+        x0, xmin, xmax, fmin = _tstoptfct.init( name, npar )
+        serial = optfcts.lmdif( _tstoptfct.rosenbrock, x0, xmin, xmax )
+        parallel = optfcts.lmdif( _tstoptfct.rosenbrock, x0, xmin, xmax,
+                                  numcores=2 )
+        self.assertEqualWithinTol( parallel[2], fmin, self.tolerance )
+        for serial_par, parallel_par in zip( serial[1], parallel[1] ):
+            self.assertEqualWithinTol( serial_par, parallel_par,
+                                       self.tolerance )
+
+    def test_lmdif_numcores_error(self):
+        # An exception from the function stops lmdif at once and is
+        # raised; only the calls made by this process are counted, the
+        # jacobian being worked out by others
+        name = 'rosenbrock'
+        npar = 4
+        x0, xmin, xmax, fmin = _tstoptfct.init( name, npar )
+        class CallbackError( Exception ):
+            pass
+        pid = os.getpid()
+        ncalls = [ 0 ]
+        def fct( pars ):
+            if os.getpid() == pid:
+                ncalls[ 0 ] += 1
+                if ncalls[ 0 ] > 3:
+                    raise CallbackError( 'no more calls' )
+            return _tstoptfct.rosenbrock( pars )
+        self.assertRaises( CallbackError, optfcts.lmdif, fct, x0, xmin,
+                           xmax, numcores=2 )
+        self.assertEqual( ncalls[ 0 ], 4 )
+
+    def test_lmdif_batch(self):
+        name = 'rosenbrock'
+        npar = 4
+        x0, xmin, xmax, fmin = _tstoptfct.init( name, npar )
+        npoints = []
+        def fct( pars ):
+            return _tstoptfct.rosenbrock( pars )
+        def batch( points ):
+            npoints.append( len( points ) )
+            vals = [ _tstoptfct.rosenbrock( pars ) for pars in points ]
+            return ( [ val[0] for val in vals ], [ val[1] for val in vals ] )
+        fct.batch = batch
+        serial = optfcts.lmdif( _tstoptfct.rosenbrock, x0, xmin, xmax )
+        batched = optfcts.lmdif( fct, x0, xmin, xmax, batch=True )
+        self.assert_( len( npoints ) > 0 )
+        self.assert_( min( npoints ) == npar )
+        self.assertEqualWithinTol( batched[2], fmin, self.tolerance )
+        for serial_par, batched_par in zip( serial[1], batched[1] ):
+            self.assertEqualWithinTol( serial_par, batched_par,
+                                       self.tolerance )
+
+        # With numcores > 1 the batch function is preferred to worker
+        # processes, so that the jacobian is worked out in this process
+        del npoints[:]
+        parallel = optfcts.lmdif( fct, x0, xmin, xmax, numcores=2 )
+        self.assert_( len( npoints ) > 0 )
+        self.assertEqual( parallel[1].tolist(), batched[1].tolist() )
+
+    def test_lmdif_batch_error(self):
+        # With batch, an exception from either the batch function or the
+        # function itself stops lmdif at once and is raised
+        name = 'rosenbrock'
+        npar = 4
+        x0, xmin, xmax, fmin = _tstoptfct.init( name, npar )
+        class CallbackError( Exception ):
+            pass
+        for failing in ( 'batch', 'fct' ):
+            ncalls = { 'batch' : 0, 'fct' : 0 }
+            def fct( pars ):
+                ncalls[ 'fct' ] += 1
+                if failing == 'fct' and ncalls[ 'fct' ] > 3:
+                    raise CallbackError( 'no more calls' )
+                return _tstoptfct.rosenbrock( pars )
+            def batch( points ):
+                ncalls[ 'batch' ] += 1
+                if failing == 'batch' and ncalls[ 'batch' ] > 1:
+                    raise CallbackError( 'no more calls' )
+                vals = [ _tstoptfct.rosenbrock( pars ) for pars in points ]
+                return ( [ val[0] for val in vals ],
+                         [ val[1] for val in vals ] )
+            fct.batch = batch
+            for verbose in ( 0, 1 ):
+                ncalls.update( batch=0, fct=0 )
+                self.assertRaises( CallbackError, optfcts.lmdif, fct, x0,
+                                   xmin, xmax, batch=True, verbose=verbose )
+                if failing == 'batch':
+                    self.assertEqual( ncalls[ 'batch' ], 2 )
+                else:
+                    self.assertEqual( ncalls[ 'fct' ], 4 )
+
+    def test_difevo_nm_synchronous(self):
+        name = 'rosenbrock'
+        npar = 2
+        x0, xmin, xmax, fmin = _tstoptfct.init( name, npar )
+        one = optfcts.difevo_nm( _tstoptfct.rosenbrock, x0, xmin, xmax,
+                                 synchronous=True )
+        two = optfcts.difevo_nm( _tstoptfct.rosenbrock, x0, xmin, xmax,
+                                 synchronous=True, numcores=2 )
+        self.assertEqualWithinTol( one[2], fmin, self.tolerance )
+        self.assertEqual( one[2], two[2] )
+        self.assertEqual( one[4]['nfev'], two[4]['nfev'] )
+        self.assertEqual( list( one[1] ), list( two[1] ) )
+
+    def test_difevo_synchronous_maxfev(self):
+        # The generation that uses up maxfev is kept: the result is the
+        # best point the function was evaluated at
+        name = 'rosenbrock'
+        npar = 2
+        x0, xmin, xmax, fmin = _tstoptfct.init( name, npar )
+        xmin = [ -2.0 ] * npar
+        xmax = [ 2.0 ] * npar
+        vals = []
+        def fct( pars ):
+            vals.append( _tstoptfct.rosenbrock( pars )[ 0 ] )
+            return vals[ -1 ]
+        for maxfev in ( 50, 87, 124, 272 ):
+            del vals[ : ]
+            result = optfcts.difevo( fct, x0, xmin, xmax, maxfev=maxfev,
+                                     synchronous=True )
+            self.assertEqual( result[ 4 ][ 'info' ], 3 )
+            self.assertEqual( result[ 2 ], min( vals ) )
+
+    def test_neldermead_cache(self):
+        name = 'rosenbrock'
+        npar = 2
+        x0, xmin, xmax, fmin = _tstoptfct.init( name, npar )
+        one = optfcts.neldermead( _tstoptfct.rosenbrock, x0, xmin, xmax )
+        two = optfcts.neldermead( _tstoptfct.rosenbrock, x0, xmin, xmax,
+                                  cache=64 )
+        self.assertEqual( one[2], two[2] )
+        self.assertEqual( list( one[1] ), list( two[1] ) )
+        self.assertTrue( 'cache_hits' in two[4] )
+        self.assertTrue( 'cache_misses' in two[4] )
+        self.assertTrue( two[4]['cache_hits'] > 0 )
+        self.assertEqual( one[4]['nfev'],
+                          two[4]['nfev'] + two[4]['cache_hits'] )
+        # with count_hits the repeats are counted in nfev again
+        three = optfcts.neldermead( _tstoptfct.rosenbrock, x0, xmin, xmax,
+                                    cache=64, count_hits=True )
+        self.assertEqual( one[2], three[2] )
+        self.assertEqual( list( one[1] ), list( three[1] ) )
+        self.assertEqual( one[4]['nfev'], three[4]['nfev'] )
+        self.assertEqual( two[4]['cache_hits'], three[4]['cache_hits'] )
+        self.assertEqual( two[4]['cache_misses'], three[4]['cache_misses'] )
+
+    def test_neldermead_multistart(self):
+        name = 'rosenbrock'
+        npar = 2
+        x0, xmin, xmax, fmin = _tstoptfct.init( name, npar )
+        one = optfcts.neldermead( _tstoptfct.rosenbrock, x0, xmin, xmax,
+                                  numstarts=4 )
+        two = optfcts.neldermead( _tstoptfct.rosenbrock, x0, xmin, xmax,
+                                  numstarts=4, numcores=2 )
+        self.assertEqualWithinTol( one[2], fmin, self.tolerance )
+        self.assertTrue( one[0] )
+        self.assertTrue( two[0] )
+        self.assertTrue( one[4]['nfev'] <= 1024 * npar )
+        self.assertEqual( one[2], two[2] )
+        self.assertEqual( list( one[1] ), list( two[1] ) )
+        self.assertEqual( len( one[4]['starts'] ), 4 )
+        self.assertEqual( one[4]['starts'], two[4]['starts'] )
+        for start in one[4]['starts']:
+            if start['cancelled']:
+                self.assertEqual( start['info'], 6 )
+        # the starts share maxfev
+        maxfev = 300
+        three = optfcts.neldermead( _tstoptfct.rosenbrock, x0, xmin, xmax,
+                                    numstarts=4, maxfev=maxfev )
+        self.assertFalse( three[0] )
+        self.assertTrue( three[4]['nfev'] <= maxfev )
+        self.assertEqual( three[4]['nfev'],
+                          sum( [ start['nfev']
+                                 for start in three[4]['starts'] ] ) )
+        for start in three[4]['starts']:
+            self.assertEqual( start['info'], 3 )
+
+    def test_neldermead_parallel(self):
+        name = 'variably_dimensioned'
+        npar = 6
+        x0, xmin, xmax, fmin = _tstoptfct.init( name, npar )
+        one = optfcts.neldermead( _tstoptfct.variably_dimensioned, x0, xmin,
+                                  xmax, parallel=2 )
+        two = optfcts.neldermead( _tstoptfct.variably_dimensioned, x0, xmin,
+                                  xmax, parallel=2, numcores=2 )
+        self.assertEqualWithinTol( one[2], fmin, self.tolerance )
+        for xx, lo, hi in zip( one[1], xmin, xmax ):
+            self.assertTrue( lo <= xx <= hi )
+        self.assertTrue( one[4]['nfev'] <= 1024 * npar )
+        self.assertEqual( one[2], two[2] )
+        self.assertEqual( list( one[1] ), list( two[1] ) )
+        self.assertEqual( one[4]['nfev'], two[4]['nfev'] )
+        # a step evaluates no more points than are left of maxfev
+        maxfev = 200
+        three = optfcts.neldermead( _tstoptfct.variably_dimensioned, x0,
+                                    xmin, xmax, parallel=3, maxfev=maxfev )
+        self.assertTrue( three[4]['nfev'] <= maxfev )
+        self.assertRaises( TypeError, optfcts.neldermead,
+                           _tstoptfct.variably_dimensioned, x0, xmin, xmax,
+                           parallel=2, numstarts=2 )
+
+    def test_neldermead_parallel_pool(self):
+        # The worker processes are started once for the whole call, not
+        # for every round of evaluations
+        import tempfile
+        name = 'variably_dimensioned'
+        npar = 6
+        x0, xmin, xmax, fmin = _tstoptfct.init( name, npar )
+        fd, pidfile = tempfile.mkstemp()
+        os.close( fd )
+        def fct( pars ):
+            out = open( pidfile, 'a' )
+            print >> out, os.getpid()
+            out.close()
+            return _tstoptfct.variably_dimensioned( pars )
+        try:
+            result = optfcts.neldermead( fct, x0, xmin, xmax, parallel=2,
+                                         numcores=2 )
+            pids = set( open( pidfile ).read().split() )
+        finally:
+            os.remove( pidfile )
+        self.assertEqualWithinTol( result[2], fmin, self.tolerance )
+        pids.discard( str( os.getpid() ) )
+        self.assertTrue( 0 < len( pids ) <= 2 )
+
 def tstme():
     from sherpa.utils import SherpaTest
     import sherpa.optmethods
@@ -17,8 +17,9 @@
 #  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 #
 
+from itertools import izip
 import numpy
-from sherpa.utils import NoNewAttributesAfterInit
+from sherpa.utils import NoNewAttributesAfterInit, SherpaFloat
 from sherpa.utils.err import StatErr
 import sherpa.stats._statfcts
 
@@ -63,6 +64,138 @@ class Stat(NoNewAttributesAfterInit):
                   weight=None):
         raise NotImplementedError
 
+    # The calc_stat that the fast forms of the statistic compute: the
+    # _calc_stat_* static methods and the _prepared forms in _statfcts.
+    # A subclass that overrides calc_stat alone inherits them, but gets
+    # the generic forms below, built on its own calc_stat, instead
+    _fast_calc_stat = None
+
+    def _fast(self):
+        cls = type(self)
+        return (cls._fast_calc_stat is not None and
+                cls.calc_stat == cls._fast_calc_stat)
+
+    # The statistic alone, without the per-bin deviations
+    def calc_stat_scalar(self, data, model, staterror=None, syserror=None,
+                         weight=None):
+        if self._fast():
+            return self._calc_stat_scalar(data, model, staterror, syserror,
+                                          weight)
+        return self.calc_stat(data, model, staterror, syserror, weight)[0]
+
+    def calc_stat_grad(self, data, model, staterror=None, syserror=None,
+                       weight=None):
+        """The statistic and the array of its derivatives with respect
+        to the model value in each bin, for statistics with a closed
+        form derivative"""
+        if self._fast():
+            return self._calc_stat_grad(data, model, staterror, syserror,
+                                        weight)
+        raise NotImplementedError
+
+    def calc_stat_batch(self, data, models, staterror=None, syserror=None,
+                        weight=None, fvec=False):
+        """The statistic for each row of the 2D array models, returned
+        as an array; with fvec true, the tuple of that and the 2D array
+        of the per-bin deviations.  Statistics with a batched form in
+        _statfcts make a single call."""
+        if self._fast():
+            return self._calc_stat_batch(data, models, staterror, syserror,
+                                         weight, fvec)
+        if fvec:
+            results = [self.calc_stat(data, model, staterror, syserror,
+                                      weight) for model in models]
+            return (numpy.array([r[0] for r in results]),
+                    numpy.array([r[1] for r in results]))
+        return numpy.array([self.calc_stat_scalar(data, model, staterror,
+                                                  syserror, weight)
+                            for model in models])
+
+    # The names of the prepared forms of the statistic in _statfcts, if
+    # any: the dense one, and one that keeps only the bins with counts
+    _prepared = None
+    _prepared_sparse = None
+
+    # The sparse form is used for data with at least this fraction of
+    # empty bins
+    sparse_fraction = 0.5
+
+    def prepare(self, data, staterror=None, syserror=None, weight=None,
+                sparse=None):
+        """Return a function of the model values alone that gives the
+        statistic for this data, for the many evaluations of a fit.
+        The data-only terms are worked out once, here.
+
+        For a statistic with a sparse form, sparse selects it (None
+        picks it when enough of the bins are empty), and the function
+        takes the sum of weight * model as an optional second argument
+        for callers that know it without summing the model."""
+        if self._prepared is None or not self._fast():
+            def calc(model, model_sum=None):
+                return self.calc_stat_scalar(data, model, staterror,
+                                             syserror, weight)
+            return calc
+
+        name = self._prepared
+        if self._prepared_sparse is not None:
+            data = numpy.asarray(data)
+            if sparse is None:
+                sparse = (data.size > 0 and (data == 0).sum() >=
+                          self.sparse_fraction * data.size)
+            if sparse:
+                name = self._prepared_sparse
+
+        handle = _statfcts.prepare_stat(name, data, staterror, syserror,
+                                        weight, truncation_value)
+        def calc(model, model_sum=None):
+            return _statfcts.calc_prepared_stat(handle, model, model_sum)
+        calc.handle = handle
+        return calc
+
+    def calc_stat_segments(self, data, models, staterrors=None,
+                           syserrors=None, weights=None):
+        """The statistic over several data sets, given as lists of
+        arrays, without joining them: returns the total and an array of
+        the statistic of each data set.  The systematic error and weight
+        lists may be None, or hold None.  Statistics with a segmented
+        form in _statfcts make a single call, and need the statistical
+        errors of every data set, as calc_stat does; otherwise they may
+        be None if the statistic does not use them."""
+        if self._fast():
+            return self._calc_stat_segments(data, models, staterrors,
+                                            syserrors, weights)
+        nseg = len(data)
+        stats = numpy.array([self.calc_stat_scalar(*args) for args in
+                             izip(data, models,
+                                  staterrors or [None] * nseg,
+                                  syserrors or [None] * nseg,
+                                  weights or [None] * nseg)],
+                            dtype=SherpaFloat)
+        return stats.sum(), stats
+
+    def prepare_segments(self, data, staterrors=None, syserrors=None,
+                         weights=None, sparse=None):
+        """As prepare, for several data sets given as lists of arrays:
+        the function takes the list of model arrays and returns what
+        calc_stat_segments does."""
+        nseg = len(data)
+        calcs = [self.prepare(*args, **{'sparse': sparse}) for args in
+                 izip(data, staterrors or [None] * nseg,
+                      syserrors or [None] * nseg, weights or [None] * nseg)]
+        handles = [getattr(calc, 'handle', None) for calc in calcs]
+
+        if [handle for handle in handles if handle is None]:
+            def calc(models):
+                stats = numpy.array([f(model) for f, model in
+                                     izip(calcs, models)],
+                                    dtype=SherpaFloat)
+                return stats.sum(), stats
+            return calc
+
+        def calc(models):
+            return _statfcts.calc_prepared_stat_segments(handles, models)
+        return calc
+
 class Likelihood(Stat):
     """Maximum likelihood function"""
     def __init__(self, name='likelihood'):
@@ -77,6 +210,9 @@ class Likelihood(Stat):
 
 class Cash(Likelihood):
     """Maximum likelihood function"""
+    _prepared = 'cash'
+    _prepared_sparse = 'sparse_cash'
+
     def __init__(self, name='cash'):
         Likelihood.__init__(self, name)
 
@@ -85,9 +221,41 @@ class Cash(Likelihood):
         return _statfcts.calc_cash_stat(data, model, staterror, syserror,
                                         weight, truncation_value)
 
+    _fast_calc_stat = calc_stat
+
+    @staticmethod
+    def _calc_stat_scalar(data, model, staterror=None, syserror=None,
+                          weight=None):
+        return _statfcts.calc_cash_stat_scalar(data, model, staterror,
+                                               syserror, weight,
+                                               truncation_value)
+
+    @staticmethod
+    def _calc_stat_grad(data, model, staterror=None, syserror=None,
+                        weight=None):
+        return _statfcts.calc_cash_stat_grad(data, model, staterror, syserror,
+                                             weight, truncation_value)
+
+    @staticmethod
+    def _calc_stat_batch(data, models, staterror=None, syserror=None,
+                         weight=None, fvec=False):
+        return _statfcts.calc_cash_stat_batch(data, models, staterror,
+                                              syserror, weight,
+                                              truncation_value, fvec)
+
+    @staticmethod
+    def _calc_stat_segments(data, models, staterrors, syserrors=None,
+                            weights=None):
+        return _statfcts.calc_cash_stat_segments(data, models, staterrors,
+                                                 syserrors, weights,
+                                                 truncation_value)
+
 
 class CStat(Likelihood):
     """Maximum likelihood function (XSPEC style)"""
+    _prepared = 'cstat'
+    _prepared_sparse = 'sparse_cstat'
+
     def __init__(self, name='cstat'):
         Likelihood.__init__(self, name)
 
@@ -96,9 +264,40 @@ class CStat(Likelihood):
         return _statfcts.calc_cstat_stat(data, model, staterror, syserror,
                                          weight, truncation_value)
 
+    _fast_calc_stat = calc_stat
+
+    @staticmethod
+    def _calc_stat_scalar(data, model, staterror=None, syserror=None,
+                          weight=None):
+        return _statfcts.calc_cstat_stat_scalar(data, model, staterror,
+                                                syserror, weight,
+                                                truncation_value)
+
+    @staticmethod
+    def _calc_stat_grad(data, model, staterror=None, syserror=None,
+                        weight=None):
+        return _statfcts.calc_cstat_stat_grad(data, model, staterror, syserror,
+                                              weight, truncation_value)
+
+    @staticmethod
+    def _calc_stat_batch(data, models, staterror=None, syserror=None,
+                         weight=None, fvec=False):
+        return _statfcts.calc_cstat_stat_batch(data, models, staterror,
+                                               syserror, weight,
+                                               truncation_value, fvec)
+
+    @staticmethod
+    def _calc_stat_segments(data, models, staterrors, syserrors=None,
+                            weights=None):
+        return _statfcts.calc_cstat_stat_segments(data, models, staterrors,
+                                                  syserrors, weights,
+                                                  truncation_value)
+
 
 class Chi2(Stat):
     """Chi Squared"""
+    _prepared = 'chi2'
+
     def __init__(self, name='chi2'):
         Stat.__init__(self, name)
 
@@ -111,8 +310,37 @@ class Chi2(Stat):
         return _statfcts.calc_chi2_stat(data, model, staterror,
                                         syserror, weight, truncation_value)
 
+    _fast_calc_stat = calc_stat
+
+    @staticmethod
+    def _calc_stat_scalar(data, model, staterror, syserror=None, weight=None):
+         return _statfcts.calc_chi2_stat_scalar(data, model, staterror,
+                                               syserror, weight,
+                                               truncation_value)
+
+    @staticmethod
+    def _calc_stat_grad(data, model, staterror, syserror=None, weight=None):
+         return _statfcts.calc_chi2_stat_grad(data, model, staterror, syserror,
+                                             weight, truncation_value)
+
+    @staticmethod
+    def _calc_stat_batch(data, models, staterror, syserror=None,
+                         weight=None, fvec=False):
+        return _statfcts.calc_chi2_stat_batch(data, models, staterror,
+                                              syserror, weight,
+                                              truncation_value, fvec)
+
+    @staticmethod
+    def _calc_stat_segments(data, models, staterrors, syserrors=None,
+                            weights=None):
+        return _statfcts.calc_chi2_stat_segments(data, models, staterrors,
+                                                 syserrors, weights,
+                                                 truncation_value)
+
 class LeastSq(Chi2):
     """Least Squared"""
+    _prepared = 'lsq'
+
     def __init__(self, name='leastsq'):
         Stat.__init__(self, name)
 
@@ -124,6 +352,33 @@ class LeastSq(Chi2):
     def calc_stat(data, model, staterror, syserror=None, weight=None):
         return _statfcts.calc_lsq_stat(data, model, staterror,
                                        syserror, weight, truncation_value)
+
+    _fast_calc_stat = calc_stat
+
+    @staticmethod
+    def _calc_stat_scalar(data, model, staterror, syserror=None, weight=None):
+         return _statfcts.calc_lsq_stat_scalar(data, model, staterror,
+                                              syserror, weight,
+                                              truncation_value)
+
+    @staticmethod
+    def _calc_stat_grad(data, model, staterror, syserror=None, weight=None):
+         return _statfcts.calc_lsq_stat_grad(data, model, staterror, syserror,
+                                            weight, truncation_value)
+
+    @staticmethod
+    def _calc_stat_batch(data, models, staterror, syserror=None,
+                         weight=None, fvec=False):
+        return _statfcts.calc_lsq_stat_batch(data, models, staterror,
+                                             syserror, weight,
+                                             truncation_value, fvec)
+
+    @staticmethod
+    def _calc_stat_segments(data, models, staterrors, syserrors=None,
+                            weights=None):
+        return _statfcts.calc_lsq_stat_segments(data, models, staterrors,
+                                                syserrors, weights,
+                                                truncation_value)
     
 
 class Chi2Gehrels(Chi2):
@@ -152,6 +407,8 @@ class Chi2DataVar(Chi2):
 
 class Chi2ModVar(Chi2):
     """Chi Squared with model amplitude variance"""
+    _prepared = 'chi2modvar'
+
     def __init__(self, name='chi2modvar'):
         Chi2.__init__(self, name)
 
@@ -166,6 +423,35 @@ class Chi2ModVar(Chi2):
                                               syserror, weight,
                                               truncation_value)
 
+    _fast_calc_stat = calc_stat
+
+    @staticmethod
+    def _calc_stat_scalar(data, model, staterror, syserror=None, weight=None):
+         return _statfcts.calc_chi2modvar_stat_scalar(data, model, staterror,
+                                                     syserror, weight,
+                                                     truncation_value)
+
+    @staticmethod
+    def _calc_stat_grad(data, model, staterror, syserror=None, weight=None):
+         return _statfcts.calc_chi2modvar_stat_grad(data, model, staterror,
+                                                   syserror, weight,
+                                                   truncation_value)
+
+    @staticmethod
+    def _calc_stat_batch(data, models, staterror, syserror=None,
+                         weight=None, fvec=False):
+        return _statfcts.calc_chi2modvar_stat_batch(data, models, staterror,
+                                                    syserror, weight,
+                                                    truncation_value, fvec)
+
+    @staticmethod
+    def _calc_stat_segments(data, models, staterrors, syserrors=None,
+                            weights=None):
+        return _statfcts.calc_chi2modvar_stat_segments(data, models,
+                                                       staterrors, syserrors,
+                                                       weights,
+                                                       truncation_value)
+
 
 class Chi2XspecVar(Chi2):
     """Chi Squared with data variance (XSPEC style)"""
@@ -20,6 +20,8 @@
 #include "sherpa/stat_extension.hh"
 #include "sherpa/stats.hh"
 
+typedef sherpa::stats::PreparedStat< SherpaFloat > Prep;
+
 
 static PyMethodDef StatFcts[] = {
 
@@ -34,6 +36,15 @@ static PyMethodDef StatFcts[] = {
   STATFCT( calc_chi2modvar_stat ),
   STATFCT( calc_lsq_stat ),
 
+  STATFCT_BATCH( calc_cash_stat, Prep::CASH ),
+  STATFCT_BATCH( calc_cstat_stat, Prep::CSTAT ),
+  STATFCT_BATCH( calc_chi2_stat, Prep::CHI2 ),
+  STATFCT_BATCH( calc_chi2modvar_stat, Prep::CHI2MODVAR ),
+  STATFCT_BATCH( calc_lsq_stat, Prep::LSQ ),
+
+  STATFCT_PREPARED,
+  STATFCT_REDUCTION,
+
   { NULL, NULL, 0, NULL }
 
 };
@@ -0,0 +1,432 @@
+#
+#  Copyright (C) 2013  Smithsonian Astrophysical Observatory
+#
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License along
+#  with this program; if not, write to the Free Software Foundation, Inc.,
+#  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+
+import numpy
+from sherpa.utils import SherpaTestCase
+from sherpa.data import Data1D, DataSimulFit
+from sherpa.stats import Cash, CStat, Chi2, Chi2DataVar, Chi2ModVar, \
+     LeastSq, UserStat, _statfcts
+
+
+class test_stats(SherpaTestCase):
+
+    def setUp(self):
+        rng = numpy.random.RandomState(1234)
+        self.model = rng.uniform(0.5, 20.0, 1000)
+        self.data = rng.poisson(self.model).astype(numpy.float_)
+        self.data[self.data == 0] = 1.0
+        self.staterror = numpy.sqrt(self.data)
+        self.syserror = 0.1 * self.data
+        self.weight = rng.uniform(0.0, 2.0, 1000)
+
+    def test_scalar_stat(self):
+        # The scalar form gives the statistic of the full form exactly
+        for stat in (Cash(), CStat(), Chi2(), Chi2DataVar(), Chi2ModVar(),
+                     LeastSq()):
+            for syserror, weight in ((None, None),
+                                     (self.syserror, self.weight)):
+                args = (self.data, self.model, self.staterror, syserror,
+                        weight)
+                val, fvec = stat.calc_stat(*args)
+                self.assertEqual(stat.calc_stat_scalar(*args), val)
+
+        # and fails on the same input
+        data = self.data.copy()
+        data[10] = -1.0
+        for stat in (Cash(), CStat()):
+            self.assertRaises(ValueError, stat.calc_stat, data, self.model,
+                              self.staterror)
+            self.assertRaises(ValueError, stat.calc_stat_scalar, data,
+                              self.model, self.staterror)
+
+        # Statistics without a scalar form fall back on calc_stat
+        def statfunc(data, model, staterror, syserror, weight):
+            return ((data - model)**2).sum(), data - model
+        stat = UserStat(statfunc)
+        self.assertEqual(stat.calc_stat_scalar(self.data, self.model),
+                         statfunc(self.data, self.model, None, None,
+                                  None)[0])
+
+        # and so do subclasses that override calc_stat alone, for every
+        # form of the statistic, while those that do not keep them
+        class HalfChi2(Chi2):
+            @staticmethod
+            def calc_stat(data, model, staterror, syserror=None,
+                          weight=None):
+                stat, fvec = Chi2.calc_stat(data, model, staterror,
+                                            syserror, weight)
+                return 0.5 * stat, fvec
+        args = (self.data, self.model, self.staterror)
+        half = HalfChi2()
+        val = 0.5 * Chi2().calc_stat_scalar(*args)
+        self.assertEqual(half.calc_stat_scalar(*args), val)
+        self.assertEqual(half.prepare(self.data, self.staterror)(self.model),
+                         val)
+        self.assertEqual(list(half.calc_stat_batch(self.data, [self.model],
+                                                   self.staterror)), [val])
+        self.assertEqual(half.calc_stat_segments([self.data], [self.model],
+                                                 [self.staterror])[0], val)
+        self.assertRaises(NotImplementedError, half.calc_stat_grad, *args)
+        self.assert_(Chi2DataVar()._fast() and not half._fast())
+
+    def test_stat_grad(self):
+        # The derivatives agree with central differences of the statistic
+        data = self.data[:50]
+        model = self.model[:50].copy()
+        model[3] = 0.5
+        args = (self.staterror[:50], self.syserror[:50], self.weight[:50])
+        for stat in (Cash(), CStat(), Chi2(), Chi2DataVar(), Chi2ModVar(),
+                     LeastSq()):
+            val, grad = stat.calc_stat_grad(data, model, *args)
+            self.assertEqual(val, stat.calc_stat_scalar(data, model, *args))
+            self.assertEqual(grad.shape, model.shape)
+            for ii in xrange(len(model)):
+                step = 1e-6 * max(1.0, abs(model[ii]))
+                up = model.copy()
+                up[ii] += step
+                down = model.copy()
+                down[ii] -= step
+                diff = (stat.calc_stat_scalar(data, up, *args) -
+                        stat.calc_stat_scalar(data, down, *args)) / (2 * step)
+                self.assert_(abs(grad[ii] - diff) <=
+                             1e-5 * max(1.0, abs(diff)))
+
+        # Statistics without a closed form say so
+        stat = UserStat(lambda *args: (0.0, None))
+        self.assertRaises(NotImplementedError, stat.calc_stat_grad, data,
+                          model)
+
+    def test_prepared_stat(self):
+        # The prepared statistic agrees with the scalar form, to rounding
+        # in the terms worked out ahead of time
+        for stat in (Cash(), CStat(), Chi2(), Chi2DataVar(), Chi2ModVar(),
+                     LeastSq()):
+            for syserror, weight in ((None, None),
+                                     (self.syserror, self.weight)):
+                calc = stat.prepare(self.data, self.staterror, syserror,
+                                    weight)
+                val = stat.calc_stat_scalar(self.data, self.model,
+                                            self.staterror, syserror, weight)
+                self.assertEqualWithinTol(calc(self.model), val, 1e-12)
+                self.assertEqualWithinTol(calc(2.0 * self.model),
+                                          stat.calc_stat_scalar(
+                                              self.data, 2.0 * self.model,
+                                              self.staterror, syserror,
+                                              weight), 1e-12)
+
+        # Bad data are caught when the statistic is prepared
+        data = self.data.copy()
+        data[10] = -1.0
+        for stat in (Cash(), CStat()):
+            self.assertRaises(ValueError, stat.prepare, data,
+                              self.staterror)
+
+        # Only handles from prepare_stat are accepted, not other C objects
+        from sherpa.models import _modelfcts
+        kernel = _modelfcts.expr_kernels().values()[0]
+        for handle in (kernel, 'cash'):
+            self.assertRaises(TypeError, _statfcts.calc_prepared_stat,
+                              handle, self.model)
+            self.assertRaises(TypeError,
+                              _statfcts.calc_prepared_stat_segments,
+                              [handle], [self.model])
+
+        # Statistics without a prepared form use the scalar one
+        def statfunc(data, model, staterror, syserror, weight):
+            return ((data - model)**2).sum(), data - model
+        stat = UserStat(statfunc)
+        self.assertEqual(stat.prepare(self.data)(self.model),
+                         statfunc(self.data, self.model, None, None,
+                                  None)[0])
+
+    def test_sparse_stat(self):
+        # Mostly empty data, as in an image
+        rng = numpy.random.RandomState(5678)
+        model = rng.uniform(0.001, 0.1, 10000)
+        data = numpy.where(rng.uniform(size=10000) < 0.05,
+                           rng.poisson(3.0, 10000), 0).astype(numpy.float_)
+
+        for stat in (Cash(), CStat()):
+            for weight in (None, self.weight[:1] * numpy.ones(10000)):
+                val = stat.calc_stat_scalar(data, model, None, None, weight)
+                dense = stat.prepare(data, None, None, weight, sparse=False)
+                sparse = stat.prepare(data, None, None, weight, sparse=True)
+                self.assertEqualWithinTol(dense(model), val, 1e-12)
+                self.assertEqualWithinTol(sparse(model), val, 1e-12)
+
+                # picked by the fraction of empty bins
+                self.assertEqualWithinTol(
+                    stat.prepare(data, None, None, weight)(model), val,
+                    1e-12)
+
+                # a model sum from the caller replaces the sum over bins
+                if weight is None:
+                    total = model.sum()
+                else:
+                    total = (weight * model).sum()
+                self.assertEqualWithinTol(sparse(model, total), val, 1e-12)
+                self.assertEqualWithinTol(sparse(model, total + 1.0),
+                                          val + 2.0, 1e-12)
+
+            data[3] = -1.0
+            self.assertRaises(ValueError, stat.prepare, data, sparse=True)
+            data[3] = 0.0
+
+    def test_batch_stat(self):
+        # One call for a population of models gives the statistics of
+        # the models one at a time
+        models = numpy.array([self.model * scale
+                              for scale in (0.5, 0.9, 1.0, 1.1, 2.0)])
+        oldreduction = _statfcts.get_reduction()
+        try:
+            for nthreads in (1, 4):
+                _statfcts.set_reduction(oldreduction[0], nthreads)
+                for stat in (Cash(), CStat(), Chi2(), Chi2DataVar(),
+                             Chi2ModVar(), LeastSq()):
+                    args = (self.staterror, self.syserror, self.weight)
+                    rows = [stat.calc_stat(self.data, model, *args)
+                            for model in models]
+
+                    vals = stat.calc_stat_batch(self.data, models, *args)
+                    self.assertEqual(vals.shape, (5,))
+                    for val, row in zip(vals, rows):
+                        self.assertEqualWithinTol(val, row[0], 1e-12)
+
+                    vals, fvecs = stat.calc_stat_batch(self.data, models,
+                                                       *args, fvec=True)
+                    self.assertEqual(fvecs.shape, models.shape)
+                    for val, fvec, row in zip(vals, fvecs, rows):
+                        self.assertEqual(val, row[0])
+                        self.assertEqual(list(fvec), list(row[1]))
+        finally:
+            _statfcts.set_reduction(*oldreduction)
+
+        # The model matrix must match the data
+        self.assertRaises(TypeError, Chi2().calc_stat_batch, self.data,
+                          models[:, :-1], self.staterror)
+        self.assertRaises(TypeError, Chi2().calc_stat_batch, self.data,
+                          self.model, self.staterror)
+
+        # Statistics without a batched form evaluate the rows in turn
+        def statfunc(data, model, staterror, syserror, weight):
+            return ((data - model)**2).sum(), data - model
+        stat = UserStat(statfunc)
+        vals = stat.calc_stat_batch(self.data, models)
+        for val, model in zip(vals, models):
+            self.assertEqual(val, statfunc(self.data, model, None, None,
+                                           None)[0])
+
+    def test_segmented_stat(self):
+        # Three data sets of different sizes give the statistic of the
+        # joined arrays, and the statistic of each on its own
+        bounds = [(0, 100), (100, 350), (350, 1000)]
+        data, models, staterrors, syserrors, weights = [
+            [arr[lo:hi] for lo, hi in bounds]
+            for arr in (self.data, self.model, self.staterror,
+                        self.syserror, self.weight)]
+        syserrors[1] = None
+
+        joined = numpy.concatenate([syserrors[0], numpy.zeros(250),
+                                    syserrors[2]])
+        for stat in (Cash(), CStat(), Chi2(), Chi2DataVar(), Chi2ModVar(),
+                     LeastSq()):
+            total, stats = stat.calc_stat_segments(data, models, staterrors,
+                                                   syserrors, weights)
+            self.assertEqual(len(stats), 3)
+            self.assertEqualWithinTol(
+                total, stat.calc_stat(self.data, self.model, self.staterror,
+                                      joined, self.weight)[0], 1e-12)
+            for val, args in zip(stats, zip(data, models, staterrors,
+                                            syserrors, weights)):
+                self.assertEqualWithinTol(val, stat.calc_stat(*args)[0],
+                                          1e-12)
+
+            calc = stat.prepare_segments(data, staterrors, syserrors,
+                                         weights)
+            ptotal, pstats = calc(models)
+            self.assertEqualWithinTol(ptotal, total, 1e-12)
+            for pval, val in zip(pstats, stats):
+                self.assertEqualWithinTol(pval, val, 1e-12)
+
+        self.assertRaises(TypeError, Chi2().calc_stat_segments, data,
+                          models[:2], staterrors)
+        self.assertRaises(TypeError, Chi2().calc_stat_segments, data,
+                          [models[1], models[0], models[2]], staterrors)
+        self.assertRaises(TypeError, Chi2().calc_stat_segments, data,
+                          models, None)
+
+        # The lists come from a simultaneous data set
+        simul = DataSimulFit('simul', [Data1D('d%d' % ii, numpy.arange(len(y)),
+                                              y, err)
+                                       for ii, (y, err) in
+                                       enumerate(zip(data, staterrors))])
+        deps, errs, syserrs = simul.to_fit_segments()
+        self.assertEqual(syserrs, None)
+        for dep, y, err, staterror in zip(deps, data, errs, staterrors):
+            self.assertEqual(list(dep), list(y))
+            self.assertEqual(list(err), list(staterror))
+
+    def test_float32_evaluation(self):
+        # Single precision is off by default: float32 input is evaluated,
+        # and returned, in double precision
+        data = self.data.astype(numpy.float32)
+        model = self.model.astype(numpy.float32)
+        staterror = self.staterror.astype(numpy.float32)
+        self.assertEqual(_statfcts.get_single_precision(), False)
+        self.assert_(Chi2().calc_stat(data, model, staterror)[1].dtype.type
+                     is numpy.float_)
+        self.assert_(Chi2DataVar().calc_staterror(data).dtype.type
+                     is numpy.float_)
+
+        # Switched on, every array is read as float32, whatever its type,
+        # and the terms are still summed in double precision
+        try:
+            _statfcts.set_single_precision(True)
+            self.assertEqual(_statfcts.get_single_precision(), True)
+            for stat in (Cash(), CStat(), Chi2(), Chi2ModVar(), LeastSq()):
+                single, fvec = stat.calc_stat(self.data, self.model,
+                                              self.staterror)
+                self.assert_(fvec.dtype.type is numpy.float32)
+                self.assertEqual(stat.calc_stat_scalar(self.data, self.model,
+                                                       self.staterror),
+                                 single)
+                _statfcts.set_single_precision(False)
+                double = stat.calc_stat(data.astype(numpy.float_),
+                                        model.astype(numpy.float_),
+                                        staterror.astype(numpy.float_))[0]
+                _statfcts.set_single_precision(True)
+                self.assertEqualWithinTol(single, double, 1e-5)
+
+            # including the errors worked out from the data alone
+            errors = Chi2DataVar().calc_staterror(self.data)
+            self.assert_(errors.dtype.type is numpy.float32)
+            self.assert_(abs(errors - numpy.sqrt(data)).max() <
+                         1e-6 * numpy.sqrt(data).max())
+        finally:
+            _statfcts.set_single_precision(False)
+
+    def test_prepared_fit(self):
+        # A fit by an optimizer that takes the statistic alone, which is
+        # prepared ahead of time, ends where the same fit with the full
+        # statistic does, with one data set or several and with Primini's
+        # method changing the errors between fits
+        from sherpa.fit import Fit
+        from sherpa.models import SimulFitModel
+        from sherpa.models.basic import Gauss1D
+        from sherpa.optmethods import NelderMead
+
+        rng = numpy.random.RandomState(2468)
+        x = numpy.linspace(-5.0, 5.0, 101)
+        sets = []
+        for ii, (fwhm, pos, ampl) in enumerate(((2.0, 0.5, 50.0),
+                                                (3.0, -1.0, 80.0))):
+            truth = Gauss1D()
+            truth.fwhm, truth.pos, truth.ampl = fwhm, pos, ampl
+            y = rng.poisson(truth(x)).astype(numpy.float_) + 1.0
+            sets.append((x, y, numpy.sqrt(y)))
+
+        def fit(nsets, needs_fvec, itermethod_opts):
+            data = [Data1D('d%d' % ii, x, y, staterror)
+                    for ii, (x, y, staterror) in enumerate(sets[:nsets])]
+            models = []
+            for ii in range(nsets):
+                model = Gauss1D('g%d' % ii)
+                model.fwhm, model.pos, model.ampl = 1.0, 0.0, 40.0
+                models.append(model)
+            if nsets > 1:
+                data = DataSimulFit('simul', data)
+                models = SimulFitModel('simul', models)
+            else:
+                data, models = data[0], models[0]
+            method = NelderMead()
+            method.needs_fvec = needs_fvec
+            result = Fit(data, models, Chi2DataVar(), method,
+                         itermethod_opts=itermethod_opts).fit()
+            self.assert_(result.succeeded)
+            return result
+
+        primini = {'name': 'primini', 'tol': 1.0e-3, 'maxiters': 10}
+        for nsets in (1, 2):
+            parvals = []
+            for opts in ({'name': 'none'}, primini):
+                prepared = fit(nsets, False, opts)
+                full = fit(nsets, True, opts)
+                self.assertEqualWithinTol(prepared.statval, full.statval,
+                                          1e-6)
+                for pval, fval in zip(prepared.parvals, full.parvals):
+                    self.assertEqualWithinTol(pval, fval, 1e-5)
+                parvals.append(numpy.array(prepared.parvals))
+
+            # the errors from the model move the best fit
+            self.assert_(abs(parvals[1] - parvals[0]).max() > 1e-3)
+
+    def test_reproducible_sums(self):
+        # With reproducible sums the statistic does not depend on the
+        # number of threads that sum it
+        rng = numpy.random.RandomState(4321)
+        model = rng.uniform(0.5, 20.0, 100001)
+        data = rng.poisson(model).astype(numpy.float_)
+        staterror = numpy.sqrt(data + 1.0)
+        oldreduction = _statfcts.get_reduction()
+        try:
+            for stat in (Cash(), CStat(), Chi2(), Chi2ModVar(), LeastSq()):
+                vals = []
+                for nthreads in (1, 2, 3, 8):
+                    _statfcts.set_reduction(True, nthreads)
+                    self.assertEqual(_statfcts.get_reduction(),
+                                     (True, nthreads))
+                    calc = stat.prepare(data, staterror)
+                    vals.append((stat.calc_stat(data, model, staterror)[0],
+                                 stat.calc_stat_scalar(data, model,
+                                                       staterror),
+                                 calc(model)))
+                for val in vals[1:]:
+                    self.assertEqual(val, vals[0])
+                self.assertEqual(vals[0][0], vals[0][1])
+                self.assertEqualWithinTol(vals[0][0], vals[0][2], 1e-12)
+
+                # and agrees with the serial sum to rounding
+                _statfcts.set_reduction(False)
+                self.assertEqualWithinTol(
+                    stat.calc_stat(data, model, staterror)[0], vals[0][0],
+                    1e-12)
+
+            self.assertRaises(ValueError, _statfcts.set_reduction, True, 0)
+        finally:
+            _statfcts.set_reduction(*oldreduction)
+
+    def test_reduction_threads(self):
+        # The statistics have their own thread count, which neither
+        # changes nor follows the threading of the model functions
+        from sherpa.models import _modelfcts
+        oldreduction = _statfcts.get_reduction()
+        oldthreads = _modelfcts.get_threads()
+        try:
+            _statfcts.set_reduction(True, oldthreads[0] + 2)
+            self.assertEqual(_modelfcts.get_threads(), oldthreads)
+            _modelfcts.set_threads(oldthreads[0] + 5)
+            self.assertEqual(_statfcts.get_reduction(),
+                             (True, oldthreads[0] + 2))
+            _statfcts.set_reduction(False)
+            self.assertEqual(_statfcts.get_reduction(),
+                             (False, oldthreads[0] + 2))
+            self.assertEqual(_modelfcts.get_threads()[0], oldthreads[0] + 5)
+        finally:
+            _modelfcts.set_threads(*oldthreads)
+            _statfcts.set_reduction(*oldreduction)
@@ -89,7 +89,8 @@ __all__ = ('NoNewAttributesAfterInit', 'SherpaTest', 'SherpaTestCase',
            'lgam', 'linear_interp', 'nearest_interp',
            'needs_data', 'neville', 'neville2d',
            'new_muller', 'normalize', 'numpy_convolve',
-           'pad_bounding_box', 'parallel_map', 'param_apply_limits',
+           'pad_bounding_box', 'parallel_map', 'ParallelPool',
+           'param_apply_limits',
            'parse_expr', 'poisson_noise', 'print_fields', 'rebin',
            'sao_arange', 'sao_fcmp', 'set_origin', 'sum_intervals', 'zeroin',
            'multinormal_pdf', 'multit_pdf', 'get_error_estimates', 'quantile',
@@ -1355,6 +1356,65 @@ def parallel_map(function, sequence, numcores=None):
     return run_tasks(procs, err_q, out_q, numcores)
 
 
+# The function of the ParallelPool a worker process belongs to; it is
+# set when the worker is forked, so it need not be picklable
+_pool_function = None
+
+def _pool_init(function):
+    global _pool_function
+    _pool_function = function
+
+def _pool_worker(arg):
+    return _pool_function(arg)
+
+
+class ParallelPool(object):
+    """
+    parallel_map for repeated calls with the same function, e.g. from
+    each iteration of an optimizer: the worker processes are started on
+    the first call that needs them and kept until close(), rather than
+    started for every call.  As with parallel_map, side effects of
+    function in the workers are lost.
+
+    :param function: callable function that accepts argument from iterable
+    :param numcores: number of cores to use
+    """
+
+    def __init__(self, function, numcores=None):
+        if not callable(function):
+            raise TypeError("input function '%s' is not callable" %
+                            repr(function))
+        if numcores is None:
+            numcores = _ncpus
+        self.function = function
+        self.numcores = numcores
+        self._pool = None
+
+    def __call__(self, sequence):
+        if not numpy.iterable(sequence):
+            raise TypeError("input '%s' is not iterable" %
+                            repr(sequence))
+
+        if not _multi or len(sequence) < 2 or self.numcores < 2:
+            return map(self.function, sequence)
+
+        if self._pool is None:
+            self._pool = multiprocessing.Pool(self.numcores, _pool_init,
+                                              (self.function,))
+        try:
+            return self._pool.map(_pool_worker, sequence)
+        except:
+            # Do not leave the workers busy on the rest of the sequence
+            self.close()
+            raise
+
+    def close(self):
+        if self._pool is not None:
+            self._pool.terminate()
+            self._pool.join()
+            self._pool = None
+
+
 
 ################################# Neville2d ###################################
 def neville2d( xinterp, yinterp, x, y, fval ):
@@ -184,6 +184,11 @@ int sao_integration_qng (int (*f)(double *x, int len, void *params),
 			 double epsabs, double epsrel,
 			 double * result, double * abserr, size_t * neval);
 
+int sao_integration_qng_batch (int (*f)(double *x, int len, void *params),
+                               size_t n, const double *a, const double *b,
+                               void *params, double epsabs, double epsrel,
+                               double *result, double *abserr, int *status);
+
 int gsl_integration_qag (const gsl_function * f,
                          double a, double b,
                          double epsabs, double epsrel, size_t limit,
@@ -398,3 +398,264 @@ sao_integration_qng (int (*f)(double *x, int len, void *params),
 
   GSL_ERROR("failed to reach tolerance with highest-order rule", GSL_ETOL) ;
 }
+
+
+/* sao_integration_qng applied to the n intervals [a[i], b[i]] at once.
+   Each rule evaluates the nodes of every interval that has not yet
+   converged in a single call to f, so f is called at most three times
+   whatever n is.  The result, error estimate and status (GSL_SUCCESS,
+   GSL_ETOL or GSL_EBADTOL) of each interval are the ones
+   sao_integration_qng gives for it.  Returns -1 if f fails, GSL_ENOMEM
+   if the workspace cannot be allocated and GSL_SUCCESS otherwise. */
+
+static int
+qng_converged (double err, double result, double epsabs, double epsrel)
+{
+  return (err < epsabs || err < epsrel * fabs (result));
+}
+
+int
+sao_integration_qng_batch (int (*f)(double *x, int len, void *params),
+                           size_t n, const double *a, const double *b,
+                           void *params, double epsabs, double epsrel,
+                           double *result, double *abserr, int *status)
+{
+  double *vals;     /* nodes of the pending intervals, then f at the nodes */
+  double *savfun;   /* 21 saved sums per interval, as in the single version */
+  double *f_center, *resabs, *resasc, *prev;
+  size_t *pending;  /* the intervals still to be refined */
+  size_t npending, nnext, i, j;
+  int k, retval = GSL_SUCCESS;
+
+  if (epsabs <= 0 && (epsrel < 50 * GSL_DBL_EPSILON || epsrel < 0.5e-28))
+    {
+      for (i = 0; i < n; i++)
+        {
+          result[i] = 0;
+          abserr[i] = 0;
+          status[i] = GSL_EBADTOL;
+        }
+      return GSL_SUCCESS;
+    }
+
+  if (0 == n)
+    return GSL_SUCCESS;
+
+  vals = (double *) malloc (44 * n * sizeof (double));
+  savfun = (double *) malloc (21 * n * sizeof (double));
+  f_center = (double *) malloc (4 * n * sizeof (double));
+  pending = (size_t *) malloc (n * sizeof (size_t));
+
+  if (NULL == vals || NULL == savfun || NULL == f_center || NULL == pending)
+    {
+      retval = GSL_ENOMEM;
+      goto done;
+    }
+
+  resabs = f_center + n;
+  resasc = resabs + n;
+  prev = resasc + n;
+
+  /* The 10- and 21-point formulae for every interval. */
+
+  for (i = 0; i < n; i++)
+    {
+      const double half_length = 0.5 * (b[i] - a[i]);
+      const double center = 0.5 * (b[i] + a[i]);
+      double *x = vals + 21 * i;
+
+      x[0] = center;
+      for (k = 0; k < 5; k++)
+        {
+          double abscissa = half_length * x1[k];
+          x[2*k+1] = center + abscissa;
+          x[2*k+2] = center - abscissa;
+
+          abscissa = half_length * x2[k];
+          x[2*k+11] = center + abscissa;
+          x[2*k+12] = center - abscissa;
+        }
+    }
+
+  if (EXIT_SUCCESS != f (vals, (int) (21 * n), params))
+    {
+      retval = -1;
+      goto done;
+    }
+
+  npending = 0;
+  for (i = 0; i < n; i++)
+    {
+      const double *fv = vals + 21 * i;
+      double *sav = savfun + 21 * i;
+      const double half_length = 0.5 * (b[i] - a[i]);
+      const double abs_half_length = fabs (half_length);
+      double res10 = 0;
+      double res21 = w21b[5] * fv[0];
+      double rabs = w21b[5] * fabs (fv[0]);
+      double rasc, mean;
+
+      for (k = 0; k < 5; k++)
+        {
+          const double fval = fv[2*k+1] + fv[2*k+2];
+          res10 += w10[k] * fval;
+          res21 += w21a[k] * fval;
+          rabs += w21a[k] * (fabs (fv[2*k+1]) + fabs (fv[2*k+2]));
+          sav[k] = fval;
+        }
+
+      for (k = 0; k < 5; k++)
+        {
+          const double fval = fv[2*k+11] + fv[2*k+12];
+          res21 += w21b[k] * fval;
+          rabs += w21b[k] * (fabs (fv[2*k+11]) + fabs (fv[2*k+12]));
+          sav[k + 5] = fval;
+        }
+
+      rabs *= abs_half_length;
+
+      mean = 0.5 * res21;
+      rasc = w21b[5] * fabs (fv[0] - mean);
+      for (k = 0; k < 5; k++)
+        {
+          rasc +=
+            (w21a[k] * (fabs (fv[2*k+1] - mean) + fabs (fv[2*k+2] - mean))
+             + w21b[k] * (fabs (fv[2*k+11] - mean) + fabs (fv[2*k+12] - mean)));
+        }
+      rasc *= abs_half_length;
+
+      f_center[i] = fv[0];
+      resabs[i] = rabs;
+      resasc[i] = rasc;
+      prev[i] = res21;
+
+      result[i] = res21 * half_length;
+      abserr[i] = rescale_error ((res21 - res10) * half_length, rabs, rasc);
+
+      if (qng_converged (abserr[i], result[i], epsabs, epsrel))
+        status[i] = GSL_SUCCESS;
+      else
+        {
+          status[i] = GSL_ETOL;
+          pending[npending++] = i;
+        }
+    }
+
+  /* The 43-point formula for the intervals that did not converge. */
+
+  if (npending > 0)
+    {
+      for (j = 0; j < npending; j++)
+        {
+          const double half_length = 0.5 * (b[pending[j]] - a[pending[j]]);
+          const double center = 0.5 * (b[pending[j]] + a[pending[j]]);
+          double *x = vals + 22 * j;
+
+          for (k = 0; k < 11; k++)
+            {
+              const double abscissa = half_length * x3[k];
+              x[2*k] = center + abscissa;
+              x[2*k+1] = center - abscissa;
+            }
+        }
+
+      if (EXIT_SUCCESS != f (vals, (int) (22 * npending), params))
+        {
+          retval = -1;
+          goto done;
+        }
+
+      nnext = 0;
+      for (j = 0; j < npending; j++)
+        {
+          const double *fv = vals + 22 * j;
+          double *sav;
+          double half_length, res43;
+
+          i = pending[j];
+          sav = savfun + 21 * i;
+          half_length = 0.5 * (b[i] - a[i]);
+
+          res43 = w43b[11] * f_center[i];
+          for (k = 0; k < 10; k++)
+            res43 += sav[k] * w43a[k];
+
+          for (k = 0; k < 11; k++)
+            {
+              const double fval = fv[2*k] + fv[2*k+1];
+              res43 += fval * w43b[k];
+              sav[k + 10] = fval;
+            }
+
+          result[i] = res43 * half_length;
+          abserr[i] = rescale_error ((res43 - prev[i]) * half_length,
+                                     resabs[i], resasc[i]);
+          prev[i] = res43;
+
+          if (qng_converged (abserr[i], result[i], epsabs, epsrel))
+            status[i] = GSL_SUCCESS;
+          else
+            pending[nnext++] = i;
+        }
+      npending = nnext;
+    }
+
+  /* The 87-point formula for the rest; those that still fail keep
+     GSL_ETOL. */
+
+  if (npending > 0)
+    {
+      for (j = 0; j < npending; j++)
+        {
+          const double half_length = 0.5 * (b[pending[j]] - a[pending[j]]);
+          const double center = 0.5 * (b[pending[j]] + a[pending[j]]);
+          double *x = vals + 44 * j;
+
+          for (k = 0; k < 22; k++)
+            {
+              const double abscissa = half_length * x4[k];
+              x[2*k] = center + abscissa;
+              x[2*k+1] = center - abscissa;
+            }
+        }
+
+      if (EXIT_SUCCESS != f (vals, (int) (44 * npending), params))
+        {
+          retval = -1;
+          goto done;
+        }
+
+      for (j = 0; j < npending; j++)
+        {
+          const double *fv = vals + 44 * j;
+          const double *sav;
+          double half_length, res87;
+
+          i = pending[j];
+          sav = savfun + 21 * i;
+          half_length = 0.5 * (b[i] - a[i]);
+
+          res87 = w87b[22] * f_center[i];
+          for (k = 0; k < 21; k++)
+            res87 += sav[k] * w87a[k];
+
+          for (k = 0; k < 22; k++)
+            res87 += w87b[k] * (fv[2*k] + fv[2*k+1]);
+
+          result[i] = res87 * half_length;
+          abserr[i] = rescale_error ((res87 - prev[i]) * half_length,
+                                     resabs[i], resasc[i]);
+
+          if (qng_converged (abserr[i], result[i], epsabs, epsrel))
+            status[i] = GSL_SUCCESS;
+        }
+    }
+
+ done:
+  free (vals);
+  free (savfun);
+  free (f_center);
+  free (pending);
+
+  return retval;
+}
@@ -21,6 +21,7 @@
 #include "sherpa/integration.hh"
 #include <iostream>
 #include <limits>
+#include <vector>
 #include <Python.h>
 #include "gsl_errno.h"
 #include "gsl_integration.h"
@@ -104,6 +105,50 @@ namespace sherpa { namespace integration {
 
   }
 
+  // The first integral of the process that fails to converge is tried
+  // again at single precision tolerance, then with the trapezoid rule;
+  // later failures keep the estimate of the highest-order rule
+  static int retry_py_integrate_1d( integrand_1d_vec fct, void* params,
+				    const double xlo, const double xhi,
+				    unsigned int maxeval, double epsabs,
+				    double epsrel, double &result,
+				    double& abserr, std::ostringstream& err )
+  {
+
+    if (sao_int_flag) {
+      err << "Gauss-Kronrod integration failed "
+	  << "with tolerance " << epsabs << ", trying lower tolerance...";
+
+      size_t neval = size_t( maxeval );
+      double tol = std::numeric_limits< float >::epsilon();
+      int retval = sao_integration_qng( fct, xlo, xhi, params, tol, epsrel,
+					&result, &abserr, &neval );
+
+      if (retval != EXIT_SUCCESS) {
+	err << std::endl << "integration failed with tolerance " << tol
+	    << ", resorting to trapezoid method";
+
+
+	double loval[1], hival[1];
+	loval[0] = xlo;
+	hival[0] = xhi;
+	if (-1 == fct(loval, 1, params) )
+	  return EXIT_FAILURE;
+
+	if (-1 == fct(hival, 1, params) )
+	  return EXIT_FAILURE;
+
+	result = 0.5 * ( xhi - xlo ) * ( loval[0] + hival[0] );
+      }
+      else {
+	err << std::endl << "integration succeeded with tolerance " << tol;
+      }
+    }
+    sao_int_flag=0;
+    return EXIT_SUCCESS;
+
+  }
+
   int py_integrate_1d( integrand_1d_vec fct, void* params,
 		       const double xlo, const double xhi,
 		       unsigned int maxeval, double epsabs, double epsrel,
@@ -127,40 +172,50 @@ namespace sherpa { namespace integration {
       return EXIT_FAILURE;
     }
     
-    if (retval != EXIT_SUCCESS) {
-      if (sao_int_flag) {
-	err << "Gauss-Kronrod integration failed "
-	    << "with tolerance " << epsabs << ", trying lower tolerance...";
-	
-	double tol = std::numeric_limits< float >::epsilon();
-	retval = sao_integration_qng( fct, xlo, xhi, params, tol, epsrel,
-				      &result, &abserr, &neval );
-	
-	if (retval != EXIT_SUCCESS) {
-	  err << std::endl << "integration failed with tolerance " << tol
-	      << ", resorting to trapezoid method";
-
-	  
-	  double loval[1], hival[1];
-	  loval[0] = xlo;
-	  hival[0] = xhi;
-	  if (-1 == fct(loval, 1, params) )
-	    return EXIT_FAILURE;
-	  
-	  if (-1 == fct(hival, 1, params) )
-	    return EXIT_FAILURE;
-	  
-	  result = 0.5 * ( xhi - xlo ) * ( loval[0] + hival[0] );
-	}
-	else {
-	  err << std::endl << "integration succeeded with tolerance " << tol;
-	}
-      }
-      sao_int_flag=0;
-    }
+    if (retval != EXIT_SUCCESS)
+      return retry_py_integrate_1d( fct, params, xlo, xhi, maxeval,
+				    epsabs, epsrel, result, abserr, err );
+
     return EXIT_SUCCESS;
     
   }
+
+  int py_integrate_1d_batch( integrand_1d_vec fct, void* params,
+			     std::size_t nbins, const double* xlo,
+			     const double* xhi, unsigned int maxeval,
+			     double epsabs, double epsrel, double* result,
+			     int errflag, std::ostringstream& err )
+  {
+
+    if ( NULL == fct || NULL == xlo || NULL == xhi || NULL == result )
+      return EXIT_FAILURE;
+
+    if ( 0 == nbins )
+      return EXIT_SUCCESS;
+
+    std::vector< double > abserr( nbins );
+    std::vector< int > status( nbins );
+
+    gsl_set_error_handler_off ();
+
+    if ( GSL_SUCCESS !=
+	 sao_integration_qng_batch( fct, nbins, xlo, xhi, params,
+				    epsabs, epsrel, result, &abserr[0],
+				    &status[0] ) )
+      return EXIT_FAILURE;
+
+    for ( std::size_t ii = 0; ii < nbins; ii++ )
+      if ( GSL_SUCCESS != status[ ii ] &&
+	   EXIT_SUCCESS != retry_py_integrate_1d( fct, params,
+						  xlo[ ii ], xhi[ ii ],
+						  maxeval, epsabs, epsrel,
+						  result[ ii ], abserr[ ii ],
+						  err ) )
+	return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+
+  }
     
 }  }  /* namespace integration, namespace sherpa */
 
@@ -169,7 +224,7 @@ PyMODINIT_FUNC
 initintegration(void)
 {
 
-  static void *Integration_API[3];
+  static void *Integration_API[4];
 
   PyObject *m;
   PyObject *api_cobject;
@@ -180,6 +235,7 @@ initintegration(void)
   Integration_API[0] = (void*)sherpa::integration::integrate_1d;
   Integration_API[1] = (void*)sherpa::integration::integrate_Nd;
   Integration_API[2] = (void*)sherpa::integration::py_integrate_1d;
+  Integration_API[3] = (void*)sherpa::integration::py_integrate_1d_batch;
 
   if ( NULL == ( api_cobject = PyCObject_FromVoidPtr( (void*)Integration_API,
 						      NULL) ) )